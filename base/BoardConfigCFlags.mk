@@ -26,6 +26,10 @@ ifeq ($(BOARD_USES_HWC_SERVICES),true)
 	LOCAL_CFLAGS += -DHWC_SERVICES
 endif
 
+ifeq ($(BOARD_USES_HWC_DUMP_LZ4), true)
+	LOCAL_CFLAGS += -DUSES_HWC_DUMP_LZ4
+endif
+
 ifeq ($(HWC_SKIP_VALIDATE),true)
 	LOCAL_CFLAGS += -DHWC_SKIP_VALIDATE
 endif
@@ -71,6 +71,9 @@ int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& comman
 }
 
 void ComposerCommandEngine::dispatchDisplayCommand(const DisplayCommand& command) {
+    if (!command.layers.empty()) {
+        dispatchLayerStates(command.display, command.layers);
+    }
     for (const auto& layerCmd : command.layers) {
         dispatchLayerCommand(command.display, layerCmd);
     }
@@ -87,21 +90,55 @@ void ComposerCommandEngine::dispatchDisplayCommand(const DisplayCommand& command
                                            PresentOrValidateDisplay);
 }
 
+// The states that are common to every frame are applied to all the layers of the
+// display at once by dispatchLayerStates(). The others are dispatched per layer.
+void ComposerCommandEngine::dispatchLayerStates(int64_t display,
+                                                const std::vector<LayerCommand>& layerCommands) {
+    std::vector<std::optional<buffer_handle_t>> buffers(layerCommands.size());
+    std::vector<std::unique_ptr<IBufferReleaser>> bufferReleasers;
+
+    for (size_t ix = 0; ix < layerCommands.size(); ++ix) {
+        const auto& layerCmd = layerCommands[ix];
+        if (!layerCmd.buffer) {
+            continue;
+        }
+
+        const Buffer& buffer = *layerCmd.buffer;
+        bool useCache = !buffer.handle;
+        buffer_handle_t handle = useCache
+                                 ? nullptr
+                                 : ::android::makeFromAidl(*buffer.handle);
+        buffer_handle_t hwcBuffer;
+        // the replaced buffer is released after the new one is set
+        auto bufferReleaser = mResources->createReleaser(true);
+        auto err = mResources->getLayerBuffer(display, layerCmd.layer, buffer.slot, useCache,
+                                              handle, hwcBuffer, bufferReleaser.get());
+        if (err) {
+            LOG(ERROR) << __func__ << ": getLayerBuffer err " << err;
+            mWriter->setError(mCommandIndex, err);
+            continue;
+        }
+        buffers[ix] = hwcBuffer;
+        bufferReleasers.push_back(std::move(bufferReleaser));
+    }
+
+    std::vector<int32_t> errors;
+    auto err = mHal->setLayerStates(display, layerCommands, buffers, &errors);
+    if (errors.size() != layerCommands.size()) {
+        LOG(ERROR) << __func__ << ": err " << err;
+        mWriter->setError(mCommandIndex, err);
+        return;
+    }
+    for (auto layerErr : errors) {
+        if (layerErr) {
+            LOG(ERROR) << __func__ << ": err " << layerErr;
+            mWriter->setError(mCommandIndex, layerErr);
+        }
+    }
+}
+
 void ComposerCommandEngine::dispatchLayerCommand(int64_t display, const LayerCommand& command) {
-    DISPATCH_LAYER_COMMAND(display, command, cursorPosition, CursorPosition);
-    DISPATCH_LAYER_COMMAND(display, command, buffer, Buffer);
-    DISPATCH_LAYER_COMMAND(display, command, damage, SurfaceDamage);
-    DISPATCH_LAYER_COMMAND(display, command, blendMode, BlendMode);
-    DISPATCH_LAYER_COMMAND(display, command, color, Color);
-    DISPATCH_LAYER_COMMAND(display, command, composition, Composition);
-    DISPATCH_LAYER_COMMAND(display, command, dataspace, Dataspace);
-    DISPATCH_LAYER_COMMAND(display, command, displayFrame, DisplayFrame);
-    DISPATCH_LAYER_COMMAND(display, command, planeAlpha, PlaneAlpha);
     DISPATCH_LAYER_COMMAND(display, command, sidebandStream, SidebandStream);
-    DISPATCH_LAYER_COMMAND(display, command, sourceCrop, SourceCrop);
-    DISPATCH_LAYER_COMMAND(display, command, transform, Transform);
-    DISPATCH_LAYER_COMMAND(display, command, visibleRegion, VisibleRegion);
-    DISPATCH_LAYER_COMMAND(display, command, z, ZOrder);
     DISPATCH_LAYER_COMMAND(display, command, colorTransform, ColorTransform);
     // TODO: (b/196171661) add support for mixed composition
     // DISPATCH_LAYER_COMMAND(display, command, whitePointNits, WhitePointNits);
@@ -185,7 +222,11 @@ void ComposerCommandEngine::executeSetOutputBuffer(uint64_t display, const Buffe
 
 void ComposerCommandEngine::executeSetExpectedPresentTimeInternal(
         int64_t display, const std::optional<ClockMonotonicTimestamp> expectedPresentTime) {
-    mHal->setExpectedPresentTime(display, expectedPresentTime);
+    // The hint does not fail the command
+    auto err = mHal->setExpectedPresentTime(display, expectedPresentTime);
+    if (err) {
+        LOG(WARNING) << __func__ << ": err " << err;
+    }
 }
 
 void ComposerCommandEngine::executeValidateDisplay(
@@ -246,100 +287,6 @@ int ComposerCommandEngine::executePresentDisplay(int64_t display) {
     return err;
 }
 
-void ComposerCommandEngine::executeSetLayerCursorPosition(int64_t display, int64_t layer,
-                                       const common::Point& cursorPosition) {
-    auto err = mHal->setLayerCursorPosition(display, layer, cursorPosition.x, cursorPosition.y);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerBuffer(int64_t display, int64_t layer,
-                                                  const Buffer& buffer) {
-    bool useCache = !buffer.handle;
-    buffer_handle_t handle = useCache
-                             ? nullptr
-                             : ::android::makeFromAidl(*buffer.handle);
-    buffer_handle_t hwcBuffer;
-    auto bufferReleaser = mResources->createReleaser(true);
-    auto err = mResources->getLayerBuffer(display, layer, buffer.slot, useCache,
-                                          handle, hwcBuffer, bufferReleaser.get());
-    if (!err) {
-        err = mHal->setLayerBuffer(display, layer, hwcBuffer, buffer.fence);
-        if (err) {
-            LOG(ERROR) << __func__ << ": setLayerBuffer err " << err;
-            mWriter->setError(mCommandIndex, err);
-        }
-    } else {
-        LOG(ERROR) << __func__ << ": getLayerBuffer err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerSurfaceDamage(int64_t display, int64_t layer,
-                              const std::vector<std::optional<common::Rect>>& damage) {
-    auto err = mHal->setLayerSurfaceDamage(display, layer, damage);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerBlendMode(int64_t display, int64_t layer,
-                                                     const ParcelableBlendMode& blendMode) {
-    auto err = mHal->setLayerBlendMode(display, layer, blendMode.blendMode);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerColor(int64_t display, int64_t layer,
-                                                 const Color& color) {
-    auto err = mHal->setLayerColor(display, layer, color);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerComposition(int64_t display, int64_t layer,
-                                                       const ParcelableComposition& composition) {
-    auto err = mHal->setLayerCompositionType(display, layer, composition.composition);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerDataspace(int64_t display, int64_t layer,
-                                                     const ParcelableDataspace& dataspace) {
-    auto err = mHal->setLayerDataspace(display, layer, dataspace.dataspace);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerDisplayFrame(int64_t display, int64_t layer,
-                                                        const common::Rect& rect) {
-    auto err = mHal->setLayerDisplayFrame(display, layer, rect);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerPlaneAlpha(int64_t display, int64_t layer,
-                                                      const PlaneAlpha& planeAlpha) {
-    auto err = mHal->setLayerPlaneAlpha(display, layer, planeAlpha.alpha);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
 void ComposerCommandEngine::executeSetLayerSidebandStream(int64_t display, int64_t layer,
                                                  const AidlNativeHandle& sidebandStream) {
     buffer_handle_t handle = ::android::makeFromAidl(sidebandStream);
@@ -357,42 +304,6 @@ void ComposerCommandEngine::executeSetLayerSidebandStream(int64_t display, int64
     }
 }
 
-void ComposerCommandEngine::executeSetLayerSourceCrop(int64_t display, int64_t layer,
-                                                      const common::FRect& sourceCrop) {
-    auto err = mHal->setLayerSourceCrop(display, layer, sourceCrop);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerTransform(int64_t display, int64_t layer,
-                                                     const ParcelableTransform& transform) {
-    auto err = mHal->setLayerTransform(display, layer, transform.transform);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerVisibleRegion(int64_t display, int64_t layer,
-                          const std::vector<std::optional<common::Rect>>& visibleRegion) {
-    auto err = mHal->setLayerVisibleRegion(display, layer, visibleRegion);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerZOrder(int64_t display, int64_t layer,
-                                                  const ZOrder& zOrder) {
-    auto err = mHal->setLayerZOrder(display, layer, zOrder.z);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
 void ComposerCommandEngine::executeSetLayerPerFrameMetadata(int64_t display, int64_t layer,
                 const std::vector<std::optional<PerFrameMetadata>>& perFrameMetadata) {
     auto err = mHal->setLayerPerFrameMetadata(display, layer, perFrameMetadata);
@@ -222,7 +222,7 @@ int32_t HalImpl::destroyLayer(int64_t display, int64_t layer) {
     ExynosLayer *halLayer;
     RET_IF_ERR(getHalLayer(display, layer, halLayer));
 
-    return halDisplay->destroyLayer(reinterpret_cast<hwc2_layer_t>(halLayer));
+    return halDisplay->destroyLayer(halLayer->mHandle);
 }
 
 int32_t HalImpl::createVirtualDisplay(uint32_t width, uint32_t height, AidlPixelFormat format,
@@ -868,6 +868,85 @@ int32_t HalImpl::setLayerZOrder(int64_t display, int64_t layer, uint32_t z) {
     return halLayer->setLayerZOrder(z);
 }
 
+int32_t HalImpl::setLayerStates(int64_t display, const std::vector<LayerCommand>& commands,
+                               const std::vector<std::optional<buffer_handle_t>>& buffers,
+                               std::vector<int32_t>* outErrors) {
+    ExynosDisplay* halDisplay;
+    RET_IF_ERR(getHalDisplay(display, halDisplay));
+
+    size_t count = commands.size();
+    std::vector<exynos_layer_state> states(count);
+    // the rectangles should be kept until the states are applied
+    std::vector<std::vector<hwc_rect_t>> hwcDamage(count);
+    std::vector<std::vector<hwc_rect_t>> hwcVisible(count);
+
+    for (size_t ix = 0; ix < count; ++ix) {
+        const LayerCommand& command = commands[ix];
+        exynos_layer_state& state = states[ix];
+
+        a2h::translate(command.layer, state.layer);
+        if (command.cursorPosition) {
+            state.flags |= LAYER_STATE_CURSOR_POSITION;
+            state.cursorX = command.cursorPosition->x;
+            state.cursorY = command.cursorPosition->y;
+        }
+        if (command.buffer && buffers[ix]) {
+            state.flags |= LAYER_STATE_BUFFER;
+            state.buffer = *buffers[ix];
+            a2h::translate(command.buffer->fence, state.acquireFence);
+        }
+        if (command.damage) {
+            state.flags |= LAYER_STATE_SURFACE_DAMAGE;
+            a2h::translate(*command.damage, hwcDamage[ix]);
+            state.damage = { hwcDamage[ix].size(), hwcDamage[ix].data() };
+        }
+        if (command.blendMode) {
+            state.flags |= LAYER_STATE_BLEND_MODE;
+            a2h::translate(command.blendMode->blendMode, state.blendMode);
+        }
+        if (command.color) {
+            state.flags |= LAYER_STATE_COLOR;
+            a2h::translate(*command.color, state.color);
+        }
+        if (command.composition) {
+            state.flags |= LAYER_STATE_COMPOSITION;
+            a2h::translate(command.composition->composition, state.compositionType);
+        }
+        if (command.dataspace) {
+            state.flags |= LAYER_STATE_DATASPACE;
+            a2h::translate(command.dataspace->dataspace, state.dataspace);
+        }
+        if (command.displayFrame) {
+            state.flags |= LAYER_STATE_DISPLAY_FRAME;
+            a2h::translate(*command.displayFrame, state.displayFrame);
+        }
+        if (command.planeAlpha) {
+            state.flags |= LAYER_STATE_PLANE_ALPHA;
+            state.planeAlpha = command.planeAlpha->alpha;
+        }
+        if (command.sourceCrop) {
+            state.flags |= LAYER_STATE_SOURCE_CROP;
+            a2h::translate(*command.sourceCrop, state.sourceCrop);
+        }
+        if (command.transform) {
+            state.flags |= LAYER_STATE_TRANSFORM;
+            a2h::translate(command.transform->transform, state.transform);
+        }
+        if (command.visibleRegion) {
+            state.flags |= LAYER_STATE_VISIBLE_REGION;
+            a2h::translate(*command.visibleRegion, hwcVisible[ix]);
+            state.visible = { hwcVisible[ix].size(), hwcVisible[ix].data() };
+        }
+        if (command.z) {
+            state.flags |= LAYER_STATE_Z_ORDER;
+            state.z = command.z->z;
+        }
+    }
+
+    outErrors->resize(count);
+    return halDisplay->setLayerStates(count, states.data(), outErrors->data());
+}
+
 int32_t HalImpl::setOutputBuffer(int64_t display, buffer_handle_t buffer,
                                  const ndk::ScopedFileDescriptor& releaseFence) {
     ExynosDisplay* halDisplay;
@@ -968,9 +1047,14 @@ int32_t HalImpl::validateDisplay(int64_t display, std::vector<int64_t>* outChang
 }
 
 int HalImpl::setExpectedPresentTime(
-        int64_t __unused display, const std::optional<ClockMonotonicTimestamp> __unused expectedPresentTime) {
+        int64_t display, const std::optional<ClockMonotonicTimestamp> expectedPresentTime) {
+    ExynosDisplay* halDisplay;
+    RET_IF_ERR(getHalDisplay(display, halDisplay));
 
-    return HWC2_ERROR_UNSUPPORTED;
+    uint64_t timestamp = expectedPresentTime.has_value() ?
+            expectedPresentTime->timestampNanos : 0;
+
+    return halDisplay->setExpectedPresentTime(timestamp);
 }
 
 } // namespace aidl::android::hardware::graphics::composer3::impl
@@ -127,6 +127,9 @@ class HalImpl : public IComposerHal {
     int32_t setLayerVisibleRegion(int64_t display, int64_t layer,
                           const std::vector<std::optional<common::Rect>>& visible) override;
     int32_t setLayerZOrder(int64_t display, int64_t layer, uint32_t z) override;
+    int32_t setLayerStates(int64_t display, const std::vector<LayerCommand>& commands,
+                           const std::vector<std::optional<buffer_handle_t>>& buffers,
+                           std::vector<int32_t>* outErrors) override;
     int32_t setOutputBuffer(int64_t display, buffer_handle_t buffer,
                             const ndk::ScopedFileDescriptor& releaseFence) override;
     int32_t setPowerMode(int64_t display, PowerMode mode) override;
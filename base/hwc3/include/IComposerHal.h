@@ -193,6 +193,13 @@ class IComposerHal {
     virtual int32_t setLayerVisibleRegion(int64_t display, int64_t layer,
                                  const std::vector<std::optional<common::Rect>>& visible) = 0;
     virtual int32_t setLayerZOrder(int64_t display, int64_t layer, uint32_t z) = 0;
+    // Applies the layer states of a DisplayCommand in one call. buffers[i] holds the
+    // buffer of commands[i] that is resolved from the buffer cache, or nullopt if the
+    // buffer should not be set. sidebandStream, colorTransform and the per-frame
+    // metadata are not applied. outErrors receives the result of each command.
+    virtual int32_t setLayerStates(int64_t display, const std::vector<LayerCommand>& commands,
+                            const std::vector<std::optional<buffer_handle_t>>& buffers,
+                            std::vector<int32_t>* outErrors) = 0; // cmd
     virtual int32_t setOutputBuffer(int64_t display, buffer_handle_t buffer,
                                     const ndk::ScopedFileDescriptor& releaseFence) = 0;
     virtual int32_t setPowerMode(int64_t display, PowerMode mode) = 0;
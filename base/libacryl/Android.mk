@@ -35,7 +35,7 @@ else
     LOCAL_CFLAGS += -DLIBACRYL_DEFAULT_BLTER=\"no_default_blter\"
 endif
 
-LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libion_exynos
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libsync libion_exynos
 ifdef BOARD_LIBACRYL_G2D9810_HDR_PLUGIN
     LOCAL_SHARED_LIBRARIES += $(BOARD_LIBACRYL_G2D9810_HDR_PLUGIN)
     LOCAL_CFLAGS += -DLIBACRYL_G2D9810_HDR_PLUGIN
@@ -49,7 +49,7 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/include
 
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/include
 
-LOCAL_SRC_FILES := acrylic.cpp acrylic_dummy.cpp
+LOCAL_SRC_FILES := acrylic.cpp acrylic_sw.cpp
 LOCAL_SRC_FILES += acrylic_g2d.cpp acrylic_mscl9810.cpp acrylic_g2d9810.cpp acrylic_mscl3830.cpp acrylic_mscl3830_pre.cpp
 LOCAL_SRC_FILES += acrylic_factory.cpp acrylic_layer.cpp acrylic_formats.cpp
 LOCAL_SRC_FILES += acrylic_performance.cpp acrylic_device.cpp
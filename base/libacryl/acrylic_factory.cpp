@@ -26,7 +26,7 @@
 #include "acrylic_g2d9810.h"
 #include "acrylic_mscl9810.h"
 #include "acrylic_mscl3830.h"
-#include "acrylic_dummy.h"
+#include "acrylic_sw.h"
 
 static uint32_t all_fimg2d_formats[] = {
     HAL_PIXEL_FORMAT_RGBA_8888,
@@ -48,6 +48,25 @@ static uint32_t all_fimg2d_formats[] = {
     HAL_PIXEL_FORMAT_YCbCr_422_SP,                  // YUV422 2P (YUV422 semi-planar)
 };
 
+// The formats that AcrylicCompositorSW reads and writes
+static uint32_t all_sw_formats[] = {
+    HAL_PIXEL_FORMAT_RGBA_8888,
+    HAL_PIXEL_FORMAT_BGRA_8888,
+    HAL_PIXEL_FORMAT_RGBX_8888,
+    HAL_PIXEL_FORMAT_RGB_888,
+    HAL_PIXEL_FORMAT_RGB_565,
+    HAL_PIXEL_FORMAT_YCrCb_420_SP,                  // NV21 (YVU420 semi-planar)
+    HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M,         // NV21 on multi-buffer
+    HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL,    // NV21 on multi-buffer
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP,           // NV12 (YUV420 semi-planar)
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN,          // NV12 with MFC alignment constraints
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M,         // NV12M with MFC alignment constraints on multi-buffer
+    HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_PRIV,    // NV12M with MFC alignment constraints on multi-buffer
+    HAL_PIXEL_FORMAT_YCbCr_422_I,                   // YUYV
+    HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I,            // YVYU
+    HAL_PIXEL_FORMAT_YCbCr_422_SP,                  // YUV422 2P (YUV422 semi-planar)
+};
+
 static uint32_t all_fimg2d_hdr_formats[] = {
     HAL_PIXEL_FORMAT_RGBA_8888,
     HAL_PIXEL_FORMAT_BGRA_8888,
@@ -537,6 +556,28 @@ const static stHW2DCapability __capability_mscl_3830 = {
     .base_align = 4,
 };
 
+const static stHW2DCapability __capability_sw = {
+    .max_upsampling_num = {32767, 32767},
+    .max_downsampling_factor = {32767, 32767},
+    .max_upsizing_num = {32767, 32767},
+    .max_downsizing_factor = {32767, 32767},
+    .min_src_dimension = {1, 1},
+    .max_src_dimension = {8192, 8192},
+    .min_dst_dimension = {1, 1},
+    .max_dst_dimension = {8192, 8192},
+    .min_pix_align = {1, 1},
+    .rescaling_count = 0,
+    .compositing_mode = HW2DCapability::BLEND_NONE | HW2DCapability::BLEND_SRC_COPY | HW2DCapability::BLEND_SRC_OVER,
+    .transform_type = HW2DCapability::TRANSFORM_ALL,
+    .auxiliary_feature = HW2DCapability::FEATURE_PLANE_ALPHA | HW2DCapability::FEATURE_SOLIDCOLOR,
+    .num_formats = ARRSIZE(all_sw_formats),
+    .num_dataspaces = ARRSIZE(all_hwc_dataspaces),
+    .max_layers = 16,
+    .pixformats = all_sw_formats,
+    .dataspaces = all_hwc_dataspaces,
+    .base_align = 1,
+};
+
 static const HW2DCapability capability_fimg2d_8895(__capability_fimg2d_8895);
 static const HW2DCapability capability_fimg2d_8890(__capability_fimg2d_8890);
 static const HW2DCapability capability_fimg2d_9610(__capability_fimg2d_9610);
@@ -548,6 +589,7 @@ static const HW2DCapability capability_mscl_9810(__capability_mscl_9810);
 static const HW2DCapability capability_mscl_sbwc(__capability_mscl_sbwc);
 static const HW2DCapability capability_mscl_sbwcl(__capability_mscl_sbwcl);
 static const HW2DCapability capability_mscl_3830(__capability_mscl_3830);
+static const HW2DCapability capability_sw(__capability_sw);
 
 Acrylic *Acrylic::createInstance(const char *spec)
 {
@@ -579,8 +621,8 @@ Acrylic *Acrylic::createInstance(const char *spec)
         compositor = new AcrylicCompositorMSCL9810(capability_mscl_sbwcl);
     } else if (strcmp(spec, "mscl_3830") == 0) {
         compositor = new AcrylicCompositorMSCL3830(capability_mscl_3830);
-    } else if (strcmp(spec, "dummy") == 0) {
-        compositor = new AcrylicCompositorDummy(capability_fimg2d_8895);
+    } else if ((strcmp(spec, "sw") == 0) || (strcmp(spec, "dummy") == 0)) {
+        compositor = new AcrylicCompositorSW(capability_sw);
     } else {
         ALOGE("Unknown HW2D compositor spec., %s", spec);
         return NULL;
@@ -0,0 +1,788 @@
+/*
+ * Copyright Samsung Electronics Co.,LTD.
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include <log/log.h>
+#include <android/sync.h>
+
+#include <hardware/hwcomposer2.h>
+
+#include <exynos_format.h> // hardware/smasung_slsi/exynos/include
+
+#include "acrylic_internal.h"
+#include "acrylic_sw.h"
+
+// The number of rows of the target image processed by a worker at a time.
+// It should be even not to split the chroma rows of YCbCr 4:2:0 targets.
+#define SW_BAND_ROWS        16
+#define SW_MAX_THREADS      4
+// The CPU reads the sources and writes the target directly. It should not
+// start before the producers of the buffers signal their acquire fences.
+#define SW_FENCE_TIMEOUT_MS 1000
+
+#define SW_MFC_ALIGN(v)     (((v) + 15) & ~15)
+#define SW_MFC_PAD_SIZE     256
+
+enum {
+    SW_BLEND_NONE,
+    SW_BLEND_PREMULT,
+    SW_BLEND_COVERAGE,
+};
+
+/*
+ * Coefficients of the conversion between YCbCr and RGB in Q10.
+ * The first six values are for YCbCr to RGB and the rest are for RGB to YCbCr.
+ */
+struct AcrylicSWCsc {
+    int32_t yoff, ymul, rv, gu, gv, bu;
+    int32_t ry, gy, by, ru, gu_, bu_, rv_, gv_, bv_;
+};
+
+static const AcrylicSWCsc csc_bt601_limited = {
+    16, 1192, 1634, -401, -832, 2066,
+    263, 516, 100, -152, -298, 450, 450, -377, -73,
+};
+
+static const AcrylicSWCsc csc_bt709_limited = {
+    16, 1192, 1836, -218, -546, 2163,
+    187, 629, 64, -103, -347, 450, 450, -409, -41,
+};
+
+static const AcrylicSWCsc csc_bt601_full = {
+    0, 1024, 1436, -352, -731, 1815,
+    306, 601, 117, -173, -339, 512, 512, -429, -83,
+};
+
+static const AcrylicSWCsc csc_bt709_full = {
+    0, 1024, 1613, -192, -479, 1900,
+    218, 732, 74, -117, -395, 512, 512, -465, -47,
+};
+
+static const AcrylicSWCsc *find_csc(int dataspace)
+{
+    if (dataspace == HAL_DATASPACE_JFIF)
+        return &csc_bt601_full;
+    if (dataspace == HAL_DATASPACE_BT709)
+        return &csc_bt709_limited;
+
+    bool bt709 = (dataspace & HAL_DATASPACE_STANDARD_MASK) == HAL_DATASPACE_STANDARD_BT709;
+    bool full = (dataspace & HAL_DATASPACE_RANGE_MASK) == HAL_DATASPACE_RANGE_FULL;
+
+    if (bt709)
+        return full ? &csc_bt709_full : &csc_bt709_limited;
+    return full ? &csc_bt601_full : &csc_bt601_limited;
+}
+
+static inline uint8_t clamp255(int32_t v)
+{
+    return static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+}
+
+// rounded division by 255 that is exact for the product of two 8-bit values
+static inline uint32_t div255(uint32_t v)
+{
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+static inline void yuv_to_rgba(const AcrylicSWCsc &csc, int32_t y, int32_t u, int32_t v, uint8_t *out)
+{
+    int32_t c = (y - csc.yoff) * csc.ymul + 512;
+
+    u -= 128;
+    v -= 128;
+
+    out[0] = clamp255((c + csc.rv * v) >> 10);
+    out[1] = clamp255((c + csc.gu * u + csc.gv * v) >> 10);
+    out[2] = clamp255((c + csc.bu * u) >> 10);
+    out[3] = 255;
+}
+
+static inline uint8_t rgb_to_y(const AcrylicSWCsc &csc, int32_t r, int32_t g, int32_t b)
+{
+    return clamp255(((csc.ry * r + csc.gy * g + csc.by * b + 512) >> 10) + csc.yoff);
+}
+
+static inline uint8_t rgb_to_u(const AcrylicSWCsc &csc, int32_t r, int32_t g, int32_t b)
+{
+    return clamp255(((csc.ru * r + csc.gu_ * g + csc.bu_ * b + 512) >> 10) + 128);
+}
+
+static inline uint8_t rgb_to_v(const AcrylicSWCsc &csc, int32_t r, int32_t g, int32_t b)
+{
+    return clamp255(((csc.rv_ * r + csc.gv_ * g + csc.bv_ * b + 512) >> 10) + 128);
+}
+
+static bool is_cbcr_order(uint32_t fmt)
+{
+    switch (fmt) {
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Resolve the buffer addresses and the strides of @canvas.
+ * YCbCr images should have even width (and even height if the chroma is
+ * vertically subsampled) because the compositor does not handle partial
+ * chroma samples.
+ */
+static bool resolve_image(AcrylicCanvas &canvas, AcrylicSWImage &image)
+{
+    hw2d_coord_t xy = canvas.getImageDimension();
+    uint32_t w = xy.hori;
+    uint32_t h = xy.vert;
+    size_t len[2] = {0, 0};
+
+    if (canvas.getBufferType() != AcrylicCanvas::MT_USERPTR) {
+        ALOGE("Only userptr buffers are supported by the software compositor (type %d)",
+              canvas.getBufferType());
+        return false;
+    }
+
+    if (canvas.isCompressed() || canvas.isUOrder()) {
+        ALOGE("Compressed or U-Order image is not supported by the software compositor");
+        return false;
+    }
+
+    image.fmt = canvas.getFormat();
+    image.width = xy.hori;
+    image.height = xy.vert;
+    image.plane[0] = static_cast<uint8_t *>(canvas.getUserptr(0));
+    image.plane[1] = nullptr;
+    image.stride[1] = 0;
+    image.csc = find_csc(canvas.getDataspace());
+
+    switch (image.fmt) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+        image.stride[0] = w * 4;
+        len[0] = image.stride[0] * h;
+        break;
+    case HAL_PIXEL_FORMAT_RGB_888:
+        image.stride[0] = w * 3;
+        len[0] = image.stride[0] * h;
+        break;
+    case HAL_PIXEL_FORMAT_RGB_565:
+        image.stride[0] = w * 2;
+        len[0] = image.stride[0] * h;
+        break;
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I:
+        image.stride[0] = w * 2;
+        len[0] = image.stride[0] * h;
+        break;
+    case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+        image.stride[0] = w;
+        image.stride[1] = w;
+        image.plane[1] = image.plane[0] + w * h;
+        len[0] = w * h * 2;
+        break;
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP:
+        image.stride[0] = w;
+        image.stride[1] = w;
+        image.plane[1] = image.plane[0] + w * h;
+        len[0] = w * h + w * h / 2;
+        break;
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN:
+        image.stride[0] = w;
+        image.stride[1] = w;
+        image.plane[1] = image.plane[0] + SW_MFC_ALIGN(w) * SW_MFC_ALIGN(h) + SW_MFC_PAD_SIZE;
+        len[0] = SW_MFC_ALIGN(w) * SW_MFC_ALIGN(h) + SW_MFC_PAD_SIZE + w * h / 2;
+        break;
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_PRIV:
+        if (canvas.getBufferCount() < 2) {
+            ALOGE("Format %#x requires 2 buffers but %u buffer is given",
+                  image.fmt, canvas.getBufferCount());
+            return false;
+        }
+        image.stride[0] = w;
+        image.stride[1] = w;
+        image.plane[1] = static_cast<uint8_t *>(canvas.getUserptr(1));
+        len[0] = w * h;
+        len[1] = w * h / 2;
+        break;
+    default:
+        ALOGE("Format %#x is not supported by the software compositor", image.fmt);
+        return false;
+    }
+
+    if ((halfmt_chroma_subsampling(image.fmt) != 0x11) &&
+            (((w & 1) != 0) || (((halfmt_chroma_subsampling(image.fmt) & 0xF) == 2) && ((h & 1) != 0)))) {
+        ALOGE("Odd dimension %ux%u is not allowed for YCbCr format %#x", w, h, image.fmt);
+        return false;
+    }
+
+    for (unsigned int i = 0; i < canvas.getBufferCount(); i++) {
+        if ((i < 2) && (canvas.getBufferLength(i) < len[i])) {
+            ALOGE("Buffer %u of %ux%u (fmt %#x) is too small: %u < %zu",
+                  i, w, h, image.fmt, canvas.getBufferLength(i), len[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Read @count pixels into @out in R, G, B, A order. The coordinates are
+ * given by @fixed and @var[]: (@var[i], @fixed) if @row is set and
+ * (@fixed, @var[i]) otherwise.
+ */
+static void fetch_span(const AcrylicSWImage &img, int32_t fixed, const int32_t *var,
+                       unsigned int count, bool row, uint8_t *out)
+{
+#define SW_FOR_EACH_PIXEL(...)                               \
+    for (unsigned int i = 0; i < count; i++, out += 4) {     \
+        int32_t x = row ? var[i] : fixed;                    \
+        int32_t y = row ? fixed : var[i];                    \
+        __VA_ARGS__                                          \
+    }
+
+    const uint8_t *p0 = img.plane[0];
+    const uint8_t *p1 = img.plane[1];
+    const uint32_t s0 = img.stride[0];
+    const uint32_t s1 = img.stride[1];
+
+    switch (img.fmt) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + x * 4;
+            out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = p[3];
+        )
+        break;
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + x * 4;
+            out[0] = p[2]; out[1] = p[1]; out[2] = p[0]; out[3] = p[3];
+        )
+        break;
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + x * 4;
+            out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = 255;
+        )
+        break;
+    case HAL_PIXEL_FORMAT_RGB_888:
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + x * 3;
+            out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = 255;
+        )
+        break;
+    case HAL_PIXEL_FORMAT_RGB_565:
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + x * 2;
+            uint32_t v = p[0] | (p[1] << 8);
+            uint32_t r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+            out[0] = (r << 3) | (r >> 2); out[1] = (g << 2) | (g >> 4);
+            out[2] = (b << 3) | (b >> 2); out[3] = 255;
+        )
+        break;
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I: {
+        const unsigned int uoff = is_cbcr_order(img.fmt) ? 1 : 3;
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *p = p0 + y * s0 + (x & ~1) * 2;
+            yuv_to_rgba(*img.csc, p[(x & 1) * 2], p[uoff], p[4 - uoff], out);
+        )
+        break;
+    }
+    default: {
+        // semi-planar YCbCr 4:2:0 and 4:2:2
+        const unsigned int uoff = is_cbcr_order(img.fmt) ? 0 : 1;
+        const unsigned int vshift = ((halfmt_chroma_subsampling(img.fmt) & 0xF) == 2) ? 1 : 0;
+        SW_FOR_EACH_PIXEL(
+            const uint8_t *c = p1 + (y >> vshift) * s1 + (x & ~1);
+            yuv_to_rgba(*img.csc, p0[y * s0 + x], c[uoff], c[1 - uoff], out);
+        )
+        break;
+    }
+    }
+#undef SW_FOR_EACH_PIXEL
+}
+
+/*
+ * Write @rows rows of premultiplied RGBA pixels in @band to @img from the
+ * row @y0. @y0 should be even for YCbCr 4:2:0 images.
+ */
+static void store_rows(const AcrylicSWImage &img, int32_t y0, int32_t rows, const uint8_t *band)
+{
+    const uint32_t w = img.width;
+    const uint32_t s0 = img.stride[0];
+    const uint32_t s1 = img.stride[1];
+
+    switch (img.fmt) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+        for (int32_t r = 0; r < rows; r++)
+            memcpy(img.plane[0] + (y0 + r) * s0, band + r * w * 4, w * 4);
+        return;
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_RGB_888:
+    case HAL_PIXEL_FORMAT_RGB_565:
+        for (int32_t r = 0; r < rows; r++) {
+            const uint8_t *in = band + r * w * 4;
+            uint8_t *p = img.plane[0] + (y0 + r) * s0;
+
+            if (img.fmt == HAL_PIXEL_FORMAT_BGRA_8888) {
+                for (uint32_t x = 0; x < w; x++, in += 4, p += 4) {
+                    p[0] = in[2]; p[1] = in[1]; p[2] = in[0]; p[3] = in[3];
+                }
+            } else if (img.fmt == HAL_PIXEL_FORMAT_RGBX_8888) {
+                for (uint32_t x = 0; x < w; x++, in += 4, p += 4) {
+                    p[0] = in[0]; p[1] = in[1]; p[2] = in[2]; p[3] = 255;
+                }
+            } else if (img.fmt == HAL_PIXEL_FORMAT_RGB_888) {
+                for (uint32_t x = 0; x < w; x++, in += 4, p += 3) {
+                    p[0] = in[0]; p[1] = in[1]; p[2] = in[2];
+                }
+            } else {
+                for (uint32_t x = 0; x < w; x++, in += 4, p += 2) {
+                    uint32_t v = ((in[0] >> 3) << 11) | ((in[1] >> 2) << 5) | (in[2] >> 3);
+                    p[0] = v & 0xFF;
+                    p[1] = v >> 8;
+                }
+            }
+        }
+        return;
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+    case HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I: {
+        const unsigned int uoff = is_cbcr_order(img.fmt) ? 1 : 3;
+        for (int32_t r = 0; r < rows; r++) {
+            const uint8_t *in = band + r * w * 4;
+            uint8_t *p = img.plane[0] + (y0 + r) * s0;
+
+            for (uint32_t x = 0; x < w; x += 2, in += 8, p += 4) {
+                int32_t rr = in[0] + in[4], gg = in[1] + in[5], bb = in[2] + in[6];
+                p[0] = rgb_to_y(*img.csc, in[0], in[1], in[2]);
+                p[2] = rgb_to_y(*img.csc, in[4], in[5], in[6]);
+                p[uoff] = rgb_to_u(*img.csc, (rr + 1) >> 1, (gg + 1) >> 1, (bb + 1) >> 1);
+                p[4 - uoff] = rgb_to_v(*img.csc, (rr + 1) >> 1, (gg + 1) >> 1, (bb + 1) >> 1);
+            }
+        }
+        return;
+    }
+    default: {
+        const unsigned int uoff = is_cbcr_order(img.fmt) ? 0 : 1;
+        const bool vsub = (halfmt_chroma_subsampling(img.fmt) & 0xF) == 2;
+
+        for (int32_t r = 0; r < rows; r++) {
+            const uint8_t *in = band + r * w * 4;
+            uint8_t *p = img.plane[0] + (y0 + r) * s0;
+
+            for (uint32_t x = 0; x < w; x++, in += 4)
+                p[x] = rgb_to_y(*img.csc, in[0], in[1], in[2]);
+        }
+
+        for (int32_t r = 0; r < rows; r += vsub ? 2 : 1) {
+            const uint8_t *in0 = band + r * w * 4;
+            const uint8_t *in1 = (vsub && (r + 1 < rows)) ? in0 + w * 4 : in0;
+            uint8_t *c = img.plane[1] + ((y0 + r) >> (vsub ? 1 : 0)) * s1;
+
+            for (uint32_t x = 0; x < w; x += 2, in0 += 8, in1 += 8, c += 2) {
+                int32_t rr = (in0[0] + in0[4] + in1[0] + in1[4] + 2) >> 2;
+                int32_t gg = (in0[1] + in0[5] + in1[1] + in1[5] + 2) >> 2;
+                int32_t bb = (in0[2] + in0[6] + in1[2] + in1[6] + 2) >> 2;
+                c[uoff] = rgb_to_u(*img.csc, rr, gg, bb);
+                c[1 - uoff] = rgb_to_v(*img.csc, rr, gg, bb);
+            }
+        }
+        return;
+    }
+    }
+}
+
+/*
+ * Blend @count premultiplied or non-premultiplied RGBA pixels in @src onto
+ * the premultiplied RGBA pixels in @dst. The loops have no dependency between
+ * pixels so that the compiler vectorizes them to NEON or SSE.
+ */
+template <unsigned int BLEND>
+static void blend_span(uint8_t *__restrict dst, const uint8_t *__restrict src,
+                       unsigned int count, uint32_t plane_alpha)
+{
+    if ((BLEND == SW_BLEND_NONE) && (plane_alpha == 255)) {
+        for (unsigned int i = 0; i < count * 4; i += 4) {
+            dst[i + 0] = src[i + 0];
+            dst[i + 1] = src[i + 1];
+            dst[i + 2] = src[i + 2];
+            dst[i + 3] = 255;
+        }
+        return;
+    }
+
+    for (unsigned int i = 0; i < count * 4; i += 4) {
+        uint32_t sa = (BLEND == SW_BLEND_NONE) ? 255 : src[i + 3];
+        uint32_t alpha = div255(sa * plane_alpha);
+        uint32_t mul = (BLEND == SW_BLEND_COVERAGE) ? alpha : plane_alpha;
+        uint32_t inv = 255 - alpha;
+
+        dst[i + 0] = std::min(div255(src[i + 0] * mul + dst[i + 0] * inv), 255U);
+        dst[i + 1] = std::min(div255(src[i + 1] * mul + dst[i + 1] * inv), 255U);
+        dst[i + 2] = std::min(div255(src[i + 2] * mul + dst[i + 2] * inv), 255U);
+        dst[i + 3] = alpha + div255(dst[i + 3] * inv);
+    }
+}
+
+static void fill_span(uint8_t *dst, const uint8_t color[4], unsigned int count)
+{
+    for (unsigned int i = 0; i < count * 4; i += 4) {
+        dst[i + 0] = color[0];
+        dst[i + 1] = color[1];
+        dst[i + 2] = color[2];
+        dst[i + 3] = color[3];
+    }
+}
+
+/*
+ * Build the map from the pixels in the target area of @size to the pixels
+ * of the source area from @pos of @srcsize with the nearest sampling.
+ */
+static void build_map(std::vector<int32_t> &map, int32_t size, int32_t pos, int32_t srcsize, bool flip)
+{
+    map.resize(size);
+    for (int32_t i = 0; i < size; i++) {
+        int32_t s = static_cast<int32_t>((static_cast<int64_t>(2 * i + 1) * srcsize) / (2 * size));
+        map[i] = pos + (flip ? srcsize - 1 - s : s);
+    }
+}
+
+AcrylicCompositorSW::AcrylicCompositorSW(const HW2DCapability &capability)
+    : Acrylic(capability), mLoadTarget(true), mJobSequence(0), mNumBands(0),
+      mBusyWorkers(0), mNextBand(0), mExiting(false), mLaptimeUSec(0)
+{
+    unsigned int nthreads = std::min(std::max(std::thread::hardware_concurrency(), 1U),
+                                     static_cast<unsigned int>(SW_MAX_THREADS));
+
+    memset(&mTarget, 0, sizeof(mTarget));
+    memset(mBackground, 0, sizeof(mBackground));
+
+    // The caller of execute() is the worker of index 0
+    mScratch.resize(nthreads);
+    for (unsigned int i = 1; i < nthreads; i++)
+        mWorkers.emplace_back(&AcrylicCompositorSW::workerLoop, this, i);
+
+    ALOGD("software compositor created with %u threads", nthreads);
+}
+
+AcrylicCompositorSW::~AcrylicCompositorSW()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mJobCond.notify_all();
+
+    for (auto &worker: mWorkers)
+        worker.join();
+
+    ALOGD("software compositor deleted!");
+}
+
+void AcrylicCompositorSW::workerLoop(unsigned int index)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (true) {
+        mJobCond.wait(lock, [&] { return mExiting || (mJobSequence != seen); });
+        if (mExiting)
+            return;
+
+        seen = mJobSequence;
+        lock.unlock();
+
+        unsigned int band;
+        while ((band = mNextBand.fetch_add(1)) < mNumBands)
+            composeBand(band, mScratch[index]);
+
+        lock.lock();
+        if (--mBusyWorkers == 0)
+            mDoneCond.notify_all();
+    }
+}
+
+void AcrylicCompositorSW::runBands()
+{
+    unsigned int nbands = (mTarget.height + SW_BAND_ROWS - 1) / SW_BAND_ROWS;
+
+    if ((nbands == 1) || mWorkers.empty()) {
+        for (unsigned int band = 0; band < nbands; band++)
+            composeBand(band, mScratch[0]);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+
+    // Every worker joins every job so that no worker sees the band counter
+    // of the previous job.
+    mNumBands = nbands;
+    mNextBand = 0;
+    mBusyWorkers = static_cast<unsigned int>(mWorkers.size());
+    mJobSequence++;
+    lock.unlock();
+    mJobCond.notify_all();
+
+    unsigned int band;
+    while ((band = mNextBand.fetch_add(1)) < nbands)
+        composeBand(band, mScratch[0]);
+
+    lock.lock();
+    mDoneCond.wait(lock, [&] { return mBusyWorkers == 0; });
+}
+
+void AcrylicCompositorSW::composeBand(unsigned int band, Scratch &scratch)
+{
+    const int32_t width = mTarget.width;
+    const int32_t y0 = band * SW_BAND_ROWS;
+    const int32_t y1 = std::min(y0 + SW_BAND_ROWS, mTarget.height);
+    uint8_t *span = scratch.span.data();
+
+    for (int32_t y = y0; y < y1; y++) {
+        uint8_t *row = scratch.band.data() + (y - y0) * width * 4;
+
+        if (mLoadTarget)
+            fetch_span(mTarget, y, mIdentityMap.data(), width, true, row);
+        else
+            fill_span(row, mBackground, width);
+
+        for (auto &plan: mPlans) {
+            const hw2d_rect_t &rect = plan.target;
+
+            if ((y < rect.pos.vert) || (y >= (rect.pos.vert + rect.size.vert)))
+                continue;
+
+            int32_t j = y - rect.pos.vert;
+
+            if (plan.solid)
+                fill_span(span, plan.solid_color, rect.size.hori);
+            else
+                fetch_span(plan.image, plan.row_map[j], plan.col_map.data(),
+                           rect.size.hori, !plan.rot90, span);
+
+            uint8_t *dst = row + rect.pos.hori * 4;
+
+            if (plan.blend == SW_BLEND_PREMULT)
+                blend_span<SW_BLEND_PREMULT>(dst, span, rect.size.hori, plan.plane_alpha);
+            else if (plan.blend == SW_BLEND_COVERAGE)
+                blend_span<SW_BLEND_COVERAGE>(dst, span, rect.size.hori, plan.plane_alpha);
+            else
+                blend_span<SW_BLEND_NONE>(dst, span, rect.size.hori, plan.plane_alpha);
+        }
+    }
+
+    store_rows(mTarget, y0, y1 - y0, scratch.band.data());
+}
+
+bool AcrylicCompositorSW::prepareExecution()
+{
+    if (!resolve_image(getCanvas(), mTarget)) {
+        ALOGE("Failed to configure the target image");
+        return false;
+    }
+
+    hw2d_coord_t xy = getCanvas().getImageDimension();
+
+    mIdentityMap.resize(xy.hori);
+    for (int32_t i = 0; i < xy.hori; i++)
+        mIdentityMap[i] = i;
+
+    mPlans.resize(layerCount());
+
+    for (unsigned int i = 0; i < layerCount(); i++) {
+        AcrylicLayer &layer = *getLayer(i);
+        AcrylicSWLayer &plan = mPlans[i];
+        uint32_t mode = layer.getCompositingMode();
+
+        if ((mode == HWC_BLENDING_PREMULT) || (mode == HWC2_BLEND_MODE_PREMULTIPLIED))
+            plan.blend = SW_BLEND_PREMULT;
+        else if ((mode == HWC_BLENDING_COVERAGE) || (mode == HWC2_BLEND_MODE_COVERAGE))
+            plan.blend = SW_BLEND_COVERAGE;
+        else
+            plan.blend = SW_BLEND_NONE;
+
+        plan.plane_alpha = layer.getPlaneAlpha();
+        plan.target = layer.getTargetRect();
+        if (area_is_zero(plan.target)) {
+            plan.target.pos = {0, 0};
+            plan.target.size = xy;
+        }
+
+        plan.solid = layer.isSolidColor();
+        if (plan.solid) {
+            uint32_t color = layer.getSolidColor();
+
+            plan.solid_color[0] = (color >> 16) & 0xFF;
+            plan.solid_color[1] = (color >> 8) & 0xFF;
+            plan.solid_color[2] = color & 0xFF;
+            plan.solid_color[3] = color >> 24;
+            plan.rot90 = false;
+            continue;
+        }
+
+        if (!resolve_image(layer, plan.image)) {
+            ALOGE("Failed to configure source layer %u", i);
+            return false;
+        }
+
+        hw2d_rect_t src = layer.getImageRect();
+        if (area_is_zero(src)) {
+            src.pos = {0, 0};
+            src.size = layer.getImageDimension();
+        }
+
+        // HAL transforms flip the source image first and rotate it by 90 degree clockwise.
+        uint32_t transform = layer.getTransform();
+        bool fliph = !!(transform & HAL_TRANSFORM_FLIP_H);
+        bool flipv = !!(transform & HAL_TRANSFORM_FLIP_V);
+
+        plan.rot90 = !!(transform & HAL_TRANSFORM_ROT_90);
+        if (plan.rot90) {
+            // The leftmost column of the target comes from the bottom row of the rotated source
+            build_map(plan.row_map, plan.target.size.vert, src.pos.hori, src.size.hori, fliph);
+            build_map(plan.col_map, plan.target.size.hori, src.pos.vert, src.size.vert, !flipv);
+        } else {
+            build_map(plan.col_map, plan.target.size.hori, src.pos.hori, src.size.hori, fliph);
+            build_map(plan.row_map, plan.target.size.vert, src.pos.vert, src.size.vert, flipv);
+        }
+    }
+
+    if (hasBackgroundColor()) {
+        uint16_t r, g, b, a;
+
+        getBackgroundColor(&r, &g, &b, &a);
+
+        a >>= 8;
+        mBackground[0] = div255((r >> 8) * a);
+        mBackground[1] = div255((g >> 8) * a);
+        mBackground[2] = div255((b >> 8) * a);
+        mBackground[3] = a;
+    } else {
+        memset(mBackground, 0, sizeof(mBackground));
+    }
+
+    // Reading the target is not required if the lowest layer overwrites it entirely
+    mLoadTarget = !hasBackgroundColor();
+    if (mLoadTarget && !mPlans.empty()) {
+        const AcrylicSWLayer &bottom = mPlans[0];
+
+        if ((bottom.blend == SW_BLEND_NONE) && (bottom.plane_alpha == 255) &&
+                (bottom.target.pos.hori == 0) && (bottom.target.pos.vert == 0) &&
+                (bottom.target.size == xy))
+            mLoadTarget = false;
+    }
+
+    for (auto &scratch: mScratch) {
+        scratch.band.resize(SW_BAND_ROWS * xy.hori * 4);
+        scratch.span.resize(xy.hori * 4);
+    }
+
+    return true;
+}
+
+bool AcrylicCompositorSW::execute(int fence[], unsigned int num_fences)
+{
+    if (!execute(NULL))
+        return false;
+
+    // The composition is already finished. No release fence is required.
+    for (unsigned int i = 0; i < num_fences; i++)
+        fence[i] = -1;
+
+    return true;
+}
+
+bool AcrylicCompositorSW::waitFences()
+{
+    bool success = true;
+    unsigned int index = 0;
+    AcrylicLayer *layer;
+
+    while ((layer = getLayer(index++))) {
+        if (success && (layer->getFence() >= 0) &&
+                (sync_wait(layer->getFence(), SW_FENCE_TIMEOUT_MS) < 0)) {
+            ALOGERR("Failed to wait for the acquire fence %d of layer %u", layer->getFence(), index - 1);
+            success = false;
+        }
+        layer->setFence(-1);
+    }
+
+    if (success && (getCanvas().getFence() >= 0) &&
+            (sync_wait(getCanvas().getFence(), SW_FENCE_TIMEOUT_MS) < 0)) {
+        ALOGERR("Failed to wait for the acquire fence %d of the target", getCanvas().getFence());
+        success = false;
+    }
+    getCanvas().setFence(-1);
+
+    return success;
+}
+
+bool AcrylicCompositorSW::execute(int *handle)
+{
+    if (!validateAllLayers())
+        return false;
+
+    sortLayers();
+
+    if (!waitFences())
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!prepareExecution())
+        return false;
+
+    runBands();
+
+    mLaptimeUSec = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+
+    if (handle)
+        *handle = 0;
+
+    unsigned index = 0;
+    AcrylicLayer *layer;
+
+    while ((layer = getLayer(index++)))
+        layer->setFence(-1);
+
+    getCanvas().setFence(-1);
+
+    getCanvas().clearSettingModified();
+    for (unsigned int i = 0; i < layerCount(); i++)
+        getLayer(i)->clearSettingModified();
+
+    return true;
+}
+
+bool AcrylicCompositorSW::waitExecution(int __unused handle)
+{
+    // execute() returns after the composition is completed
+    return true;
+}
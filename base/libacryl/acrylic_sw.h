@@ -0,0 +1,113 @@
+/*
+ * Copyright Samsung Electronics Co.,LTD.
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HARDWARE_EXYNOS_HW2DCOMPOSITOR_SW_H__
+#define __HARDWARE_EXYNOS_HW2DCOMPOSITOR_SW_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <hardware/exynos/acryl.h>
+
+struct AcrylicSWCsc;
+
+/*
+ * Description of an image in the memory that the software compositor reads
+ * from or writes to. It is resolved from an AcrylicCanvas once per execution.
+ */
+struct AcrylicSWImage {
+    uint32_t fmt;
+    int32_t  width;
+    int32_t  height;
+    uint8_t *plane[2];
+    uint32_t stride[2];    // bytes per line of each plane
+    const AcrylicSWCsc *csc;  // color conversion coefficients for YCbCr formats
+};
+
+/*
+ * Per-layer state of an execution that is shared by all workers.
+ * @col_map and @row_map map a pixel in the target area to the coordinate of
+ * the source image. If @rot90 is set, @col_map gives the vertical coordinate
+ * and @row_map gives the horizontal coordinate in the source image.
+ */
+struct AcrylicSWLayer {
+    AcrylicSWImage image;
+    hw2d_rect_t target;
+    bool rot90;
+    bool solid;
+    uint8_t solid_color[4];  // R, G, B, A
+    uint8_t plane_alpha;
+    unsigned int blend;
+    std::vector<int32_t> col_map;
+    std::vector<int32_t> row_map;
+};
+
+/*
+ * AcrylicCompositorSW - CPU implementation of the compositor
+ *
+ * AcrylicCompositorSW composites the layers with MT_USERPTR buffers (or solid
+ * colors) into the target image with MT_USERPTR buffer. It supports the same
+ * blending modes, plane alpha, background color and transforms as G2D does and
+ * is intended for the fallback of G2D and the reference of G2D for tests.
+ * The target image is divided into bands of rows and the bands are processed
+ * by a small pool of worker threads together with the caller of execute().
+ * Scaling is done with the nearest neighbor sampling.
+ */
+class AcrylicCompositorSW: public Acrylic {
+public:
+    AcrylicCompositorSW(const HW2DCapability &capability);
+    virtual ~AcrylicCompositorSW();
+    virtual bool execute(int fence[], unsigned int num_fences);
+    virtual bool execute(int *handle = NULL);
+    virtual bool waitExecution(int handle);
+    virtual unsigned int getLaptimeUSec() { return mLaptimeUSec; }
+private:
+    struct Scratch {
+        std::vector<uint8_t> band;
+        std::vector<uint8_t> span;
+    };
+
+    bool waitFences();
+    bool prepareExecution();
+    void composeBand(unsigned int band, Scratch &scratch);
+    void runBands();
+    void workerLoop(unsigned int index);
+
+    AcrylicSWImage mTarget;
+    std::vector<AcrylicSWLayer> mPlans;
+    std::vector<int32_t> mIdentityMap;
+    bool mLoadTarget;
+    uint8_t mBackground[4];
+
+    std::vector<std::thread> mWorkers;
+    std::vector<Scratch> mScratch;
+    std::mutex mLock;
+    std::condition_variable mJobCond;
+    std::condition_variable mDoneCond;
+    uint64_t mJobSequence;
+    unsigned int mNumBands;
+    unsigned int mBusyWorkers;
+    std::atomic<unsigned int> mNextBand;
+    bool mExiting;
+
+    unsigned int mLaptimeUSec;
+};
+
+#endif /* __HARDWARE_EXYNOS_HW2DCOMPOSITOR_SW_H__ */
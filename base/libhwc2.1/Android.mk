@@ -62,6 +62,7 @@ LOCAL_SRC_FILES := \
 	libdevice/ExynosDisplay.cpp \
 	libdevice/ExynosDevice.cpp \
 	libdevice/ExynosLayer.cpp \
+	libdevice/ExynosLayerDumper.cpp \
 	libmaindisplay/ExynosPrimaryDisplay.cpp \
 	libresource/ExynosMPP.cpp \
 	libresource/ExynosResourceManager.cpp \
@@ -82,6 +83,10 @@ LOCAL_CFLAGS += -Wno-unused-parameter
 LOCAL_MODULE := libexynosdisplay
 LOCAL_MODULE_TAGS := optional
 
+ifeq ($(BOARD_USES_HWC_DUMP_LZ4), true)
+LOCAL_SHARED_LIBRARIES += liblz4
+endif
+
 include $(TOP)/hardware/samsung_slsi-linaro/graphics/base/BoardConfigCFlags.mk
 include $(BUILD_SHARED_LIBRARY)
 
@@ -254,7 +254,7 @@ int32_t exynos_destroyLayer(hwc2_device_t *dev, hwc2_display_t display,
         if (exynosDisplay) {
             ExynosLayer *exynosLayer = checkLayer(exynosDisplay, layer);
             if (exynosLayer)
-                return exynosDisplay->destroyLayer((hwc2_layer_t)exynosLayer);
+                return exynosDisplay->destroyLayer(layer);
             else
                 return HWC2_ERROR_BAD_LAYER;
         }
@@ -864,6 +864,20 @@ int32_t exynos_setLayerZOrder(hwc2_device_t *dev, hwc2_display_t display,
     return HWC2_ERROR_BAD_LAYER;
 }
 
+int32_t exynos_setLayerStates(hwc2_device_t *dev, hwc2_display_t display,
+        uint32_t numStates, const exynos_layer_state *states, int32_t *outErrors)
+{
+    ExynosDevice *exynosDevice = checkDevice(dev);
+
+    if (exynosDevice) {
+        ExynosDisplay *exynosDisplay = checkDisplay(exynosDevice, display);
+        if (exynosDisplay)
+            return exynosDisplay->setLayerStates(numStates, states, outErrors);
+    }
+
+    return HWC2_ERROR_BAD_DISPLAY;
+}
+
 int32_t exynos_setOutputBuffer(hwc2_device_t *dev, hwc2_display_t display,
         buffer_handle_t buffer, int32_t releaseFence)
 {
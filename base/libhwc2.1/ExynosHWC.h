@@ -52,9 +52,11 @@ enum {
     HWC_CTL_ENABLE_FENCE_TRACER = 307,
     HWC_CTL_DO_FENCE_FILE_DUMP = 308,
     HWC_CTL_SYS_FENCE_LOGGING = 309,
+    HWC_CTL_ENABLE_ASSIGN_PLAN_REUSE = 310,
 };
 
 class ExynosDevice;
+struct exynos_layer_state;
 
 hwc2_function_pointer_t exynos_getFunction(struct hwc2_device* device, int32_t descriptor);
 void exynos_getCapabilities(struct hwc2_device* device, uint32_t* outcount, int32_t* outcapabilities);
@@ -113,6 +115,13 @@ int32_t exynos_setLayerSurfaceDamage(hwc2_device_t *device, hwc2_display_t displ
 int32_t exynos_setLayerTransform(hwc2_device_t *device, hwc2_display_t display, hwc2_layer_t layer, int32_t transform);
 int32_t exynos_setLayerVisibleRegion(hwc2_device_t *device, hwc2_display_t display, hwc2_layer_t layer, hwc_region_t visible);
 int32_t exynos_setLayerZOrder(hwc2_device_t *device, hwc2_display_t display, hwc2_layer_t layer, uint32_t z);
+/*
+ * Batched form of the exynos_setLayer* functions above.
+ * It is not in the HWC2 function table and is called by the composer
+ * service directly. See ExynosDisplay::setLayerStates().
+ */
+int32_t exynos_setLayerStates(hwc2_device_t *device, hwc2_display_t display,
+        uint32_t numStates, const exynos_layer_state *states, int32_t *outErrors);
 int32_t exynos_setOutputBuffer(hwc2_device_t *device, hwc2_display_t display, buffer_handle_t buffer, int32_t releaseFence);
 int32_t exynos_setPowerMode(hwc2_device_t *device, hwc2_display_t display, int32_t mode);
 int32_t exynos_setVsyncEnabled(hwc2_device_t *device, hwc2_display_t display, int32_t enabled);
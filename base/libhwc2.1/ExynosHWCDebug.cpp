@@ -130,33 +130,8 @@ int32_t saveFenceTrace(ExynosDisplay *display) {
             localTime->tm_sec, tv.tv_usec/1000,
             ((tv.tv_sec * 1000) + (tv.tv_usec / 1000)));
 
-    if (device != NULL) {
-        for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-            uint32_t i = it->first;
-
-            hwc_fence_info_t info = device->mFenceInfo.at(i);
-
-            if (info.usage >= 1) {
-                saveString.appendFormat("FD hwc : %d, usage %d, pending : %d\n", i, info.usage, (int)info.pendingAllowed);
-                for (int j = 0; j < MAX_FENCE_SEQUENCE; j++) {
-                    fenceTrace_t *seq = &info.seq[j];
-                    saveString.appendFormat("    %s(%s)(%s)(cur:%d)(usage:%d)(last:%d)",
-                            GET_STRING(fence_dir_map, seq->dir),
-                            GET_STRING(fence_ip_map, seq->ip), GET_STRING(fence_type_map, seq->type),
-                            seq->curFlag, seq->usage, (int)seq->isLast);
-
-                    tv = seq->time;
-                    localTime = (struct tm*)localtime((time_t*)&tv.tv_sec);
-
-                    saveString.appendFormat(" - time:%02d-%02d %02d:%02d:%02d.%03lu(%lu)\n",
-                            localTime->tm_mon+1, localTime->tm_mday,
-                            localTime->tm_hour, localTime->tm_min,
-                            localTime->tm_sec, tv.tv_usec/1000,
-                            ((tv.tv_sec * 1000) + (tv.tv_usec / 1000)));
-                }
-            }
-        }
-    }
+    if (device != NULL)
+        analyzeFenceLeaks(display, saveString);
 
     if (pFile != NULL) {
         fwrite(saveString.string(), 1, saveString.size(), pFile);
@@ -50,6 +50,9 @@ GrallocWrapper::Allocator* ExynosDevice::mAllocator = NULL;
 ExynosDevice::ExynosDevice()
     : mGeometryChanged(0),
     mDRThread(0),
+    mDRThreadStatus(0),
+    mDRLoopStatus(false),
+    mDRArmedDisplays(0),
     mVsyncDisplayId(getDisplayId(HWC_DISPLAY_PRIMARY, 0)),
     mTimestamp(0),
     mDisplayMode(0),
@@ -75,11 +78,10 @@ ExynosDevice::ExynosDevice()
     exynosHWCControl.sysFenceLogging = false;
     exynosHWCControl.useDynamicRecomp = false;
 
-    mFenceInfo.clear();
-
-    ALOGD("HWC2 : %s : %d , %lu", __func__, __LINE__, (unsigned long)mFenceInfo.size());
+    ALOGD("HWC2 : %s : %d", __func__, __LINE__);
 
     mResourceManager = new ExynosResourceManagerModule(this);
+    mLayerDumper = android::sp<ExynosLayerDumper>::make();
 
     for (size_t i = 0; i < DISPLAY_COUNT; i++) {
         exynos_display_t display_t = AVAILABLE_DISPLAY_UNITS[i];
@@ -221,9 +223,9 @@ ExynosDevice::~ExynosDevice() {
 
     ExynosDisplay *primary_display = getDisplay(getDisplayId(HWC_DISPLAY_PRIMARY,0));
 
-    /* TODO kill threads here */
-    pthread_kill(mDRThread, SIGTERM);
-    pthread_join(mDRThread, NULL);
+    dynamicRecompositionThreadStop();
+
+    mLayerDumper->stop();
 
     if (mMapper != NULL)
         delete mMapper;
@@ -365,59 +367,110 @@ void ExynosDevice::checkDynamicRecompositionThread()
             if (mDisplays[i]->mDREnable)
                 return;
         }
-        mDRLoopStatus = false;
-        pthread_join(mDRThread, 0);
+        dynamicRecompositionThreadStop();
     }
 }
 
 void ExynosDevice::dynamicRecompositionThreadCreate()
 {
     if (exynosHWCControl.useDynamicRecomp == true) {
+        Mutex::Autolock lock(mDRTimerMutex);
+        if (mDRLoopStatus)
+            return;
+        mDRLoopStatus = true;
         /* pthread_create shouldn't have been failed. But, ignore if some error was occurred */
         if (pthread_create(&mDRThread, NULL, dynamicRecompositionThreadLoop, this) != 0) {
             ALOGE("%s: failed to start hwc_dynamicrecomp_thread thread:", __func__);
             mDRLoopStatus = false;
-        } else {
-            mDRLoopStatus = true;
         }
     }
 }
 
+void ExynosDevice::dynamicRecompositionThreadStop()
+{
+    {
+        Mutex::Autolock lock(mDRTimerMutex);
+        if (!mDRLoopStatus)
+            return;
+        mDRLoopStatus = false;
+        mDRTimerCondition.signal();
+    }
+    pthread_join(mDRThread, NULL);
+}
+
+void ExynosDevice::armDynamicRecompositionTimer(ExynosDisplay *display)
+{
+    Mutex::Autolock lock(mDRTimerMutex);
+
+    if (!mDRLoopStatus)
+        return;
+
+    /*
+     * All displays use the same timeout, so a new deadline is never earlier
+     * than the armed ones. The thread needs to be woken up only if it waits
+     * without timeout.
+     */
+    if (display->mDRIdleDeadline == 0) {
+        if (mDRArmedDisplays++ == 0)
+            mDRTimerCondition.signal();
+    }
+    display->mDRIdleDeadline = systemTime(SYSTEM_TIME_MONOTONIC) + DYNAMIC_RECOMP_IDLE_TIMEOUT;
+}
+
 void *ExynosDevice::dynamicRecompositionThreadLoop(void *data)
 {
     ExynosDevice *dev = (ExynosDevice *)data;
-    ExynosDisplay *display[dev->mDisplays.size()];
-    uint64_t event_cnt[dev->mDisplays.size()];
+    uint32_t displayNum = dev->mDisplays.size();
+    ExynosDisplay *expired[displayNum];
 
-    for (uint32_t i = 0; i < dev->mDisplays.size(); i++) {
-        display[i] = dev->mDisplays[i];
-        event_cnt[i] = 0;
-    }
     android_atomic_inc(&(dev->mDRThreadStatus));
 
+    Mutex::Autolock lock(dev->mDRTimerMutex);
     while (dev->mDRLoopStatus) {
-        uint32_t result = 0;
-        for (uint32_t i = 0; i < dev->mDisplays.size(); i++)
-            event_cnt[i] = display[i]->mUpdateEventCnt;
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t nextDeadline = 0;
+        uint32_t expiredNum = 0;
+
+        for (uint32_t i = 0; i < displayNum; i++) {
+            ExynosDisplay *display = dev->mDisplays[i];
+            if (display->mDRIdleDeadline == 0)
+                continue;
+            if (display->mDRIdleDeadline <= now) {
+                display->mDRIdleDeadline = 0;
+                dev->mDRArmedDisplays--;
+                expired[expiredNum++] = display;
+            } else if ((nextDeadline == 0) || (display->mDRIdleDeadline < nextDeadline)) {
+                nextDeadline = display->mDRIdleDeadline;
+            }
+        }
+
+        if (expiredNum == 0) {
+            if (nextDeadline == 0)
+                dev->mDRTimerCondition.wait(dev->mDRTimerMutex);
+            else
+                dev->mDRTimerCondition.waitRelative(dev->mDRTimerMutex, nextDeadline - now);
+            continue;
+        }
 
         /*
-         * If there is no update for more than 100ms, favor the 3D composition mode.
+         * There was no update for DYNAMIC_RECOMP_IDLE_TIMEOUT.
          * If all other conditions are met, mode will be switched to 3D composition.
          */
-        usleep(100000);
-        for (uint32_t i = 0; i < dev->mDisplays.size(); i++) {
-            if (display[i]->mDREnable &&
-                display[i]->mPlugState == true &&
-                event_cnt[i] == display[i]->mUpdateEventCnt) {
-                if (display[i]->checkDynamicReCompMode() == DEVICE_2_CLIENT) {
-                    display[i]->mUpdateEventCnt = 0;
-                    display[i]->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
+        dev->mDRTimerMutex.unlock();
+        uint32_t result = 0;
+        for (uint32_t i = 0; i < expiredNum; i++) {
+            if (expired[i]->mDREnable &&
+                expired[i]->mPlugState == true) {
+                if (expired[i]->checkDynamicReCompMode() == DEVICE_2_CLIENT) {
+                    expired[i]->mUpdateEventCnt = 0;
+                    expired[i]->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
                     result = 1;
                 }
             }
         }
         if (result)
             dev->invalidate();
+        dev->mDRTimerMutex.lock();
     }
 
     android_atomic_dec(&(dev->mDRThreadStatus));
@@ -506,6 +559,9 @@ void ExynosDevice::dump(uint32_t *outSize, char *outBuffer) {
             display->dump(result);
     }
 
+    mResourceManager->dump(result);
+    mLayerDumper->dump(result);
+
     if (outBuffer == NULL) {
         *outSize = (uint32_t)result.length();
     } else {
@@ -709,6 +765,7 @@ void ExynosDevice::setHWCControl(uint32_t display, uint32_t ctrl, int32_t val)
         case HWC_CTL_USE_MAX_G2D_SRC:
         case HWC_CTL_ENABLE_HANDLE_LOW_FPS:
         case HWC_CTL_ENABLE_EARLY_START_MPP:
+        case HWC_CTL_ENABLE_ASSIGN_PLAN_REUSE:
             exynosDisplay = (ExynosDisplay*)getDisplay(display);
             if (exynosDisplay == NULL) {
                 for (uint32_t i = 0; i < mDisplays.size(); i++) {
@@ -22,6 +22,8 @@
 
 #include <utils/Vector.h>
 #include <utils/Trace.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -41,6 +43,7 @@
 #include "gralloc_priv.h"
 #endif
 #include "GrallocWrapper.h"
+#include "ExynosLayerDumper.h"
 
 #define MAX_DEV_NAME 128
 #define ERROR_LOG_PATH0 "/data/vendor/log/hwc"
@@ -52,6 +55,11 @@
 #define DOZE_VSYNC_PERIOD 33333333 // 30fps
 #endif
 
+/* If there is no update for this time, favor the 3D composition mode */
+#ifndef DYNAMIC_RECOMP_IDLE_TIMEOUT
+#define DYNAMIC_RECOMP_IDLE_TIMEOUT 100000000 // 100ms
+#endif
+
 namespace android {
 namespace GrallocWrapper {
 class Mapper;
@@ -171,10 +179,16 @@ class ExynosDevice {
 
         /**
          * If Panel has not self-refresh feature, dynamic recomposition will be enabled.
+         * The thread sleeps until the idle timeout of a display that is armed by
+         * presentDisplay() expires, and it waits without timeout if no timeout is armed.
          */
         pthread_t mDRThread;
         volatile int32_t mDRThreadStatus;
         bool mDRLoopStatus;
+        Mutex mDRTimerMutex;
+        Condition mDRTimerCondition;
+        /* Number of displays that have armed idle timeout */
+        uint32_t mDRArmedDisplays;
         bool mPrimaryBlank;
 
         bool isBootFinished;
@@ -200,9 +214,11 @@ class ExynosDevice {
 
         uint32_t mTotalDumpCount;
         bool mIsDumpRequest;
+        /* Writes the layers of debug_dump_source off the composition path */
+        android::sp<ExynosLayerDumper> mLayerDumper;
 
         // Variable for fence tracer
-        std::unordered_map<int32_t, hwc_fence_info> mFenceInfo;
+        ExynosFenceTracker mFenceTracker;
 
         /**
          * This will be initialized with differnt class
@@ -225,8 +241,15 @@ class ExynosDevice {
          */
 
         void dynamicRecompositionThreadCreate();
+        void dynamicRecompositionThreadStop();
         static void* dynamicRecompositionThreadLoop(void *data);
 
+        /**
+         * Restart the idle timeout of the display
+         * @param display
+         */
+        void armDynamicRecompositionTimer(ExynosDisplay *display);
+
 
         /**
          * @param display
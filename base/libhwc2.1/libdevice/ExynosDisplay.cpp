@@ -82,6 +82,66 @@ int ExynosSortedLayer::compare(ExynosLayer * const *lhs, ExynosLayer *const *rhs
     return left->mZOrder > right->mZOrder;
 }
 
+ExynosLayerHandleTable::ExynosLayerHandleTable()
+    : mFreeHead(INVALID_SLOT),
+    mNumLayers(0)
+{
+}
+
+hwc2_layer_t ExynosLayerHandleTable::add(ExynosLayer *layer)
+{
+    uint32_t index;
+    if (mFreeHead != INVALID_SLOT) {
+        index = mFreeHead;
+        mFreeHead = mSlots[index].nextFree;
+    } else {
+        index = mSlots.size();
+        mSlots.push_back({NULL, 1, INVALID_SLOT});
+    }
+
+    Slot &slot = mSlots[index];
+    slot.layer = layer;
+    slot.nextFree = INVALID_SLOT;
+    mNumLayers++;
+
+    return ((hwc2_layer_t)slot.generation << 32) | (hwc2_layer_t)(index + 1);
+}
+
+ExynosLayer *ExynosLayerHandleTable::remove(hwc2_layer_t handle)
+{
+    ExynosLayer *layer = get(handle);
+    if (layer == NULL)
+        return NULL;
+
+    uint32_t index = (uint32_t)(handle & 0xffffffff) - 1;
+    Slot &slot = mSlots[index];
+    slot.layer = NULL;
+    /* Generation 0 is skipped so that handle 0 is never valid */
+    if (++slot.generation == 0)
+        slot.generation = 1;
+    slot.nextFree = mFreeHead;
+    mFreeHead = index;
+    mNumLayers--;
+
+    return layer;
+}
+
+void ExynosLayerHandleTable::clear()
+{
+    mFreeHead = INVALID_SLOT;
+    for (uint32_t i = mSlots.size(); i > 0; i--) {
+        Slot &slot = mSlots[i - 1];
+        if (slot.layer != NULL) {
+            slot.layer = NULL;
+            if (++slot.generation == 0)
+                slot.generation = 1;
+        }
+        slot.nextFree = mFreeHead;
+        mFreeHead = i - 1;
+    }
+    mNumLayers = 0;
+}
+
 ssize_t ExynosSortedLayer::remove(const ExynosLayer *item)
 {
     for (size_t i = 0; i < this->size(); i++)
@@ -127,6 +187,237 @@ int32_t ExynosLowFpsLayerInfo::addLowFpsLayer(uint32_t layerIndex)
     return NO_ERROR;
 }
 
+ExynosAssignPlan::ExynosAssignPlan()
+    : mValid(false),
+    mXres(0),
+    mYres(0),
+    mColorTransformHint(0),
+    mBlendingNoneIndex(-1),
+    mHasLowFpsLayer(false),
+    mLowFpsFirstIndex(-1),
+    mLowFpsLastIndex(-1),
+    mDynamicReCompMode(NO_MODE_SWITCH),
+    mForceGpu(0),
+    mHasClientComposition(false),
+    mClientFirstIndex(-1),
+    mClientLastIndex(-1),
+    mHasExynosComposition(false),
+    mExynosFirstIndex(-1),
+    mExynosLastIndex(-1),
+    mHitCount(0),
+    mMissCount(0)
+{
+}
+
+void ExynosAssignPlan::invalidate()
+{
+    mValid = false;
+    mLayers.clear();
+}
+
+void ExynosAssignPlan::dump(String8& result)
+{
+    uint64_t total = mHitCount + mMissCount;
+    result.appendFormat("assign plan: valid(%d), layers(%zu), hit(%" PRIu64 "), miss(%" PRIu64 "), hit ratio(%" PRIu64 "%%)\n",
+            mValid, mLayers.size(), mHitCount, mMissCount,
+            (total > 0) ? (mHitCount * 100 / total) : 0);
+}
+
+static inline int64_t rectArea(const hwc_rect &rect)
+{
+    return (int64_t)WIDTH(rect) * HEIGHT(rect);
+}
+
+static inline bool rectsOverlap(const hwc_rect &r1, const hwc_rect &r2)
+{
+    return (r1.left < r2.right) && (r2.left < r1.right) &&
+        (r1.top < r2.bottom) && (r2.top < r1.bottom);
+}
+
+/* Pixels that are not damaged but updated if r1 and r2 are merged */
+static inline int64_t rectMergeCost(const hwc_rect &r1, const hwc_rect &r2)
+{
+    return rectArea(expand(r1, r2)) - rectArea(r1) - rectArea(r2);
+}
+
+ExynosPresentSchedule::ExynosPresentSchedule()
+    : mExpectedPresentTime(0),
+    mLastTargetTime(0),
+    mFrameCount(0),
+    mEarlyCount(0),
+    mLateCount(0),
+    mCoalescedCount(0),
+    mFarCount(0),
+    mEarlyTime(0),
+    mLateTime(0),
+    mMaxLateTime(0)
+{
+}
+
+nsecs_t ExynosPresentSchedule::schedule(nsecs_t now, nsecs_t vsyncPeriod)
+{
+    nsecs_t expected = mExpectedPresentTime;
+    mExpectedPresentTime = 0;
+
+    if ((expected == 0) || (vsyncPeriod <= 0))
+        return now;
+
+    mFrameCount++;
+
+    /*
+     * The previous frame has taken the vsync already.
+     * This frame is latched at the next vsync without waiting.
+     */
+    if ((mLastTargetTime != 0) && (llabs(expected - mLastTargetTime) < vsyncPeriod / 2)) {
+        mCoalescedCount++;
+        return now;
+    }
+    mLastTargetTime = expected;
+
+    if (now > expected) {
+        nsecs_t late = now - expected;
+        mLateCount++;
+        mLateTime += late;
+        mMaxLateTime = max(mMaxLateTime, late);
+        return now;
+    }
+
+    nsecs_t deliverTime = expected - vsyncPeriod + VSYNC_MARGIN;
+    if (deliverTime <= now)
+        return now;
+
+    /* Not to hold the display for longer than a vsync period */
+    if (deliverTime - now > vsyncPeriod) {
+        mFarCount++;
+        mLastTargetTime = 0;
+        return now;
+    }
+
+    mEarlyCount++;
+    mEarlyTime += deliverTime - now;
+
+    return deliverTime;
+}
+
+void ExynosPresentSchedule::dump(String8& result)
+{
+    if (mFrameCount == 0)
+        return;
+
+    result.appendFormat("present schedule: frames(%" PRIu64 "), early(%" PRIu64 ", avg %" PRId64 " us), "
+            "late(%" PRIu64 ", avg %" PRId64 " us, max %" PRId64 " us), coalesced(%" PRIu64 "), "
+            "far(%" PRIu64 ")\n",
+            mFrameCount,
+            mEarlyCount, (mEarlyCount > 0) ? ns2us(mEarlyTime / (nsecs_t)mEarlyCount) : 0,
+            mLateCount, (mLateCount > 0) ? ns2us(mLateTime / (nsecs_t)mLateCount) : 0,
+            ns2us(mMaxLateTime), mCoalescedCount, mFarCount);
+}
+
+ExynosDamageRegion::ExynosDamageRegion()
+    : mNumRects(0),
+    mFrameCount(0),
+    mPartialCount(0),
+    mFullBytes(0),
+    mUpdatedBytes(0),
+    mDamagedBytes(0),
+    mLastFullBytes(0),
+    mLastUpdatedBytes(0)
+{
+}
+
+void ExynosDamageRegion::add(const hwc_rect &rect)
+{
+    if ((rect.left >= rect.right) || (rect.top >= rect.bottom))
+        return;
+
+    /* Absorb the rectangles that overlap or that are cheap to merge */
+    hwc_rect merged = rect;
+    bool absorbed;
+    do {
+        absorbed = false;
+        for (uint32_t i = 0; i < mNumRects; i++) {
+            if (rectsOverlap(merged, mRects[i]) ||
+                (rectMergeCost(merged, mRects[i]) <= (int64_t)REGION_OVERHEAD_PIXELS)) {
+                merged = expand(merged, mRects[i]);
+                mRects[i] = mRects[--mNumRects];
+                absorbed = true;
+                break;
+            }
+        }
+    } while (absorbed);
+
+    mRects[mNumRects++] = merged;
+
+    if (mNumRects > MAX_RECTS)
+        mergeCheapest();
+}
+
+void ExynosDamageRegion::mergeCheapest()
+{
+    uint32_t first = 0, second = 1;
+    int64_t minCost = rectMergeCost(mRects[0], mRects[1]);
+
+    for (uint32_t i = 0; i < mNumRects; i++) {
+        for (uint32_t j = i + 1; j < mNumRects; j++) {
+            int64_t cost = rectMergeCost(mRects[i], mRects[j]);
+            if (cost < minCost) {
+                minCost = cost;
+                first = i;
+                second = j;
+            }
+        }
+    }
+
+    hwc_rect merged = expand(mRects[first], mRects[second]);
+    /* second is greater than first */
+    mRects[second] = mRects[--mNumRects];
+    mRects[first] = mRects[--mNumRects];
+    /* The merged rectangle can overlap the others */
+    add(merged);
+}
+
+hwc_rect ExynosDamageRegion::getBounds() const
+{
+    hwc_rect bounds = {0, 0, 0, 0};
+
+    if (mNumRects == 0)
+        return bounds;
+
+    bounds = mRects[0];
+    for (uint32_t i = 1; i < mNumRects; i++)
+        bounds = expand(bounds, mRects[i]);
+
+    return bounds;
+}
+
+void ExynosDamageRegion::addFrameStats(uint64_t fullBytes, uint64_t updatedBytes,
+        uint64_t damagedBytes)
+{
+    mFrameCount++;
+    if (updatedBytes < fullBytes)
+        mPartialCount++;
+    mFullBytes += fullBytes;
+    mUpdatedBytes += updatedBytes;
+    mDamagedBytes += damagedBytes;
+    mLastFullBytes = fullBytes;
+    mLastUpdatedBytes = updatedBytes;
+}
+
+void ExynosDamageRegion::dump(String8& result)
+{
+    result.appendFormat("window update: frames(%" PRIu64 "), partial(%" PRIu64 "), "
+            "damaged(%" PRIu64 "%%), updated(%" PRIu64 "%%), "
+            "saved bytes(%" PRIu64 "), last frame saved bytes(%" PRIu64 " of %" PRIu64 ")\n",
+            mFrameCount, mPartialCount,
+            (mFullBytes > 0) ? (mDamagedBytes * 100 / mFullBytes) : 0,
+            (mFullBytes > 0) ? (mUpdatedBytes * 100 / mFullBytes) : 0,
+            mFullBytes - mUpdatedBytes,
+            mLastFullBytes - mLastUpdatedBytes, mLastFullBytes);
+    for (uint32_t i = 0; i < mNumRects; i++)
+        result.appendFormat("\tdamage[%u] : %d, %d, %d, %d\n", i,
+                mRects[i].left, mRects[i].top, mRects[i].right, mRects[i].bottom);
+}
+
 ExynosCompositionInfo::ExynosCompositionInfo(uint32_t type)
     : ExynosMPPSource(MPP_SOURCE_COMPOSITION_TARGET, this),
     mType(type),
@@ -303,12 +594,16 @@ ExynosDisplay::ExynosDisplay(uint32_t index, ExynosDevice *device)
     mClientCompositionInfo(COMPOSITION_CLIENT),
     mExynosCompositionInfo(COMPOSITION_EXYNOS),
     mGeometryChanged(0x0),
+    mBatchingLayerStates(false),
+    mBatchedGeometryChanged(0x0),
     mRenderingState(RENDERING_STATE_NONE),
     mHWCRenderingState(RENDERING_STATE_NONE),
     mDisplayBW(0),
     mDynamicReCompMode(NO_MODE_SWITCH),
     mDREnable(false),
     mDRDefault(false),
+    mDRStats{0, 0, 0},
+    mDRIdleDeadline(0),
     mErrorFrameCount(0),
     mUpdateEventCnt(0),
     mDumpCount(0),
@@ -468,7 +763,7 @@ void ExynosDisplay::initDisplay() {
 int32_t ExynosDisplay::destroyLayer(hwc2_layer_t outLayer) {
 
     Mutex::Autolock lock(mDRMutex);
-    ExynosLayer *layer = (ExynosLayer *)outLayer;
+    ExynosLayer *layer = mLayerHandles.remove(outLayer);
 
     if (layer == nullptr) {
         return HWC2_ERROR_BAD_LAYER;
@@ -500,6 +795,8 @@ int32_t ExynosDisplay::destroyLayer(hwc2_layer_t outLayer) {
  * @return void
  */
 void ExynosDisplay::destroyLayers() {
+    mLayerHandles.clear();
+
     for (uint32_t index = 0; index < mLayers.size();) {
         ExynosLayer *layer = mLayers[index];
         mLayers.removeAt(index);
@@ -514,21 +811,40 @@ void ExynosDisplay::destroyLayers() {
 }
 
 ExynosLayer *ExynosDisplay::checkLayer(hwc2_layer_t addr) {
-    ExynosLayer *temp = (ExynosLayer *)addr;
-    if (!mLayers.isEmpty()) {
-        for (size_t i = 0; i < mLayers.size(); i++) {
-            if (mLayers[i] == temp)
-                return mLayers[i];
-        }
-    }
+    ExynosLayer *layer = mLayerHandles.get(addr);
+    if (layer == NULL)
+        ALOGE("HWC2 : %s : %d, wrong layer request!", __func__, __LINE__);
 
-    if (mIgnoreLayers.size()) {
-        auto it = std::find(mIgnoreLayers.begin(), mIgnoreLayers.end(), temp);
-        return (it == mIgnoreLayers.end()) ? NULL : *it;
+    return layer;
+}
+
+int32_t ExynosDisplay::setLayerStates(uint32_t numStates,
+        const exynos_layer_state *states, int32_t *outErrors) {
+    int32_t ret = HWC2_ERROR_NONE;
+
+    Mutex::Autolock lock(mDisplayMutex);
+    mBatchingLayerStates = true;
+    mBatchedGeometryChanged = 0;
+
+    for (uint32_t i = 0; i < numStates; i++) {
+        int32_t err = HWC2_ERROR_BAD_LAYER;
+        ExynosLayer *layer = checkLayer(states[i].layer);
+        if (layer != NULL)
+            err = layer->applyLayerState(states[i]);
+        else if ((states[i].flags & LAYER_STATE_BUFFER) && (states[i].acquireFence >= 0))
+            close(states[i].acquireFence);
+
+        if (outErrors != NULL)
+            outErrors[i] = err;
+        if ((err != HWC2_ERROR_NONE) && (ret == HWC2_ERROR_NONE))
+            ret = err;
     }
 
-    ALOGE("HWC2 : %s : %d, wrong layer request!", __func__, __LINE__);
-    return NULL;
+    mBatchingLayerStates = false;
+    if (mBatchedGeometryChanged)
+        setGeometryChanged(mBatchedGeometryChanged);
+
+    return ret;
 }
 
 void ExynosDisplay::checkIgnoreLayers() {
@@ -703,11 +1019,10 @@ int ExynosDisplay::checkLayerFps() {
  * @return int
  */
 int ExynosDisplay::checkDynamicReCompMode() {
-    unsigned int updateFps = 0;
-    unsigned int lcd_size = this->mXres * this->mYres;
+    uint64_t lcd_size = (uint64_t)this->mXres * this->mYres;
     uint64_t TimeStampDiff;
-    uint64_t w = 0, h = 0, incomingPixels = 0;
-    uint64_t maxFps = 0, layerFps = 0;
+    dynamic_recomp_stats_t stats;
+    bool highFps;
 
     Mutex::Autolock lock(mDRMutex);
 
@@ -724,29 +1039,27 @@ int ExynosDisplay::checkDynamicReCompMode() {
         return 0;
     }
 
-    /* If video layer is there, skip the mode switch */
-    for (size_t i = 0; i < mLayers.size(); i++) {
-        if ((mLayers[i]->mLayerBuffer) && (isFormatYUV(mLayers[i]->mLayerBuffer->format))) {
-            if (mDynamicReCompMode != DEVICE_2_CLIENT) {
-                return 0;
-            } else {
-                mDynamicReCompMode = CLIENT_2_DEVICE;
-                mLastModeSwitchTimeStamp = mLastUpdateTimeStamp;
-                DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] GLES_2_HWC by video layer");
-                this->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
-                return CLIENT_2_DEVICE;
-            }
-        }
+    /* The aggregates are maintained by ExynosLayer::checkFps() */
+    {
+        Mutex::Autolock statsLock(mDRStatsMutex);
+        stats = mDRStats;
     }
 
-    for (size_t i = 0; i < mLayers.size(); i++) {
-        w = WIDTH(mLayers[i]->mPreprocessedInfo.displayFrame);
-        h = HEIGHT(mLayers[i]->mPreprocessedInfo.displayFrame);
-        incomingPixels += w * h;
+    /* If video layer is there, skip the mode switch */
+    if (stats.yuvLayers) {
+        if (mDynamicReCompMode != DEVICE_2_CLIENT) {
+            return 0;
+        } else {
+            mDynamicReCompMode = CLIENT_2_DEVICE;
+            mLastModeSwitchTimeStamp = mLastUpdateTimeStamp;
+            DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] GLES_2_HWC by video layer");
+            this->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
+            return CLIENT_2_DEVICE;
+        }
     }
 
     /* Mode Switch is not required if total pixels are not more than the threshold */
-    if (incomingPixels <= lcd_size) {
+    if (stats.pixels <= lcd_size) {
         if (mDynamicReCompMode != DEVICE_2_CLIENT) {
             return 0;
         } else {
@@ -775,24 +1088,19 @@ int ExynosDisplay::checkDynamicReCompMode() {
     if ((mUpdateEventCnt != 1) &&
         (mDynamicReCompMode == DEVICE_2_CLIENT)) {
         DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] first frame after DEVICE_2_CLIENT");
-        updateFps = HWC_FPS_TH;
+        highFps = true;
     } else {
-        for (uint32_t i = 0; i < mLayers.size(); i++) {
-            layerFps = mLayers[i]->getFps();
-            if (maxFps < layerFps)
-                maxFps = layerFps;
-        }
-        updateFps = maxFps;
+        highFps = (stats.highFpsLayers > 0);
     }
 
     /*
      * FPS estimation.
-     * If FPS is lower than HWC_FPS_TH, try to switch the mode to GLES
+     * If no layer reaches HWC_FPS_TH, try to switch the mode to GLES
      */
-    if (updateFps < HWC_FPS_TH) {
+    if (!highFps) {
         if (mDynamicReCompMode != DEVICE_2_CLIENT) {
             mDynamicReCompMode = DEVICE_2_CLIENT;
-            DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] DEVICE_2_CLIENT by low FPS(%d)", updateFps);
+            DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] DEVICE_2_CLIENT by low FPS");
             this->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
             return DEVICE_2_CLIENT;
         } else {
@@ -801,7 +1109,8 @@ int ExynosDisplay::checkDynamicReCompMode() {
     } else {
         if (mDynamicReCompMode == DEVICE_2_CLIENT) {
             mDynamicReCompMode = CLIENT_2_DEVICE;
-            DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] CLIENT_2_HWC by high FPS(%d)", updateFps);
+            DISPLAY_LOGD(eDebugDynamicRecomp, "[DYNAMIC_RECOMP] CLIENT_2_HWC by high FPS(%d layers)",
+                    stats.highFpsLayers);
             this->setGeometryChanged(GEOMETRY_DISPLAY_DYNAMIC_RECOMPOSITION);
             return CLIENT_2_DEVICE;
         } else {
@@ -812,6 +1121,15 @@ int ExynosDisplay::checkDynamicReCompMode() {
     return 0;
 }
 
+void ExynosDisplay::updateDynamicReCompStats(const dynamic_recomp_stats_t &prev,
+        const dynamic_recomp_stats_t &cur)
+{
+    Mutex::Autolock lock(mDRStatsMutex);
+    mDRStats.pixels = mDRStats.pixels - prev.pixels + cur.pixels;
+    mDRStats.yuvLayers = mDRStats.yuvLayers - prev.yuvLayers + cur.yuvLayers;
+    mDRStats.highFpsLayers = mDRStats.highFpsLayers - prev.highFpsLayers + cur.highFpsLayers;
+}
+
 /**
  * @return int
  */
@@ -1824,39 +2142,14 @@ void ExynosDisplay::printDebugInfos(String8 &reason)
     }
 
     /* Fence Tracer Information */
-    ExynosDevice *device = mDevice;
-    if (device != NULL) {
-        for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-
-            uint32_t i = it->first;
-
-            if (device->mFenceInfo.count(i) == 0 ) continue;
-
-            hwc_fence_info_t info = device->mFenceInfo.at(i);
-            if (info.usage >= 1 && !info.pendingAllowed) {
-                result.appendFormat("\nFD hwc : %d, usage %d, pending : %d\n", i, info.usage, (int)info.pendingAllowed);
-                for (int j = 0; j < MAX_FENCE_SEQUENCE; j++) {
-                    fenceTrace_t *seq = &info.seq[j];
-                    result.appendFormat("    %s(%s)(%s)(cur:%d)(usage:%d)(last:%d)",
-                            GET_STRING(fence_dir_map, seq->dir),
-                            GET_STRING(fence_ip_map, seq->ip), GET_STRING(fence_type_map, seq->type),
-                            seq->curFlag, seq->usage, (int)seq->isLast);
-
-                    tv = seq->time;
-                    localTime = (struct tm*)localtime((time_t*)&tv.tv_sec);
-
-                    result.appendFormat(" - time:%02d-%02d %02d:%02d:%02d.%03lu(%lu)\n",
-                            localTime->tm_mon+1, localTime->tm_mday,
-                            localTime->tm_hour, localTime->tm_min,
-                            localTime->tm_sec, tv.tv_usec/1000,
-                            ((tv.tv_sec * 1000) + (tv.tv_usec / 1000)));
-                    if (pFile != NULL) {
-                        fwrite(result.string(), 1, result.size(), pFile);
-                    }
-                    result.clear();
-                }
-            }
+    if (mDevice != NULL) {
+        result.appendFormat("\n");
+        analyzeFenceLeaks(this, result);
+        ALOGD("%s", result.string());
+        if (pFile != NULL) {
+            fwrite(result.string(), 1, result.size(), pFile);
         }
+        result.clear();
     }
 
     if (pFile != NULL) {
@@ -2341,7 +2634,8 @@ int32_t ExynosDisplay::createLayer(hwc2_layer_t* outLayer) {
     /* TODO : Sort sequence should be added to somewhere */
     mLayers.add((ExynosLayer*)layer);
 
-    *outLayer = (hwc2_layer_t)layer;
+    layer->mHandle = mLayerHandles.add(layer);
+    *outLayer = layer->mHandle;
     setGeometryChanged(GEOMETRY_DISPLAY_LAYER_ADDED);
 
     return HWC2_ERROR_NONE;
@@ -2407,7 +2701,7 @@ int32_t ExynosDisplay::getChangedCompositionTypes(
             count++;
         } else {
             if (count < num) {
-                out_layers[count] = (hwc2_layer_t)layer;
+                out_layers[count] = layer->mHandle;
                 out_types[count] = type;
                 count++;
             } else {
@@ -2556,7 +2850,7 @@ int32_t ExynosDisplay::getDisplayRequests(
                                 __func__, requestNum, *outNumElements);
                         goto err;
                     }
-                    outLayers[requestNum] = (hwc2_layer_t)layer;
+                    outLayers[requestNum] = layer->mHandle;
                     outLayerRequests[requestNum] = HWC2_LAYER_REQUEST_CLEAR_CLIENT_TARGET;
                 }
                 requestNum++;
@@ -2618,7 +2912,7 @@ int32_t ExynosDisplay::getReleaseFences(
                 if (deviceLayerNum < *outNumElements) {
                     // transfer fence ownership to the caller
                     setFenceName(mLayers[i]->mReleaseFence, FENCE_LAYER_RELEASE_DPP);
-                    outLayers[deviceLayerNum] = (hwc2_layer_t)mLayers[i];
+                    outLayers[deviceLayerNum] = mLayers[i]->mHandle;
                     outFences[deviceLayerNum] = mLayers[i]->mReleaseFence;
                     mLayers[i]->mReleaseFence = -1;
 
@@ -2967,6 +3261,8 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
 
     setDisplayWinConfigData();
 
+    waitForExpectedPresentTime();
+
     if ((ret = deliverWinConfigData()) != NO_ERROR) {
         HWC_LOGE(this, "%s:: fail to deliver win_config (%d)", __func__, ret);
         if (mDpuData.retire_fence > 0)
@@ -3048,6 +3344,9 @@ set_state:
     setPresentAndClearRenderingStatesFlags();
     mRenderingState = RENDERING_STATE_PRESENTED;
 
+    if (exynosHWCControl.useDynamicRecomp && mDREnable)
+        mDevice->armDynamicRecompositionTimer(this);
+
     return ret;
 err:
     printDebugInfos(errString);
@@ -3099,7 +3398,12 @@ int32_t ExynosDisplay::presentPostProcessing()
 
 int32_t ExynosDisplay::setActiveConfig(
         hwc2_config_t config) {
-    return mDisplayInterface->setActiveConfig(config);
+    uint32_t prevXres = mXres;
+    uint32_t prevYres = mYres;
+    int32_t ret = mDisplayInterface->setActiveConfig(config);
+    if ((ret == NO_ERROR) && ((mXres != prevXres) || (mYres != prevYres)))
+        mResourceManager->prewarmDstBufs(this, prevXres, prevYres);
+    return ret;
 }
 
 int32_t ExynosDisplay::setClientTarget(
@@ -3323,6 +3627,39 @@ int32_t ExynosDisplay::getDisplayVsyncPeriod(hwc2_vsync_period_t* outVsyncPeriod
     return HWC2_ERROR_NONE;
 }
 
+int32_t ExynosDisplay::setExpectedPresentTime(uint64_t timestamp)
+{
+    Mutex::Autolock lock(mDisplayMutex);
+    mPresentSchedule.setExpectedPresentTime((nsecs_t)timestamp);
+    return HWC2_ERROR_NONE;
+}
+
+/*
+ * Called with mDisplayMutex locked by presentDisplay().
+ * The other calls to this display are blocked while it waits, so the wait
+ * is bounded to a vsync period by ExynosPresentSchedule::schedule().
+ */
+void ExynosDisplay::waitForExpectedPresentTime()
+{
+    if (mType == HWC_DISPLAY_VIRTUAL) {
+        mPresentSchedule.setExpectedPresentTime(0);
+        return;
+    }
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t deliverTime = mPresentSchedule.schedule(now, mVsyncPeriod);
+    if (deliverTime <= now)
+        return;
+
+    ATRACE_NAME("waitForExpectedPresentTime");
+    DISPLAY_LOGD(eDebugWinConfig, "%s:: delay %" PRId64 " us", __func__, ns2us(deliverTime - now));
+
+    struct timespec ts;
+    ts.tv_sec = deliverTime / s2ns(1);
+    ts.tv_nsec = deliverTime % s2ns(1);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
 int32_t ExynosDisplay::setActiveConfigWithConstraints(hwc2_config_t config,
         hwc_vsync_period_change_constraints_t* vsyncPeriodChangeConstraints,
         hwc_vsync_period_change_timeline_t* outTimeline)
@@ -3555,8 +3892,12 @@ int32_t ExynosDisplay::doDisplayConfigPostProcess(ExynosDevice *dev)
 
     if (needSetActiveConfig) {
         int32_t ret = NO_ERROR;
+        uint32_t prevXres = mXres;
+        uint32_t prevYres = mYres;
         if ((ret = mDisplayInterface->setActiveConfig(mDesiredConfig)) != NO_ERROR)
             return ret;
+        if ((mXres != prevXres) || (mYres != prevYres))
+            mResourceManager->prewarmDstBufs(this, prevXres, prevYres);
 
         mConfigRequestState = hwc_request_state_t::SET_CONFIG_STATE_REQUESTED;
     }
@@ -3863,6 +4204,11 @@ void ExynosDisplay::dump(String8& result)
             mXres, mYres, mVsyncState, mColorMode, mColorTransformHint);
     mClientCompositionInfo.dump(result);
     mExynosCompositionInfo.dump(result);
+    mAssignPlan.dump(result);
+    mDamageRegion.dump(result);
+    mPresentSchedule.dump(result);
+    if (mDevice != NULL)
+        analyzeFenceLeaks(this, result);
 
     if (mLayers.size()) {
         result.appendFormat("============================== dump layers ===========================================\n");
@@ -4460,6 +4806,7 @@ int ExynosDisplay::handleWindowUpdate()
     mDpuData.win_update_region.w = mXres;
     mDpuData.win_update_region.y = 0;
     mDpuData.win_update_region.h = mYres;
+    mDamageRegion.clear();
 
     if (exynosHWCControl.windowUpdate != 1) return 0;
 
@@ -4489,7 +4836,7 @@ int ExynosDisplay::handleWindowUpdate()
         if (excp == eDamageRegionPartial) {
             DISPLAY_LOGD(eDebugWindowUpdate, "layer(%zu) partial : %d, %d, %d, %d", i,
                     damageRect.left, damageRect.top, damageRect.right, damageRect.bottom);
-            mergedRect = expand(mergedRect, damageRect);
+            mDamageRegion.add(damageRect);
         }
         else if (excp == eDamageRegionSkip) {
             int32_t windowIndex = mLayers[i]->mWindowIndex;
@@ -4508,11 +4855,11 @@ int ExynosDisplay::handleWindowUpdate()
                 damageRect.bottom = mLayers[i]->mDisplayFrame.bottom;
                 DISPLAY_LOGD(eDebugWindowUpdate, "Skip layer (origin) : %d, %d, %d, %d",
                         damageRect.left, damageRect.top, damageRect.right, damageRect.bottom);
-                mergedRect = expand(mergedRect, damageRect);
+                mDamageRegion.add(damageRect);
                 hwc_rect prevDst = {mLastDpuData.configs[i].dst.x, mLastDpuData.configs[i].dst.y,
                     mLastDpuData.configs[i].dst.x + (int)mLastDpuData.configs[i].dst.w,
                     mLastDpuData.configs[i].dst.y + (int)mLastDpuData.configs[i].dst.h};
-                mergedRect = expand(mergedRect, prevDst);
+                mDamageRegion.add(prevDst);
             } else {
                 DISPLAY_LOGD(eDebugWindowUpdate, "layer(%zu) skip", i);
                 continue;
@@ -4525,7 +4872,7 @@ int ExynosDisplay::handleWindowUpdate()
             damageRect.bottom = mLayers[i]->mDisplayFrame.bottom;
             DISPLAY_LOGD(eDebugWindowUpdate, "Full layer update : %d, %d, %d, %d", mLayers[i]->mDisplayFrame.left,
                     mLayers[i]->mDisplayFrame.top, mLayers[i]->mDisplayFrame.right, mLayers[i]->mDisplayFrame.bottom);
-            mergedRect = expand(mergedRect, damageRect);
+            mDamageRegion.add(damageRect);
         }
         else {
             DISPLAY_LOGD(eDebugWindowUpdate, "Partial canceled, Skip reason (layer %zu) : %d", i, excp);
@@ -4533,10 +4880,12 @@ int ExynosDisplay::handleWindowUpdate()
         }
     }
 
-    if (mergedRect.left != (int32_t)mXres || mergedRect.right != 0 ||
-        mergedRect.top != (int32_t)mYres || mergedRect.bottom != 0) {
-        DISPLAY_LOGD(eDebugWindowUpdate, "Partial(origin) : %d, %d, %d, %d",
-                mergedRect.left, mergedRect.top, mergedRect.right, mergedRect.bottom);
+    if (!mDamageRegion.isEmpty()) {
+        /* DPU updates a single region that covers all the damaged rectangles */
+        mergedRect = mDamageRegion.getBounds();
+        DISPLAY_LOGD(eDebugWindowUpdate, "Partial(origin) : %d, %d, %d, %d, %u rects",
+                mergedRect.left, mergedRect.top, mergedRect.right, mergedRect.bottom,
+                mDamageRegion.mNumRects);
     } else {
         return 0;
     }
@@ -4569,6 +4918,31 @@ int ExynosDisplay::handleWindowUpdate()
         mergedRect.bottom = pixel_align(mergedRect.bottom, blockHeight);
     if (mergedRect.bottom > (int32_t)mYres) mergedRect.bottom = mYres;
 
+    /*
+     * The partial update has the overhead of the reconfiguration of DPU and
+     * the panel. Update the full frame if the bytes that the region saves
+     * do not pay for it.
+     */
+    hwc_rect fullRect = {0, 0, (int)mXres, (int)mYres};
+    uint64_t fullBytes = getWindowUpdateBytes(fullRect);
+    uint64_t updateBytes = getWindowUpdateBytes(mergedRect);
+    uint64_t damagedBytes = 0;
+    for (uint32_t i = 0; i < mDamageRegion.mNumRects; i++)
+        damagedBytes += getWindowUpdateBytes(mDamageRegion.mRects[i]);
+
+    if ((fullBytes > 0) &&
+        (updateBytes + fullBytes * WINDOW_UPDATE_OVERHEAD_PERCENT / 100 >= fullBytes)) {
+        DISPLAY_LOGD(eDebugWindowUpdate, "Partial(aligned) : %d, %d, %d, %d, "
+                "%" PRIu64 " bytes of %" PRIu64 " bytes, update full size",
+                mergedRect.left, mergedRect.top, mergedRect.right, mergedRect.bottom,
+                updateBytes, fullBytes);
+        mergedRect = fullRect;
+    }
+
+    mDamageRegion.addFrameStats(fullBytes,
+            (WIDTH(mergedRect) == (int)mXres && HEIGHT(mergedRect) == (int)mYres) ?
+            fullBytes : updateBytes, damagedBytes);
+
     if (mergedRect.left == 0 && mergedRect.right == (int32_t)mXres &&
             mergedRect.top == 0 && mergedRect.bottom == (int32_t)mYres) {
         DISPLAY_LOGD(eDebugWindowUpdate, "Partial(aligned) : Full size");
@@ -4600,6 +4974,29 @@ int ExynosDisplay::handleWindowUpdate()
     return 0;
 }
 
+/* Estimated bytes that DPU fetches to update the region */
+uint64_t ExynosDisplay::getWindowUpdateBytes(const hwc_rect &rect)
+{
+    uint64_t bytes = 0;
+
+    for (size_t i = 0; i < mDpuData.configs.size(); i++) {
+        exynos_win_config_data &config = mDpuData.configs[i];
+        if (config.state != config.WIN_STATE_BUFFER)
+            continue;
+
+        hwc_rect dst = {config.dst.x, config.dst.y,
+            config.dst.x + (int)config.dst.w, config.dst.y + (int)config.dst.h};
+        if (!rectsOverlap(rect, dst))
+            continue;
+
+        hwc_rect overlap = {max(rect.left, dst.left), max(rect.top, dst.top),
+            min(rect.right, dst.right), min(rect.bottom, dst.bottom)};
+        bytes += (uint64_t)rectArea(overlap) * formatToBpp(config.format) / 8;
+    }
+
+    return bytes;
+}
+
 unsigned int ExynosDisplay::getLayerRegion(ExynosLayer *layer, hwc_rect *rect_area, uint32_t regionType) {
 
     android::Vector <hwc_rect_t> hwcRects;
@@ -4820,6 +5217,10 @@ void ExynosDisplay::setHWCControl(uint32_t ctrl, int32_t val)
         case HWC_CTL_ENABLE_EARLY_START_MPP:
             mDisplayControl.earlyStartMPP = (unsigned int)val;
             break;
+        case HWC_CTL_ENABLE_ASSIGN_PLAN_REUSE:
+            mDisplayControl.reuseAssignPlan = (unsigned int)val;
+            mAssignPlan.invalidate();
+            break;
         default:
             ALOGE("%s: unsupported HWC_CTL (%d)", __func__, ctrl);
             break;
@@ -4997,14 +5398,20 @@ void ExynosDisplay::setDumpCount(uint32_t dumpCount)
     mDumpCount = dumpCount;
 }
 
+/*
+ * The layer buffers are handed to the dumper of the device with their
+ * acquire fences. It copies the buffers as soon as the fences signal,
+ * before the layers release them, and writes the copies on its own thread.
+ */
 void ExynosDisplay::getDumpLayer()
 {
-    void *temp = NULL;
     size_t bufLength[4];
+    ExynosLayerDumper::Frame frame;
 
-    DISPLAY_LOGD(eDebugHWC,"debug_dump_source %s dumpCount=%d mDisplayId=%d", __func__, mDumpCount, mDisplayId);
+    frame.displayId = mDisplayId;
+    frame.frameIndex = mDevice->mTotalDumpCount - mDumpCount + 1;
 
-    //virtual and external check whether connection
+    DISPLAY_LOGD(eDebugHWC,"debug_dump_source %s dumpCount=%d mDisplayId=%d", __func__, mDumpCount, mDisplayId);
 
     for (size_t i = 0; i < mLayers.size(); i++) {
         private_handle_t *hnd = mLayers[i]->mLayerBuffer;
@@ -5014,115 +5421,47 @@ void ExynosDisplay::getDumpLayer()
             continue;
         }
 
-        if (fence_valid(mLayers[i]->mAcquireFence)) {
-            if (sync_wait(mLayers[i]->mAcquireFence, 1000) < 0) {
-                ALOGE("debug_dump_source %s:: [%zu] sync wait failed", __func__, i);
-                return;
-            }
-        }
-
         if (getBufLength(hnd, 4, bufLength, hnd->format, hnd->stride, hnd->vstride) != NO_ERROR) {
             ALOGE("debug_dump_source %s:: invalid bufferLength(%zu, %zu, %zu), format(0x%8x)", __func__,
                     bufLength[0], bufLength[1], bufLength[2], hnd->format);
-            return;
+            continue;
         }
 
-        writeDumpData(hnd, bufLength, i, temp);
-    }
-
-    mDumpCount--;
-    if (mDumpCount == 0) {
-        uint32_t dumpedIdx = mDevice->mTotalDumpCount - mDumpCount + 1;
-        DISPLAY_LOGD(eDebugHWC, "debug_dump_source finished dump file index=%d", dumpedIdx);
-    }
-}
-
-void ExynosDisplay::writeDumpData(private_handle_t *hnd, size_t bufLength[], size_t i, void *temp){
-    FILE *fp = NULL;
-    size_t result = 0;
-    char filePath[MAX_DEV_NAME];
-    uint32_t bufferNum = 0;
-    uint32_t layer_type = 0;
-    int bufFds[4];
-    uint32_t currentDumpIdx;
-
-    bufFds[0] = hnd->fd;
-    bufFds[1] = hnd->fd1;
-    bufFds[2] = hnd->fd2;
-    bufferNum = getBufferNumOfFormat(hnd->format);
-    layer_type = getTypeOfFormat(hnd->format);
-    currentDumpIdx = mDevice->mTotalDumpCount - mDumpCount + 1;
-
-
-    DISPLAY_LOGD(eDebugHWC, "%s::debug_dump_source fd=%d, fd1=%d, fd2=%d size=%zu size1=%zu size2=%zu"
-            "layer_index=%zu srcHandle->size=%d srcHandle->size1=%d srcHandle->size2=%d srcHandle->fd=%d srcHandle->fd1=%d srcHandle->fd2=%d bufferNum=%d",
-            __func__, bufFds[0], bufFds[1], bufFds[2], bufLength[0], bufLength[1], bufLength[2], i, hnd->size, hnd->size1,
-            hnd->size2, hnd->fd, hnd->fd1, hnd->fd2, bufferNum);
-
-    if ((1 == bufferNum) && (layer_type == (RGB|BIT8) || layer_type == (RGB|BIT10) || layer_type == (RGB|UNDEF_BIT))) {
-        DISPLAY_LOGD(eDebugHWC, "debug_dump_source rgb data enter");
-        sprintf(filePath,"%s/displayid_%u_layer_%zu_%dx%d_format_%d_compressed_%d_comtype_%d_frame_%d.raw", ERROR_LOG_PATH0, mDisplayId,
-                i, hnd->width, hnd->height, hnd->format, mLayers[i]->mCompressed, mLayers[i]->mCompositionType, currentDumpIdx);
-        fp = fopen(filePath, "w+");
-
-        if (fp)
-        {
-            temp = mmap(0, bufLength[0], PROT_READ|PROT_WRITE, MAP_SHARED, bufFds[0], 0);
-            if (temp != MAP_FAILED && temp != NULL)
-            {
-                result = fwrite(temp, hnd->size, 1, fp);
-                munmap(temp, bufLength[0]);
+        ExynosLayerDumper::Layer layer;
+        memset(&layer.info, 0, sizeof(layer.info));
+        layer.info.layerIndex = i;
+        layer.info.format = hnd->format;
+        layer.info.width = hnd->width;
+        layer.info.height = hnd->height;
+        layer.info.stride = hnd->stride;
+        layer.info.vstride = hnd->vstride;
+        layer.info.compressed = mLayers[i]->mCompressed;
+        layer.info.compositionType = mLayers[i]->mCompositionType;
+        layer.info.planeNum = min(getBufferNumOfFormat(hnd->format), (uint32_t)LAYER_DUMP_MAX_PLANES);
+
+        int bufFds[LAYER_DUMP_MAX_PLANES] = {hnd->fd, hnd->fd1, hnd->fd2};
+        for (uint32_t j = 0; j < LAYER_DUMP_MAX_PLANES; j++) {
+            layer.fds[j] = -1;
+            layer.data[j] = NULL;
+            if (j < layer.info.planeNum) {
+                layer.fds[j] = dup(bufFds[j]);
+                layer.info.rawSize[j] = bufLength[j];
             }
-            fclose(fp);
-        }
-        DISPLAY_LOGD(eDebugHWC, "debug_dump_source Frame Dump %s: is %s result=%s mLayers.size=%zu", filePath, result ? "Successful" : "Failed", result ? "1" : strerror(errno), mLayers.size());
-    }
-
-    if ((bufferNum >= 1) && (layer_type == (YUV420|BIT8) || layer_type == (YUV420|BIT10))) {
-        sprintf(filePath,"%s/displayid_%u_layer_%zu_%dx%d_format_%d_compressed_%d_comtype_%d_frame_%d.raw", ERROR_LOG_PATH0, mDisplayId,
-                i, hnd->width, hnd->height, hnd->format, mLayers[i]->mCompressed, mLayers[i]->mCompositionType, currentDumpIdx);
-        //forbit apend buffer when file has exited.so before each dumping,clear file
-        fp = fopen(filePath, "w+");
-        if (fp) {
-            fclose(fp);
         }
-        for (uint32_t start =0; start < bufferNum; start++)
-        {
-            DISPLAY_LOGD(eDebugHWC, "debug_dump_source yuv data enter start_times=%d", start);
-            fp = fopen(filePath, "a+");
+        layer.acquireFence = fence_valid(mLayers[i]->mAcquireFence) ?
+            dup(mLayers[i]->mAcquireFence) : -1;
 
-            if (fp)
-            {
-                temp = mmap(0, bufLength[start], PROT_READ|PROT_WRITE, MAP_SHARED, bufFds[start], 0);
-                if (temp != MAP_FAILED && temp != NULL)
-                {
-                    int align_width =  hnd->stride;
-                    int width = hnd->width;
-                    int height =  start == 0? hnd->height: hnd->height/2;
-                    if(bufferNum == 3 && start != 0)
-                    {
-                        height =  start == 0? hnd->height: hnd->height/4;
-                    }
-                    result = yuvWriteByLines(temp, align_width,width, height, fp);
-                    munmap(temp, bufLength[start]);
-                }
-                fclose(fp);
-            }
-            DISPLAY_LOGD(eDebugHWC, "debug_dump_source Frame Dump %s: is %s result=%s mLayers.size=%zu", filePath, result ? "Successful" : "Failed", result ? "1" : strerror(errno), mLayers.size());
-        }
+        frame.layers.push_back(layer);
     }
-}
-
-size_t ExynosDisplay::yuvWriteByLines(void * temp, int align_Width, int original_Width, int original_Height, FILE *fp) {
-    size_t result = 0;
 
-    DISPLAY_LOGD(eDebugHWC,"debug_dump_source yuvWriteByLines enter align_Width=%d original_Width=%d, original_Height=%d",
-            align_Width, original_Width, original_Height);
+    if (frame.layers.size() > 0)
+        mDevice->mLayerDumper->queueFrame(frame);
 
-    for (int h = 0; h < original_Height; h++) {
-        result = fwrite((char*)temp+ h * align_Width, original_Width, 1, fp);
+    mDumpCount--;
+    if (mDumpCount == 0) {
+        uint32_t dumpedIdx = mDevice->mTotalDumpCount - mDumpCount + 1;
+        DISPLAY_LOGD(eDebugHWC, "debug_dump_source finished dump file index=%d", dumpedIdx);
     }
-    return result;
 }
 
 void ExynosDisplay::assignInitialResourceSet() {
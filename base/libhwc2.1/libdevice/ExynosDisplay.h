@@ -21,6 +21,7 @@
 
 #include <utils/Vector.h>
 #include <utils/KeyedVector.h>
+#include <utils/Timers.h>
 #include <system/graphics.h>
 #include <android/hardware/graphics/composer/2.4/types.h>
 
@@ -43,6 +44,12 @@
 
 #define LOW_FPS_THRESHOLD     5
 
+/*
+ * Overhead of the partial update in percent of the bytes of the full update.
+ * The full frame is updated if the partial update saves less than it.
+ */
+#define WINDOW_UPDATE_OVERHEAD_PERCENT 10
+
 #if defined(HDR_CAPABILITIES_NUM)
 #define SET_HDR_CAPABILITIES_NUM HDR_CAPABILITIES_NUM
 #else
@@ -66,6 +73,17 @@ enum dynamic_recomp_mode {
     CLIENT_2_DEVICE
 };
 
+/*
+ * Layer aggregates of dynamic recomposition.
+ * Each layer keeps its own contribution and applies the difference
+ * to the display whenever it changes.
+ */
+typedef struct dynamic_recomp_stats {
+    uint64_t pixels;
+    uint32_t yuvLayers;
+    uint32_t highFpsLayers;
+} dynamic_recomp_stats_t;
+
 enum rendering_state {
     RENDERING_STATE_NONE = 0,
     RENDERING_STATE_VALIDATED,
@@ -230,6 +248,51 @@ struct redering_state_flags_info {
     bool presentFlag = false;
 };
 
+/* Fields of exynos_layer_state that are valid */
+enum {
+    LAYER_STATE_CURSOR_POSITION = 1 << 0,
+    LAYER_STATE_BUFFER          = 1 << 1,
+    LAYER_STATE_SURFACE_DAMAGE  = 1 << 2,
+    LAYER_STATE_BLEND_MODE      = 1 << 3,
+    LAYER_STATE_COLOR           = 1 << 4,
+    LAYER_STATE_COMPOSITION     = 1 << 5,
+    LAYER_STATE_DATASPACE       = 1 << 6,
+    LAYER_STATE_DISPLAY_FRAME   = 1 << 7,
+    LAYER_STATE_PLANE_ALPHA     = 1 << 8,
+    LAYER_STATE_SOURCE_CROP     = 1 << 9,
+    LAYER_STATE_TRANSFORM       = 1 << 10,
+    LAYER_STATE_VISIBLE_REGION  = 1 << 11,
+    LAYER_STATE_Z_ORDER         = 1 << 12,
+};
+
+/*
+ * State delta of a layer for ExynosDisplay::setLayerStates()
+ * Only the fields in flags are applied. They are applied in the order of
+ * the LAYER_STATE_* bits. The rectangles of the regions should be valid
+ * until setLayerStates() returns. The acquire fence with LAYER_STATE_BUFFER
+ * is owned by setLayerStates() even if the layer is not found.
+ */
+struct exynos_layer_state
+{
+    hwc2_layer_t layer = 0;
+    uint32_t flags = 0;
+    int32_t cursorX = 0;
+    int32_t cursorY = 0;
+    buffer_handle_t buffer = NULL;
+    int32_t acquireFence = -1;
+    hwc_region_t damage = {0, NULL};
+    int32_t blendMode = HWC2_BLEND_MODE_NONE;
+    hwc_color_t color = {0, 0, 0, 0};
+    int32_t compositionType = HWC2_COMPOSITION_INVALID;
+    int32_t dataspace = HAL_DATASPACE_UNKNOWN;
+    hwc_rect_t displayFrame = {0, 0, 0, 0};
+    float planeAlpha = 1.0f;
+    hwc_frect_t sourceCrop = {0, 0, 0, 0};
+    int32_t transform = 0;
+    hwc_region_t visible = {0, NULL};
+    uint32_t z = 0;
+};
+
 class ExynosLowFpsLayerInfo
 {
     public:
@@ -242,6 +305,173 @@ class ExynosLowFpsLayerInfo
         int32_t addLowFpsLayer(uint32_t layerIndex);
 };
 
+/*
+ * Resource assignment result of a layer
+ * and the layer information that the result depends on
+ */
+struct ExynosAssignPlanLayer
+{
+    ExynosLayer *layer;
+    int32_t compositionType;
+    uint32_t supportedMPPFlag;
+    int32_t overlayPriority;
+    bool hasBuffer;
+    exynos_image srcImg;
+    exynos_image dstImg;
+
+    int32_t validateCompositionType;
+    uint32_t overlayInfo;
+    ExynosMPP *otfMPP;
+    ExynosMPP *m2mMPP;
+    exynos_image midImg;
+};
+
+/*
+ * Resource assignment result of the last full search.
+ * It is replayed by ExynosResourceManager if the layer stack
+ * has the same geometry signature. The signature is the resolved state of
+ * the layers, not which geometry has changed, because a plan is looked up
+ * only when the geometry has changed.
+ */
+class ExynosAssignPlan
+{
+    public:
+        ExynosAssignPlan();
+        bool mValid;
+
+        /* Display information that the plan depends on */
+        uint32_t mXres;
+        uint32_t mYres;
+        int32_t mColorTransformHint;
+        int32_t mBlendingNoneIndex;
+        bool mHasLowFpsLayer;
+        int32_t mLowFpsFirstIndex;
+        int32_t mLowFpsLastIndex;
+        uint32_t mDynamicReCompMode;
+        uint32_t mForceGpu;
+        std::vector<ExynosAssignPlanLayer> mLayers;
+
+        bool mHasClientComposition;
+        int32_t mClientFirstIndex;
+        int32_t mClientLastIndex;
+        bool mHasExynosComposition;
+        int32_t mExynosFirstIndex;
+        int32_t mExynosLastIndex;
+
+        uint64_t mHitCount;
+        uint64_t mMissCount;
+
+        void invalidate();
+        void dump(String8& result);
+};
+
+/*
+ * Schedule of the frames by the expected present time from the composer.
+ * A frame is delivered to the DPU after the vsync before its expected present
+ * time, so that a frame that comes early does not take the vsync before it.
+ * The delay is at most a vsync period because presentDisplay() waits with
+ * mDisplayMutex held. A frame expected further out is delivered at once.
+ */
+class ExynosPresentSchedule
+{
+    public:
+        /* Delivery after the previous vsync, not to race with it */
+        static constexpr nsecs_t VSYNC_MARGIN = 1000000;        // 1ms
+
+        ExynosPresentSchedule();
+        nsecs_t mExpectedPresentTime;   // 0 if the frame has no hint
+        nsecs_t mLastTargetTime;        // expected present time of the last scheduled frame
+
+        /* Statistics of the frames that have the hint */
+        uint64_t mFrameCount;
+        uint64_t mEarlyCount;           // delayed to the vsync before the expected time
+        uint64_t mLateCount;            // delivered after the expected time
+        uint64_t mCoalescedCount;       // the same vsync as the previous frame
+        uint64_t mFarCount;             // the hint was more than a vsync period away
+        nsecs_t mEarlyTime;
+        nsecs_t mLateTime;
+        nsecs_t mMaxLateTime;
+
+        void setExpectedPresentTime(nsecs_t time) { mExpectedPresentTime = time; };
+        /* Returns the time to deliver the frame. The hint is consumed. */
+        nsecs_t schedule(nsecs_t now, nsecs_t vsyncPeriod);
+        void dump(String8& result);
+};
+
+/*
+ * Damaged area of a frame for the window update
+ * It is kept as a small set of disjoint rectangles. Rectangles are merged
+ * when the pixels added by the merge cost less than the overhead of a region
+ * or when there are more than MAX_RECTS rectangles.
+ */
+class ExynosDamageRegion
+{
+    public:
+        /* Maximum number of disjoint rectangles */
+        static constexpr uint32_t MAX_RECTS = 4;
+        /* Overhead of a region in pixels, about 64 x 64 */
+        static constexpr uint64_t REGION_OVERHEAD_PIXELS = 4096;
+
+        ExynosDamageRegion();
+        hwc_rect mRects[MAX_RECTS + 1];
+        uint32_t mNumRects;
+
+        /* Statistics of the frames that the window update is evaluated */
+        uint64_t mFrameCount;
+        uint64_t mPartialCount;
+        uint64_t mFullBytes;        // bytes to fetch if every frame is fully updated
+        uint64_t mUpdatedBytes;     // bytes to fetch for the updated regions
+        uint64_t mDamagedBytes;     // bytes to fetch for the damaged rectangles
+        uint64_t mLastFullBytes;
+        uint64_t mLastUpdatedBytes;
+
+        void clear() { mNumRects = 0; };
+        bool isEmpty() const { return mNumRects == 0; };
+        void add(const hwc_rect &rect);
+        hwc_rect getBounds() const;
+        void addFrameStats(uint64_t fullBytes, uint64_t updatedBytes, uint64_t damagedBytes);
+        void dump(String8& result);
+    private:
+        void mergeCheapest();
+};
+
+/*
+ * Table of the layers created by createLayer()
+ * hwc2_layer_t handle is the slot index plus one in the lower 32 bits and
+ * the generation of the slot in the upper 32 bits. The generation of a slot
+ * is increased whenever its layer is destroyed so that a stale handle of
+ * the destroyed layer is rejected even if the slot is reused.
+ */
+class ExynosLayerHandleTable
+{
+    public:
+        ExynosLayerHandleTable();
+        hwc2_layer_t add(ExynosLayer *layer);
+        ExynosLayer *remove(hwc2_layer_t handle);
+        void clear();
+        uint32_t size() const { return mNumLayers; };
+
+        ExynosLayer *get(hwc2_layer_t handle) const {
+            uint32_t index = (uint32_t)(handle & 0xffffffff) - 1;
+            if (index >= mSlots.size())
+                return NULL;
+            const Slot &slot = mSlots[index];
+            if (slot.generation != (uint32_t)(handle >> 32))
+                return NULL;
+            return slot.layer;
+        };
+    private:
+        static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+        struct Slot {
+            ExynosLayer *layer;
+            uint32_t generation;
+            uint32_t nextFree;
+        };
+        std::vector<Slot> mSlots;
+        uint32_t mFreeHead;
+        uint32_t mNumLayers;
+};
+
 class ExynosSortedLayer : public Vector <ExynosLayer*>
 {
     public:
@@ -334,6 +564,8 @@ struct DisplayControl {
     bool cursorSupport;
     /** readback support **/
     bool readbackSupport = false;
+    /** Replay previous resource assignment if geometry is same **/
+    bool reuseAssignPlan = true;
 };
 
 typedef struct hiberState {
@@ -386,6 +618,9 @@ class ExynosDisplay {
         ExynosSortedLayer mLayers;
         std::vector<ExynosLayer*> mIgnoreLayers;
 
+        /* Handles of mLayers and mIgnoreLayers */
+        ExynosLayerHandleTable mLayerHandles;
+
         ExynosResourceManager *mResourceManager;
 
         /**
@@ -405,6 +640,13 @@ class ExynosDisplay {
          */
         uint64_t  mGeometryChanged;
 
+        /**
+         * Geometry change bits of the layers that are collected
+         * while setLayerStates() applies a batch of layer states.
+         */
+        bool mBatchingLayerStates;
+        uint64_t mBatchedGeometryChanged;
+
         /**
          * Rendering step information that is seperated by
          * VALIDATED, ACCEPTED_CHANGE, PRESENTED.
@@ -437,6 +679,11 @@ class ExynosDisplay {
         bool mDREnable;
         bool mDRDefault;
         Mutex mDRMutex;
+        /* Sum of the contributions of the layers, guarded by mDRStatsMutex */
+        Mutex mDRStatsMutex;
+        dynamic_recomp_stats_t mDRStats;
+        /* Idle timeout of the display, guarded by ExynosDevice::mDRTimerMutex */
+        nsecs_t mDRIdleDeadline;
 
         uint64_t mErrorFrameCount;
         uint64_t mLastModeSwitchTimeStamp;
@@ -480,6 +727,18 @@ class ExynosDisplay {
 
         ExynosLowFpsLayerInfo mLowFpsLayerInfo;
 
+        /* Resource assignment result of the last full search */
+        ExynosAssignPlan mAssignPlan;
+
+        /* Damaged rectangles of the window update and its statistics */
+        ExynosDamageRegion mDamageRegion;
+
+        /* Delivery time of the frames by setExpectedPresentTime() */
+        ExynosPresentSchedule mPresentSchedule;
+
+        /* Fence events of the display for the fence tracer */
+        ExynosFenceTraceRing mFenceTraceRing;
+
         // HDR capabilities
         uint32_t mHdrTypeNum;
         android_hdr_t mHdrTypes[HDR_CAPABILITIES_NUM];
@@ -529,7 +788,6 @@ class ExynosDisplay {
 
         int getId();
 
-        size_t yuvWriteByLines(void * temp, int align_Width, int original_Width, int original_Height, FILE *fp);
         int32_t setCompositionTargetExynosImage(uint32_t targetType, exynos_image *src_img, exynos_image *dst_img);
         int32_t initializeValidateInfos();
         int32_t addClientCompositionLayer(uint32_t layerIndex,
@@ -551,6 +809,19 @@ class ExynosDisplay {
 
         ExynosLayer *checkLayer(hwc2_layer_t addr);
 
+        /**
+         * Apply the state deltas of the layers with a single lock of
+         * mDisplayMutex. The geometry of the display is marked as changed
+         * once for the batch. The result of each state is stored to
+         * outErrors if it is not NULL.
+         * @param numStates
+         * @param states
+         * @param outErrors
+         * @return HWC2_ERROR_NONE or the first error of the states
+         */
+        int32_t setLayerStates(uint32_t numStates,
+                const exynos_layer_state *states, int32_t *outErrors);
+
         void checkIgnoreLayers();
         virtual void doPreProcessing();
 
@@ -558,6 +829,14 @@ class ExynosDisplay {
 
         int checkDynamicReCompMode();
 
+        /**
+         * Called by a layer when its contribution to the aggregates is changed
+         * @param prev : previous contribution of the layer
+         * @param cur : new contribution of the layer
+         */
+        void updateDynamicReCompStats(const dynamic_recomp_stats_t &prev,
+                const dynamic_recomp_stats_t &cur);
+
         int handleDynamicReCompMode();
 
         /**
@@ -884,6 +1163,14 @@ class ExynosDisplay {
          */
         int32_t getDisplayVsyncPeriod(hwc2_vsync_period_t* __unused outVsyncPeriod);
 
+        /* setExpectedPresentTime(..., timestamp)
+         * Parameters:
+         *   timestamp - CLOCK_MONOTONIC time that the next frame is expected
+         *               to be presented at, 0 if there is no expectation.
+         */
+        int32_t setExpectedPresentTime(uint64_t timestamp);
+        void waitForExpectedPresentTime();
+
         /* setActiveConfigWithConstraints(...,
          *                                config,
          *                                vsyncPeriodChangeConstraints,
@@ -1106,6 +1393,7 @@ class ExynosDisplay {
 
         int handleWindowUpdate();
         bool windowUpdateExceptions();
+        uint64_t getWindowUpdateBytes(const hwc_rect &rect);
 
         virtual void waitPreviousFrameDone() { return; }
 
@@ -1134,7 +1422,6 @@ class ExynosDisplay {
         virtual void initDisplayInterface(uint32_t interfaceType);
         void getDumpLayer();
         void setDumpCount(uint32_t dumpCount);
-        void writeDumpData( private_handle_t *hnd, size_t bufLength[], size_t i, void *temp);
         virtual void assignInitialResourceSet();
         /* Override for each display's meaning of 'enabled state'
          * Primary : Power on, this function overrided in primary display module
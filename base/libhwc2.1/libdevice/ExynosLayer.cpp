@@ -36,6 +36,7 @@ using namespace android;
 ExynosLayer::ExynosLayer(ExynosDisplay* display)
 : ExynosMPPSource(MPP_SOURCE_LAYER, this),
     mDisplay(display),
+    mHandle(0),
     mCompositionType(HWC2_COMPOSITION_INVALID),
     mExynosCompositionType(HWC2_COMPOSITION_INVALID),
     mValidateCompositionType(HWC2_COMPOSITION_INVALID),
@@ -53,6 +54,7 @@ ExynosLayer::ExynosLayer(ExynosDisplay* display)
     mFrameCount(0),
     mLastFrameCount(0),
     mLastFpsTime(0),
+    mDRStats{0, 0, 0},
     mLastLayerBuffer(NULL),
     mLayerBuffer(NULL),
     mDamageNum(0),
@@ -81,6 +83,8 @@ ExynosLayer::ExynosLayer(ExynosDisplay* display)
 
 ExynosLayer::~ExynosLayer() {
 
+    updateDynamicReCompStats(true);
+
     if (mM2mMPP != NULL) {
         for (int i = 0; i < NUM_MPP_SRC_BUFS; i++) {
             if (mM2mMPP->mPrevFrameInfo.srcInfo[i].bufferHandle == mLayerBuffer) {
@@ -131,9 +135,32 @@ uint32_t ExynosLayer::checkFps() {
         (wasLowFps != nowLowFps))
         setGeometryChanged(GEOMETRY_LAYER_FPS_CHANGED);
 
+    updateDynamicReCompStats();
+
     return mFps;
 }
 
+void ExynosLayer::updateDynamicReCompStats(bool remove) {
+    dynamic_recomp_stats_t stats = {0, 0, 0};
+
+    if (mDisplay == NULL)
+        return;
+
+    if (!remove && ((mLayerFlag & EXYNOS_HWC_IGNORE_LAYER) == 0)) {
+        stats.pixels = (uint64_t)WIDTH(mDisplayFrame) * HEIGHT(mDisplayFrame);
+        stats.yuvLayers = ((mLayerBuffer != NULL) && isFormatYUV(mLayerBuffer->format)) ? 1 : 0;
+        stats.highFpsLayers = (mFps >= HWC_FPS_TH) ? 1 : 0;
+    }
+
+    if ((stats.pixels == mDRStats.pixels) &&
+        (stats.yuvLayers == mDRStats.yuvLayers) &&
+        (stats.highFpsLayers == mDRStats.highFpsLayers))
+        return;
+
+    mDisplay->updateDynamicReCompStats(mDRStats, stats);
+    mDRStats = stats;
+}
+
 /**
  * @return float
  */
@@ -541,6 +568,7 @@ int32_t ExynosLayer::setLayerDisplayFrame(hwc_rect_t frame) {
         (frame.bottom != mDisplayFrame.bottom))
         setGeometryChanged(GEOMETRY_LAYER_DISPLAYFRAME_CHANGED);
     mDisplayFrame = frame;
+    updateDynamicReCompStats();
 
     return HWC2_ERROR_NONE;
 }
@@ -559,6 +587,7 @@ int32_t ExynosLayer::setLayerPlaneAlpha(float alpha) {
         mLayerFlag &= ~(EXYNOS_HWC_IGNORE_LAYER);
     else
         mLayerFlag |= EXYNOS_HWC_IGNORE_LAYER;
+    updateDynamicReCompStats();
 
     return HWC2_ERROR_NONE;
 }
@@ -605,6 +634,38 @@ int32_t ExynosLayer::setLayerZOrder(uint32_t z) {
     return HWC2_ERROR_NONE;
 }
 
+int32_t ExynosLayer::applyLayerState(const exynos_layer_state &state) {
+    int32_t ret = HWC2_ERROR_NONE;
+    int32_t err;
+
+#define APPLY_LAYER_STATE(flag, call)                       \
+    do {                                                    \
+        if (state.flags & (flag)) {                         \
+            err = call;                                     \
+            if ((err != HWC2_ERROR_NONE) && (ret == HWC2_ERROR_NONE)) \
+                ret = err;                                  \
+        }                                                   \
+    } while (0)
+
+    APPLY_LAYER_STATE(LAYER_STATE_CURSOR_POSITION, setCursorPosition(state.cursorX, state.cursorY));
+    APPLY_LAYER_STATE(LAYER_STATE_BUFFER, setLayerBuffer(state.buffer, state.acquireFence));
+    APPLY_LAYER_STATE(LAYER_STATE_SURFACE_DAMAGE, setLayerSurfaceDamage(state.damage));
+    APPLY_LAYER_STATE(LAYER_STATE_BLEND_MODE, setLayerBlendMode(state.blendMode));
+    APPLY_LAYER_STATE(LAYER_STATE_COLOR, setLayerColor(state.color));
+    APPLY_LAYER_STATE(LAYER_STATE_COMPOSITION, setLayerCompositionType(state.compositionType));
+    APPLY_LAYER_STATE(LAYER_STATE_DATASPACE, setLayerDataspace(state.dataspace));
+    APPLY_LAYER_STATE(LAYER_STATE_DISPLAY_FRAME, setLayerDisplayFrame(state.displayFrame));
+    APPLY_LAYER_STATE(LAYER_STATE_PLANE_ALPHA, setLayerPlaneAlpha(state.planeAlpha));
+    APPLY_LAYER_STATE(LAYER_STATE_SOURCE_CROP, setLayerSourceCrop(state.sourceCrop));
+    APPLY_LAYER_STATE(LAYER_STATE_TRANSFORM, setLayerTransform(state.transform));
+    APPLY_LAYER_STATE(LAYER_STATE_VISIBLE_REGION, setLayerVisibleRegion(state.visible));
+    APPLY_LAYER_STATE(LAYER_STATE_Z_ORDER, setLayerZOrder(state.z));
+
+#undef APPLY_LAYER_STATE
+
+    return ret;
+}
+
 int32_t ExynosLayer::setLayerPerFrameMetadata(uint32_t numElements,
         const int32_t* /*hw2_per_frame_metadata_key_t*/ keys, const float* metadata)
 {
@@ -1033,7 +1094,10 @@ void ExynosLayer::printLayer()
 void ExynosLayer::setGeometryChanged(uint64_t changedBit)
 {
     mGeometryChanged |= changedBit;
-    mDisplay->setGeometryChanged(changedBit);
+    if (mDisplay->mBatchingLayerStates)
+        mDisplay->mBatchedGeometryChanged |= changedBit;
+    else
+        mDisplay->setGeometryChanged(changedBit);
 }
 
 int ExynosLayer::allocMetaParcel()
@@ -79,6 +79,9 @@ class ExynosLayer : public ExynosMPPSource {
 
         ExynosDisplay* mDisplay;
 
+        /* hwc2_layer_t handle given by ExynosDisplay::createLayer() */
+        hwc2_layer_t mHandle;
+
         /**
          * Layer's compositionType
          */
@@ -156,6 +159,12 @@ class ExynosLayer : public ExynosMPPSource {
         uint32_t mLastFrameCount;
         nsecs_t mLastFpsTime;
 
+        /**
+         * Contribution of the layer to the dynamic recomposition
+         * aggregates of the display
+         */
+        dynamic_recomp_stats_t mDRStats;
+
         /**
          * Previous buffer's handle
          */
@@ -242,6 +251,11 @@ class ExynosLayer : public ExynosMPPSource {
 
         uint32_t checkFps();
 
+        /**
+         * @param remove : withdraw the contribution of the layer
+         */
+        void updateDynamicReCompStats(bool remove = false);
+
         uint32_t getFps();
 
         int32_t doPreProcess();
@@ -343,6 +357,12 @@ class ExynosLayer : public ExynosMPPSource {
          */
         virtual int32_t setLayerZOrder(uint32_t z);
 
+        /* applyLayerState(state)
+         * Apply the fields of the state that are valid in state.flags
+         * Called by ExynosDisplay::setLayerStates()
+         */
+        int32_t applyLayerState(const exynos_layer_state &state);
+
         virtual int32_t setLayerPerFrameMetadata(uint32_t numElements,
                 const int32_t* /*hw2_per_frame_metadata_key_t*/ keys, const float* metadata);
 
@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <log/log.h>
+#include <android/sync.h>
+#include <system/thread_defs.h>
+#ifdef USES_HWC_DUMP_LZ4
+#include <lz4.h>
+#endif
+
+#include "ExynosLayerDumper.h"
+#include "ExynosDevice.h"
+
+ExynosLayerDumper::ExynosLayerDumper()
+    : mRunning(false),
+    mStagingBytes(0),
+    mBytesPerSec(LAYER_DUMP_BYTES_PER_SEC),
+#ifdef USES_HWC_DUMP_LZ4
+    mCompression(true),
+#else
+    mCompression(false),
+#endif
+    mBudget(0),
+    mBudgetTime(0),
+    mQueuedFrames(0),
+    mDroppedFrames(0),
+    mWrittenFrames(0),
+    mWrittenBytes(0)
+{
+}
+
+ExynosLayerDumper::~ExynosLayerDumper()
+{
+    stop();
+}
+
+void ExynosLayerDumper::releaseFrame(Frame &frame)
+{
+    for (size_t i = 0; i < frame.layers.size(); i++) {
+        Layer &layer = frame.layers.editItemAt(i);
+        for (uint32_t j = 0; j < LAYER_DUMP_MAX_PLANES; j++) {
+            if (layer.fds[j] >= 0)
+                close(layer.fds[j]);
+            layer.fds[j] = -1;
+        }
+        if (layer.acquireFence >= 0)
+            close(layer.acquireFence);
+        layer.acquireFence = -1;
+        for (uint32_t j = 0; j < LAYER_DUMP_MAX_PLANES; j++) {
+            free(layer.data[j]);
+            layer.data[j] = NULL;
+        }
+    }
+    frame.layers.clear();
+}
+
+uint64_t ExynosLayerDumper::frameBytes(const Frame &frame)
+{
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < frame.layers.size(); i++) {
+        const layer_dump_index_t &info = frame.layers[i].info;
+        for (uint32_t j = 0; j < info.planeNum; j++)
+            bytes += info.rawSize[j];
+    }
+    return bytes;
+}
+
+bool ExynosLayerDumper::queueFrame(Frame &frame)
+{
+    Mutex::Autolock lock(mMutex);
+
+    if ((mCaptureFrames.size() + mFrames.size()) >= LAYER_DUMP_QUEUE_MAX) {
+        ALOGW("%s:: queue is full, frame %d of display %d is dropped",
+                __func__, frame.frameIndex, frame.displayId);
+        mDroppedFrames++;
+        releaseFrame(frame);
+        return false;
+    }
+
+    /* A frame larger than the limit is still dumped if nothing is pending */
+    uint64_t bytes = frameBytes(frame);
+    if ((mStagingBytes > 0) && (mStagingBytes + bytes > LAYER_DUMP_STAGING_MAX)) {
+        ALOGW("%s:: %" PRIu64 " bytes are pending, frame %d of display %d (%" PRIu64 " bytes) is dropped",
+                __func__, mStagingBytes, frame.frameIndex, frame.displayId, bytes);
+        mDroppedFrames++;
+        releaseFrame(frame);
+        return false;
+    }
+
+    if (!mRunning) {
+        mRunning = true;
+        mCaptureThread = new CaptureThread(this);
+        if ((mCaptureThread->run("LayerDumpCapture", PRIORITY_DISPLAY) != NO_ERROR) ||
+            (run("LayerDumper", PRIORITY_BACKGROUND) != NO_ERROR)) {
+            ALOGE("%s:: fail to run the capture or the writer", __func__);
+            mRunning = false;
+            mCaptureThread->requestExit();
+            mCaptureCondition.signal();
+            releaseFrame(frame);
+            return false;
+        }
+    }
+
+    mCaptureFrames.push_back(frame);
+    /* The queued frame owns the fds now */
+    frame.layers.clear();
+    mStagingBytes += bytes;
+    mQueuedFrames++;
+    mCaptureCondition.signal();
+
+    return true;
+}
+
+void ExynosLayerDumper::setRateLimit(uint32_t bytesPerSec)
+{
+    Mutex::Autolock lock(mMutex);
+    mBytesPerSec = bytesPerSec;
+}
+
+void ExynosLayerDumper::stop()
+{
+    {
+        Mutex::Autolock lock(mMutex);
+        if (!mRunning)
+            return;
+        mRunning = false;
+        requestExit();
+        mCaptureThread->requestExit();
+        mCondition.signal();
+        mCaptureCondition.signal();
+    }
+    mCaptureThread->requestExitAndWait();
+    requestExitAndWait();
+
+    Mutex::Autolock lock(mMutex);
+    for (List<Frame>::iterator it = mCaptureFrames.begin(); it != mCaptureFrames.end(); it++)
+        releaseFrame(*it);
+    mCaptureFrames.clear();
+    for (List<Frame>::iterator it = mFrames.begin(); it != mFrames.end(); it++)
+        releaseFrame(*it);
+    mFrames.clear();
+    mStagingBytes = 0;
+    mCaptureThread.clear();
+}
+
+void ExynosLayerDumper::dump(String8 &result)
+{
+    Mutex::Autolock lock(mMutex);
+
+    if (mQueuedFrames == 0)
+        return;
+
+    result.appendFormat("Layer dump: queued(%" PRIu64 "), dropped(%" PRIu64 "), written(%" PRIu64 "), "
+            "pending(%zu), staging bytes(%" PRIu64 "), written bytes(%" PRIu64 "), "
+            "rate limit(%d bytes/s), compression(%d)\n",
+            mQueuedFrames, mDroppedFrames, mWrittenFrames, mCaptureFrames.size() + mFrames.size(),
+            mStagingBytes, mWrittenBytes, mBytesPerSec, mCompression);
+}
+
+bool ExynosLayerDumper::captureLoop()
+{
+    Frame frame;
+    {
+        Mutex::Autolock lock(mMutex);
+        while (mRunning && mCaptureFrames.empty())
+            mCaptureCondition.wait(mMutex);
+        if (!mRunning)
+            return false;
+        frame = *mCaptureFrames.begin();
+        mCaptureFrames.erase(mCaptureFrames.begin());
+    }
+
+    captureFrame(frame);
+
+    Mutex::Autolock lock(mMutex);
+    if (!mRunning) {
+        releaseFrame(frame);
+        return false;
+    }
+    mFrames.push_back(frame);
+    mCondition.signal();
+
+    return true;
+}
+
+bool ExynosLayerDumper::threadLoop()
+{
+    Frame frame;
+    {
+        Mutex::Autolock lock(mMutex);
+        while (mRunning && mFrames.empty())
+            mCondition.wait(mMutex);
+        if (!mRunning)
+            return false;
+        frame = *mFrames.begin();
+        mFrames.erase(mFrames.begin());
+    }
+
+    writeFrame(frame);
+
+    Mutex::Autolock lock(mMutex);
+    mStagingBytes -= frameBytes(frame);
+    releaseFrame(frame);
+
+    return true;
+}
+
+/*
+ * The producer of a layer might reuse the buffer once the layer releases
+ * it. The planes are copied without the rate limit as soon as the fence
+ * signals, and the fds are closed right after.
+ */
+void ExynosLayerDumper::captureFrame(Frame &frame)
+{
+    for (size_t i = 0; i < frame.layers.size(); i++) {
+        Layer &layer = frame.layers.editItemAt(i);
+        layer_dump_index_t &info = layer.info;
+
+        if ((layer.acquireFence >= 0) &&
+            (sync_wait(layer.acquireFence, LAYER_DUMP_FENCE_TIMEOUT) < 0)) {
+            ALOGW("%s:: layer %d fence timeout", __func__, info.layerIndex);
+            info.flags |= LAYER_DUMP_FLAG_FENCE_TIMEOUT;
+        }
+
+        for (uint32_t j = 0; j < info.planeNum; j++) {
+            void *data = mmap(0, info.rawSize[j], PROT_READ, MAP_SHARED, layer.fds[j], 0);
+            if (data == MAP_FAILED) {
+                ALOGE("%s:: fail to map layer %d plane %d: %s",
+                        __func__, info.layerIndex, j, strerror(errno));
+                info.flags |= LAYER_DUMP_FLAG_MAP_FAILED;
+                continue;
+            }
+            layer.data[j] = (char *)malloc(info.rawSize[j]);
+            if (layer.data[j] == NULL) {
+                ALOGE("%s:: fail to allocate %" PRIu64 " bytes for layer %d plane %d",
+                        __func__, info.rawSize[j], info.layerIndex, j);
+                info.flags |= LAYER_DUMP_FLAG_MAP_FAILED;
+            } else {
+                memcpy(layer.data[j], data, info.rawSize[j]);
+            }
+            munmap(data, info.rawSize[j]);
+        }
+
+        for (uint32_t j = 0; j < LAYER_DUMP_MAX_PLANES; j++) {
+            if (layer.fds[j] >= 0)
+                close(layer.fds[j]);
+            layer.fds[j] = -1;
+        }
+        if (layer.acquireFence >= 0)
+            close(layer.acquireFence);
+        layer.acquireFence = -1;
+    }
+}
+
+/* Writing the files competes with the display for memory bandwidth */
+void ExynosLayerDumper::throttle(size_t bytes)
+{
+    uint32_t bytesPerSec;
+    {
+        Mutex::Autolock lock(mMutex);
+        bytesPerSec = mBytesPerSec;
+    }
+    if (bytesPerSec == 0)
+        return;
+
+    /* The budget is refilled with time and allows a burst of a second */
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t elapsed = min(now - mBudgetTime, s2ns(1));
+    mBudgetTime = now;
+    mBudget = min(mBudget + elapsed * bytesPerSec / s2ns(1), (int64_t)bytesPerSec);
+    mBudget -= bytes;
+
+    if (mBudget < 0) {
+        nsecs_t delay = -mBudget * s2ns(1) / bytesPerSec;
+        usleep(ns2us(delay));
+    }
+}
+
+static bool writeFully(int fd, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool ExynosLayerDumper::writePlane(int fd, const char *data, size_t size, uint64_t &storedSize)
+{
+    storedSize = 0;
+
+    for (size_t offset = 0; offset < size; offset += LAYER_DUMP_CHUNK_SIZE) {
+        size_t chunk = min(size - offset, (size_t)LAYER_DUMP_CHUNK_SIZE);
+        throttle(chunk);
+
+        if (!mCompression) {
+            if (!writeFully(fd, data + offset, chunk))
+                return false;
+            storedSize += chunk;
+            continue;
+        }
+
+#ifdef USES_HWC_DUMP_LZ4
+        layer_dump_block_t block;
+        block.rawSize = chunk;
+        mCompressBuf.resize(LZ4_compressBound(LAYER_DUMP_CHUNK_SIZE));
+        int compressed = LZ4_compress_default(data + offset, mCompressBuf.editArray(),
+                chunk, mCompressBuf.size());
+        const char *stored = data + offset;
+        if ((compressed > 0) && ((size_t)compressed < chunk)) {
+            stored = mCompressBuf.array();
+            block.storedSize = compressed;
+        } else {
+            block.storedSize = chunk;
+        }
+        if (!writeFully(fd, &block, sizeof(block)) ||
+            !writeFully(fd, stored, block.storedSize))
+            return false;
+        storedSize += sizeof(block) + block.storedSize;
+#endif
+    }
+
+    return true;
+}
+
+void ExynosLayerDumper::writeFrame(Frame &frame)
+{
+    char filePath[MAX_DEV_NAME];
+    snprintf(filePath, sizeof(filePath), "%s/displayid_%u_frame_%u.hwcdump",
+            ERROR_LOG_PATH0, frame.displayId, frame.frameIndex);
+
+    int fd = open(filePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGE("%s:: fail to open %s: %s", __func__, filePath, strerror(errno));
+        return;
+    }
+
+    layer_dump_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = LAYER_DUMP_MAGIC;
+    header.version = LAYER_DUMP_VERSION;
+    header.displayId = frame.displayId;
+    header.frameIndex = frame.frameIndex;
+    header.layerNum = frame.layers.size();
+
+    uint64_t offset = sizeof(header) + sizeof(layer_dump_index_t) * frame.layers.size();
+    bool result = true;
+
+    for (size_t i = 0; (i < frame.layers.size()) && result; i++) {
+        Layer &layer = frame.layers.editItemAt(i);
+        layer_dump_index_t &info = layer.info;
+
+        info.compression = mCompression ? LAYER_DUMP_COMPRESSION_LZ4 : LAYER_DUMP_COMPRESSION_NONE;
+
+        for (uint32_t j = 0; j < info.planeNum; j++) {
+            info.offset[j] = offset;
+            info.storedSize[j] = 0;
+            if (layer.data[j] == NULL)
+                continue;
+            if (lseek(fd, offset, SEEK_SET) < 0)
+                result = false;
+            else
+                result = writePlane(fd, layer.data[j], info.rawSize[j], info.storedSize[j]);
+            if (!result)
+                break;
+            offset += info.storedSize[j];
+        }
+    }
+
+    if (result) {
+        result = (pwrite(fd, &header, sizeof(header), 0) == sizeof(header));
+        for (size_t i = 0; (i < frame.layers.size()) && result; i++) {
+            off_t indexOffset = sizeof(header) + sizeof(layer_dump_index_t) * i;
+            result = (pwrite(fd, &frame.layers[i].info, sizeof(layer_dump_index_t), indexOffset) ==
+                    sizeof(layer_dump_index_t));
+        }
+    }
+    close(fd);
+
+    if (!result) {
+        ALOGE("%s:: fail to write %s: %s", __func__, filePath, strerror(errno));
+        unlink(filePath);
+        return;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    mWrittenFrames++;
+    mWrittenBytes += offset;
+    ALOGI("%s:: %s, %" PRIu64 " bytes", __func__, filePath, offset);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _EXYNOSLAYERDUMPER_H
+#define _EXYNOSLAYERDUMPER_H
+
+#include <utils/Thread.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/String8.h>
+#include <utils/List.h>
+#include <utils/Vector.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+/* Number of frames that can wait for the capture or the writer */
+#ifndef LAYER_DUMP_QUEUE_MAX
+#define LAYER_DUMP_QUEUE_MAX        4
+#endif
+/* Bytes of the captured layer buffers that can wait for the writer */
+#ifndef LAYER_DUMP_STAGING_MAX
+#define LAYER_DUMP_STAGING_MAX      (128 * 1024 * 1024)
+#endif
+/* Bytes of layer buffers written to files per second */
+#ifndef LAYER_DUMP_BYTES_PER_SEC
+#define LAYER_DUMP_BYTES_PER_SEC    (32 * 1024 * 1024)
+#endif
+#define LAYER_DUMP_CHUNK_SIZE       (256 * 1024)
+#define LAYER_DUMP_FENCE_TIMEOUT    1000    /* msec */
+#define LAYER_DUMP_MAX_PLANES       3
+
+/*
+ * A frame is written to a file that has
+ *  - layer_dump_header_t
+ *  - layer_dump_index_t per layer
+ *  - data of the planes of the layers at the offsets in the index
+ * A plane is stored as it is in the buffer, including the stride.
+ * If the plane is compressed, it is a sequence of blocks of
+ * layer_dump_block_t followed by storedSize bytes of LZ4 block that is
+ * decompressed to rawSize bytes. The block is not compressed if both of
+ * the sizes are the same.
+ */
+#define LAYER_DUMP_MAGIC            0x504d4448  /* "HDMP" */
+#define LAYER_DUMP_VERSION          1
+
+enum {
+    LAYER_DUMP_COMPRESSION_NONE,
+    LAYER_DUMP_COMPRESSION_LZ4,
+};
+
+enum {
+    LAYER_DUMP_FLAG_FENCE_TIMEOUT = 0x1,    /* contents might be incomplete */
+    LAYER_DUMP_FLAG_MAP_FAILED = 0x2,       /* no data */
+};
+
+typedef struct layer_dump_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t displayId;
+    uint32_t frameIndex;
+    uint32_t layerNum;
+    uint32_t reserved;
+} layer_dump_header_t;
+
+typedef struct layer_dump_index {
+    uint32_t layerIndex;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t vstride;
+    uint32_t compressed;
+    uint32_t compositionType;
+    uint32_t planeNum;
+    uint32_t compression;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t offset[LAYER_DUMP_MAX_PLANES];
+    uint64_t storedSize[LAYER_DUMP_MAX_PLANES];
+    uint64_t rawSize[LAYER_DUMP_MAX_PLANES];
+} layer_dump_index_t;
+
+typedef struct layer_dump_block {
+    uint32_t rawSize;
+    uint32_t storedSize;
+} layer_dump_block_t;
+
+/*
+ * Writes layer buffers to files on background threads so that dumping
+ * does not stall the composition. Queued layers hold duplicated buffer fds
+ * and acquire fence. The capture thread copies the planes to staging
+ * buffers as soon as the fence signals, before the layer releases the
+ * buffer to its producer, and closes them. The writer thread writes the
+ * staging buffers to a file at the rate limit.
+ */
+class ExynosLayerDumper: public Thread {
+    public:
+        struct Layer {
+            layer_dump_index_t info;
+            int fds[LAYER_DUMP_MAX_PLANES];
+            int acquireFence;
+            char *data[LAYER_DUMP_MAX_PLANES];  /* staging buffers */
+        };
+        struct Frame {
+            uint32_t displayId;
+            uint32_t frameIndex;
+            android::Vector<Layer> layers;
+        };
+
+        ExynosLayerDumper();
+        ~ExynosLayerDumper();
+
+        /*
+         * Owns the fds of the frame. The frame is dropped if the queue is full
+         * or if its buffers exceed the staging limit.
+         */
+        bool queueFrame(Frame &frame);
+        void setRateLimit(uint32_t bytesPerSec);
+        void stop();
+        void dump(String8 &result);
+        virtual bool threadLoop();
+
+    private:
+        class CaptureThread: public Thread {
+            public:
+                CaptureThread(ExynosLayerDumper *dumper) : mDumper(dumper) {}
+                virtual bool threadLoop() { return mDumper->captureLoop(); }
+            private:
+                ExynosLayerDumper *mDumper;
+        };
+
+        Mutex mMutex;
+        Condition mCondition;
+        Condition mCaptureCondition;
+        List<Frame> mCaptureFrames;
+        List<Frame> mFrames;
+        sp<CaptureThread> mCaptureThread;
+        bool mRunning;
+        /* Bytes of the buffers of the frames in both queues */
+        uint64_t mStagingBytes;
+        uint32_t mBytesPerSec;
+        bool mCompression;
+
+        /* Used by the writer only */
+        int64_t mBudget;
+        nsecs_t mBudgetTime;
+        android::Vector<char> mCompressBuf;
+
+        uint64_t mQueuedFrames;
+        uint64_t mDroppedFrames;
+        uint64_t mWrittenFrames;
+        uint64_t mWrittenBytes;
+
+        bool captureLoop();
+        void captureFrame(Frame &frame);
+        void writeFrame(Frame &frame);
+        static uint64_t frameBytes(const Frame &frame);
+        bool writePlane(int fd, const char *data, size_t size, uint64_t &storedSize);
+        void throttle(size_t bytes);
+        static void releaseFrame(Frame &frame);
+};
+
+#endif //_EXYNOSLAYERDUMPER_H
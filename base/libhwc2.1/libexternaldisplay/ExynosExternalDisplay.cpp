@@ -133,6 +133,7 @@ void ExynosExternalDisplay::closeExternalDisplay()
         layer->mAcquireFence = fence_close(layer->mAcquireFence, this, FENCE_TYPE_SRC_ACQUIRE, FENCE_IP_LAYER);
         layer->mReleaseFence = -1;
         layer->mLayerBuffer = NULL;
+        layer->updateDynamicReCompStats();
     }
 }
 
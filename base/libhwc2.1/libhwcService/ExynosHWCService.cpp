@@ -284,6 +284,7 @@ int ExynosHWCService::setHWCCtl(uint32_t display, uint32_t ctrl, int32_t val)
     case HWC_CTL_USE_MAX_G2D_SRC:
     case HWC_CTL_ENABLE_HANDLE_LOW_FPS:
     case HWC_CTL_ENABLE_EARLY_START_MPP:
+    case HWC_CTL_ENABLE_ASSIGN_PLAN_REUSE:
     case HWC_CTL_DISPLAY_MODE:
     case HWC_CTL_DDI_RESOLUTION_CHANGE:
     case HWC_CTL_ENABLE_FENCE_TRACER:
@@ -724,128 +724,262 @@ struct tm* getLocalTime(struct timeval tv) {
     return (struct tm*)localtime((time_t*)&tv.tv_sec);
 }
 
-void writeFenceInfo(uint32_t fd, hwc_fence_info_t *info,
-    hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
-    uint32_t direction, bool pendingAllowed) {
-
-    /* Sequnce is ring buffer */
-    /* update last flag, sequence */
-    info->seq[info->seq_no].isLast = false;
-    info->seq_no++;
-    if (info->seq_no >= MAX_FENCE_SEQUENCE) info->seq_no = 0;
-    fenceTrace_t *seq = &info->seq[info->seq_no];
-    seq->isLast = true;
-
-    /* direction, type, ip */
-    seq->dir =  direction;
-    seq->type = type;
-    seq->ip = ip;
-    seq->curFlag = 1;
-    info->pendingAllowed = pendingAllowed;
-
-    /* time */
-    struct timeval tv;
-    gettimeofday(&seq->time, NULL);
-    tv = seq->time;
+ExynosFenceTraceRing::ExynosFenceTraceRing()
+    : mHead(0)
+{
+    for (uint32_t i = 0; i < FENCE_TRACE_RING_SIZE; i++) {
+        mSlots[i].seq.store(0, std::memory_order_relaxed);
+        for (uint32_t j = 0; j < 3; j++)
+            mSlots[i].word[j].store(0, std::memory_order_relaxed);
+    }
 }
 
-void setFenceInfo(uint32_t fd, ExynosDisplay* display,
-        hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
-        uint32_t direction, bool pendingAllowed) {
+void ExynosFenceTraceRing::record(const fenceTrace_t &trace)
+{
+    uint32_t index = mHead.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = mSlots[index & (FENCE_TRACE_RING_SIZE - 1)];
+
+    /* Odd sequence number while the slot is being written */
+    slot.seq.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.word[0].store((uint64_t)(uint32_t)trace.fd | ((uint64_t)trace.displayId << 32),
+            std::memory_order_relaxed);
+    slot.word[1].store((uint64_t)(uint32_t)trace.usage |
+            ((uint64_t)(trace.dir & 0xff) << 32) |
+            ((uint64_t)(trace.type & 0xff) << 40) |
+            ((uint64_t)(trace.ip & 0xff) << 48) |
+            ((uint64_t)trace.pendingAllowed << 56), std::memory_order_relaxed);
+    slot.word[2].store((uint64_t)trace.timeUs, std::memory_order_relaxed);
+
+    slot.seq.store(index * 2 + 2, std::memory_order_release);
+}
 
-    if (!fence_valid(fd) || display == NULL) return;
-    ExynosDevice* device = display->mDevice;
-    if (device == NULL) return;
+size_t ExynosFenceTraceRing::collect(int32_t fd, std::vector<fenceTrace_t> &traces) const
+{
+    uint32_t head = mHead.load(std::memory_order_acquire);
+    uint32_t start = (head > FENCE_TRACE_RING_SIZE) ? (head - FENCE_TRACE_RING_SIZE) : 0;
+    size_t count = 0;
+
+    for (uint32_t index = start; index != head; index++) {
+        const Slot &slot = mSlots[index & (FENCE_TRACE_RING_SIZE - 1)];
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        /* Skip the slot that is being written or overwritten */
+        if (seq != index * 2 + 2)
+            continue;
 
-    /* init or recevice(from previous) trace info */
-    hwc_fence_info_t info;
-    if (device->mFenceInfo.count(fd) == 0) {
-        memset(&info, 0, sizeof(hwc_fence_info_t));
-    } else
-        info = device->mFenceInfo.at(fd);
-
-    info.displayId = display->mDisplayId;
-
-    writeFenceInfo(fd, &info, type, ip, direction, pendingAllowed);
-
-    fenceTrace_t *seq = &info.seq[info.seq_no];
-    /* update usage count */
-    if ((seq->dir == FENCE_FROM) || (seq->dir == FENCE_DUP)) {
-        info.usage++;
-    } else if ((seq->dir == FENCE_TO) || (seq->dir == FENCE_CLOSE)) {
-        info.usage--;
-        if ((seq->dir == FENCE_CLOSE) && (info.usage < 0)) info.usage = 0;
-    } else
-        ALOGE("Fence trace : Undefined direction!");
+        uint64_t word[3];
+        for (uint32_t j = 0; j < 3; j++)
+            word[j] = slot.word[j].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+            continue;
+
+        fenceTrace_t trace;
+        trace.index = index;
+        trace.fd = (int32_t)(uint32_t)word[0];
+        if ((fd >= 0) && (trace.fd != fd))
+            continue;
+        trace.displayId = (uint32_t)(word[0] >> 32);
+        trace.usage = (int32_t)(uint32_t)word[1];
+        trace.dir = (uint32_t)((word[1] >> 32) & 0xff);
+        trace.type = (hwc_fdebug_fence_type)((word[1] >> 40) & 0xff);
+        trace.ip = (hwc_fdebug_ip_type)((word[1] >> 48) & 0xff);
+        trace.pendingAllowed = !!((word[1] >> 56) & 0x1);
+        trace.timeUs = (int64_t)word[2];
+        traces.push_back(trace);
+        count++;
+    }
+
+    return count;
+}
+
+ExynosFenceTracker::ExynosFenceTracker()
+    : mMaxFd(-1),
+    mActiveCount(0),
+    mUntrackedCount(0)
+{
+    for (uint32_t i = 0; i < FENCE_TRACE_MAX_FD; i++) {
+        mFds[i].usage.store(0, std::memory_order_relaxed);
+        mFds[i].displayId.store(0, std::memory_order_relaxed);
+        mFds[i].pendingAllowed.store(false, std::memory_order_relaxed);
+        mFds[i].leaking.store(false, std::memory_order_relaxed);
+    }
+}
+
+int32_t ExynosFenceTracker::update(int32_t fd, uint32_t displayId, uint32_t dir,
+        bool pendingAllowed)
+{
+    if (!isTracked(fd)) {
+        mUntrackedCount.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
 
-    seq->usage = info.usage;
+    FdSlot &slot = mFds[fd];
+    int32_t usage = slot.usage.load(std::memory_order_relaxed);
+    int32_t newUsage;
 
+    do {
+        if ((dir == FENCE_FROM) || (dir == FENCE_DUP)) {
+            newUsage = usage + 1;
+        } else {
+            newUsage = usage - 1;
+            if ((dir == FENCE_CLOSE) && (newUsage < 0))
+                newUsage = 0;
+        }
+    } while (!slot.usage.compare_exchange_weak(usage, newUsage, std::memory_order_relaxed));
+
+    if ((usage == 0) && (newUsage != 0))
+        mActiveCount.fetch_add(1, std::memory_order_relaxed);
+    else if ((usage != 0) && (newUsage == 0))
+        mActiveCount.fetch_sub(1, std::memory_order_relaxed);
+
+    slot.displayId.store(displayId, std::memory_order_relaxed);
     // Fence's usage count shuld be zero at end of frame(present done).
     // This flag means usage count of the fence can be pended over frame.
-    if (info.usage == 0)
-        info.pendingAllowed = false;
+    slot.pendingAllowed.store((newUsage != 0) && pendingAllowed, std::memory_order_relaxed);
+    if (newUsage == 0)
+        slot.leaking.store(false, std::memory_order_relaxed);
 
-    /* last direction */
-    info.last_dir = direction;
+    int32_t maxFd = mMaxFd.load(std::memory_order_relaxed);
+    while ((fd > maxFd) &&
+            !mMaxFd.compare_exchange_weak(maxFd, fd, std::memory_order_relaxed));
 
-    FT_LOGI("FD : %d, direction : %d, type : %d, ip : %d, usage : %d (%s)",
-            fd, direction, seq->type, seq->ip, info.usage, __func__);
+    return newUsage;
+}
+
+void ExynosFenceTracker::setState(int32_t fd, uint32_t displayId, bool pendingAllowed)
+{
+    if (!isTracked(fd))
+        return;
 
-    device->mFenceInfo[fd] = info;
+    mFds[fd].displayId.store(displayId, std::memory_order_relaxed);
+    mFds[fd].pendingAllowed.store(pendingAllowed, std::memory_order_relaxed);
+}
 
+int32_t ExynosFenceTracker::getUsage(int32_t fd) const
+{
+    return isTracked(fd) ? mFds[fd].usage.load(std::memory_order_relaxed) : 0;
 }
 
-void printLastFenceInfo(uint32_t fd, ExynosDisplay* display) {
+uint32_t ExynosFenceTracker::getDisplayId(int32_t fd) const
+{
+    return isTracked(fd) ? mFds[fd].displayId.load(std::memory_order_relaxed) : 0;
+}
 
+bool ExynosFenceTracker::isPendingAllowed(int32_t fd) const
+{
+    return isTracked(fd) ? mFds[fd].pendingAllowed.load(std::memory_order_relaxed) : false;
+}
+
+bool ExynosFenceTracker::isLeaking(int32_t fd) const
+{
+    return isTracked(fd) ? mFds[fd].leaking.load(std::memory_order_relaxed) : false;
+}
+
+void ExynosFenceTracker::setLeaking(int32_t fd)
+{
+    if (isTracked(fd))
+        mFds[fd].leaking.store(true, std::memory_order_relaxed);
+}
+
+static void recordFenceTrace(ExynosDisplay *display, uint32_t fd,
+        hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
+        uint32_t direction, int32_t usage, bool pendingAllowed) {
+    fenceTrace_t trace;
     struct timeval tv;
 
-    if (!fence_valid(fd)) return;
+    gettimeofday(&tv, NULL);
+
+    trace.index = 0;
+    trace.fd = (int32_t)fd;
+    trace.displayId = display->mDisplayId;
+    trace.dir = direction;
+    trace.type = type;
+    trace.ip = ip;
+    trace.usage = usage;
+    trace.pendingAllowed = pendingAllowed;
+    trace.timeUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+    display->mFenceTraceRing.record(trace);
+}
 
+static void appendFenceTrace(String8 &result, const fenceTrace_t &trace) {
+    struct timeval tv;
+    tv.tv_sec = trace.timeUs / 1000000;
+    tv.tv_usec = trace.timeUs % 1000000;
+    struct tm* localTime = getLocalTime(tv);
+
+    result.appendFormat("    %s(%s)(%s)(usage:%d)(display:%u)(pending:%d)",
+            GET_STRING(fence_dir_map, trace.dir),
+            GET_STRING(fence_ip_map, trace.ip), GET_STRING(fence_type_map, trace.type),
+            trace.usage, trace.displayId, (int)trace.pendingAllowed);
+    result.appendFormat(" - time:%02d-%02d %02d:%02d:%02d.%03lu(%lu)\n",
+            localTime->tm_mon+1, localTime->tm_mday,
+            localTime->tm_hour, localTime->tm_min,
+            localTime->tm_sec, tv.tv_usec/1000,
+            ((tv.tv_sec * 1000) + (tv.tv_usec / 1000)));
+}
+
+void setFenceInfo(uint32_t fd, ExynosDisplay* display,
+        hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
+        uint32_t direction, bool pendingAllowed) {
+
+    if (!fence_valid(fd) || display == NULL) return;
     ExynosDevice* device = display->mDevice;
+    if (device == NULL) return;
 
-    if (device->mFenceInfo.count(fd) == 0)
+    if (direction >= FENCE_DIR_MAX) {
+        ALOGE("Fence trace : Undefined direction!");
         return;
+    }
+
+    int32_t usage = device->mFenceTracker.update(fd, display->mDisplayId,
+            direction, pendingAllowed);
+    recordFenceTrace(display, fd, type, ip, direction, usage, pendingAllowed);
+
+    FT_LOGI("FD : %d, direction : %d, type : %d, ip : %d, usage : %d (%s)",
+            fd, direction, type, ip, usage, __func__);
+}
 
-    hwc_fence_info_t info = device->mFenceInfo.at(fd);
-    FT_LOGD("---- Fence FD : %d, Display(%d), usage(%d) ----", fd, info.displayId, info.usage);
+void printLastFenceInfo(uint32_t fd, ExynosDisplay* display) {
 
-    for (int i = 0; i < MAX_FENCE_SEQUENCE; i++) {
-        fenceTrace_t *seq = &info.seq[i];
-        FT_LOGD("fd(%d) %s(%s)(%s)(cur:%d)(usage:%d)(last:%d)",
-                fd, GET_STRING(fence_dir_map, seq->dir),
-                GET_STRING(fence_ip_map, seq->ip), GET_STRING(fence_type_map, seq->type),
-                seq->curFlag, seq->usage, (int)seq->isLast);
+    if (!fence_valid(fd)) return;
 
-        tv = seq->time;
-        struct tm* localTime = getLocalTime(tv);
+    ExynosDevice* device = display->mDevice;
+    std::vector<fenceTrace_t> traces;
+    String8 result;
 
-        FT_LOGD("time:%02d-%02d %02d:%02d:%02d.%03lu(%lu)",
-                localTime->tm_mon+1, localTime->tm_mday,
-                localTime->tm_hour, localTime->tm_min,
-                localTime->tm_sec, tv.tv_usec/1000,
-                ((tv.tv_sec * 1000) + (tv.tv_usec / 1000)));
+    FT_LOGD("---- Fence FD : %d, Display(%d), usage(%d) ----", fd,
+            device->mFenceTracker.getDisplayId(fd), device->mFenceTracker.getUsage(fd));
+
+    for (size_t i = 0; i < device->mDisplays.size(); i++) {
+        traces.clear();
+        device->mDisplays[i]->mFenceTraceRing.collect(fd, traces);
+        size_t first = (traces.size() > MAX_FENCE_SEQUENCE) ? traces.size() - MAX_FENCE_SEQUENCE : 0;
+        for (size_t j = first; j < traces.size(); j++) {
+            result.clear();
+            appendFenceTrace(result, traces[j]);
+            FT_LOGD("fd(%d)%s", fd, result.string());
+        }
     }
-
 }
 
 void dumpFenceInfo(ExynosDisplay *display, int32_t __unused depth) {
 
-    ExynosDevice* device = display->mDevice;
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
 
     FT_LOGD("Dump fence ++");
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if (device->mFenceInfo.count(i) == 0) continue;
-        if ((info.usage >= 1 || info.usage <= -1) && (!info.pendingAllowed))
-            printLastFenceInfo(i, display);
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        if ((tracker.getUsage(fd) != 0) && (!tracker.isPendingAllowed(fd)))
+            printLastFenceInfo(fd, display);
     }
     FT_LOGD("Dump fence --");
 }
 
 void printLeakFds(ExynosDisplay *display){
 
-    ExynosDevice* device = display->mDevice;
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
 
     int cnt = 1;
 
@@ -854,11 +988,9 @@ void printLeakFds(ExynosDisplay *display){
 
     errStringPlus.appendFormat("Leak Fds (1) :\n");
 
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if(info.usage >= 1) {
-            errStringPlus.appendFormat("%d,", i);
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        if (tracker.getUsage(fd) >= 1) {
+            errStringPlus.appendFormat("%d,", fd);
             if(cnt++%10 == 0)
                 errStringPlus.appendFormat("\n");
         }
@@ -868,11 +1000,9 @@ void printLeakFds(ExynosDisplay *display){
     errStringMinus.appendFormat("Leak Fds (-1) :\n");
 
     cnt = 1;
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if(info.usage < 0) {
-            errStringMinus.appendFormat("%d,", i);
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        if (tracker.getUsage(fd) < 0) {
+            errStringMinus.appendFormat("%d,", fd);
             if(cnt++%10 == 0)
                 errStringMinus.appendFormat("\n");
         }
@@ -882,17 +1012,15 @@ void printLeakFds(ExynosDisplay *display){
 
 void dumpNCheckLeak(ExynosDisplay *display, int32_t __unused depth) {
 
-    ExynosDevice* device = display->mDevice;
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
 
     FT_LOGD("Dump leaking fence ++");
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if ((info.usage >= 1 || info.usage <= -1) && (!info.pendingAllowed))
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        if ((tracker.getUsage(fd) != 0) && (!tracker.isPendingAllowed(fd)))
             // leak is occured in this frame first
-            if (!info.leaking) {
-                info.leaking = true;
-                printLastFenceInfo(i, display);
+            if (!tracker.isLeaking(fd)) {
+                tracker.setLeaking(fd);
+                printLastFenceInfo(fd, display);
             }
     }
 
@@ -909,12 +1037,7 @@ bool fenceWarn(ExynosDisplay *display, uint32_t threshold) {
     uint32_t cnt = 0, r_cnt = 0;
     ExynosDevice* device = display->mDevice;
 
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if(info.usage >= 1 || info.usage <= -1)
-            cnt++;
-    }
+    cnt = device->mFenceTracker.getActiveCount();
 
     if ((cnt>threshold) || (exynosHWCControl.fenceTracer > 0))
         dumpFenceInfo(display, 0);
@@ -928,20 +1051,18 @@ bool fenceWarn(ExynosDisplay *display, uint32_t threshold) {
 }
 
 void resetFenceCurFlag(ExynosDisplay *display) {
-    ExynosDevice* device = display->mDevice;
-    FT_LOGD("%s ++", __func__);
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-
-        if (device->mFenceInfo.count(i) == 0) continue;
+    /* The events are kept in the ring. Only the mismatches are reported */
+    if (exynosHWCControl.fenceTracer == 0)
+        return;
 
-        if (info.usage == 0) {
-            hwc_fence_info_t *info_ = &device->mFenceInfo[i];
-            for(int j=0; j<MAX_FENCE_SEQUENCE; j++) info_->seq[j].curFlag = 0;
-        } else if (!info.pendingAllowed)
-            FT_LOGE("usage mismatched fd %d, usage %d, pending %d", i,
-                    info.usage, info.pendingAllowed);
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
+    FT_LOGD("%s ++", __func__);
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        int32_t usage = tracker.getUsage(fd);
+        bool pendingAllowed = tracker.isPendingAllowed(fd);
+        if ((usage != 0) && !pendingAllowed)
+            FT_LOGE("usage mismatched fd %d, usage %d, pending %d", fd,
+                    usage, pendingAllowed);
     }
     FT_LOGD("%s --", __func__);
 }
@@ -949,16 +1070,19 @@ void resetFenceCurFlag(ExynosDisplay *display) {
 bool validateFencePerFrame(ExynosDisplay *display) {
 
     bool ret = true;
-    ExynosDevice* device = display->mDevice;
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
 
-    for (auto it = device->mFenceInfo.begin(); it != device->mFenceInfo.end(); ++it) {
-        uint32_t i = it->first;
-        hwc_fence_info_t info = device->mFenceInfo.at(i);
-        if (info.displayId != display->mDisplayId)
+    if (tracker.getActiveCount() == 0)
+        return true;
+
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        if (tracker.getUsage(fd) == 0)
+            continue;
+        if (tracker.getDisplayId(fd) != display->mDisplayId)
             continue;
-        if ((info.usage >= 1 || info.usage <= -1) &&
-                (!info.pendingAllowed) && (!info.leaking)) {
+        if ((!tracker.isPendingAllowed(fd)) && (!tracker.isLeaking(fd))) {
             ret = false;
+            break;
         }
     }
 
@@ -972,6 +1096,67 @@ bool validateFencePerFrame(ExynosDisplay *display) {
     return ret;
 }
 
+/*
+ * Offline analysis of the fences of the display that have non-zero usage
+ * The events of the fds are found from the trace ring of the display and the
+ * IPs that touched the leaking fds last are summarized as the suspects.
+ */
+void analyzeFenceLeaks(ExynosDisplay *display, String8 &result) {
+
+    ExynosFenceTracker &tracker = display->mDevice->mFenceTracker;
+    std::vector<fenceTrace_t> traces;
+    std::map<uint32_t, uint32_t> suspects;
+    uint32_t leaks = 0;
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    int64_t nowUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+    display->mFenceTraceRing.collect(-1, traces);
+
+    result.appendFormat("fence tracer: events(%u), active fds(%u), untracked events(%u)\n",
+            display->mFenceTraceRing.getEventCount(), tracker.getActiveCount(),
+            tracker.getUntrackedCount());
+
+    for (int32_t fd = 0; fd <= tracker.getMaxFd(); fd++) {
+        int32_t usage = tracker.getUsage(fd);
+        if ((usage == 0) || (tracker.getDisplayId(fd) != display->mDisplayId))
+            continue;
+
+        bool pendingAllowed = tracker.isPendingAllowed(fd);
+        result.appendFormat("  FD hwc : %d, usage %d, pending : %d, %s\n", fd, usage,
+                (int)pendingAllowed,
+                (usage > 0) ? "not transferred or closed" : "released more than acquired");
+        if (!pendingAllowed)
+            leaks++;
+
+        /* Last events of the fd from the newest */
+        uint32_t found = 0;
+        for (auto it = traces.rbegin(); (it != traces.rend()) && (found < MAX_FENCE_SEQUENCE); ++it) {
+            if (it->fd != fd)
+                continue;
+            if ((found == 0) && !pendingAllowed) {
+                suspects[(it->ip << 8) | it->type]++;
+                result.appendFormat("    last event %" PRId64 " ms ago\n",
+                        (nowUs - it->timeUs) / 1000);
+            }
+            appendFenceTrace(result, *it);
+            found++;
+        }
+        if (found == 0)
+            result.appendFormat("    history was overwritten\n");
+    }
+
+    if (leaks > 0) {
+        result.appendFormat("fence leak suspects (last IP/type of %u leaking fds):", leaks);
+        for (auto &s : suspects)
+            result.appendFormat(" %s/%s(%u)",
+                    GET_STRING(fence_ip_map, s.first >> 8),
+                    GET_STRING(fence_type_map, s.first & 0xff), s.second);
+        result.appendFormat("\n");
+    }
+}
+
 void changeFenceInfoState(uint32_t fd, ExynosDisplay *display,
         hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
         uint32_t direction, bool pendingAllowed) {
@@ -980,21 +1165,11 @@ void changeFenceInfoState(uint32_t fd, ExynosDisplay *display,
     ExynosDevice* device = display->mDevice;
     if (device == NULL) return;
 
-    /* init or recevice(from previous) trace info */
-    hwc_fence_info_t info;
-    if (device->mFenceInfo.count(fd) == 0) {
-        memset(&info, 0, sizeof(hwc_fence_info_t));
-        info.seq_no = 0;
-    } else
-        info = device->mFenceInfo.at(fd);
-
-    info.displayId = display->mDisplayId;
-
-    writeFenceInfo(fd, &info, type, ip, direction, pendingAllowed);
+    device->mFenceTracker.setState(fd, display->mDisplayId, pendingAllowed);
+    recordFenceTrace(display, fd, type, ip, direction,
+            device->mFenceTracker.getUsage(fd), pendingAllowed);
 
     FT_LOGD("FD : %d, direction : %d, type(%d), ip(%d) (%s)", fd, direction, type, ip, __func__);
-
-    device->mFenceInfo[fd] = info;
 }
 
 String8 getMPPStr(int typeId) {
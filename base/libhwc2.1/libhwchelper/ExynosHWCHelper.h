@@ -18,7 +18,9 @@
 
 #include <utils/String8.h>
 #include <hardware/hwcomposer2.h>
+#include <atomic>
 #include <map>
+#include <vector>
 #ifdef GRALLOC_VERSION1
 #include "gralloc1_priv.h"
 #else
@@ -32,6 +34,8 @@
 #define MAX_FENCE_NAME 64
 #define MAX_FENCE_THRESHOLD 500
 #define MAX_FENCE_SEQUENCE 3
+#define FENCE_TRACE_RING_SIZE 1024  /* events of a display, power of 2 */
+#define FENCE_TRACE_MAX_FD 4096     /* fds that have a summary slot */
 
 #define MAX_USE_FORMAT 27
 #ifndef P010M_Y_SIZE
@@ -462,6 +466,16 @@ inline hwc_rect expand(const hwc_rect &r1, const hwc_rect &r2)
     return i;
 }
 
+inline hwc_rect intersection(const hwc_rect &r1, const hwc_rect &r2)
+{
+    hwc_rect i;
+    i.top = max(r1.top, r2.top);
+    i.bottom = min(r1.bottom, r2.bottom);
+    i.left = max(r1.left, r2.left);
+    i.right = min(r1.right, r2.right);
+    return i;
+}
+
 int pixel_align_down(int x, int a);
 
 inline int pixel_align(int x, int a) {
@@ -475,25 +489,77 @@ int getBufLength(private_handle_t *handle, uint32_t planer_num, size_t *length,
 //class hwc_fence_info(sync_fence_info_data* data, sync_pt_info* info) {
 struct tm* getHwcFenceTime();
 
+/* A fence event decoded from ExynosFenceTraceRing */
 typedef struct fenceTrace {
+    uint32_t index;         // sequence number of the event in the ring
+    int32_t fd;
+    uint32_t displayId;
     uint32_t dir;
     hwc_fdebug_fence_type type;
     hwc_fdebug_ip_type ip;
-    struct timeval time;
-    int32_t curFlag;
-    int32_t usage;
-    bool isLast;
+    int32_t usage;          // usage count of the fd after the event
+    bool pendingAllowed;
+    int64_t timeUs;         // wall clock time
 } fenceTrace_t;
 
-typedef struct hwc_fence_info {
-    uint32_t displayId;
-    fenceTrace_t seq[MAX_FENCE_SEQUENCE];
-    uint32_t seq_no = 0;
-    uint32_t last_dir;
-    int32_t usage;
-    bool pendingAllowed = false;
-    bool leaking = false;
-} hwc_fence_info_t;
+/*
+ * Fixed-size ring of the fence events of a display
+ * record() is lock-free and never blocks. Each slot is guarded by a sequence
+ * number so that a reader skips the slot that is being overwritten.
+ */
+class ExynosFenceTraceRing {
+    public:
+        ExynosFenceTraceRing();
+        void record(const fenceTrace_t &trace);
+        /*
+         * Copy the events of @fd (every fd if @fd < 0) in the ring
+         * from the oldest to @traces. Returns the number of events copied.
+         */
+        size_t collect(int32_t fd, std::vector<fenceTrace_t> &traces) const;
+        uint32_t getEventCount() const { return mHead.load(std::memory_order_relaxed); };
+    private:
+        struct Slot {
+            std::atomic<uint32_t> seq;
+            std::atomic<uint64_t> word[3];
+        };
+        Slot mSlots[FENCE_TRACE_RING_SIZE];
+        std::atomic<uint32_t> mHead;
+};
+
+/*
+ * Usage count of the fences of a device
+ * The summary slots are indexed by fd, so no lookup or allocation is
+ * required to update them. The fds over FENCE_TRACE_MAX_FD are not tracked.
+ */
+class ExynosFenceTracker {
+    public:
+        ExynosFenceTracker();
+        /* Apply @dir to the usage count of @fd and return the new usage count */
+        int32_t update(int32_t fd, uint32_t displayId, uint32_t dir, bool pendingAllowed);
+        void setState(int32_t fd, uint32_t displayId, bool pendingAllowed);
+        bool isTracked(int32_t fd) const { return (fd >= 0) && (fd < FENCE_TRACE_MAX_FD); };
+        int32_t getUsage(int32_t fd) const;
+        uint32_t getDisplayId(int32_t fd) const;
+        bool isPendingAllowed(int32_t fd) const;
+        bool isLeaking(int32_t fd) const;
+        void setLeaking(int32_t fd);
+        /* fds that have been tracked are less than or equal to getMaxFd() */
+        int32_t getMaxFd() const { return mMaxFd.load(std::memory_order_relaxed); };
+        /* Number of fds that have non-zero usage count */
+        uint32_t getActiveCount() const { return mActiveCount.load(std::memory_order_relaxed); };
+        uint32_t getUntrackedCount() const { return mUntrackedCount.load(std::memory_order_relaxed); };
+    private:
+        struct FdSlot {
+            std::atomic<int32_t> usage;
+            std::atomic<uint32_t> displayId;
+            std::atomic<bool> pendingAllowed;
+            std::atomic<bool> leaking;
+        };
+        FdSlot mFds[FENCE_TRACE_MAX_FD];
+        std::atomic<int32_t> mMaxFd;
+        std::atomic<uint32_t> mActiveCount;
+        std::atomic<uint32_t> mUntrackedCount;
+};
 
 
 void setFenceName(int fenceFd, hwc_fence_type fenceType);
@@ -503,13 +569,12 @@ void changeFenceInfoState(uint32_t fd, ExynosDisplay *display,
 void setFenceInfo(uint32_t fd, ExynosDisplay *display,
         hwc_fdebug_fence_type type, hwc_fdebug_ip_type ip,
         uint32_t direction, bool pendingAllowed = false);
-void printFenceInfo(uint32_t fd, hwc_fence_info_t* info);
 void dumpFenceInfo(ExynosDisplay *display, int32_t __unused depth);
-bool fenceWarn(hwc_fence_info_t **info, uint32_t threshold);
 void resetFenceCurFlag(ExynosDisplay *display);
 bool fenceWarn(ExynosDisplay *display, uint32_t threshold);
 void printLeakFds(ExynosDisplay *display);
 bool validateFencePerFrame(ExynosDisplay *display);
+void analyzeFenceLeaks(ExynosDisplay *display, String8 &result);
 android_dataspace colorModeToDataspace(android_color_mode_t mode);
 
 inline uint32_t getDisplayId(int32_t displayType, int32_t displayIndex = 0 ) {
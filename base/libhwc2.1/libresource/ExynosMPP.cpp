@@ -26,6 +26,7 @@
 #include "ExynosResourceRestriction.h"
 #include <hardware/hwcomposer_defs.h>
 #include <math.h>
+#include <vector>
 #ifdef GRALLOC_VERSION1
 #include "gralloc1_priv.h"
 #else
@@ -54,6 +55,10 @@ extern struct exynos_hwc_control exynosHWCControl;
 extern feature_support_t feature_table[];
 #endif
 
+/* Polling period and timeout for the fences of freed buffers */
+#define MPP_FREED_BUF_POLL_PERIOD   ms2ns(4)
+#define MPP_FREED_BUF_TIMEOUT       ms2ns(1000)
+
 void dumpExynosMPPImgInfo(uint32_t type, exynos_mpp_img_info &imgInfo)
 {
     HDEBUGLOGD(type, "\tbuffer: %p, bufferType: %d",
@@ -144,6 +149,15 @@ ExynosMPP::ExynosMPP(ExynosResourceManager* resourceManager,
     mFreeOutBufFlag(true),
     mHWBusyFlag(false),
     mWasUsedPrevFrame(false),
+    mPrevComposedBuf(NULL),
+    mPrevComposedColorMode(HAL_COLOR_MODE_NATIVE),
+    mPartialComposition(false),
+    mPartialLayerNum(0),
+    mComposedFrames(0),
+    mPartialComposedFrames(0),
+    mLastComposedPixels(0),
+    mTotalComposedPixels(0),
+    mTotalCanvasPixels(0),
     mCurrentDstBuf(0),
     mPrivDstBuf(-1),
     mNeedCompressedTarget(false),
@@ -158,6 +172,8 @@ ExynosMPP::ExynosMPP(ExynosResourceManager* resourceManager,
         memset(&mSrcSizeRestrictions[i], 0, sizeof(restriction_size));
         memset(&mDstSizeRestrictions[i], 0, sizeof(restriction_size));
     }
+    memset(mSrcRestrictionSnapshot, 0, sizeof(mSrcRestrictionSnapshot));
+    memset(mDstRestrictionSnapshot, 0, sizeof(mDstRestrictionSnapshot));
 
     if (mPhysicalType == MPP_G2D) {
         if (mLogicalType == MPP_LOGICAL_G2D_RGB) {
@@ -240,6 +256,13 @@ ExynosMPP::ExynosMPP(ExynosResourceManager* resourceManager,
         mSrcImgs[i].acrylicAcquireFenceFd = -1;
         mSrcImgs[i].acrylicReleaseFenceFd = -1;
     }
+    for (uint32_t i = 0; i < MPP_PARTIAL_LAYER_MAX; i++) {
+        memset(&mPartialImgs[i], 0, sizeof(exynos_mpp_img_info));
+        mPartialImgs[i].acrylicAcquireFenceFd = -1;
+        mPartialImgs[i].acrylicReleaseFenceFd = -1;
+    }
+    memset(&mPartialRect, 0, sizeof(mPartialRect));
+    memset(mPartialSources, 0, sizeof(mPartialSources));
     for (uint32_t i = 0; i < NUM_MPP_DST_BUFS(mLogicalType); i++) {
         memset(&mDstImgs[i], 0, sizeof(exynos_mpp_img_info));
         mDstImgs[i].acrylicAcquireFenceFd = -1;
@@ -251,6 +274,11 @@ ExynosMPP::ExynosMPP(ExynosResourceManager* resourceManager,
         mPreAssignDisplayList[i] = (preAssignInfo >> (DISPLAY_MODE_MASK_LEN * i)) & DISPLAY_MODE_MASK_BIT;
     }
     mPreAssignedCapacity = (float)0.0f;
+    memset(mPerfModel, 0, sizeof(mPerfModel));
+    mPerfSample.entry = NULL;
+    mPerfSample.capacity = 0;
+    mPerfSample.submitTime = 0;
+    mPerfSample.fence = -1;
 }
 
 ExynosMPP::~ExynosMPP()
@@ -265,6 +293,9 @@ ExynosMPP::~ExynosMPP()
             mSrcImgs[i].mppLayer = NULL;
         }
     }
+    deletePartialLayers();
+    if (mPerfSample.fence >= 0)
+        close(mPerfSample.fence);
     if (mAcrylicHandle != NULL)
         delete mAcrylicHandle;
 }
@@ -483,29 +514,12 @@ bool ExynosMPP::isSrcFormatSupported(struct exynos_image &src)
 
     if (mResourceManager == NULL) return false;
 
-    for (uint32_t i = 0 ; i < mResourceManager->mFormatRestrictionCnt; i++) {
-        if ((mResourceManager->mFormatRestrictions[i].hwType == mPhysicalType) &&
-                ((mResourceManager->mFormatRestrictions[i].nodeType == NODE_NONE) ||
-                 (mResourceManager->mFormatRestrictions[i].nodeType == NODE_SRC)) &&
-                (mResourceManager->mFormatRestrictions[i].format == src.format))
-            return true;
-    }
-
-    return false;
+    return mResourceManager->mFormatRestrictionBitmap.test(mPhysicalType, NODE_SRC, src.format);
 }
 
 bool ExynosMPP::isDstFormatSupported(struct exynos_image &dst)
 {
-
-    for (uint32_t i = 0 ; i < mResourceManager->mFormatRestrictionCnt; i++) {
-        if ((mResourceManager->mFormatRestrictions[i].hwType == mPhysicalType) &&
-                ((mResourceManager->mFormatRestrictions[i].nodeType == NODE_NONE) ||
-                 (mResourceManager->mFormatRestrictions[i].nodeType == NODE_DST)) &&
-                (mResourceManager->mFormatRestrictions[i].format == dst.format))
-            return true;
-    }
-
-    return false;
+    return mResourceManager->mFormatRestrictionBitmap.test(mPhysicalType, NODE_DST, dst.format);
 }
 
 uint32_t ExynosMPP::getMaxUpscale(struct exynos_image &src, struct exynos_image __unused &dst)
@@ -768,7 +782,10 @@ bool ExynosMPP::ResourceManageThread::threadLoop()
         Mutex::Autolock lock(mMutex);
         while((mFreedBuffers.size() == 0) &&
                 (mStateFences.size() == 0)) {
-            mCondition.wait(mMutex);
+            if (mPendingBuffers.size() == 0)
+                mCondition.wait(mMutex);
+            else if (mCondition.waitRelative(mMutex, MPP_FREED_BUF_POLL_PERIOD) == TIMED_OUT)
+                break;
         }
 
         if ((mExynosMPP->mHWState == MPP_HW_STATE_RUNNING) &&
@@ -786,24 +803,47 @@ bool ExynosMPP::ResourceManageThread::threadLoop()
             }
         }
 
-        if (mFreedBuffers.size() != 0) {
+        if ((mFreedBuffers.size() != 0) || (mPendingBuffers.size() != 0)) {
             freeBuffers();
         }
     }
     return true;
 }
 
+static inline bool isFenceSignaled(int fence)
+{
+    return !fence_valid(fence) || (sync_wait(fence, 0) == 0);
+}
+
+/*
+ * A freed buffer goes back to the buffer pool when HW does not access it
+ * anymore. It is freed to gralloc if its fences are not signaled in time.
+ */
 void ExynosMPP::ResourceManageThread::freeBuffers()
 {
-    android::List<exynos_mpp_img_info >::iterator it;
-    android::List<exynos_mpp_img_info >::iterator end;
-    it = mFreedBuffers.begin();
-    end = mFreedBuffers.end();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    ExynosMPPBufferPool &bufferPool = mExynosMPP->mResourceManager->mDstBufPool;
+
+    android::List<exynos_mpp_img_info >::iterator it = mFreedBuffers.begin();
+    while (it != mFreedBuffers.end()) {
+        PendingBuffer pendingBuffer = {*it, now + MPP_FREED_BUF_TIMEOUT};
+        mPendingBuffers.push_back(pendingBuffer);
+        it = mFreedBuffers.erase(it);
+    }
 
     uint32_t freebufNum = 0;
-    while (it != end) {
-        exynos_mpp_img_info freeBuffer = (exynos_mpp_img_info)(*it);
-        HDEBUGLOGD(eDebugMPP|eDebugFence|eDebugBuf, "freebufNum: %d, buffer: %p", freebufNum, freeBuffer.bufferHandle);
+    android::List<PendingBuffer>::iterator pending = mPendingBuffers.begin();
+    while (pending != mPendingBuffers.end()) {
+        exynos_mpp_img_info &freeBuffer = pending->img;
+        bool idle = isFenceSignaled(freeBuffer.acrylicAcquireFenceFd) &&
+            isFenceSignaled(freeBuffer.acrylicReleaseFenceFd);
+        if (!idle && (now < pending->deadline)) {
+            ++pending;
+            continue;
+        }
+
+        HDEBUGLOGD(eDebugMPP|eDebugFence|eDebugBuf, "freebufNum: %d, buffer: %p, idle: %d",
+                freebufNum, freeBuffer.bufferHandle, idle);
         dumpExynosMPPImgInfo(eDebugMPP|eDebugFence|eDebugBuf, freeBuffer);
         if (fence_valid(freeBuffer.acrylicAcquireFenceFd)) {
             freeBuffer.acrylicAcquireFenceFd =
@@ -815,8 +855,12 @@ void ExynosMPP::ResourceManageThread::freeBuffers()
                 fence_close(freeBuffer.acrylicReleaseFenceFd, mExynosMPP->mAssignedDisplay,
                         FENCE_TYPE_SRC_RELEASE, FENCE_IP_ALL);
         }
-        mExynosMPP->mMapper->freeBuffer(freeBuffer.bufferHandle);
-        it = mFreedBuffers.erase(it);
+        if (idle)
+            bufferPool.release(freeBuffer.bufferHandle);
+        else
+            bufferPool.free(freeBuffer.bufferHandle);
+        pending = mPendingBuffers.erase(pending);
+        freebufNum++;
     }
 }
 
@@ -862,6 +906,218 @@ void ExynosMPP::ResourceManageThread::addStateFence(int fence)
     mCondition.signal();
 }
 
+ExynosMPPBufferPool::ExynosMPPBufferPool()
+: mAllocator(NULL),
+    mMapper(NULL),
+    mBudget(MPP_DST_BUF_POOL_BUDGET),
+    mFreeBytes(0),
+    mUsedBytes(0),
+    mHitCount(0),
+    mMissCount(0),
+    mPrewarmCount(0),
+    mTrimCount(0)
+{
+}
+
+ExynosMPPBufferPool::~ExynosMPPBufferPool()
+{
+    Mutex::Autolock lock(mMutex);
+    trimLocked(0);
+}
+
+int32_t ExynosMPPBufferPool::allocateBuffer(const Key &key, Entry &entry)
+{
+    ATRACE_CALL();
+
+    GrallocWrapper::IMapper::BufferDescriptorInfo info = {};
+    info.width = key.width;
+    info.height = key.height;
+    info.layerCount = 1;
+    info.format = static_cast<GrallocWrapper::PixelFormat>(key.format);
+    info.usage = key.usage;
+
+    uint32_t stride = 0;
+    buffer_handle_t buffer = NULL;
+    GrallocWrapper::Error error = mAllocator->allocate(info, &stride, &buffer);
+    if ((error != GrallocWrapper::Error::NONE) || (buffer == NULL)) {
+        HWC_LOGE(NULL, "%s:: failed to allocate buffer(%dx%d, format: 0x%8x): %d",
+                __func__, key.width, key.height, key.format, error);
+        return -ENOMEM;
+    }
+
+    entry.handle = private_handle_t::dynamicCast(buffer);
+    entry.key = key;
+    entry.size = (uint64_t)entry.handle->size + entry.handle->size1 + entry.handle->size2;
+
+    return NO_ERROR;
+}
+
+int32_t ExynosMPPBufferPool::allocate(const Key &key, private_handle_t **outHandle)
+{
+    Mutex::Autolock lock(mMutex);
+    if ((mAllocator == NULL) && (mMapper == NULL))
+        ExynosDevice::getAllocator(&mMapper, &mAllocator);
+
+    /* Take the most recently used one */
+    Entry entry;
+    bool found = false;
+    for (List<Entry>::iterator it = mFreeBuffers.end(); it != mFreeBuffers.begin();) {
+        --it;
+        if (it->key == key) {
+            entry = *it;
+            mFreeBuffers.erase(it);
+            mFreeBytes -= entry.size;
+            found = true;
+            break;
+        }
+    }
+
+    if (found) {
+        mHitCount++;
+    } else {
+        mMissCount++;
+        int32_t ret = allocateBuffer(key, entry);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    mUsedBuffers[entry.handle] = entry;
+    mUsedBytes += entry.size;
+    *outHandle = entry.handle;
+
+    HDEBUGLOGD(eDebugBuf, "%s:: %p (%dx%d, format: 0x%8x), hit: %d",
+            __func__, entry.handle, key.width, key.height, key.format, found);
+
+    return NO_ERROR;
+}
+
+void ExynosMPPBufferPool::release(private_handle_t *handle)
+{
+    if (handle == NULL)
+        return;
+
+    Mutex::Autolock lock(mMutex);
+    std::map<private_handle_t*, Entry>::iterator it = mUsedBuffers.find(handle);
+    if (it == mUsedBuffers.end()) {
+        HWC_LOGE(NULL, "%s:: %p is not allocated by the pool", __func__, handle);
+        return;
+    }
+
+    Entry entry = it->second;
+    mUsedBuffers.erase(it);
+    mUsedBytes -= entry.size;
+
+    mFreeBuffers.push_back(entry);
+    mFreeBytes += entry.size;
+    trimLocked(mBudget);
+}
+
+void ExynosMPPBufferPool::free(private_handle_t *handle)
+{
+    if (handle == NULL)
+        return;
+
+    Mutex::Autolock lock(mMutex);
+    std::map<private_handle_t*, Entry>::iterator it = mUsedBuffers.find(handle);
+    if (it == mUsedBuffers.end()) {
+        HWC_LOGE(NULL, "%s:: %p is not allocated by the pool", __func__, handle);
+        return;
+    }
+
+    mUsedBytes -= it->second.size;
+    mUsedBuffers.erase(it);
+    mMapper->freeBuffer(handle);
+}
+
+bool ExynosMPPBufferPool::getKey(private_handle_t *handle, Key &key)
+{
+    Mutex::Autolock lock(mMutex);
+    std::map<private_handle_t*, Entry>::iterator it = mUsedBuffers.find(handle);
+    if (it == mUsedBuffers.end())
+        return false;
+
+    key = it->second.key;
+    return true;
+}
+
+void ExynosMPPBufferPool::prewarm(const Key &key, uint32_t count)
+{
+    ATRACE_CALL();
+    uint32_t idleNum = 0;
+    {
+        Mutex::Autolock lock(mMutex);
+        if ((mAllocator == NULL) && (mMapper == NULL))
+            ExynosDevice::getAllocator(&mMapper, &mAllocator);
+        for (List<Entry>::iterator it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it) {
+            if (it->key == key)
+                idleNum++;
+        }
+    }
+
+    /* The lock is not held while gralloc allocates so that MPPs are not blocked */
+    for (; idleNum < count; idleNum++) {
+        Entry entry;
+        if (allocateBuffer(key, entry) != NO_ERROR)
+            break;
+
+        Mutex::Autolock lock(mMutex);
+        mFreeBuffers.push_back(entry);
+        mFreeBytes += entry.size;
+        mPrewarmCount++;
+
+        /* Older buffers are trimmed first. Stop if there is no room for this one */
+        trimLocked(mBudget);
+        if ((mFreeBuffers.size() == 0) || ((*(--mFreeBuffers.end())).handle != entry.handle))
+            break;
+    }
+
+    HDEBUGLOGD(eDebugBuf, "%s:: %dx%d, format: 0x%8x, %d/%d buffers are ready",
+            __func__, key.width, key.height, key.format, idleNum, count);
+}
+
+void ExynosMPPBufferPool::setBudget(uint64_t budget)
+{
+    Mutex::Autolock lock(mMutex);
+    mBudget = budget;
+    trimLocked(mBudget);
+}
+
+void ExynosMPPBufferPool::trim(uint64_t target)
+{
+    Mutex::Autolock lock(mMutex);
+    trimLocked(target);
+}
+
+void ExynosMPPBufferPool::trimLocked(uint64_t target)
+{
+    while ((mFreeBytes > target) && (mFreeBuffers.size() != 0)) {
+        List<Entry>::iterator it = mFreeBuffers.begin();
+        HDEBUGLOGD(eDebugBuf, "%s:: %p (%dx%d, format: 0x%8x) is freed",
+                __func__, it->handle, it->key.width, it->key.height, it->key.format);
+        mMapper->freeBuffer(it->handle);
+        mFreeBytes -= it->size;
+        mFreeBuffers.erase(it);
+        mTrimCount++;
+    }
+}
+
+void ExynosMPPBufferPool::dump(String8& result)
+{
+    Mutex::Autolock lock(mMutex);
+
+    uint64_t requestCount = mHitCount + mMissCount;
+    float hitRate = (requestCount == 0) ? 0.0f : (100.0f * mHitCount / requestCount);
+    result.appendFormat("MPP dst buffer pool: budget(%" PRIu64 "), held(%" PRIu64 " bytes, %zu buffers), "
+            "used(%" PRIu64 " bytes, %zu buffers)\n",
+            mBudget, mFreeBytes, mFreeBuffers.size(), mUsedBytes, mUsedBuffers.size());
+    result.appendFormat("\thit(%" PRIu64 "), miss(%" PRIu64 "), hit rate(%.1f%%), prewarmed(%" PRIu64 "), trimmed(%" PRIu64 ")\n",
+            mHitCount, mMissCount, hitRate, mPrewarmCount, mTrimCount);
+    for (List<Entry>::iterator it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it) {
+        result.appendFormat("\t[held] %dx%d, format(0x%8x), usage(0x%" PRIx64 "), secure(%d), size(%" PRIu64 ")\n",
+                it->key.width, it->key.height, it->key.format, it->key.usage, it->key.secure, it->size);
+    }
+}
+
 /**
  * @param w
  * @param h
@@ -871,7 +1127,6 @@ void ExynosMPP::ResourceManageThread::addStateFence(int fence)
  */
 int32_t ExynosMPP::allocOutBuf(uint32_t w, uint32_t h, uint32_t format, uint64_t usage, uint32_t index) {
     ATRACE_CALL();
-    uint32_t dstStride = 0;
 
     MPP_LOGD(eDebugMPP|eDebugBuf, "index: %d++++++++", index);
 
@@ -884,29 +1139,20 @@ int32_t ExynosMPP::allocOutBuf(uint32_t w, uint32_t h, uint32_t format, uint64_t
     dumpExynosMPPImgInfo(eDebugMPP, mDstImgs[index]);
 
     uint64_t allocUsage = getBufferUsage(usage);
-    buffer_handle_t dstBuffer;
+    private_handle_t *dstBuffer = NULL;
 
     MPP_LOGD(eDebugMPP|eDebugBuf, "\tw: %d, h: %d, format: 0x%8x, previousBuffer: %p, allocUsage: 0x%" PRIx64 ", usage: 0x%" PRIx64 "",
             w, h, format, freeDstBuf.bufferHandle, allocUsage, usage);
 
-    if ((mAllocator == NULL) && (mMapper == NULL))
-        ExynosDevice::getAllocator(&mMapper, &mAllocator);
-
-    GrallocWrapper::IMapper::BufferDescriptorInfo info = {};
-    info.width = w;
-    info.height = h;
-    info.layerCount = 1;
-    info.format = static_cast<GrallocWrapper::PixelFormat>(format);
-    info.usage = allocUsage;
-    GrallocWrapper::Error error = GrallocWrapper::Error::NONE;
-
-    {
-        ATRACE_CALL();
-        error = mAllocator->allocate(info, &dstStride, &dstBuffer);
-    }
+    ExynosMPPBufferPool::Key key = {};
+    key.width = w;
+    key.height = h;
+    key.format = format;
+    key.usage = allocUsage;
+    key.secure = (getDrmMode(usage) == SECURE_DRM);
 
-    if ((error != GrallocWrapper::Error::NONE) || (dstBuffer == NULL)) {
-        MPP_LOGE("failed to allocate destination buffer(%dx%d): %d", w, h, error);
+    if (mResourceManager->mDstBufPool.allocate(key, &dstBuffer) != NO_ERROR) {
+        MPP_LOGE("failed to allocate destination buffer(%dx%d)", w, h);
         return -EINVAL;
     }
 
@@ -914,7 +1160,7 @@ int32_t ExynosMPP::allocOutBuf(uint32_t w, uint32_t h, uint32_t format, uint64_t
 
     mDstImgs[index].acrylicAcquireFenceFd = -1;
     mDstImgs[index].acrylicReleaseFenceFd = -1;
-    mDstImgs[index].bufferHandle = private_handle_t::dynamicCast(dstBuffer);
+    mDstImgs[index].bufferHandle = dstBuffer;
     mDstImgs[index].bufferType = getBufferType(usage);
     mDstImgs[index].format = format;
 
@@ -954,6 +1200,9 @@ int32_t ExynosMPP::setOutBuf(buffer_handle_t outbuf, int32_t fence, ExynosDispla
  * @return int32_t
  */
 int32_t ExynosMPP::freeOutBuf(struct exynos_mpp_img_info dst) {
+    /* The buffer can be handed to other MPPs by the pool */
+    if (dst.bufferHandle == mPrevComposedBuf)
+        mPrevComposedBuf = NULL;
     mResourceManageThread->addFreedBuffer(dst);
     dst.bufferHandle = NULL;
     return NO_ERROR;
@@ -1126,6 +1375,340 @@ bool ExynosMPP::canUsePrevFrame()
     return true;
 }
 
+static inline bool isEmptyRect(const hwc_rect_t &rect)
+{
+    return ((rect.left >= rect.right) || (rect.top >= rect.bottom));
+}
+
+static inline hwc_rect_t getImageRect(const exynos_image &img)
+{
+    hwc_rect_t rect = {(int)img.x, (int)img.y, (int)(img.x + img.w), (int)(img.y + img.h)};
+    return rect;
+}
+
+/* Union of two rects that ignores an empty rect */
+static inline hwc_rect_t unionRect(const hwc_rect_t &r1, const hwc_rect_t &r2)
+{
+    if (isEmptyRect(r1))
+        return r2;
+    if (isEmptyRect(r2))
+        return r1;
+    return expand(r1, r2);
+}
+
+/*
+ * A source can be cropped to a part of its destination without resampling
+ * artifacts only if it is copied pixel by pixel.
+ */
+static inline bool isCroppableSource(const exynos_image &src, const exynos_image &dst)
+{
+    if (src.layerFlags & EXYNOS_HWC_DIM_LAYER)
+        return true;
+    return ((src.transform == 0) && (src.w == dst.w) && (src.h == dst.h) &&
+            isFormatRgb(src.format) && !src.compressed);
+}
+
+/**
+ * Region of the destination that should be recomposed for the source
+ * at index because it is changed from the previous frame.
+ * @return false if the source is not changed
+ */
+bool ExynosMPP::getSourceDamage(uint32_t index, hwc_rect_t &damage)
+{
+    exynos_image &src = mAssignedSources[index]->mSrcImg;
+    exynos_image &dst = mAssignedSources[index]->mMidImg;
+    exynos_image &prevSrc = mPrevFrameInfo.srcInfo[index];
+    exynos_image &prevDst = mPrevFrameInfo.dstInfo[index];
+    hwc_rect_t dstRect = getImageRect(dst);
+
+    /* Both of the previous and current area are changed if the source is moved or changed */
+    if ((prevSrc.x != src.x) || (prevSrc.y != src.y) ||
+        (prevSrc.w != src.w) || (prevSrc.h != src.h) ||
+        (prevSrc.format != src.format) ||
+        (prevSrc.usageFlags != src.usageFlags) ||
+        (prevSrc.dataSpace != src.dataSpace) ||
+        (prevSrc.blending != src.blending) ||
+        (prevSrc.transform != src.transform) ||
+        (prevSrc.compressed != src.compressed) ||
+        (prevSrc.planeAlpha != src.planeAlpha) ||
+        (prevSrc.layerFlags != src.layerFlags) ||
+        (prevSrc.zOrder != src.zOrder) ||
+        (prevSrc.color.r != src.color.r) || (prevSrc.color.g != src.color.g) ||
+        (prevSrc.color.b != src.color.b) || (prevSrc.color.a != src.color.a) ||
+        (prevDst.x != dst.x) || (prevDst.y != dst.y) ||
+        (prevDst.w != dst.w) || (prevDst.h != dst.h) ||
+        (prevDst.format != dst.format)) {
+        damage = unionRect(getImageRect(prevDst), dstRect);
+        return true;
+    }
+
+    if (prevSrc.bufferHandle == src.bufferHandle) {
+        memset(&damage, 0, sizeof(damage));
+        return false;
+    }
+
+    damage = dstRect;
+    if ((mAssignedSources[index]->mSourceType != MPP_SOURCE_LAYER) ||
+        !isCroppableSource(src, dst))
+        return true;
+
+    /* Surface damage is given in the buffer coordinates */
+    ExynosLayer *layer = (ExynosLayer *)mAssignedSources[index];
+    if ((layer->mDamageNum == 0) || (layer->mDamageRects.size() == 0))
+        return true;
+
+    if ((layer->mDamageNum == 1) &&
+        (layer->mDamageRects[0].left == 0) && (layer->mDamageRects[0].top == 0) &&
+        (layer->mDamageRects[0].right == 0) && (layer->mDamageRects[0].bottom == 0)) {
+        memset(&damage, 0, sizeof(damage));
+        return false;
+    }
+
+    int dx = (int)dst.x - (int)src.x;
+    int dy = (int)dst.y - (int)src.y;
+    hwc_rect_t damaged;
+    memset(&damaged, 0, sizeof(damaged));
+    for (size_t i = 0; i < layer->mDamageRects.size(); i++) {
+        hwc_rect_t rect = layer->mDamageRects[i];
+        rect.left += dx;
+        rect.right += dx;
+        rect.top += dy;
+        rect.bottom += dy;
+        damaged = unionRect(damaged, intersection(rect, dstRect));
+    }
+    damage = damaged;
+
+    return !isEmptyRect(damage);
+}
+
+/**
+ * Incremental composition recomposes only the changed region of the frame.
+ * The previous destination buffer is copied to the current one and the
+ * sources in the changed region are composed on it again.
+ * mPartialRect and mPartialSources are valid if it returns true.
+ */
+bool ExynosMPP::canComposePartially()
+{
+    if (exynosHWCControl.skipM2mProcessing == false)
+        return false;
+
+    if ((mPhysicalType != MPP_G2D) || (mMaxSrcLayerNum <= 1) ||
+        (mAllocOutBufFlag == false) || mNeedCompressedTarget)
+        return false;
+
+    if ((mAssignedDisplay == NULL) || (mAssignedDisplay->mType == HWC_DISPLAY_VIRTUAL) ||
+        (mPrevAssignedDisplayType != (int32_t)mAssignedDisplay->mType) ||
+        (mPrevComposedColorMode != mAssignedDisplay->mColorMode))
+        return false;
+
+    size_t sourceNum = mAssignedSources.size();
+    if ((sourceNum == 0) || (mPrevFrameInfo.srcNum != sourceNum))
+        return false;
+
+    int32_t prevDstIndex = (mCurrentDstBuf + NUM_MPP_DST_BUFS(mLogicalType) - 1) % NUM_MPP_DST_BUFS(mLogicalType);
+    exynos_mpp_img_info &prevDst = mDstImgs[prevDstIndex];
+    if ((prevDst.bufferHandle == NULL) || (prevDst.bufferHandle != mPrevComposedBuf) ||
+        (prevDst.bufferHandle == mDstImgs[mCurrentDstBuf].bufferHandle) ||
+        (prevDst.format != mDstImgs[mCurrentDstBuf].format) ||
+        !isFormatRgb(prevDst.format))
+        return false;
+
+    hwc_rect_t canvas = {0, 0, (int)mAssignedDisplay->mXres, (int)mAssignedDisplay->mYres};
+    hwc_rect_t partialRect;
+    memset(&partialRect, 0, sizeof(partialRect));
+    for (uint32_t i = 0; i < sourceNum; i++) {
+        if (getDrmMode(mAssignedSources[i]->mSrcImg.usageFlags) != NO_DRM)
+            return false;
+        hwc_rect_t damage;
+        if (getSourceDamage(i, damage))
+            partialRect = unionRect(partialRect, damage);
+    }
+    partialRect = intersection(partialRect, canvas);
+
+    /* Nothing is changed but the buffers. Let it be composed as before. */
+    if (isEmptyRect(partialRect))
+        return false;
+
+    /* Sources that can not be cropped are recomposed entirely */
+    bool expanded = true;
+    while (expanded) {
+        expanded = false;
+        for (uint32_t i = 0; i < sourceNum; i++) {
+            hwc_rect_t dstRect = intersection(getImageRect(mAssignedSources[i]->mMidImg), canvas);
+            if (isEmptyRect(intersection(dstRect, partialRect)) ||
+                isCroppableSource(mAssignedSources[i]->mSrcImg, mAssignedSources[i]->mMidImg))
+                continue;
+            hwc_rect_t rect = unionRect(partialRect, dstRect);
+            if (memcmp(&rect, &partialRect, sizeof(rect))) {
+                partialRect = rect;
+                expanded = true;
+            }
+        }
+    }
+
+    uint64_t partialArea = (uint64_t)WIDTH(partialRect) * HEIGHT(partialRect);
+    uint64_t canvasArea = (uint64_t)WIDTH(canvas) * HEIGHT(canvas);
+    if (partialArea > canvasArea * MPP_PARTIAL_COMPOSITION_MAX_RATIO)
+        return false;
+
+    uint32_t layerNum = MPP_PARTIAL_LAYER_MAX;
+    for (uint32_t i = 0; i < sourceNum; i++) {
+        mPartialSources[i] = !isEmptyRect(intersection(getImageRect(mAssignedSources[i]->mMidImg), partialRect));
+        if (mPartialSources[i])
+            layerNum++;
+    }
+    if (layerNum > mMaxSrcLayerNum)
+        return false;
+
+    mPartialRect = partialRect;
+    mPartialLayerNum = layerNum;
+
+    MPP_LOGD(eDebugMPP, "partial composition [%d, %d, %d, %d], layers(%d)",
+            mPartialRect.left, mPartialRect.top, mPartialRect.right, mPartialRect.bottom,
+            mPartialLayerNum);
+
+    return true;
+}
+
+void ExynosMPP::deletePartialLayers()
+{
+    for (uint32_t i = 0; i < MPP_PARTIAL_LAYER_MAX; i++) {
+        if (mPartialImgs[i].mppLayer != NULL) {
+            delete mPartialImgs[i].mppLayer;
+            mPartialImgs[i].mppLayer = NULL;
+        }
+    }
+}
+
+/*
+ * The copy of the previous destination buffer is read by the same compositor
+ * that has written it, so it does not wait for the acquire fence of it.
+ */
+int32_t ExynosMPP::setupPartialLayers()
+{
+    int ret = NO_ERROR;
+    size_t sourceNum = mAssignedSources.size();
+    int32_t prevDstIndex = (mCurrentDstBuf + NUM_MPP_DST_BUFS(mLogicalType) - 1) % NUM_MPP_DST_BUFS(mLogicalType);
+    exynos_mpp_img_info &prevDst = mDstImgs[prevDstIndex];
+
+    exynos_image copyImg;
+    copyImg.fullWidth = prevDst.bufferHandle->stride;
+    copyImg.fullHeight = prevDst.bufferHandle->vstride;
+    copyImg.x = 0;
+    copyImg.y = 0;
+    copyImg.w = mAssignedDisplay->mXres;
+    copyImg.h = mAssignedDisplay->mYres;
+    copyImg.color.r = copyImg.color.g = copyImg.color.b = copyImg.color.a = 0;
+    copyImg.format = prevDst.format;
+    copyImg.usageFlags = 0;
+    copyImg.layerFlags = 0;
+    copyImg.bufferHandle = prevDst.bufferHandle;
+    copyImg.dataSpace = prevDst.dataspace;
+    copyImg.blending = HWC2_BLEND_MODE_NONE;
+    copyImg.transform = 0;
+    copyImg.compressed = 0;
+    copyImg.planeAlpha = 1.0f;
+    copyImg.zOrder = MPP_PARTIAL_COPY_LAYER;
+    if ((ret = setupLayer(&mPartialImgs[MPP_PARTIAL_COPY_LAYER], copyImg, copyImg)) != NO_ERROR) {
+        MPP_LOGE("%s:: fail to setup copy layer, ret %d", __func__, ret);
+        return ret;
+    }
+
+    exynos_image clearImg = copyImg;
+    clearImg.x = mPartialRect.left;
+    clearImg.y = mPartialRect.top;
+    clearImg.w = WIDTH(mPartialRect);
+    clearImg.h = HEIGHT(mPartialRect);
+    clearImg.layerFlags = EXYNOS_HWC_DIM_LAYER;
+    clearImg.bufferHandle = NULL;
+    clearImg.zOrder = MPP_PARTIAL_CLEAR_LAYER;
+    if ((ret = setupLayer(&mPartialImgs[MPP_PARTIAL_CLEAR_LAYER], clearImg, clearImg)) != NO_ERROR) {
+        MPP_LOGE("%s:: fail to setup clear layer, ret %d", __func__, ret);
+        return ret;
+    }
+
+    for (size_t i = 0; i < sourceNum; i++) {
+        if (mPartialSources[i] == false) {
+            mAssignedSources[i]->mSrcImg.acquireFenceFd =
+                fence_close(mAssignedSources[i]->mSrcImg.acquireFenceFd,
+                        mAssignedDisplay, FENCE_TYPE_SRC_ACQUIRE, FENCE_IP_G2D);
+            if (mSrcImgs[i].mppLayer != NULL) {
+                delete mSrcImgs[i].mppLayer;
+                mSrcImgs[i].mppLayer = NULL;
+            }
+            continue;
+        }
+
+        exynos_image src = mAssignedSources[i]->mSrcImg;
+        exynos_image dst = mAssignedSources[i]->mMidImg;
+        hwc_rect_t rect = intersection(getImageRect(dst), mPartialRect);
+        src.x += rect.left - (int)dst.x;
+        src.y += rect.top - (int)dst.y;
+        src.w = WIDTH(rect);
+        src.h = HEIGHT(rect);
+        dst.x = rect.left;
+        dst.y = rect.top;
+        dst.w = WIDTH(rect);
+        dst.h = HEIGHT(rect);
+        src.zOrder += MPP_PARTIAL_LAYER_MAX;
+
+        MPP_LOGD(eDebugMPP|eDebugFence, "Setup [%zu] partial source: %p", i, mAssignedSources[i]);
+        if ((ret = setupLayer(&mSrcImgs[i], src, dst)) != NO_ERROR) {
+            MPP_LOGE("%s:: fail to setupLayer[%zu], ret %d",
+                    __func__, i, ret);
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * Fences of partial composition are given in the order of
+ * [copy layer, clear layer, composed sources..., dst] because libacryl sorts
+ * the layers by z-order before execution and setupPartialLayers() places the
+ * copy and the clear layers at z-order MPP_PARTIAL_COPY_LAYER and
+ * MPP_PARTIAL_CLEAR_LAYER under the sources shifted by MPP_PARTIAL_LAYER_MAX.
+ * They are moved to the order of full composition, [sources..., dst].
+ * The fences array should have room for both of them.
+ */
+void ExynosMPP::remapPartialFences(int *fences)
+{
+    size_t sourceNum = mAssignedSources.size();
+    int dstFence = fences[mPartialLayerNum];
+    std::vector<int> composedFences(fences + MPP_PARTIAL_LAYER_MAX, fences + mPartialLayerNum);
+    uint32_t composedNum = 0;
+
+    for (uint32_t i = 0; i < MPP_PARTIAL_LAYER_MAX; i++)
+        fences[i] = fence_close(fences[i], mAssignedDisplay,
+                FENCE_TYPE_SRC_RELEASE, FENCE_IP_G2D);
+
+    for (size_t i = 0; i < sourceNum; i++) {
+        if (mPartialSources[i])
+            fences[i] = composedFences[composedNum++];
+        else
+            fences[i] = -1;
+    }
+    fences[sourceNum] = dstFence;
+}
+
+void ExynosMPP::updateComposedPixels()
+{
+    if ((mMaxSrcLayerNum <= 1) || (mAssignedDisplay == NULL))
+        return;
+
+    uint64_t canvasPixels = (uint64_t)mAssignedDisplay->mXres * mAssignedDisplay->mYres;
+    if (mPartialComposition) {
+        mLastComposedPixels = (uint64_t)WIDTH(mPartialRect) * HEIGHT(mPartialRect);
+        mPartialComposedFrames++;
+    } else {
+        mLastComposedPixels = canvasPixels;
+    }
+    mComposedFrames++;
+    mTotalComposedPixels += mLastComposedPixels;
+    mTotalCanvasPixels += canvasPixels;
+}
+
 int32_t ExynosMPP::setupLayer(exynos_mpp_img_info *srcImgInfo, struct exynos_image &src, struct exynos_image &dst)
 {
     int ret = NO_ERROR;
@@ -1404,13 +1987,21 @@ int32_t ExynosMPP::doPostProcessingInternal()
         return -EINVAL;
     }
 
+    bool samplePerf = finishPerfModelSample() && !mPartialComposition && canSamplePerfModel();
+
     /* setup source layers */
-    for(size_t i = 0; i < sourceNum; i++) {
-        MPP_LOGD(eDebugMPP|eDebugFence, "Setup [%zu] source: %p", i, mAssignedSources[i]);
-        if ((ret = setupLayer(&mSrcImgs[i], mAssignedSources[i]->mSrcImg, mAssignedSources[i]->mMidImg)) != NO_ERROR) {
-            MPP_LOGE("%s:: fail to setupLayer[%zu], ret %d",
-                    __func__, i, ret);
+    if (mPartialComposition) {
+        if ((ret = setupPartialLayers()) != NO_ERROR)
             return ret;
+    } else {
+        deletePartialLayers();
+        for(size_t i = 0; i < sourceNum; i++) {
+            MPP_LOGD(eDebugMPP|eDebugFence, "Setup [%zu] source: %p", i, mAssignedSources[i]);
+            if ((ret = setupLayer(&mSrcImgs[i], mAssignedSources[i]->mSrcImg, mAssignedSources[i]->mMidImg)) != NO_ERROR) {
+                MPP_LOGE("%s:: fail to setupLayer[%zu], ret %d",
+                        __func__, i, ret);
+                return ret;
+            }
         }
     }
     if (mPrevFrameInfo.srcNum > sourceNum) {
@@ -1426,9 +2017,10 @@ int32_t ExynosMPP::doPostProcessingInternal()
         }
     }
 
-    if (mAcrylicHandle->layerCount() != mAssignedSources.size()) {
-        MPP_LOGE("Different layer number, acrylic layers(%d), assigned size(%zu)",
-                mAcrylicHandle->layerCount(), mAssignedSources.size());
+    size_t layerNum = mPartialComposition ? mPartialLayerNum : sourceNum;
+    if (mAcrylicHandle->layerCount() != layerNum) {
+        MPP_LOGE("Different layer number, acrylic layers(%d), assigned size(%zu), partial(%d)",
+                mAcrylicHandle->layerCount(), mAssignedSources.size(), mPartialComposition);
         return -EINVAL;
     }
     MPP_LOGD(eDebugFence, "setupDst ++ mDstImgs[%d] acrylicReleaseFenceFd(%d)",
@@ -1445,10 +2037,11 @@ int32_t ExynosMPP::doPostProcessingInternal()
 
 #ifndef DISABLE_FENCE
     if (mUseM2MSrcFence)
-        usingFenceCnt = sourceNum + 1; // Get and Use src + dst fence
+        usingFenceCnt = layerNum + 1;  // Get and Use src + dst fence
     else
         usingFenceCnt = 1;             // Get and Use only dst fence
-    int *outFences = new int[usingFenceCnt];
+    /* Partial composition has its own layers that are remapped to the sources */
+    int *outFences = new int[max(layerNum, sourceNum) + 1];
     int dstBufIdx = usingFenceCnt - 1;
 #else
     usingFenceCnt = 0;                 // Get and Use no fences
@@ -1456,6 +2049,7 @@ int32_t ExynosMPP::doPostProcessingInternal()
     int *outFences = NULL;
 #endif
 
+    nsecs_t submitTime = systemTime(SYSTEM_TIME_MONOTONIC);
     {
         ATRACE_CALL();
         acrylicReturn = mAcrylicHandle->execute(outFences, usingFenceCnt);
@@ -1503,6 +2097,16 @@ int32_t ExynosMPP::doPostProcessingInternal()
         mDstImgs[mCurrentDstBuf].acrylicAcquireFenceFd = -1;
         ret = -EPERM;
     } else {
+        if (mPartialComposition) {
+            if (usingFenceCnt > 1) {
+                remapPartialFences(outFences);
+                usingFenceCnt = sourceNum + 1;
+                dstBufIdx = usingFenceCnt - 1;
+            }
+        } else if (samplePerf && (usingFenceCnt > 0)) {
+            startPerfModelSample(outFences[dstBufIdx], submitTime);
+        }
+        updateComposedPixels();
 
         // set fence informations from acryl
         if (mPhysicalType == MPP_G2D) {
@@ -1706,6 +2310,8 @@ int32_t ExynosMPP::doPostProcessing(struct exynos_image &src, struct exynos_imag
         goto save_frame_info;
     }
 
+    mPartialComposition = (realloc == false) && canComposePartially();
+
     /* G2D or sclaer case */
     if ((ret = doPostProcessingInternal()) < 0) {
         MPP_LOGE("%s:: fail to post processing, ret %d",
@@ -1715,6 +2321,12 @@ int32_t ExynosMPP::doPostProcessing(struct exynos_image &src, struct exynos_imag
 
 save_frame_info:
     /* Save current frame information for next frame*/
+    if ((ret == NO_ERROR) && mAllocOutBufFlag) {
+        mPrevComposedBuf = mDstImgs[mCurrentDstBuf].bufferHandle;
+        mPrevComposedColorMode = mAssignedDisplay->mColorMode;
+    } else {
+        mPrevComposedBuf = NULL;
+    }
     mPrevAssignedDisplayType = mAssignedDisplay->mType;
     mPrevFrameInfo.srcNum = (uint32_t)mAssignedSources.size();
     for (uint32_t i = 0; i < mPrevFrameInfo.srcNum; i++) {
@@ -1906,6 +2518,10 @@ int32_t ExynosMPP::requestHWStateChange(uint32_t state)
                     MPP_LOGD(eDebugMPP|eDebugFence|eDebugBuf, "free outbuf[%d] %p",
                             i, freeDstBuf.bufferHandle);
                     if (freeDstBuf.bufferHandle != NULL && mAllocOutBufFlag) {
+                        /* The buffer can be reused by other MPPs after display releases it */
+                        freeDstBuf.acrylicReleaseFenceFd =
+                            hwc_dup(mDstImgs[i].acrylicReleaseFenceFd, mAssignedDisplay,
+                                    FENCE_TYPE_DST_RELEASE, FENCE_IP_ALL, true);
                         freeOutBuf(freeDstBuf);
                     }
                 } else {
@@ -1922,7 +2538,9 @@ int32_t ExynosMPP::requestHWStateChange(uint32_t state)
                 mSrcImgs[i].mppLayer = NULL;
             }
         }
+        deletePartialLayers();
         memset(&mPrevFrameInfo, 0, sizeof(mPrevFrameInfo));
+        mPrevComposedBuf = NULL;
         for (int i = 0; i < NUM_MPP_SRC_BUFS; i++) {
             mPrevFrameInfo.srcInfo[i].acquireFenceFd = -1;
             mPrevFrameInfo.srcInfo[i].releaseFenceFd = -1;
@@ -1990,34 +2608,104 @@ int32_t ExynosMPP::setupRestriction() {
         }
     }
 
+    buildRestrictionSnapshot();
+
     return NO_ERROR;
 }
 
-int64_t ExynosMPP::isSupported(ExynosDisplay &display, struct exynos_image &src, struct exynos_image &dst)
+/*
+ * Resolve the non-virtual restriction getters once for every
+ * (format class, transform, compression) combination so that
+ * isSupported() doesn't look up the format table per getter.
+ * Getters that can be overridden by ExynosMPPModule are still
+ * called by isSupported() directly.
+ */
+void ExynosMPP::buildRestrictionSnapshot()
+{
+    const uint32_t classFormat[RESTRICTION_FORMAT_MAX] = {
+        HAL_PIXEL_FORMAT_RGBA_8888,
+        HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN,
+        HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_S10B
+    };
+
+    for (uint32_t i = 0; i < RESTRICTION_FORMAT_MAX; i++) {
+        /* Restriction getters refer only format, transform and compressed */
+        exynos_image img;
+        img.format = classFormat[i];
+
+        for (uint32_t rot = 0; rot < RESTRICTION_ROT_MAX; rot++) {
+            restriction_src_snapshot_t &srcSnapshot = mSrcRestrictionSnapshot[i][rot];
+            img.transform = rot ? HAL_TRANSFORM_ROT_90 : 0;
+            img.compressed = 0;
+            srcSnapshot.maxWidth = getSrcMaxWidth(img);
+            srcSnapshot.maxHeight = getSrcMaxHeight(img);
+            srcSnapshot.minWidth = getSrcMinWidth(img);
+            srcSnapshot.minHeight = getSrcMinHeight(img);
+            srcSnapshot.widthAlign = getSrcWidthAlign(img);
+            srcSnapshot.heightAlign = getSrcHeightAlign(img);
+            srcSnapshot.maxCropWidth = getSrcMaxCropWidth(img);
+            srcSnapshot.maxCropHeight = getSrcMaxCropHeight(img);
+            srcSnapshot.minCropWidth = getSrcMinCropWidth(img);
+            srcSnapshot.minCropHeight = getSrcMinCropHeight(img);
+            srcSnapshot.cropWidthAlign = getSrcCropWidthAlign(img);
+            srcSnapshot.cropHeightAlign = getSrcCropHeightAlign(img);
+            srcSnapshot.yOffsetAlign = getSrcYOffsetAlign(img);
+        }
+
+        for (uint32_t comp = 0; comp < RESTRICTION_COMPRESSION_MAX; comp++) {
+            restriction_dst_snapshot_t &dstSnapshot = mDstRestrictionSnapshot[i][comp];
+            img.transform = 0;
+            img.compressed = comp;
+            dstSnapshot.maxWidth = getDstMaxWidth(img);
+            dstSnapshot.maxHeight = getDstMaxHeight(img);
+            dstSnapshot.minWidth = getDstMinWidth(img);
+            dstSnapshot.minHeight = getDstMinHeight(img);
+            dstSnapshot.heightAlign = getDstHeightAlign(img);
+        }
+    }
+}
+
+uint32_t ExynosMPP::getRestrictionFormatClass(uint32_t format)
 {
-    uint32_t maxSrcWidth = getSrcMaxWidth(src);
-    uint32_t maxSrcHeight = getSrcMaxHeight(src);
-    uint32_t minSrcWidth = getSrcMinWidth(src);
-    uint32_t minSrcHeight = getSrcMinHeight(src);
-    uint32_t srcWidthAlign = getSrcWidthAlign(src);
-    uint32_t srcHeightAlign = getSrcHeightAlign(src);
+    if ((format == HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_S10B) ||
+        (format == HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_S10B))
+        return RESTRICTION_FORMAT_YUV_S10B;
 
-    uint32_t maxSrcCropWidth = getSrcMaxCropWidth(src);
-    uint32_t maxSrcCropHeight = getSrcMaxCropHeight(src);
+    return isFormatRgb(format) ? RESTRICTION_FORMAT_RGB : RESTRICTION_FORMAT_YUV;
+}
+
+int64_t ExynosMPP::isSupported(ExynosDisplay &display, struct exynos_image &src, struct exynos_image &dst)
+{
+    const restriction_src_snapshot_t &srcRestriction =
+        mSrcRestrictionSnapshot[getRestrictionFormatClass(src.format)]
+                               [!!(src.transform & HAL_TRANSFORM_ROT_90)];
+    const restriction_dst_snapshot_t &dstRestriction =
+        mDstRestrictionSnapshot[getRestrictionFormatClass(dst.format)]
+                               [(dst.compressed == 1) ? 1 : 0];
+
+    uint32_t maxSrcWidth = srcRestriction.maxWidth;
+    uint32_t maxSrcHeight = srcRestriction.maxHeight;
+    uint32_t minSrcWidth = srcRestriction.minWidth;
+    uint32_t minSrcHeight = srcRestriction.minHeight;
+    uint32_t srcWidthAlign = srcRestriction.widthAlign;
+    uint32_t srcHeightAlign = srcRestriction.heightAlign;
+
+    uint32_t maxSrcCropWidth = srcRestriction.maxCropWidth;
+    uint32_t maxSrcCropHeight = srcRestriction.maxCropHeight;
     uint32_t maxSrcCropSize = getSrcMaxCropSize(src);
-    uint32_t minSrcCropWidth = getSrcMinCropWidth(src);
-    uint32_t minSrcCropHeight = getSrcMinCropHeight(src);
-    uint32_t srcCropWidthAlign = getSrcCropWidthAlign(src);
-    uint32_t srcCropHeightAlign = getSrcCropHeightAlign(src);
+    uint32_t minSrcCropWidth = srcRestriction.minCropWidth;
+    uint32_t minSrcCropHeight = srcRestriction.minCropHeight;
+    uint32_t srcCropWidthAlign = srcRestriction.cropWidthAlign;
+    uint32_t srcCropHeightAlign = srcRestriction.cropHeightAlign;
     uint32_t srcXOffsetAlign = getSrcXOffsetAlign(src);
-    uint32_t srcYOffsetAlign = getSrcYOffsetAlign(src);
+    uint32_t srcYOffsetAlign = srcRestriction.yOffsetAlign;
 
-    uint32_t maxDstWidth = getDstMaxWidth(dst);
-    uint32_t maxDstHeight = getDstMaxHeight(dst);
-    uint32_t minDstWidth = getDstMinWidth(dst);
-    uint32_t minDstHeight = getDstMinHeight(dst);
+    uint32_t maxDstWidth = dstRestriction.maxWidth;
+    uint32_t maxDstHeight = dstRestriction.maxHeight;
+    uint32_t minDstWidth = dstRestriction.minWidth;
+    uint32_t minDstHeight = dstRestriction.minHeight;
     uint32_t dstWidthAlign = getDstWidthAlign(dst);
-    uint32_t dstHeightAlign = getDstHeightAlign(dst);
+    uint32_t dstHeightAlign = dstRestriction.heightAlign;
 
     uint32_t maxDownscale = getMaxDownscale(display, src, dst);
     uint32_t maxUpscale = getMaxUpscale(src, dst);
@@ -2319,9 +3007,11 @@ bool ExynosMPP::hasEnoughCapa(ExynosDisplay *display, struct exynos_image &src,
         totalUsedCapacity -= mPreAssignedCapacity;
 
     float requiredCapacity = getRequiredCapacity(display, src, dst);
+    float correction = getPerfModelCorrection(src, dst);
+    requiredCapacity *= correction;
 
-    MPP_LOGD(eDebugCapacity|eDebugMPP, "mCapacity(%f), usedCapacity(%f), RequiredCapacity(%f)",
-            mCapacity, totalUsedCapacity, requiredCapacity);
+    MPP_LOGD(eDebugCapacity|eDebugMPP, "mCapacity(%f), usedCapacity(%f), RequiredCapacity(%f), correction(%f)",
+            mCapacity, totalUsedCapacity, requiredCapacity, correction);
 
     if (mCapacity >= (totalUsedCapacity + requiredCapacity))
         return true;
@@ -2605,6 +3295,154 @@ float ExynosMPP::getRequiredBaseCycles(struct exynos_image &src, struct exynos_i
     return maxResolution/(float)getPPC(src, dst, src);
 }
 
+/*
+ * src and dst are the source that is likely to be added to mAssignedSources.
+ * They are NULL to get the entry of the assigned sources.
+ */
+perf_model_entry_t& ExynosMPP::getPerfModelEntry(struct exynos_image *src, struct exynos_image *dst)
+{
+    uint32_t layerNum = mAssignedSources.size();
+    uint32_t maxResolution = 0;
+
+    if ((src != NULL) && (dst != NULL)) {
+        maxResolution = max(src->w * src->h, dst->w * dst->h);
+        layerNum++;
+    }
+
+    for (uint32_t i = 0; i < mAssignedSources.size(); i++) {
+        exynos_image &srcImg = mAssignedSources[i]->mSrcImg;
+        exynos_image &midImg = mAssignedSources[i]->mMidImg;
+        uint32_t resolution = max(srcImg.w * srcImg.h, midImg.w * midImg.h);
+        if ((src == NULL) || (resolution > maxResolution)) {
+            src = &srcImg;
+            dst = &midImg;
+            maxResolution = resolution;
+        }
+    }
+
+    uint32_t formatIndex = 0;
+    uint32_t rotIndex = 0;
+    uint32_t scaleIndex = 0;
+    getPPCIndex(*src, *dst, formatIndex, rotIndex, scaleIndex, *src);
+
+    uint32_t layerIndex = min(max(layerNum, 1U), (uint32_t)MPP_PERF_MODEL_LAYER_MAX) - 1;
+    return mPerfModel[formatIndex][rotIndex][scaleIndex][layerIndex];
+}
+
+/* The learned ratio is trusted gradually as samples are collected */
+float ExynosMPP::getPerfModelCorrection(struct exynos_image &src, struct exynos_image &dst)
+{
+    if ((mPhysicalType != MPP_G2D) && (mPhysicalType != MPP_MSC))
+        return 1.0f;
+
+    perf_model_entry_t &entry = getPerfModelEntry(&src, &dst);
+    if (entry.samples == 0)
+        return 1.0f;
+
+    float weight = (float)min(entry.samples, (uint32_t)MPP_PERF_MODEL_FULL_SAMPLES) /
+        MPP_PERF_MODEL_FULL_SAMPLES;
+    return 1.0f + (entry.ratio - 1.0f) * weight;
+}
+
+/*
+ * G2D runs the job without blocking, so the lap time reported by the driver
+ * is not the one of the job just submitted. The lap time is measured from
+ * the submission to the signal of the destination fence instead. It is
+ * sampled only if the job is not delayed by the acquire fences of the
+ * sources, the release fence of the destination, the previous job or the
+ * jobs of the other logical MPPs that share the HW in this frame.
+ */
+bool ExynosMPP::canSamplePerfModel()
+{
+    if ((mCapacity == -1) || (mAcrylicHandle == NULL) ||
+        (mAssignedSources.size() == 0) || (mUsedCapacity <= 0))
+        return false;
+
+    /* Capacity of HDR, DRM layers and virtual display is not calculated */
+    if ((mAssignedDisplay == NULL) || (mAssignedDisplay->mType == HWC_DISPLAY_VIRTUAL))
+        return false;
+    for (uint32_t i = 0; i < mAssignedSources.size(); i++) {
+        if (hasHdrInfo(mAssignedSources[i]->mSrcImg) ||
+            (getDrmMode(mAssignedSources[i]->mSrcImg.usageFlags) != NO_DRM))
+            return false;
+        int fence = mAssignedSources[i]->mSrcImg.acquireFenceFd;
+        if (fence_valid(fence) && (sync_wait(fence, 0) != 0))
+            return false;
+    }
+
+    int fence = mDstImgs[mCurrentDstBuf].acrylicReleaseFenceFd;
+    if (fence_valid(fence) && (sync_wait(fence, 0) != 0))
+        return false;
+
+    /* The job would be queued behind the jobs of the other logical MPPs of the same HW */
+    if (ExynosResourceManager::getResourceUsedCapa(*this) != mUsedCapacity)
+        return false;
+
+    return true;
+}
+
+void ExynosMPP::startPerfModelSample(int fence, nsecs_t submitTime)
+{
+    if (!fence_valid(fence))
+        return;
+
+    mPerfSample.fence = dup(fence);
+    if (mPerfSample.fence < 0)
+        return;
+    mPerfSample.entry = &getPerfModelEntry(NULL, NULL);
+    mPerfSample.capacity = mUsedCapacity;
+    mPerfSample.submitTime = submitTime;
+}
+
+/*
+ * Called before the next job is submitted.
+ * Returns false if the previous job is still running.
+ */
+bool ExynosMPP::finishPerfModelSample()
+{
+    if (mPerfSample.fence < 0)
+        return true;
+
+    nsecs_t signalTime = 0;
+    struct sync_file_info *info = sync_file_info(mPerfSample.fence);
+    if (info != NULL) {
+        if (info->status == 1) {
+            struct sync_fence_info *fences = sync_get_fence_info(info);
+            for (uint32_t i = 0; i < info->num_fences; i++)
+                signalTime = max(signalTime, (nsecs_t)fences[i].timestamp_ns);
+        }
+        sync_file_info_free(info);
+    }
+
+    close(mPerfSample.fence);
+    mPerfSample.fence = -1;
+
+    /* Not signaled yet: the next job would be queued behind it */
+    if (signalTime == 0)
+        return false;
+    if (signalTime <= mPerfSample.submitTime)
+        return true;
+
+    perf_model_entry_t &entry = *mPerfSample.entry;
+    nsecs_t laptime = signalTime - mPerfSample.submitTime;
+
+    /* Capacity is the time in msec */
+    float ratio = ((float)laptime / 1000000) / mPerfSample.capacity;
+    ratio = max(MPP_PERF_MODEL_RATIO_MIN, min(ratio, MPP_PERF_MODEL_RATIO_MAX));
+
+    if (entry.samples == 0)
+        entry.ratio = ratio;
+    else
+        entry.ratio += (ratio - entry.ratio) * MPP_PERF_MODEL_EWMA_WEIGHT;
+    if (entry.samples < UINT32_MAX)
+        entry.samples++;
+
+    MPP_LOGD(eDebugCapacity, "laptime: %" PRId64 " us, capacity: %f, ratio: %f, learned ratio: %f, samples: %d",
+            laptime / 1000, mPerfSample.capacity, ratio, entry.ratio, entry.samples);
+
+    return true;
+}
+
 bool ExynosMPP::addCapacity(ExynosMPPSource* mppSource)
 {
     if ((mppSource == NULL) || mCapacity == -1)
@@ -2809,6 +3647,7 @@ uint32_t ExynosMPP::increaseDstBuffIndex()
 void ExynosMPP::reloadResourceForHWFC()
 {
     ALOGI("reloadResourceForHWFC()");
+    deletePartialLayers();
     if (mAcrylicHandle != NULL)
         delete mAcrylicHandle;
     mAcrylicHandle = AcrylicFactory::createAcrylic("default_compositor");
@@ -2859,6 +3698,26 @@ void ExynosMPP::dump(String8& result)
             mPrevAssignedState, mPrevAssignedDisplayType, mReservedDisplay);
     result.appendFormat("\tassinedSourceNum(%zu), Capacity(%f), CapaUsed(%f), mCurrentDstBuf(%d)\n",
             mAssignedSources.size(), mCapacity, mUsedCapacity, mCurrentDstBuf);
+    if (mComposedFrames > 0) {
+        result.appendFormat("\tcomposed frames(%" PRIu64 "), partial(%" PRIu64 "), last pixels(%" PRIu64 "), "
+                "total pixels(%" PRIu64 "/%" PRIu64 ")\n",
+                mComposedFrames, mPartialComposedFrames, mLastComposedPixels,
+                mTotalComposedPixels, mTotalCanvasPixels);
+    }
+
+    for (uint32_t format = 0; format < PPC_FORMAT_FORMAT_MAX; format++) {
+        for (uint32_t rot = 0; rot < PPC_ROT_MAX; rot++) {
+            for (uint32_t scale = 0; scale < PPC_SCALE_MAX; scale++) {
+                for (uint32_t layer = 0; layer < MPP_PERF_MODEL_LAYER_MAX; layer++) {
+                    perf_model_entry_t &entry = mPerfModel[format][rot][scale][layer];
+                    if (entry.samples == 0)
+                        continue;
+                    result.appendFormat("\tperf model format(%d), rot(%d), scale(%d), layers(%d): ratio(%f), samples(%d)\n",
+                            format, rot, scale, layer + 1, entry.ratio, entry.samples);
+                }
+            }
+        }
+    }
 
 }
 
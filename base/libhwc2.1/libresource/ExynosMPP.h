@@ -139,6 +139,31 @@ class Allocator;
 #define MPP_G2D_DST_ROT_WEIGHT  2.0
 #endif
 
+/*
+ * Lap time model of M2M MPP.
+ * Frames are classified by their largest source and the number of sources.
+ * The ratio of measured lap time to the capacity from the PPC table is
+ * learned per class and blended into the required capacity.
+ */
+#ifndef MPP_PERF_MODEL_LAYER_MAX
+#define MPP_PERF_MODEL_LAYER_MAX    8
+#endif
+/* Number of samples to trust the learned ratio fully */
+#define MPP_PERF_MODEL_FULL_SAMPLES 16
+#define MPP_PERF_MODEL_EWMA_WEIGHT  0.125f
+#define MPP_PERF_MODEL_RATIO_MIN    0.5f
+#define MPP_PERF_MODEL_RATIO_MAX    2.0f
+
+/*
+ * Incremental composition of G2D.
+ * Only the region changed since the previous frame is recomposed on top of
+ * a copy of the previous destination buffer if the region is smaller than
+ * this ratio of the canvas.
+ */
+#ifndef MPP_PARTIAL_COMPOSITION_MAX_RATIO
+#define MPP_PARTIAL_COMPOSITION_MAX_RATIO   0.5f
+#endif
+
 #define MPP_DUMP_PATH  "/data/vendor/log/hwc/output.dat"
 
 using namespace android;
@@ -222,6 +247,13 @@ enum {
 #define DEFAULT_MPP_DST_YUV_FORMAT HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN
 #endif
 
+/* Layers added by incremental composition below the sources */
+enum {
+    MPP_PARTIAL_COPY_LAYER,     /* the previous destination buffer */
+    MPP_PARTIAL_CLEAR_LAYER,    /* transparent fill of the recomposed region */
+    MPP_PARTIAL_LAYER_MAX
+};
+
 typedef struct exynos_mpp_img_info {
     private_handle_t *bufferHandle;
     uint32_t bufferType;
@@ -265,6 +297,23 @@ typedef struct ppc_list_for_scaling {
 
 typedef std::map<uint32_t, ppc_list_for_scaling> ppc_table;
 
+typedef struct perf_model_entry {
+    float ratio;        /* measured lap time / capacity from PPC table */
+    uint32_t samples;
+} perf_model_entry_t;
+
+/*
+ * A job whose lap time is measured when its destination fence signals.
+ * The lap time is attributed to the entry and the capacity of the frame
+ * that submitted the job.
+ */
+typedef struct perf_model_sample {
+    perf_model_entry_t *entry;
+    float capacity;
+    nsecs_t submitTime;
+    int fence;
+} perf_model_sample_t;
+
 enum
 {
     NODE_NONE,
@@ -300,6 +349,143 @@ typedef struct restriction_key
     uint32_t reserved;
 } restriction_key_t;
 
+/*
+ * HAL formats that can be in the format restrictions, in the order of
+ * exynos_format_desc. The position is the index of the format in
+ * restriction_format_bitmap_t.
+ */
+#define RESTRICTION_FORMATS(X) \
+    X(HAL_PIXEL_FORMAT_RGBA_8888) \
+    X(HAL_PIXEL_FORMAT_RGBX_8888) \
+    X(HAL_PIXEL_FORMAT_RGB_888) \
+    X(HAL_PIXEL_FORMAT_RGB_565) \
+    X(HAL_PIXEL_FORMAT_BGRA_8888) \
+    X(HAL_PIXEL_FORMAT_RGBA_1010102) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_ARGB_8888) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P_M) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_TILED) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YV12_M) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_FULL) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_P) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_PRIV) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_PN) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_TILED) \
+    X(HAL_PIXEL_FORMAT_YCrCb_420_SP) \
+    X(HAL_PIXEL_FORMAT_YV12) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_S10B) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_S10B) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_P010_M) \
+    X(HAL_PIXEL_FORMAT_YCBCR_P010) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_CbYCrY_422_I) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_SP) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_422_I) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_CrYCbY_422_I) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC_L50) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_SBWC_L75) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_10B_SBWC) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_10B_SBWC_L40) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_10B_SBWC_L60) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SP_M_10B_SBWC_L80) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_SBWC) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_SBWC_L50) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_SBWC_L75) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_10B_SBWC) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_10B_SBWC_L40) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_10B_SBWC_L60) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCbCr_420_SPN_10B_SBWC_L80) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_SBWC) \
+    X(HAL_PIXEL_FORMAT_EXYNOS_YCrCb_420_SP_M_10B_SBWC) \
+    X(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED)
+
+enum {
+#define RESTRICTION_FORMAT_INDEX(format) RESTRICTION_FORMAT_IDX_##format,
+    RESTRICTION_FORMATS(RESTRICTION_FORMAT_INDEX)
+#undef RESTRICTION_FORMAT_INDEX
+    RESTRICTION_FORMAT_IDX_MAX
+};
+
+static_assert(RESTRICTION_FORMAT_IDX_MAX <= 64,
+        "restriction formats don't fit in the format bitmap");
+
+/* @return index of the format, -1 if the format can't be in the restrictions */
+constexpr int32_t getRestrictionFormatIndex(uint32_t format)
+{
+    switch (format) {
+#define RESTRICTION_FORMAT_CASE(format) case format: return RESTRICTION_FORMAT_IDX_##format;
+    RESTRICTION_FORMATS(RESTRICTION_FORMAT_CASE)
+#undef RESTRICTION_FORMAT_CASE
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Supported formats of each MPP type and node as a bitmap of format indexes.
+ * A restriction of NODE_NONE is applied to both NODE_SRC and NODE_DST.
+ * It replaces the linear scan of the restriction keys with a bit test.
+ */
+#define RESTRICTION_NODE_NUM 2
+typedef struct restriction_format_bitmap
+{
+    uint64_t formats[MPP_P_TYPE_MAX][RESTRICTION_NODE_NUM];
+
+    static constexpr bool isValid(const restriction_key_t &key)
+    {
+        return ((uint32_t)key.hwType < MPP_P_TYPE_MAX) &&
+            (key.nodeType <= NODE_DST) &&
+            (getRestrictionFormatIndex(key.format) >= 0);
+    }
+
+    constexpr bool set(const restriction_key_t &key)
+    {
+        if (!isValid(key))
+            return false;
+
+        uint64_t bit = 1ULL << getRestrictionFormatIndex(key.format);
+        if (key.nodeType != NODE_DST)
+            formats[key.hwType][NODE_SRC - 1] |= bit;
+        if (key.nodeType != NODE_SRC)
+            formats[key.hwType][NODE_DST - 1] |= bit;
+        return true;
+    }
+
+    /* @param nodeType : NODE_SRC or NODE_DST */
+    constexpr bool test(uint32_t hwType, uint32_t nodeType, uint32_t format) const
+    {
+        int32_t index = getRestrictionFormatIndex(format);
+        if ((hwType >= MPP_P_TYPE_MAX) || (index < 0))
+            return false;
+        return (formats[hwType][nodeType - 1] >> index) & 1;
+    }
+} restriction_format_bitmap_t;
+
+template <size_t N>
+constexpr restriction_format_bitmap_t makeRestrictionFormatBitmap(const restriction_key_t (&table)[N])
+{
+    restriction_format_bitmap_t bitmap = {};
+    for (size_t i = 0; i < N; i++)
+        bitmap.set(table[i]);
+    return bitmap;
+}
+
+/* Every key of the table should be representable in the bitmap */
+template <size_t N>
+constexpr bool isRestrictionFormatTableValid(const restriction_key_t (&table)[N])
+{
+    if (N > RESTRICTION_CNT_MAX)
+        return false;
+    for (size_t i = 0; i < N; i++) {
+        if (!restriction_format_bitmap_t::isValid(table[i]))
+            return false;
+    }
+    return true;
+}
+
 typedef struct restriction_size
 {
     uint32_t maxDownScale;
@@ -332,6 +518,55 @@ typedef struct restriction_table_element
     const restriction_size_element *table;
     uint32_t table_element_size;
 } restriction_table_element_t;
+
+/*
+ * Format class used as a key of restriction snapshot.
+ * YUV_S10B is split from YUV because some MPPs have
+ * additional restrictions only for 10bit SBWC-like formats.
+ */
+typedef enum restriction_format_class {
+    RESTRICTION_FORMAT_RGB =   0,
+    RESTRICTION_FORMAT_YUV,
+    RESTRICTION_FORMAT_YUV_S10B,
+    RESTRICTION_FORMAT_MAX
+} restriction_format_class_t;
+
+#define RESTRICTION_ROT_MAX         2 /* no rotation, rotation 90 */
+#define RESTRICTION_COMPRESSION_MAX 2 /* uncompressed, compressed */
+
+/*
+ * Resolved source restrictions of a MPP
+ * for (format class, transform)
+ */
+typedef struct restriction_src_snapshot
+{
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint32_t minWidth;
+    uint32_t minHeight;
+    uint32_t widthAlign;
+    uint32_t heightAlign;
+    uint32_t maxCropWidth;
+    uint32_t maxCropHeight;
+    uint32_t minCropWidth;
+    uint32_t minCropHeight;
+    uint32_t cropWidthAlign;
+    uint32_t cropHeightAlign;
+    uint32_t yOffsetAlign;
+} restriction_src_snapshot_t;
+
+/*
+ * Resolved destination restrictions of a MPP
+ * for (format class, compression)
+ */
+typedef struct restriction_dst_snapshot
+{
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint32_t minWidth;
+    uint32_t minHeight;
+    uint32_t heightAlign;
+} restriction_dst_snapshot_t;
 /* */
 
 #define FORMAT_SHIFT   10
@@ -435,6 +670,72 @@ const std::map<uint32_t, int32_t> dataspace_range_map =
 
 void dumpExynosMPPImgInfo(uint32_t type, exynos_mpp_img_info &imgInfo);
 
+/* Bytes of idle buffers that ExynosMPPBufferPool keeps for reuse */
+#ifndef MPP_DST_BUF_POOL_BUDGET
+#define MPP_DST_BUF_POOL_BUDGET (64 * 1024 * 1024)
+#endif
+
+/*
+ * Destination buffers of all M2M MPPs are allocated from this pool.
+ * A buffer returned by an MPP is kept idle and handed out again to any MPP
+ * that asks for the same key instead of going through gralloc.
+ * Idle buffers are trimmed from the least recently used one when they
+ * exceed the budget.
+ */
+class ExynosMPPBufferPool {
+    public:
+        struct Key {
+            uint32_t width;
+            uint32_t height;
+            uint32_t format;
+            uint64_t usage;
+            bool secure;
+            bool operator==(const Key &rhs) const {
+                return (width == rhs.width) && (height == rhs.height) &&
+                    (format == rhs.format) && (usage == rhs.usage) &&
+                    (secure == rhs.secure);
+            }
+        };
+
+        ExynosMPPBufferPool();
+        ~ExynosMPPBufferPool();
+        int32_t allocate(const Key &key, private_handle_t **outHandle);
+        /* The buffer must not be accessed by any HW anymore */
+        void release(private_handle_t *handle);
+        /* Free the buffer without keeping it for reuse */
+        void free(private_handle_t *handle);
+        bool getKey(private_handle_t *handle, Key &key);
+        /* Make count idle buffers of the key be ready */
+        void prewarm(const Key &key, uint32_t count);
+        void setBudget(uint64_t budget);
+        void trim(uint64_t target);
+        void dump(String8& result);
+
+    private:
+        struct Entry {
+            private_handle_t *handle;
+            Key key;
+            uint64_t size;
+        };
+
+        Mutex mMutex;
+        GrallocWrapper::Allocator* mAllocator;
+        GrallocWrapper::Mapper* mMapper;
+        /* Idle buffers, the least recently used one is at the front */
+        List<Entry> mFreeBuffers;
+        std::map<private_handle_t*, Entry> mUsedBuffers;
+        uint64_t mBudget;
+        uint64_t mFreeBytes;
+        uint64_t mUsedBytes;
+        uint64_t mHitCount;
+        uint64_t mMissCount;
+        uint64_t mPrewarmCount;
+        uint64_t mTrimCount;
+
+        int32_t allocateBuffer(const Key &key, Entry &entry);
+        void trimLocked(uint64_t target);
+};
+
 struct ExynosMPPFrameInfo
 {
     uint32_t srcNum;
@@ -468,6 +769,12 @@ private:
             ExynosMPP *mExynosMPP;
             Condition mCondition;
             List<exynos_mpp_img_info > mFreedBuffers;
+            /* Freed buffers that are still accessed by HW */
+            struct PendingBuffer {
+                exynos_mpp_img_info img;
+                nsecs_t deadline;
+            };
+            List<PendingBuffer> mPendingBuffers;
             List<int> mStateFences;
 
             void freeBuffers();
@@ -524,6 +831,8 @@ public:
     float mCapacity;
     float mUsedCapacity;
     float mPreAssignedCapacity;
+    perf_model_entry_t mPerfModel[PPC_FORMAT_FORMAT_MAX][PPC_ROT_MAX][PPC_SCALE_MAX][MPP_PERF_MODEL_LAYER_MAX];
+    perf_model_sample_t mPerfSample;
 
     union {
         struct {
@@ -539,6 +848,21 @@ public:
     /* For reuse previous frame */
     ExynosMPPFrameInfo mPrevFrameInfo;
     bool mWasUsedPrevFrame;
+    /* Destination buffer that has the composition result of mPrevFrameInfo */
+    private_handle_t *mPrevComposedBuf;
+    android_color_mode_t mPrevComposedColorMode;
+
+    /* For incremental composition */
+    bool mPartialComposition;
+    hwc_rect_t mPartialRect;
+    bool mPartialSources[NUM_MPP_SRC_BUFS];
+    uint32_t mPartialLayerNum;
+    struct exynos_mpp_img_info mPartialImgs[MPP_PARTIAL_LAYER_MAX];
+    uint64_t mComposedFrames;
+    uint64_t mPartialComposedFrames;
+    uint64_t mLastComposedPixels;
+    uint64_t mTotalComposedPixels;
+    uint64_t mTotalCanvasPixels;
 
     struct exynos_mpp_img_info mSrcImgs[NUM_MPP_SRC_BUFS];
     struct exynos_mpp_img_info mDstImgs[NUM_MPP_DST_BUFS_DEFAULT];
@@ -547,6 +871,9 @@ public:
     bool mNeedCompressedTarget;
     struct restriction_size mSrcSizeRestrictions[RESTRICTION_MAX];
     struct restriction_size mDstSizeRestrictions[RESTRICTION_MAX];
+    /* Built by setupRestriction(), used by isSupported() */
+    restriction_src_snapshot_t mSrcRestrictionSnapshot[RESTRICTION_FORMAT_MAX][RESTRICTION_ROT_MAX];
+    restriction_dst_snapshot_t mDstRestrictionSnapshot[RESTRICTION_FORMAT_MAX][RESTRICTION_COMPRESSION_MAX];
 
     // Force Dst buffer reallocation
     uint32_t mDstAllocatedSize;
@@ -672,6 +999,12 @@ protected:
     uint64_t getBufferUsage(uint64_t usage);
     bool needDstBufRealloc(struct exynos_image &dst, uint32_t index);
     bool canUsePrevFrame();
+    bool canComposePartially();
+    bool getSourceDamage(uint32_t index, hwc_rect_t &damage);
+    int32_t setupPartialLayers();
+    void deletePartialLayers();
+    void remapPartialFences(int *fences);
+    void updateComposedPixels();
     int32_t setupDst(exynos_mpp_img_info *dstImgInfo);
     virtual int32_t doPostProcessingInternal();
     virtual int32_t setupLayer(exynos_mpp_img_info *srcImgInfo,
@@ -680,6 +1013,8 @@ protected:
     int setCSCProperty(void *handle, unsigned int eqAuto, unsigned int fullRange, unsigned int colorspace);
 
     uint32_t getRestrictionClassification(struct exynos_image &img);
+    uint32_t getRestrictionFormatClass(uint32_t format);
+    void buildRestrictionSnapshot();
 
     /*
      * getPPC for src, dst referencing mppSources in mAssignedSources and
@@ -693,6 +1028,11 @@ protected:
             uint32_t &formatIndex, uint32_t &rotIndex, uint32_t &scaleIndex, struct exynos_image &criteria);
 
     float getRequiredBaseCycles(struct exynos_image &src, struct exynos_image &dst);
+    perf_model_entry_t& getPerfModelEntry(struct exynos_image *src, struct exynos_image *dst);
+    float getPerfModelCorrection(struct exynos_image &src, struct exynos_image &dst);
+    bool canSamplePerfModel();
+    void startPerfModelSample(int fence, nsecs_t submitTime);
+    bool finishPerfModelSample();
     bool addCapacity(ExynosMPPSource* mppSource);
     bool removeCapacity(ExynosMPPSource* mppSource);
     /*
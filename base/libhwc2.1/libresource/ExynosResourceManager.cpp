@@ -76,6 +76,12 @@ feature_support_t feature_table[] =
 };
 #endif
 
+/* Every SoC table is checked when its module is built */
+static_assert(isRestrictionFormatTableValid(restriction_format_table),
+        "restriction_format_table has a key that is not in RESTRICTION_FORMATS");
+static constexpr restriction_format_bitmap_t restriction_format_bitmap =
+    makeRestrictionFormatBitmap(restriction_format_table);
+
 using namespace android;
 
 ExynosMPPVector ExynosResourceManager::mOtfMPPs;
@@ -144,6 +150,7 @@ ExynosResourceManager::ExynosResourceManager(ExynosDevice *device)
 
     memset(mSizeRestrictionCnt, 0, sizeof(mSizeRestrictionCnt));
     memset(mFormatRestrictions, 0, sizeof(mFormatRestrictions));
+    memset(&mFormatRestrictionBitmap, 0, sizeof(mFormatRestrictionBitmap));
     memset(mSizeRestrictions, 0, sizeof(mSizeRestrictions));
 
     size_t num_mpp_units = sizeof(AVAILABLE_OTF_MPP_UNITS)/sizeof(exynos_mpp_t);
@@ -299,11 +306,91 @@ void ExynosResourceManager::DstBufMgrThread::reallocDstBufs(uint32_t Xres, uint3
     }
 }
 
+void ExynosResourceManager::prewarmDstBufs(ExynosDisplay *display, uint32_t prevXres, uint32_t prevYres)
+{
+    android::Vector<DstBufMgrThread::PrewarmRequest> requests;
+
+    /*
+     * Destination buffers of the previous resolution will be reallocated
+     * with the new resolution. Make the same number of buffers be ready.
+     */
+    for (uint32_t i = 0; i < mM2mMPPs.size(); i++) {
+        ExynosMPP *m2mMPP = mM2mMPPs[i];
+        uint32_t bufAlign = m2mMPP->getOutBufAlign();
+        for (uint32_t index = 0; index < NUM_MPP_DST_BUFS(m2mMPP->mLogicalType); index++) {
+            ExynosMPPBufferPool::Key key;
+            if (!mDstBufPool.getKey(m2mMPP->mDstImgs[index].bufferHandle, key) ||
+                (key.width != ALIGN_UP(prevXres, bufAlign)) ||
+                (key.height != ALIGN_UP(prevYres, bufAlign)))
+                continue;
+
+            key.width = ALIGN_UP(display->mXres, bufAlign);
+            key.height = ALIGN_UP(display->mYres, bufAlign);
+
+            size_t j;
+            for (j = 0; j < requests.size(); j++) {
+                if (requests[j].key == key) {
+                    requests.editItemAt(j).count++;
+                    break;
+                }
+            }
+            if (j == requests.size()) {
+                DstBufMgrThread::PrewarmRequest request = {key, 1};
+                requests.add(request);
+            }
+        }
+    }
+
+    HDEBUGLOGD(eDebugBuf, "%s:: %dx%d -> %dx%d, %zu keys", __func__,
+            prevXres, prevYres, display->mXres, display->mYres, requests.size());
+    if (requests.size() != 0)
+        mDstBufMgrThread->prewarmDstBufs(requests);
+}
+
+void ExynosResourceManager::DstBufMgrThread::prewarmDstBufs(const android::Vector<PrewarmRequest> &requests)
+{
+    {
+        Mutex::Autolock lock(mResInfoMutex);
+        mPrewarmRequests.appendVector(requests);
+    }
+    android::Mutex::Autolock lock(mMutex);
+    mCondition.signal();
+}
+
 bool ExynosResourceManager::DstBufMgrThread::threadLoop()
 {
     while(mRunning) {
         Mutex::Autolock lock(mMutex);
-        mCondition.wait(mMutex);
+        bool reallocRequested;
+        {
+            Mutex::Autolock lock(mStateMutex);
+            reallocRequested = (mExynosResourceManager->mForceReallocState == DST_REALLOC_START);
+        }
+        if (!reallocRequested) {
+            bool prewarmRequested;
+            {
+                Mutex::Autolock lock(mResInfoMutex);
+                prewarmRequested = (mPrewarmRequests.size() != 0);
+            }
+            if (!prewarmRequested)
+                mCondition.wait(mMutex);
+        }
+
+        android::Vector<PrewarmRequest> prewarmRequests;
+        {
+            Mutex::Autolock lock(mResInfoMutex);
+            prewarmRequests = mPrewarmRequests;
+            mPrewarmRequests.clear();
+        }
+        for (size_t i = 0; i < prewarmRequests.size(); i++)
+            mExynosResourceManager->mDstBufPool.prewarm(prewarmRequests[i].key,
+                    prewarmRequests[i].count);
+
+        {
+            Mutex::Autolock lock(mStateMutex);
+            if (mExynosResourceManager->mForceReallocState != DST_REALLOC_START)
+                continue;
+        }
 
         ExynosDevice *device = mExynosResourceManager->mDevice;
         if (device == NULL)
@@ -540,9 +627,30 @@ int32_t ExynosResourceManager::assignResourceInternal(ExynosDisplay *display)
 {
     int ret = NO_ERROR;
     int retry_count = 0;
+    ExynosAssignPlan plan;
 
     Mutex::Autolock lock(mDstBufMgrThread->mStateMutex);
 
+    if (display->mDisplayControl.reuseAssignPlan) {
+        makeAssignPlanSignature(display, plan);
+        if (isAssignPlanMatched(display, plan)) {
+            if ((ret = replayAssignPlan(display)) == NO_ERROR) {
+                display->mAssignPlan.mHitCount++;
+                HDEBUGLOGD(eDebugResourceManager, "%s:: previous assignment is reused", __func__);
+                return NO_ERROR;
+            }
+            HDEBUGLOGD(eDebugResourceManager, "%s:: fail to reuse previous assignment (%d)",
+                    __func__, ret);
+            /* Clear partially replayed assignment before full search */
+            for (uint32_t i = 0; i < display->mLayers.size(); i++)
+                display->mLayers[i]->resetAssignedResource();
+            resetAssignedResources(display, true);
+            display->initializeValidateInfos();
+            ret = NO_ERROR;
+        }
+        display->mAssignPlan.mMissCount++;
+    }
+
     /*
      * First add layers that SF requested HWC2_COMPOSITION_CLIENT type
      * to client composition
@@ -644,6 +752,9 @@ int32_t ExynosResourceManager::assignResourceInternal(ExynosDisplay *display)
             return ret;
     }
 
+    if (display->mDisplayControl.reuseAssignPlan)
+        saveAssignPlan(display, plan);
+
     if (hwcCheckDebugMessages(eDebugCapacity)) {
         for (uint32_t i = 0; i < mM2mMPPs.size(); i++) {
             if (mM2mMPPs[i]->mPhysicalType == MPP_G2D)
@@ -658,6 +769,198 @@ int32_t ExynosResourceManager::assignResourceInternal(ExynosDisplay *display)
 err:
     return ret;
 }
+
+static bool isSameAssignPlanImage(exynos_image &a, exynos_image &b)
+{
+    /* bufferHandle and fences can be changed without geometry change */
+    return ((a.fullWidth == b.fullWidth) &&
+            (a.fullHeight == b.fullHeight) &&
+            (a.x == b.x) && (a.y == b.y) &&
+            (a.w == b.w) && (a.h == b.h) &&
+            (a.format == b.format) &&
+            (a.usageFlags == b.usageFlags) &&
+            (a.layerFlags == b.layerFlags) &&
+            (a.dataSpace == b.dataSpace) &&
+            (a.blending == b.blending) &&
+            (a.transform == b.transform) &&
+            (a.compressed == b.compressed) &&
+            (a.planeAlpha == b.planeAlpha) &&
+            (a.hasMetaParcel == b.hasMetaParcel));
+}
+
+void ExynosResourceManager::makeAssignPlanSignature(ExynosDisplay *display, ExynosAssignPlan &plan)
+{
+    plan.mXres = display->mXres;
+    plan.mYres = display->mYres;
+    plan.mColorTransformHint = display->mColorTransformHint;
+    plan.mBlendingNoneIndex = display->mBlendingNoneIndex;
+    plan.mHasLowFpsLayer = display->mLowFpsLayerInfo.mHasLowFpsLayer;
+    plan.mLowFpsFirstIndex = display->mLowFpsLayerInfo.mFirstIndex;
+    plan.mLowFpsLastIndex = display->mLowFpsLayerInfo.mLastIndex;
+    plan.mDynamicReCompMode = display->mDREnable ? display->mDynamicReCompMode : NO_MODE_SWITCH;
+    plan.mForceGpu = exynosHWCControl.forceGpu;
+
+    plan.mLayers.resize(display->mLayers.size());
+    for (uint32_t i = 0; i < display->mLayers.size(); i++) {
+        ExynosLayer *layer = display->mLayers[i];
+        ExynosAssignPlanLayer &planLayer = plan.mLayers[i];
+        planLayer.layer = layer;
+        planLayer.compositionType = layer->mCompositionType;
+        planLayer.supportedMPPFlag = layer->mSupportedMPPFlag;
+        planLayer.overlayPriority = layer->mOverlayPriority;
+        planLayer.hasBuffer = (layer->mLayerBuffer != NULL);
+        layer->setSrcExynosImage(&planLayer.srcImg);
+        layer->setDstExynosImage(&planLayer.dstImg);
+        planLayer.validateCompositionType = HWC2_COMPOSITION_INVALID;
+        planLayer.overlayInfo = 0;
+        planLayer.otfMPP = NULL;
+        planLayer.m2mMPP = NULL;
+    }
+}
+
+bool ExynosResourceManager::isAssignPlanMatched(ExynosDisplay *display, ExynosAssignPlan &plan)
+{
+    ExynosAssignPlan &prevPlan = display->mAssignPlan;
+
+    if ((prevPlan.mValid == false) ||
+        (mForceReallocState != DST_REALLOC_DONE))
+        return false;
+
+    if ((prevPlan.mXres != plan.mXres) ||
+        (prevPlan.mYres != plan.mYres) ||
+        (prevPlan.mColorTransformHint != plan.mColorTransformHint) ||
+        (prevPlan.mBlendingNoneIndex != plan.mBlendingNoneIndex) ||
+        (prevPlan.mHasLowFpsLayer != plan.mHasLowFpsLayer) ||
+        (prevPlan.mLowFpsFirstIndex != plan.mLowFpsFirstIndex) ||
+        (prevPlan.mLowFpsLastIndex != plan.mLowFpsLastIndex) ||
+        (prevPlan.mDynamicReCompMode != plan.mDynamicReCompMode) ||
+        (prevPlan.mForceGpu != plan.mForceGpu) ||
+        (prevPlan.mLayers.size() != plan.mLayers.size())) {
+        HDEBUGLOGD(eDebugResourceManager, "%s:: display state or number of layers(%zu -> %zu) is changed",
+                __func__, prevPlan.mLayers.size(), plan.mLayers.size());
+        return false;
+    }
+
+    for (uint32_t i = 0; i < plan.mLayers.size(); i++) {
+        ExynosAssignPlanLayer &prev = prevPlan.mLayers[i];
+        ExynosAssignPlanLayer &cur = plan.mLayers[i];
+        if ((prev.layer != cur.layer) ||
+            (prev.compositionType != cur.compositionType) ||
+            (prev.supportedMPPFlag != cur.supportedMPPFlag) ||
+            (prev.overlayPriority != cur.overlayPriority) ||
+            (prev.hasBuffer != cur.hasBuffer) ||
+            !isSameAssignPlanImage(prev.srcImg, cur.srcImg) ||
+            !isSameAssignPlanImage(prev.dstImg, cur.dstImg)) {
+            HDEBUGLOGD(eDebugResourceManager, "%s:: state of layer[%d] is changed", __func__, i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int32_t ExynosResourceManager::replayAssignPlan(ExynosDisplay *display)
+{
+    int32_t ret = NO_ERROR;
+    ExynosAssignPlan &plan = display->mAssignPlan;
+
+    if ((ret = resetAssignedResources(display)) != NO_ERROR)
+        return ret;
+
+    for (uint32_t i = 0; i < plan.mLayers.size(); i++) {
+        ExynosAssignPlanLayer &planLayer = plan.mLayers[i];
+        ExynosLayer *layer = display->mLayers[i];
+        ExynosMPP *otfMPP = planLayer.otfMPP;
+        ExynosMPP *m2mMPP = planLayer.m2mMPP;
+
+        exynos_image src_img;
+        exynos_image dst_img;
+        layer->setSrcExynosImage(&src_img);
+        layer->setDstExynosImage(&dst_img);
+        layer->setExynosImage(src_img, dst_img);
+        layer->setExynosMidImage(dst_img);
+
+        if (planLayer.validateCompositionType == HWC2_COMPOSITION_DEVICE) {
+            if (m2mMPP != NULL) {
+                exynos_image otf_dst_img = dst_img;
+                otf_dst_img.format = DEFAULT_MPP_DST_FORMAT;
+                otf_dst_img.transform = 0;
+                if ((m2mMPP->isAssignable(display, src_img, planLayer.midImg) == false) ||
+                    ((otfMPP != NULL) &&
+                     (otfMPP->isAssignable(display, planLayer.midImg, otf_dst_img) == false)))
+                    return eInsufficientMPP;
+            } else if (otfMPP != NULL) {
+                if (((layer->mSupportedMPPFlag & otfMPP->mLogicalType) == 0) ||
+                    (otfMPP->isAssignable(display, src_img, dst_img) == false))
+                    return eInsufficientMPP;
+            }
+            if ((otfMPP != NULL) &&
+                ((ret = otfMPP->assignMPP(display, layer)) != NO_ERROR))
+                return ret;
+            if (m2mMPP != NULL) {
+                if ((ret = m2mMPP->assignMPP(display, layer)) != NO_ERROR)
+                    return ret;
+                layer->setExynosMidImage(planLayer.midImg);
+            }
+            display->mWindowNumUsed++;
+        } else if (planLayer.validateCompositionType == HWC2_COMPOSITION_EXYNOS) {
+            if ((m2mMPP == NULL) ||
+                ((layer->mSupportedMPPFlag & m2mMPP->mLogicalType) == 0) ||
+                (m2mMPP->isAssignable(display, src_img, dst_img) == false))
+                return eInsufficientMPP;
+            if ((ret = m2mMPP->assignMPP(display, layer)) != NO_ERROR)
+                return ret;
+        }
+        layer->mValidateCompositionType = planLayer.validateCompositionType;
+        layer->mOverlayInfo = planLayer.overlayInfo;
+        HDEBUGLOGD(eDebugResourceAssigning, "\t\t[%d] layer: replay type(%d), otfMPP(%s), m2mMPP(%s)",
+                i, layer->mValidateCompositionType,
+                (otfMPP != NULL) ? otfMPP->mName.string() : "NULL",
+                (m2mMPP != NULL) ? m2mMPP->mName.string() : "NULL");
+    }
+
+    display->mClientCompositionInfo.mHasCompositionLayer = plan.mHasClientComposition;
+    display->mClientCompositionInfo.mFirstIndex = plan.mClientFirstIndex;
+    display->mClientCompositionInfo.mLastIndex = plan.mClientLastIndex;
+    display->mExynosCompositionInfo.mHasCompositionLayer = plan.mHasExynosComposition;
+    display->mExynosCompositionInfo.mFirstIndex = plan.mExynosFirstIndex;
+    display->mExynosCompositionInfo.mLastIndex = plan.mExynosLastIndex;
+
+    if ((ret = assignCompositionTarget(display, COMPOSITION_CLIENT)) != NO_ERROR)
+        return ret;
+    if ((ret = assignCompositionTarget(display, COMPOSITION_EXYNOS)) != NO_ERROR)
+        return ret;
+
+    return setResourcePriority(display);
+}
+
+void ExynosResourceManager::saveAssignPlan(ExynosDisplay *display, ExynosAssignPlan &plan)
+{
+    ExynosAssignPlan &prevPlan = display->mAssignPlan;
+
+    for (uint32_t i = 0; i < plan.mLayers.size(); i++) {
+        ExynosAssignPlanLayer &planLayer = plan.mLayers[i];
+        ExynosLayer *layer = display->mLayers[i];
+        planLayer.validateCompositionType = layer->mValidateCompositionType;
+        planLayer.overlayInfo = layer->mOverlayInfo;
+        planLayer.otfMPP = layer->mOtfMPP;
+        planLayer.m2mMPP = layer->mM2mMPP;
+        planLayer.midImg = layer->mMidImg;
+    }
+
+    plan.mHasClientComposition = display->mClientCompositionInfo.mHasCompositionLayer;
+    plan.mClientFirstIndex = display->mClientCompositionInfo.mFirstIndex;
+    plan.mClientLastIndex = display->mClientCompositionInfo.mLastIndex;
+    plan.mHasExynosComposition = display->mExynosCompositionInfo.mHasCompositionLayer;
+    plan.mExynosFirstIndex = display->mExynosCompositionInfo.mFirstIndex;
+    plan.mExynosLastIndex = display->mExynosCompositionInfo.mLastIndex;
+
+    plan.mHitCount = prevPlan.mHitCount;
+    plan.mMissCount = prevPlan.mMissCount;
+    plan.mValid = true;
+    prevPlan = plan;
+}
+
 int32_t ExynosResourceManager::updateExynosComposition(ExynosDisplay *display)
 {
     int ret = NO_ERROR;
@@ -2644,6 +2947,9 @@ void ExynosResourceManager::makeSizeRestrictions(uint32_t mppId, restriction_siz
 void ExynosResourceManager::makeFormatRestrictions(restriction_key_t table, int deviceFormat) {
 
     mFormatRestrictions[mFormatRestrictionCnt] = table;
+    if (!mFormatRestrictionBitmap.set(table))
+        HWC_LOGE(NULL, "%s:: format %s is not in RESTRICTION_FORMATS", __func__,
+                getFormatStr(table.format).string());
 
     HDEBUGLOGD(eDebugDefault, "MPP : %s, %d, %s(device : %d), %d"
             ,getMPPStr(mFormatRestrictions[mFormatRestrictionCnt].hwType).string()
@@ -2756,6 +3062,7 @@ void ExynosResourceManager::updateRestrictions() {
             mFormatRestrictions[i].format = restriction_format_table[i].format;
             mFormatRestrictions[i].reserved = restriction_format_table[i].reserved;
         }
+        mFormatRestrictionBitmap = restriction_format_bitmap;
 
         // i = RGB, YUV
         // j = Size restriction count for each format (YUV, RGB)
@@ -3083,3 +3390,11 @@ void ExynosResourceManager::setM2mTargetCompression()
         }
     }
 }
+
+void ExynosResourceManager::dump(String8& result)
+{
+    result.appendFormat("\n");
+    for (uint32_t i = 0; i < mM2mMPPs.size(); i++)
+        mM2mMPPs[i]->dump(result);
+    mDstBufPool.dump(result);
+}
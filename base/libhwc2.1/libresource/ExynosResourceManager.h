@@ -106,7 +106,14 @@ class ExynosResourceManager {
             Mutex mResInfoMutex;
             uint32_t mBufXres;
             uint32_t mBufYres;
+            struct PrewarmRequest {
+                ExynosMPPBufferPool::Key key;
+                uint32_t count;
+            };
+            /* Protected by mResInfoMutex */
+            android::Vector<PrewarmRequest> mPrewarmRequests;
             void reallocDstBufs(uint32_t Xres, uint32_t Yres);
+            void prewarmDstBufs(const android::Vector<PrewarmRequest> &requests);
             bool needDstRealloc(uint32_t Xres, uint32_t Yres, ExynosMPP *m2mMPP);
             DstBufMgrThread(ExynosResourceManager *exynosResourceManager);
             ~DstBufMgrThread();
@@ -122,11 +129,16 @@ class ExynosResourceManager {
         uint32_t mFormatRestrictionCnt;
         uint32_t mSizeRestrictionCnt[RESTRICTION_MAX];
         restriction_key_t mFormatRestrictions[RESTRICTION_CNT_MAX];
+        /* mFormatRestrictions for lookup by ExynosMPP */
+        restriction_format_bitmap_t mFormatRestrictionBitmap;
         restriction_size_element_t mSizeRestrictions[RESTRICTION_MAX][RESTRICTION_CNT_MAX];
 
         android::Vector<uint32_t> mLayerAttributePriority;
         std::unordered_map<uint32_t /* physical type */, uint64_t /* attribute */> mMPPAttrs;
 
+        /* Destination buffers shared by all of M2M MPPs */
+        ExynosMPPBufferPool mDstBufPool;
+
         ExynosResourceManager(ExynosDevice *device);
         virtual ~ExynosResourceManager();
         void reloadResourceForHWFC();
@@ -134,6 +146,7 @@ class ExynosResourceManager {
         void setTargetDisplayDevice(int device);
         int32_t doPreProcessing();
         void doReallocDstBufs(uint32_t Xres, uint32_t Yres);
+        void prewarmDstBufs(ExynosDisplay *display, uint32_t prevXres, uint32_t prevYres);
         int32_t doAllocDstBufs(uint32_t mXres, uint32_t mYres);
         int32_t assignResource(ExynosDisplay *display);
         int32_t assignResourceInternal(ExynosDisplay *display);
@@ -209,6 +222,8 @@ class ExynosResourceManager {
         virtual bool hasHDR10PlusMPP();
         virtual void setM2mTargetCompression();
 
+        void dump(String8& result);
+
     private:
         uint32_t mUseDpuDisplayNum = 0;
         displayEnableMap_t mDisplayEnableState = 1;
@@ -216,6 +231,12 @@ class ExynosResourceManager {
                 uint32_t layer_index, exynos_image m2m_out_img, ExynosMPP *m2mMPP, ExynosMPP *otfMPP);
 
         int32_t setDstAllocSize(uint32_t width);
+
+        /* Reuse of the previous resource assignment */
+        void makeAssignPlanSignature(ExynosDisplay *display, ExynosAssignPlan &plan);
+        bool isAssignPlanMatched(ExynosDisplay *display, ExynosAssignPlan &plan);
+        int32_t replayAssignPlan(ExynosDisplay *display);
+        void saveAssignPlan(ExynosDisplay *display, ExynosAssignPlan &plan);
         sp<DstBufMgrThread> mDstBufMgrThread;
 
     protected:
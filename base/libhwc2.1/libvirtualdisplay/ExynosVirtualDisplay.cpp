@@ -67,6 +67,7 @@ ExynosVirtualDisplay::ExynosVirtualDisplay(uint32_t index, ExynosDevice *device)
     mDisplayControl.enableExynosCompositionOptimization = false;
     mDisplayControl.enableClientCompositionOptimization = false;
     mDisplayControl.handleLowFpsLayers = false;
+    mDisplayControl.reuseAssignPlan = false;
     mMaxWindowNum = 0;
 }
 
@@ -23,9 +23,10 @@ LOCAL_HEADER_LIBRARIES := libcutils_headers libsystem_headers libhardware_header
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/include
 
-LOCAL_SRC_FILES := hwjpeg-base.cpp hwjpeg-v4l2.cpp ExynosJpegEncoder.cpp \
+LOCAL_SRC_FILES := hwjpeg-base.cpp hwjpeg-v4l2.cpp hwjpeg-sw.cpp ExynosJpegEncoder.cpp \
                    LibScalerForJpeg.cpp AppMarkerWriter.cpp ExynosJpegEncoderForCamera.cpp \
-                   libhwjpeg-exynos.cpp ThumbnailScaler.cpp GiantThumbnailScaler.cpp
+                   libhwjpeg-exynos.cpp ThumbnailScaler.cpp GiantThumbnailScaler.cpp \
+                   ThumbnailRateControl.cpp
 
 LOCAL_MODULE := libhwjpeg
 LOCAL_MODULE_TAGS := optional
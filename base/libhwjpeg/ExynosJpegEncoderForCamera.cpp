@@ -28,11 +28,17 @@
 #include "hwjpeg-internal.h"
 #include "AppMarkerWriter.h"
 #include "ThumbnailScaler.h"
+#include "ThumbnailRateControl.h"
 #include "IFDWriter.h"
 
 // Data length written by H/W without the scan data.
 #define NECESSARY_JPEG_LENGTH   (0x24B + 2 * JPEG_MARKER_SIZE)
 
+// The thumbnail quality search stops if the best quality factor is known
+// within THUMB_QUALITY_TOLERANCE or after THUMB_MAX_RUNS compressions.
+#define THUMB_QUALITY_TOLERANCE 5
+#define THUMB_MAX_RUNS          4
+
 static size_t GetImageLength(unsigned int width, unsigned int height, int v4l2Format)
 {
     size_t size = width * height;
@@ -77,9 +83,15 @@ ExynosJpegEncoderForCamera::ExynosJpegEncoderForCamera(bool bBTBComp)
         : ExynosJpegEncoder(HWJPEG_INDEX),
           m_phwjpeg4thumb(NULL), m_fdIONClient(-1), m_fdIONThumbImgBuffer(-1), m_pIONThumbImgBuffer(NULL),
           m_szIONThumbImgBuffer(0), m_pIONThumbJpegBuffer(NULL), m_fdIONThumbJpegBuffer(-1), m_szIONThumbJpegBuffer(0),
+          m_pIONThumbJpegScratch(NULL), m_fdIONThumbJpegScratch(-1),
           m_nThumbWidth(0), m_nThumbHeight(0), m_nThumbQuality(0),
-          m_pStreamBase(NULL), m_fThumbBufferType(0)
+          m_pStreamBase(NULL), m_fThumbBufferType(0),
+          m_bWorkerRunning(false), m_bWorkerExit(false), m_bThumbJobQueued(false)
 {
+    pthread_mutex_init(&m_mutexWorker, NULL);
+    pthread_cond_init(&m_condWorker, NULL);
+    pthread_cond_init(&m_condJobDone, NULL);
+
     m_pAppWriter = new CAppMarkerWriter();
     if (!m_pAppWriter) {
         ALOGE("Failed to allocated an instance of CAppMarkerWriter");
@@ -116,11 +128,19 @@ ExynosJpegEncoderForCamera::ExynosJpegEncoderForCamera(bool bBTBComp)
     if (!mThumbnailScaler->available())
         ALOGW("Thumbnail scaler is not available.");
 
+    mThumbnailRateControl.reset(new ThumbnailRateControl());
+
     ALOGD("ExynosJpegEncoderForCamera Created: %p, ION %d", this, m_fdIONClient);
 }
 
 ExynosJpegEncoderForCamera::~ExynosJpegEncoderForCamera()
 {
+    StopThumbnailWorker();
+
+    pthread_cond_destroy(&m_condJobDone);
+    pthread_cond_destroy(&m_condWorker);
+    pthread_mutex_destroy(&m_mutexWorker);
+
     delete m_pAppWriter;
     delete m_phwjpeg4thumb;
 
@@ -130,17 +150,16 @@ ExynosJpegEncoderForCamera::~ExynosJpegEncoderForCamera()
     if (m_fdIONThumbImgBuffer >= 0)
         close(m_fdIONThumbImgBuffer);
 
-    if (m_pIONThumbJpegBuffer)
-        munmap(m_pIONThumbJpegBuffer, m_szIONThumbJpegBuffer);
-
-    if (m_fdIONThumbJpegBuffer >= 0)
-        close(m_fdIONThumbJpegBuffer);
+    FreeThumbJpegBuffer();
 
     if (m_fdIONClient >= 0)
         exynos_ion_close(m_fdIONClient);
 
-    ALOGD("ExynosJpegEncoderForCamera Destroyed: %p, ION %d, ThumIMG %d",
-            this, m_fdIONClient, m_fdIONThumbImgBuffer);
+    unsigned int encodes, hits, retries;
+    mThumbnailRateControl->GetStatistics(&encodes, &hits, &retries);
+
+    ALOGD("ExynosJpegEncoderForCamera Destroyed: %p, ION %d, ThumIMG %d, thumbnail hit rate %u/%u (%u retries)",
+            this, m_fdIONClient, m_fdIONThumbImgBuffer, hits, encodes, retries);
 }
 
 int ExynosJpegEncoderForCamera::setThumbnailSize(int w, int h)
@@ -222,12 +241,127 @@ size_t ExynosJpegEncoderForCamera::RemoveTrailingDummies(char *base, size_t len)
     return 0;
 }
 
-void *ExynosJpegEncoderForCamera::tCompressThumbnail(void *p)
+void *ExynosJpegEncoderForCamera::tThumbnailWorker(void *p)
 {
     ExynosJpegEncoderForCamera *encoder = reinterpret_cast<ExynosJpegEncoderForCamera *>(p);
 
-    size_t thumblen = encoder->CompressThumbnail();
-    return reinterpret_cast<void *>(thumblen);
+    pthread_mutex_lock(&encoder->m_mutexWorker);
+
+    while (true) {
+        while (!encoder->m_bWorkerExit && encoder->m_thumbJobs.empty())
+            pthread_cond_wait(&encoder->m_condWorker, &encoder->m_mutexWorker);
+
+        // The queued jobs are completed before exit not to leave a waiter
+        if (encoder->m_thumbJobs.empty())
+            break;
+
+        ThumbnailJob *job = encoder->m_thumbJobs.front();
+        encoder->m_thumbJobs.pop_front();
+
+        pthread_mutex_unlock(&encoder->m_mutexWorker);
+        size_t thumblen = encoder->CompressThumbnail(*job);
+        pthread_mutex_lock(&encoder->m_mutexWorker);
+
+        job->thumblen = thumblen;
+        job->done = true;
+        pthread_cond_broadcast(&encoder->m_condJobDone);
+    }
+
+    pthread_mutex_unlock(&encoder->m_mutexWorker);
+
+    return NULL;
+}
+
+bool ExynosJpegEncoderForCamera::StartThumbnailWorker()
+{
+    if (m_bWorkerRunning)
+        return true;
+
+    m_bWorkerExit = false;
+
+    if (pthread_create(&m_threadWorker, NULL,
+            tThumbnailWorker, reinterpret_cast<void *>(this)) != 0) {
+        ALOGERR("Failed to create thumbnail generation thread");
+        return false;
+    }
+
+    m_bWorkerRunning = true;
+
+    return true;
+}
+
+void ExynosJpegEncoderForCamera::StopThumbnailWorker()
+{
+    if (!m_bWorkerRunning)
+        return;
+
+    pthread_mutex_lock(&m_mutexWorker);
+    m_bWorkerExit = true;
+    pthread_cond_signal(&m_condWorker);
+    pthread_mutex_unlock(&m_mutexWorker);
+
+    int ret = pthread_join(m_threadWorker, NULL);
+    if (ret != 0)
+        ALOGERR("Failed to wait thumbnail thread(%d)", ret);
+
+    m_bWorkerRunning = false;
+    m_bThumbJobQueued = false;
+}
+
+bool ExynosJpegEncoderForCamera::QueueThumbnailJob()
+{
+    ThumbnailJob &job = m_thumbJob;
+
+    // A job left by a failed compression still uses the thumbnail buffers
+    WaitForThumbnailJob();
+
+    if (getSize(&job.mainWidth, &job.mainHeight) < 0) {
+        ALOGE("Failed to get main image size");
+        return false;
+    }
+
+    job.v4l2Format = getColorFormat();
+    job.bufType = checkInBufType();
+
+    int ret;
+    if (job.bufType == JPEG_BUF_TYPE_USER_PTR)
+        ret = getInBuf(job.srcBufPtr, job.srcLen, ThumbnailScaler::SCALER_MAX_PLANES);
+    else // JPEG_BUF_TYPE_DMA_BUF
+        ret = getInBuf(job.srcBufFd, job.srcLen, ThumbnailScaler::SCALER_MAX_PLANES);
+    if (ret < 0) {
+        ALOGE("Failed to retrieve the main image buffers");
+        return false;
+    }
+
+    job.thumblen = 0;
+    job.done = false;
+
+    if (!StartThumbnailWorker())
+        return false;
+
+    pthread_mutex_lock(&m_mutexWorker);
+    m_thumbJobs.push_back(&job);
+    pthread_cond_signal(&m_condWorker);
+    pthread_mutex_unlock(&m_mutexWorker);
+
+    m_bThumbJobQueued = true;
+
+    return true;
+}
+
+size_t ExynosJpegEncoderForCamera::WaitForThumbnailJob()
+{
+    if (!m_bThumbJobQueued)
+        return 0;
+
+    pthread_mutex_lock(&m_mutexWorker);
+    while (!m_thumbJob.done)
+        pthread_cond_wait(&m_condJobDone, &m_mutexWorker);
+    pthread_mutex_unlock(&m_mutexWorker);
+
+    m_bThumbJobQueued = false;
+
+    return m_thumbJob.thumblen;
 }
 
 bool ExynosJpegEncoderForCamera::ProcessExif(char *base, size_t limit,
@@ -303,11 +437,8 @@ bool ExynosJpegEncoderForCamera::PrepareCompression(bool thumbnail)
         return true;
 
     if (IsThumbGenerationNeeded()) {
-        if (pthread_create(&m_threadWorker, NULL,
-                tCompressThumbnail, reinterpret_cast<void *>(this)) != 0) {
-            ALOGERR("Failed to create thumbnail generation thread");
+        if (!QueueThumbnailJob())
             return false;
-        }
     } else {
         // allocate temporary thumbnail stream buffer
         // to prevent overflow of the compressed stream
@@ -451,6 +582,8 @@ int ExynosJpegEncoderForCamera::encode(int *size, exif_attribute_t *exifInfo,
     ssize_t mainlen = GetCompressor().Compress(&thumblen, block_mode);
     if (mainlen < 0) {
         ALOGE("Error occured while JPEG compression: %zd", mainlen);
+        // The thumbnail buffers are reused by the next compression
+        WaitForThumbnailJob();
         return -1;
     }
 
@@ -486,17 +619,9 @@ ssize_t ExynosJpegEncoderForCamera::FinishCompression(size_t mainlen, size_t thu
 
     if (thumbbase) {
         if (IsThumbGenerationNeeded()) {
-            void *len;
-            int ret = pthread_join(m_threadWorker, &len);
-            if (ret != 0) {
-                ALOGERR("Failed to wait thumbnail thread(%d)", ret);
-                return -1;
-            }
-
-            if (len == NULL)
+            thumblen = WaitForThumbnailJob();
+            if (thumblen == 0)
                 ALOGE("Error occurred during thumbnail creation: no thumbnail is embedded");
-
-            thumblen = reinterpret_cast<size_t>(len);
         } else if (TestState(STATE_NO_BTBCOMP) || !IsBTBCompressionSupported()) {
             thumblen = CompressThumbnailOnly(m_pAppWriter->GetMaxThumbnailSize(), m_nThumbQuality, getColorFormat(), checkInBufType());
         } else {
@@ -576,60 +701,35 @@ ssize_t ExynosJpegEncoderForCamera::WaitForCompression()
     return FinishCompression(streamlen, thumblen);
 }
 
-bool ExynosJpegEncoderForCamera::GenerateThumbnailImage()
+bool ExynosJpegEncoderForCamera::GenerateThumbnailImage(ThumbnailJob &job)
 {
-    int main_width, main_height;
-    if (getSize(&main_width, &main_height) < 0) {
-        ALOGE("Failed to get main image size");
-        return false;
-    }
-
-    int v4l2Format = getColorFormat();
-
-    if (!AllocThumbBuffer(v4l2Format))
+    if (!AllocThumbBuffer(job.v4l2Format))
         return false;
 
     ALOGD("Generating thumbnail image: %dx%d -> %dx%d",
-          main_width, main_height, m_nThumbWidth, m_nThumbHeight);
+          job.mainWidth, job.mainHeight, m_nThumbWidth, m_nThumbHeight);
 
     if (!mThumbnailScaler) {
         ALOGE("Thumbnail scaler is not prepared");
         return false;
     }
 
-    if (!mThumbnailScaler->SetSrcImage(main_width, main_height, v4l2Format)) {
+    if (!mThumbnailScaler->SetSrcImage(job.mainWidth, job.mainHeight, job.v4l2Format)) {
         ALOGE("Failed to configure the main image to the thumbnail scaler");
         return false;
     }
 
-
-    if (!mThumbnailScaler->SetDstImage(m_nThumbWidth, m_nThumbHeight, GetThumbnailFormat(v4l2Format))) {
+    if (!mThumbnailScaler->SetDstImage(m_nThumbWidth, m_nThumbHeight, GetThumbnailFormat(job.v4l2Format))) {
         ALOGE("Failed to configure the target image to the thumbnail scaler");
         return false;
     }
 
     bool okay = false;
 
-    if (checkInBufType() == JPEG_BUF_TYPE_USER_PTR) {
-        char *bufs[ThumbnailScaler::SCALER_MAX_PLANES];
-        int len_srcbufs[ThumbnailScaler::SCALER_MAX_PLANES];
-
-        if (getInBuf(bufs, len_srcbufs, ThumbnailScaler::SCALER_MAX_PLANES) < 0) {
-            ALOGE("Failed to retrieve the main image buffers");
-            return false;
-        }
-
-        okay = mThumbnailScaler->RunStream(bufs, len_srcbufs, m_fdIONThumbImgBuffer, m_szIONThumbImgBuffer);
-    } else { // mainbuftype == JPEG_BUF_TYPE_DMA_BUF
-        int bufs[ThumbnailScaler::SCALER_MAX_PLANES];
-        int len_srcbufs[ThumbnailScaler::SCALER_MAX_PLANES];
-
-        if (getInBuf(bufs, len_srcbufs, ThumbnailScaler::SCALER_MAX_PLANES) < 0) {
-            ALOGE("Failed to retrieve the main image buffers");
-            return false;
-        }
-        okay = mThumbnailScaler->RunStream(bufs, len_srcbufs, m_fdIONThumbImgBuffer, m_szIONThumbImgBuffer);
-    }
+    if (job.bufType == JPEG_BUF_TYPE_USER_PTR)
+        okay = mThumbnailScaler->RunStream(job.srcBufPtr, job.srcLen, m_fdIONThumbImgBuffer, m_szIONThumbImgBuffer);
+    else // mainbuftype == JPEG_BUF_TYPE_DMA_BUF
+        okay = mThumbnailScaler->RunStream(job.srcBufFd, job.srcLen, m_fdIONThumbImgBuffer, m_szIONThumbImgBuffer);
 
     if (!okay) {
         ALOGE("Failed to convert the main image to thumbnail with the thumbnail scaler");
@@ -639,25 +739,20 @@ bool ExynosJpegEncoderForCamera::GenerateThumbnailImage()
     return true;
 }
 
-size_t ExynosJpegEncoderForCamera::CompressThumbnail()
+size_t ExynosJpegEncoderForCamera::CompressThumbnail(ThumbnailJob &job)
 {
-    unsigned int v4l2Format = getColorFormat();
-    int buftype = checkInBufType();
-
-    if (IsThumbGenerationNeeded()) {
-        if (!GenerateThumbnailImage())
-            return 0;
+    if (!GenerateThumbnailImage(job))
+        return 0;
 
-        // libcsc output configured by this class is always NV21.
-        v4l2Format = GetThumbnailFormat(getColorFormat());
+    // libcsc output configured by this class is always NV21.
+    unsigned int v4l2Format = GetThumbnailFormat(job.v4l2Format);
 
-        buftype = JPEG_BUF_TYPE_DMA_BUF;
-        // reduced setInBuf2()
-        m_fdThumbnailImageBuffer[0] = m_fdIONThumbImgBuffer;
-        m_szThumbnailImageLen[0] = m_szIONThumbImgBuffer;
-    }
+    // reduced setInBuf2()
+    m_fdThumbnailImageBuffer[0] = m_fdIONThumbImgBuffer;
+    m_szThumbnailImageLen[0] = m_szIONThumbImgBuffer;
 
-    return CompressThumbnailOnly(m_pAppWriter->GetMaxThumbnailSize(), m_nThumbQuality, v4l2Format, buftype);
+    return CompressThumbnailOnly(m_pAppWriter->GetMaxThumbnailSize(), m_nThumbQuality,
+                                 v4l2Format, JPEG_BUF_TYPE_DMA_BUF);
 }
 
 bool ExynosJpegEncoderForCamera::AllocThumbBuffer(int v4l2Format)
@@ -699,6 +794,47 @@ bool ExynosJpegEncoderForCamera::AllocThumbBuffer(int v4l2Format)
     return AllocThumbJpegBuffer();
 }
 
+char *ExynosJpegEncoderForCamera::MapThumbJpegBuffer(size_t len, int *fd)
+{
+    *fd = exynos_ion_alloc(m_fdIONClient, len, EXYNOS_ION_HEAP_SYSTEM_MASK,
+                           ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC);
+    if (*fd < 0) {
+        ALOGERR("Failed to allocate %zu bytes for thumbnail stream buffer of %ux%u",
+                len, m_nThumbHeight, m_nThumbWidth);
+        *fd = -1;
+        return NULL;
+    }
+
+    char *addr = reinterpret_cast<char *>(mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0));
+    if (addr == MAP_FAILED) {
+        ALOGERR("Failed to map thumbnail stream buffer (%zu bytes)", len);
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+
+    return addr;
+}
+
+void ExynosJpegEncoderForCamera::FreeThumbJpegBuffer()
+{
+    if (m_pIONThumbJpegBuffer) {
+        munmap(m_pIONThumbJpegBuffer, m_szIONThumbJpegBuffer);
+        close(m_fdIONThumbJpegBuffer);
+    }
+
+    if (m_pIONThumbJpegScratch) {
+        munmap(m_pIONThumbJpegScratch, m_szIONThumbJpegBuffer);
+        close(m_fdIONThumbJpegScratch);
+    }
+
+    m_szIONThumbJpegBuffer = 0;
+    m_pIONThumbJpegBuffer = NULL;
+    m_fdIONThumbJpegBuffer = -1;
+    m_pIONThumbJpegScratch = NULL;
+    m_fdIONThumbJpegScratch = -1;
+}
+
 bool ExynosJpegEncoderForCamera::AllocThumbJpegBuffer()
 {
     if (m_fdIONClient < 0) {
@@ -712,33 +848,22 @@ bool ExynosJpegEncoderForCamera::AllocThumbJpegBuffer()
         if (m_szIONThumbJpegBuffer >= thumbbufsize)
             return true;
 
-        munmap(m_pIONThumbJpegBuffer, m_szIONThumbJpegBuffer);
-        close(m_fdIONThumbJpegBuffer);
-
-        m_szIONThumbJpegBuffer = 0;
-        m_pIONThumbJpegBuffer = NULL;
-        m_fdIONThumbJpegBuffer = -1;
+        FreeThumbJpegBuffer();
     }
 
-    m_fdIONThumbJpegBuffer = exynos_ion_alloc(m_fdIONClient, thumbbufsize, EXYNOS_ION_HEAP_SYSTEM_MASK,
-                              ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC);
-    if (m_fdIONThumbJpegBuffer < 0) {
-        ALOGERR("Failed to allocate %zu bytes for thumbnail stream buffer of %ux%u",
-                thumbbufsize, m_nThumbHeight, m_nThumbWidth);
+    m_pIONThumbJpegBuffer = MapThumbJpegBuffer(thumbbufsize, &m_fdIONThumbJpegBuffer);
+    if (m_pIONThumbJpegBuffer == NULL)
         return false;
-    }
 
-    m_pIONThumbJpegBuffer = reinterpret_cast<char *>(
-                        mmap(NULL, thumbbufsize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fdIONThumbJpegBuffer, 0));
-    if (m_pIONThumbJpegBuffer == MAP_FAILED) {
-        ALOGERR("Failed to map thumbnail stream buffer (%zu bytes)", thumbbufsize);
+    m_szIONThumbJpegBuffer = thumbbufsize;
 
-        m_pIONThumbJpegBuffer = NULL;
-    } else {
-        m_szIONThumbJpegBuffer = thumbbufsize;
+    m_pIONThumbJpegScratch = MapThumbJpegBuffer(thumbbufsize, &m_fdIONThumbJpegScratch);
+    if (m_pIONThumbJpegScratch == NULL) {
+        FreeThumbJpegBuffer();
+        return false;
     }
 
-    return m_pIONThumbJpegBuffer != NULL;
+    return true;
 }
 
 size_t ExynosJpegEncoderForCamera::CompressThumbnailOnly(size_t limit, int quality,
@@ -775,44 +900,115 @@ size_t ExynosJpegEncoderForCamera::CompressThumbnailOnly(size_t limit, int quali
         }
     }
 
-    if (!m_phwjpeg4thumb->SetJpegBuffer(m_fdIONThumbJpegBuffer, m_szIONThumbJpegBuffer)) {
-        ALOGE("Failed to configure thumbnail stream buffer (fd %d, size %zu)",
-                m_fdIONThumbJpegBuffer, m_szIONThumbJpegBuffer);
-        return 0;
-    }
-
     // Since the compressed stream of the thumbnail image is to be embedded in
     // APP1 segment, at the end of Exif metadata, the length of the stream should
     // not exceed the maximum length of a segment, 64KB minus the length of Exif
-    // metadata. If the stream length is too large, repeat the compression until
-    // the length become proper to embed.
-    do {
+    // metadata. The quality factor is chosen to make the stream fit from the
+    // prediction of mThumbnailRateControl. If the stream length is still too
+    // large, the prediction that learned the last result chooses the next
+    // quality factor between the known bounds.
+    if (src_buftype == JPEG_BUF_TYPE_USER_PTR)
+        mThumbnailRateControl->AnalyzeImage(m_pThumbnailImageBuffer[0], m_szThumbnailImageLen[0],
+                                            m_nThumbWidth, m_nThumbHeight, v4l2Format);
+    else
+        mThumbnailRateControl->AnalyzeImage(m_fdThumbnailImageBuffer[0], m_szThumbnailImageLen[0],
+                                            m_nThumbWidth, m_nThumbHeight, v4l2Format);
+
+    // The best stream found so far stays in one of the buffers while the
+    // next quality factor is tried with the other one.
+    char *streams[2] = {m_pIONThumbJpegBuffer, m_pIONThumbJpegScratch};
+    int fds[2] = {m_fdIONThumbJpegBuffer, m_fdIONThumbJpegScratch};
+    unsigned int cur = 0;
+    unsigned int beststream = 0;
+
+    int low = min(quality, static_cast<int>(ThumbnailRateControl::MIN_QUALITY));
+    int high = quality;
+    int best = -1;
+    ssize_t bestsize = 0;
+    unsigned int runs = 0;
+    ssize_t thumbsize = 0;
+
+    quality = mThumbnailRateControl->PredictQuality(quality, limit);
+
+    // A hit at the first compression is accepted as the prediction. After a
+    // miss, the search narrows [low, high] to the highest quality factor that
+    // fits until the range is smaller than THUMB_QUALITY_TOLERANCE or
+    // THUMB_MAX_RUNS compressions are done. The lowest quality factor is the
+    // last resort if nothing fitted by then.
+    while (true) {
         if (!m_phwjpeg4thumb->SetQuality(quality)) {
             ALOGE("Failed to configure thumbnail quality factor %u", quality);
             return 0;
         }
 
-        ssize_t thumbsize = m_phwjpeg4thumb->Compress();
+        if (!m_phwjpeg4thumb->SetJpegBuffer(fds[cur], m_szIONThumbJpegBuffer)) {
+            ALOGE("Failed to configure thumbnail stream buffer (fd %d, size %zu)",
+                    fds[cur], m_szIONThumbJpegBuffer);
+            return 0;
+        }
+
+        thumbsize = m_phwjpeg4thumb->Compress();
         if (thumbsize < 0) {
             ALOGE("Failed to compress thumbnail");
             return 0;
         }
 
-        thumbsize = RemoveTrailingDummies(m_pIONThumbJpegBuffer, thumbsize);
-        if (static_cast<size_t>(thumbsize) > limit) {
-            quality = min(50, quality - 10);
-            ALOGI_IF(quality >= 20,
-                     "Too large thumbnail stream size %zu. Retrying with quality factor %d...",
-                     thumbsize, quality);
+        runs++;
+        thumbsize = RemoveTrailingDummies(streams[cur], thumbsize);
+        mThumbnailRateControl->Update(quality, thumbsize);
+
+        if (static_cast<size_t>(thumbsize) <= limit) {
+            best = quality;
+            bestsize = thumbsize;
+            beststream = cur;
+            cur ^= 1;
+            if (runs == 1)
+                break;
+            low = quality + 1;
         } else {
-            return thumbsize;
+            high = quality - 1;
         }
-    } while (quality >= 20);
 
-    ALOG_ASSERT(false, "It should never reach here");
-    ALOGE("Thumbnail compression finally failed");
+        if (high < low)
+            break;
 
-    return 0;
+        if (best >= 0) {
+            if (((high - low) < THUMB_QUALITY_TOLERANCE) || (runs >= THUMB_MAX_RUNS))
+                break;
+        } else if (runs >= THUMB_MAX_RUNS) {
+            // Nothing fitted so far. The lowest quality factor decides.
+            high = low;
+        }
+
+        // The prediction is optimistic near the quality factors it has just
+        // learned. It should not probe beyond the midpoint of the range in
+        // the direction of the last result not to narrow the range slower
+        // than bisection.
+        int mid = (low + high + 1) / 2;
+        int next = mThumbnailRateControl->PredictQuality(high, limit);
+        if (static_cast<size_t>(thumbsize) > limit)
+            next = min(next, mid);
+        else
+            next = max(next, mid);
+        next = max(low, min(next, high));
+        ALOGI("Thumbnail stream size %zd with quality factor %d (limit %zu). Retrying with quality factor %d...",
+              thumbsize, quality, limit, next);
+        quality = next;
+    }
+
+    if (best < 0) {
+        mThumbnailRateControl->FinishEncode(quality, thumbsize, limit, runs, false);
+        ALOGE("Thumbnail compression finally failed");
+        return 0;
+    }
+
+    // The users find the thumbnail stream in m_pIONThumbJpegBuffer
+    if (streams[beststream] != m_pIONThumbJpegBuffer)
+        memcpy(m_pIONThumbJpegBuffer, streams[beststream], bestsize);
+
+    mThumbnailRateControl->FinishEncode(best, bestsize, limit, runs, true);
+
+    return bestsize;
 }
 
 int ExynosJpegEncoderForCamera::setInBuf2(int *piBuf, int *iSize)
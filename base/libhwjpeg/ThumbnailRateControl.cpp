@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2019 Samsung Electronics Co.,LTD.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+#include "hwjpeg-internal.h"
+#include "ThumbnailRateControl.h"
+
+// Bytes per pixel of the stream of YUV420 image with the reference activity
+static const struct {
+    int quality;
+    float bpp;
+} priorBytesPerPixel[] = {
+    { 20, 0.060f}, { 30, 0.075f}, { 40, 0.088f}, { 50, 0.100f}, { 60, 0.115f},
+    { 70, 0.135f}, { 80, 0.170f}, { 90, 0.250f}, {100, 0.650f},
+};
+
+// Quantization and Huffman tables, SOF, SOS and the markers
+#define STREAM_HEADER_SIZE      620
+// Mean absolute difference of the neighboring luma samples of the reference image
+#define REFERENCE_ACTIVITY      6.0f
+#define ACTIVITY_BIAS           2.0f
+#define ACTIVITY_SAMPLE_STEP    4
+// Weight of the latest sample to the learned ratio
+#define RATIO_EMA_ALPHA         0.25f
+// The ratio learned for the quality factors nearer than this is borrowed
+#define RATIO_BORROW_DISTANCE   10
+
+static float GetPriorBytesPerPixel(int quality)
+{
+    if (quality <= priorBytesPerPixel[0].quality)
+        return priorBytesPerPixel[0].bpp;
+
+    for (size_t i = 1; i < ARRSIZE(priorBytesPerPixel); i++) {
+        if (quality <= priorBytesPerPixel[i].quality) {
+            float pos = static_cast<float>(quality - priorBytesPerPixel[i - 1].quality) /
+                        (priorBytesPerPixel[i].quality - priorBytesPerPixel[i - 1].quality);
+            return priorBytesPerPixel[i - 1].bpp + pos * (priorBytesPerPixel[i].bpp - priorBytesPerPixel[i - 1].bpp);
+        }
+    }
+
+    return priorBytesPerPixel[ARRSIZE(priorBytesPerPixel) - 1].bpp;
+}
+
+ThumbnailRateControl::ThumbnailRateControl()
+    : mPixels(0), mActivityScale(1.0f), mEncodes(0), mHits(0), mRetries(0), mMaxRuns(0), mFailures(0)
+{
+    for (int i = 0; i <= MAX_QUALITY; i++) {
+        mRatio[i] = 1.0f;
+        mSamples[i] = 0;
+    }
+}
+
+ThumbnailRateControl::~ThumbnailRateControl()
+{
+    if (mEncodes > 0)
+        ALOGD("Thumbnail rate control: %u encodes, %u hits at the first compression, %u retries (max %u runs), %u failures",
+              mEncodes, mHits, mRetries, mMaxRuns, mFailures);
+}
+
+void ThumbnailRateControl::AnalyzeImage(const char *buf, size_t len, unsigned int width, unsigned int height,
+                                        unsigned int v4l2_format)
+{
+    mPixels = width * height;
+    mActivityScale = 1.0f;
+
+    if ((buf == NULL) || (width < 2) || (height < 2))
+        return;
+
+    // offset and distance of the luma samples in a line
+    size_t offset = 0, pitch = 1;
+    switch (v4l2_format) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV21M:
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_YVU420M:
+    case V4L2_PIX_FMT_NV16:
+    case V4L2_PIX_FMT_NV61:
+    case V4L2_PIX_FMT_YUV422P:
+        break;
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_VYUY:
+        offset = 1;
+        [[clang::fallthrough]];
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_YVYU:
+        pitch = 2;
+        break;
+    default:
+        return;
+    }
+
+    size_t stride = width * pitch;
+    if (len < stride * height)
+        return;
+
+    unsigned long sum = 0;
+    unsigned long count = 0;
+    for (unsigned int y = 0; y < height - 1; y += ACTIVITY_SAMPLE_STEP) {
+        const unsigned char *line = reinterpret_cast<const unsigned char *>(buf) + stride * y + offset;
+        for (unsigned int x = 0; x < width - 1; x += ACTIVITY_SAMPLE_STEP) {
+            int luma = line[x * pitch];
+            sum += abs(luma - line[(x + 1) * pitch]);
+            sum += abs(luma - line[x * pitch + stride]);
+            count += 2;
+        }
+    }
+
+    float activity = static_cast<float>(sum) / count;
+    mActivityScale = (activity + ACTIVITY_BIAS) / (REFERENCE_ACTIVITY + ACTIVITY_BIAS);
+    mActivityScale = max(0.25f, min(mActivityScale, 4.0f));
+}
+
+void ThumbnailRateControl::AnalyzeImage(int fd, size_t len, unsigned int width, unsigned int height,
+                                        unsigned int v4l2_format)
+{
+    void *buf = MAP_FAILED;
+
+    if ((fd >= 0) && (len > 0))
+        buf = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (buf == MAP_FAILED) {
+        // The reference activity is assumed
+        AnalyzeImage(static_cast<const char *>(NULL), 0, width, height, v4l2_format);
+        return;
+    }
+
+    AnalyzeImage(static_cast<const char *>(buf), len, width, height, v4l2_format);
+
+    munmap(buf, len);
+}
+
+size_t ThumbnailRateControl::PredictSize(int quality, float *tolerance)
+{
+    float ratio = 1.0f;
+
+    *tolerance = 1.25f; // not confident in the prior only
+
+    if (mSamples[quality] > 0) {
+        ratio = mRatio[quality];
+        *tolerance = 1.0f;
+    } else {
+        for (int d = 1; d <= RATIO_BORROW_DISTANCE; d++) {
+            if ((quality - d >= MIN_QUALITY) && (mSamples[quality - d] > 0)) {
+                ratio = mRatio[quality - d];
+                *tolerance = 1.1f;
+                break;
+            }
+            if ((quality + d <= MAX_QUALITY) && (mSamples[quality + d] > 0)) {
+                ratio = mRatio[quality + d];
+                *tolerance = 1.1f;
+                break;
+            }
+        }
+    }
+
+    return STREAM_HEADER_SIZE + static_cast<size_t>(mPixels * GetPriorBytesPerPixel(quality) * mActivityScale * ratio);
+}
+
+int ThumbnailRateControl::PredictQuality(int max_quality, size_t limit)
+{
+    // Lower quality factors than MIN_QUALITY are given by the user
+    if (max_quality <= MIN_QUALITY)
+        return max_quality;
+
+    max_quality = min(max_quality, MAX_QUALITY);
+
+    for (int quality = max_quality; quality > MIN_QUALITY; quality--) {
+        float tolerance;
+        size_t size = PredictSize(quality, &tolerance);
+        if (size <= limit * tolerance)
+            return quality;
+    }
+
+    return MIN_QUALITY;
+}
+
+void ThumbnailRateControl::Update(int quality, size_t size)
+{
+    if ((quality < MIN_QUALITY) || (quality > MAX_QUALITY) || (mPixels == 0))
+        return;
+
+    float prior = mPixels * GetPriorBytesPerPixel(quality) * mActivityScale;
+    float ratio = static_cast<float>(max(size, static_cast<size_t>(STREAM_HEADER_SIZE)) - STREAM_HEADER_SIZE) / prior;
+    ratio = max(0.1f, min(ratio, 10.0f));
+
+    if (mSamples[quality] == 0)
+        mRatio[quality] = ratio;
+    else
+        mRatio[quality] += RATIO_EMA_ALPHA * (ratio - mRatio[quality]);
+
+    mSamples[quality]++;
+}
+
+void ThumbnailRateControl::FinishEncode(int quality, size_t size, size_t limit, unsigned int runs, bool success)
+{
+    mEncodes++;
+    if (success && (runs == 1))
+        mHits++;
+    if (!success)
+        mFailures++;
+    mRetries += runs - 1;
+    mMaxRuns = max(mMaxRuns, runs);
+
+    ALOGD("Thumbnail quality factor %d, %zu bytes (limit %zu) after %u compression(s), hit rate %u/%u",
+          quality, size, limit, runs, mHits, mEncodes);
+}
+
+void ThumbnailRateControl::GetStatistics(unsigned int *encodes, unsigned int *hits, unsigned int *retries)
+{
+    *encodes = mEncodes;
+    *hits = mHits;
+    *retries = mRetries;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2019 Samsung Electronics Co.,LTD.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __HARDWARE_EXYNOS_THUMBNAIL_RATE_CONTROL_H__
+#define __HARDWARE_EXYNOS_THUMBNAIL_RATE_CONTROL_H__
+
+#include <cstddef>
+
+/*
+ * ThumbnailRateControl chooses the quality factor of the thumbnail so that
+ * the compressed stream fits in APP1 segment at the first compression.
+ * The stream size is predicted from the number of pixels, the activity of
+ * the luma of the thumbnail image and the ratio of the actual stream size
+ * to the prediction that is learned for each quality factor.
+ */
+class ThumbnailRateControl {
+public:
+    const static int MIN_QUALITY = 20;
+    const static int MAX_QUALITY = 100;
+
+    ThumbnailRateControl();
+    ~ThumbnailRateControl();
+
+    // Measure the activity of the image to be compressed. The activity of
+    // the average image is assumed if the luma of the image is not known.
+    void AnalyzeImage(const char *buf, size_t len, unsigned int width, unsigned int height,
+                      unsigned int v4l2_format);
+    void AnalyzeImage(int fd, size_t len, unsigned int width, unsigned int height,
+                      unsigned int v4l2_format);
+
+    // The highest quality factor not larger than max_quality that is
+    // expected to make a stream not larger than limit
+    int PredictQuality(int max_quality, size_t limit);
+
+    // Record the stream size compressed with quality
+    void Update(int quality, size_t size);
+
+    // Record the result of an encoding that compressed runs times
+    void FinishEncode(int quality, size_t size, size_t limit, unsigned int runs, bool success);
+
+    void GetStatistics(unsigned int *encodes, unsigned int *hits, unsigned int *retries);
+
+private:
+    size_t PredictSize(int quality, float *tolerance);
+
+    unsigned int mPixels;
+    float mActivityScale;
+
+    // learned ratio of the actual stream size to the prior prediction
+    float mRatio[MAX_QUALITY + 1];
+    unsigned int mSamples[MAX_QUALITY + 1];
+
+    unsigned int mEncodes;
+    unsigned int mHits;         // the first compression fitted
+    unsigned int mRetries;      // compressions after the first one
+    unsigned int mMaxRuns;
+    unsigned int mFailures;
+};
+
+#endif //__HARDWARE_EXYNOS_THUMBNAIL_RATE_CONTROL_H__
@@ -0,0 +1,1092 @@
+/*
+ * Copyright Samsung Electronics Co.,LTD.
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include <exynos-hwjpeg.h>
+#include "hwjpeg-internal.h"
+
+/*
+ * The inner loops of the DCT and the quantization run over eight lanes of
+ * contiguous samples so that the compiler vectorizes them with NEON on ARM
+ * and SSE on the host. The color conversion runs over the samples of a line.
+ */
+
+// zig-zag scan order to natural order
+static const unsigned char natural_order[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Quantization tables of ITU-T T.81 Annex K in natural order
+static const unsigned char std_luma_qtable[64] = {
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99,
+};
+
+static const unsigned char std_chroma_qtable[64] = {
+    17,  18,  24,  47,  99,  99,  99,  99,
+    18,  21,  26,  66,  99,  99,  99,  99,
+    24,  26,  56,  99,  99,  99,  99,  99,
+    47,  66,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+};
+
+// Huffman tables of ITU-T T.81 Annex K: the number of codes of each length and the symbols
+static const unsigned char dc_luma_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const unsigned char dc_chroma_bits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const unsigned char dc_vals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const unsigned char ac_luma_bits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const unsigned char ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const unsigned char ac_chroma_bits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const unsigned char ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+// Scale factors of the outputs of AAN DCT: cos(k * PI / 16) * sqrt(2) except k = 0
+static const float aan_scales[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f,
+};
+
+#define DEFAULT_QUALITY_FACTOR  90
+
+struct huff_table {
+    unsigned short code[256];
+    unsigned char size[256];
+};
+
+enum {
+    HUFF_DC_LUMA,
+    HUFF_AC_LUMA,
+    HUFF_DC_CHROMA,
+    HUFF_AC_CHROMA,
+    HUFF_NUM,
+};
+
+static huff_table huff_tables[HUFF_NUM];
+static pthread_once_t huff_tables_once = PTHREAD_ONCE_INIT;
+
+// The position of the coefficients in the output of FDCT() in the zig-zag scan order
+static unsigned char fdct_order[64];
+
+static void BuildHuffTable(const unsigned char bits[16], const unsigned char vals[], huff_table *table)
+{
+    unsigned int code = 0;
+    unsigned int k = 0;
+
+    memset(table, 0, sizeof(*table));
+
+    for (unsigned int len = 1; len <= 16; len++) {
+        for (unsigned int i = 0; i < bits[len - 1]; i++, k++) {
+            table->code[vals[k]] = static_cast<unsigned short>(code++);
+            table->size[vals[k]] = static_cast<unsigned char>(len);
+        }
+        code <<= 1;
+    }
+}
+
+static void BuildTables()
+{
+    BuildHuffTable(dc_luma_bits, dc_vals, &huff_tables[HUFF_DC_LUMA]);
+    BuildHuffTable(ac_luma_bits, ac_luma_vals, &huff_tables[HUFF_AC_LUMA]);
+    BuildHuffTable(dc_chroma_bits, dc_vals, &huff_tables[HUFF_DC_CHROMA]);
+    BuildHuffTable(ac_chroma_bits, ac_chroma_vals, &huff_tables[HUFF_AC_CHROMA]);
+
+    // FDCT() leaves the coefficients transposed
+    for (unsigned int k = 0; k < 64; k++)
+        fdct_order[k] = ((natural_order[k] % 8) * 8) + (natural_order[k] / 8);
+}
+
+/*
+ * AAN forward DCT of the eight columns of @blk at once. Each statement
+ * operates on eight lanes of the contiguous samples of a row.
+ */
+static inline void FDCTColumns(float blk[64])
+{
+    float tmp0[8], tmp1[8], tmp2[8], tmp3[8], tmp4[8], tmp5[8], tmp6[8], tmp7[8];
+
+    for (int i = 0; i < 8; i++) {
+        tmp0[i] = blk[0 * 8 + i] + blk[7 * 8 + i];
+        tmp7[i] = blk[0 * 8 + i] - blk[7 * 8 + i];
+        tmp1[i] = blk[1 * 8 + i] + blk[6 * 8 + i];
+        tmp6[i] = blk[1 * 8 + i] - blk[6 * 8 + i];
+        tmp2[i] = blk[2 * 8 + i] + blk[5 * 8 + i];
+        tmp5[i] = blk[2 * 8 + i] - blk[5 * 8 + i];
+        tmp3[i] = blk[3 * 8 + i] + blk[4 * 8 + i];
+        tmp4[i] = blk[3 * 8 + i] - blk[4 * 8 + i];
+    }
+
+    for (int i = 0; i < 8; i++) {
+        // even part
+        float tmp10 = tmp0[i] + tmp3[i];
+        float tmp13 = tmp0[i] - tmp3[i];
+        float tmp11 = tmp1[i] + tmp2[i];
+        float tmp12 = tmp1[i] - tmp2[i];
+
+        blk[0 * 8 + i] = tmp10 + tmp11;
+        blk[4 * 8 + i] = tmp10 - tmp11;
+
+        float z1 = (tmp12 + tmp13) * 0.707106781f;
+        blk[2 * 8 + i] = tmp13 + z1;
+        blk[6 * 8 + i] = tmp13 - z1;
+
+        // odd part
+        tmp10 = tmp4[i] + tmp5[i];
+        tmp11 = tmp5[i] + tmp6[i];
+        tmp12 = tmp6[i] + tmp7[i];
+
+        float z5 = (tmp10 - tmp12) * 0.382683433f;
+        float z2 = 0.541196100f * tmp10 + z5;
+        float z4 = 1.306562965f * tmp12 + z5;
+        float z3 = tmp11 * 0.707106781f;
+
+        float z11 = tmp7[i] + z3;
+        float z13 = tmp7[i] - z3;
+
+        blk[5 * 8 + i] = z13 + z2;
+        blk[3 * 8 + i] = z13 - z2;
+        blk[1 * 8 + i] = z11 + z4;
+        blk[7 * 8 + i] = z11 - z4;
+    }
+}
+
+static inline void Transpose(float blk[64])
+{
+    for (int i = 0; i < 8; i++) {
+        for (int j = i + 1; j < 8; j++) {
+            float t = blk[i * 8 + j];
+            blk[i * 8 + j] = blk[j * 8 + i];
+            blk[j * 8 + i] = t;
+        }
+    }
+}
+
+// The coefficients are stored in the transposed order, fdct_order[]
+static inline void FDCT(float blk[64])
+{
+    FDCTColumns(blk);
+    Transpose(blk);
+    FDCTColumns(blk);
+}
+
+// @divisors has the reciprocals of the quantizers scaled by AAN DCT in the transposed order
+static inline void Quantize(const float blk[64], const float divisors[64], int coefs[64])
+{
+    // Rounding toward the nearest without lrintf() that is not vectorized
+    for (int i = 0; i < 64; i++)
+        coefs[i] = static_cast<int>(blk[i] * divisors[i] + 16384.5f) - 16384;
+}
+
+class CSWJpegBitWriter {
+    std::vector<unsigned char> &m_Stream;
+    unsigned long long m_uiBuffer;
+    unsigned int m_uiBits;
+public:
+    CSWJpegBitWriter(std::vector<unsigned char> &stream) : m_Stream(stream), m_uiBuffer(0), m_uiBits(0) { }
+
+    inline void Put(unsigned int code, unsigned int size) {
+        m_uiBuffer = (m_uiBuffer << size) | (code & ((1U << size) - 1));
+        m_uiBits += size;
+        while (m_uiBits >= 8) {
+            m_uiBits -= 8;
+            unsigned char c = static_cast<unsigned char>(m_uiBuffer >> m_uiBits);
+            m_Stream.push_back(c);
+            if (c == 0xFF)
+                m_Stream.push_back(0); // byte stuffing
+        }
+    }
+
+    // Pad the last byte with 1s
+    void Flush() {
+        unsigned int pad = (8 - m_uiBits) & 7;
+        if (pad)
+            Put((1U << pad) - 1, pad);
+    }
+
+    void PutMarker(unsigned char marker) {
+        m_Stream.push_back(0xFF);
+        m_Stream.push_back(marker);
+    }
+};
+
+static inline unsigned int BitLength(int val)
+{
+    return (val == 0) ? 0 : 32 - __builtin_clz(static_cast<unsigned int>(val));
+}
+
+static void EncodeBlock(CSWJpegBitWriter &writer, const int coefs[64], int &dcpred,
+                        const huff_table &dc, const huff_table &ac)
+{
+    int diff = coefs[0] - dcpred;
+    dcpred = coefs[0];
+
+    int mag = (diff < 0) ? -diff : diff;
+    unsigned int nbits = BitLength(mag);
+    writer.Put(dc.code[nbits], dc.size[nbits]);
+    if (nbits)
+        writer.Put((diff < 0) ? diff - 1 : diff, nbits);
+
+    unsigned int run = 0;
+    for (unsigned int k = 1; k < 64; k++) {
+        int val = coefs[fdct_order[k]];
+        if (val == 0) {
+            run++;
+            continue;
+        }
+
+        while (run > 15) {
+            writer.Put(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+
+        mag = (val < 0) ? -val : val;
+        nbits = BitLength(mag);
+        unsigned int symbol = (run << 4) + nbits;
+        writer.Put(ac.code[symbol], ac.size[symbol]);
+        writer.Put((val < 0) ? val - 1 : val, nbits);
+        run = 0;
+    }
+
+    if (run > 0)
+        writer.Put(ac.code[0], ac.size[0]); // EOB
+}
+
+struct sw_jpeg_image {
+    unsigned int format;
+    unsigned int width;
+    unsigned int height;
+    const unsigned char *planes[3]; // Y, Cb and Cr (or the packed pixels at planes[0])
+
+    unsigned int num_comps;
+    unsigned int hfactor;
+    unsigned int vfactor;
+    unsigned int mcus_x;
+    unsigned int mcus_y;
+    unsigned int restart_interval;
+
+    float divisors[2][64];
+};
+
+struct sw_jpeg_slice {
+    const sw_jpeg_image *image;
+    unsigned int first_row; // in MCU rows
+    unsigned int last_row;
+    std::vector<unsigned char> stream;
+};
+
+static inline short ClampSample(int val)
+{
+    return static_cast<short>((val < 0) ? 0 : ((val > 255) ? 255 : val));
+}
+
+// Fixed point BT.601 full range conversion of JFIF with 16 bit fraction
+static inline void ConvertRGB(const unsigned char *src, unsigned int width, unsigned int pitch,
+                              unsigned int roff, unsigned int goff, unsigned int boff,
+                              short *y, short *cb, short *cr)
+{
+    for (unsigned int x = 0; x < width; x++) {
+        int r = src[x * pitch + roff];
+        int g = src[x * pitch + goff];
+        int b = src[x * pitch + boff];
+        y[x] = static_cast<short>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+        cb[x] = ClampSample((-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16);
+        cr[x] = ClampSample((32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16);
+    }
+}
+
+static inline void ConvertRGB565(const unsigned char *src, unsigned int width,
+                                 short *y, short *cb, short *cr)
+{
+    for (unsigned int x = 0; x < width; x++) {
+        unsigned int pixel = src[x * 2] | (src[x * 2 + 1] << 8);
+        int r = ((pixel >> 11) & 0x1F) * 255 / 31;
+        int g = ((pixel >> 5) & 0x3F) * 255 / 63;
+        int b = (pixel & 0x1F) * 255 / 31;
+        y[x] = static_cast<short>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+        cb[x] = ClampSample((-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16);
+        cr[x] = ClampSample((32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16);
+    }
+}
+
+// 4:2:2 packed formats. @off has the offsets of Y0, Cb, Y1 and Cr in a pair of pixels.
+static inline void ConvertPacked422(const unsigned char *src, unsigned int width, const unsigned int off[4],
+                                    short *y, short *cb, short *cr)
+{
+    for (unsigned int x = 0; x < width; x += 2) {
+        const unsigned char *pair = src + x * 2;
+        y[x] = pair[off[0]];
+        y[x + 1] = pair[off[2]];
+        cb[x] = cb[x + 1] = pair[off[1]];
+        cr[x] = cr[x + 1] = pair[off[3]];
+    }
+}
+
+static inline void ConvertSemiPlanar(const unsigned char *luma, const unsigned char *chroma,
+                                     unsigned int width, bool crcb, short *y, short *cb, short *cr)
+{
+    for (unsigned int x = 0; x < width; x++)
+        y[x] = luma[x];
+
+    unsigned int cboff = crcb ? 1 : 0;
+    for (unsigned int x = 0; x < width; x += 2) {
+        cb[x] = cb[x + 1] = chroma[x + cboff];
+        cr[x] = cr[x + 1] = chroma[x + 1 - cboff];
+    }
+}
+
+static inline void ConvertPlanar(const unsigned char *luma, const unsigned char *cbline,
+                                 const unsigned char *crline, unsigned int width,
+                                 short *y, short *cb, short *cr)
+{
+    for (unsigned int x = 0; x < width; x++)
+        y[x] = luma[x];
+
+    for (unsigned int x = 0; x < width; x += 2) {
+        cb[x] = cb[x + 1] = cbline[x / 2];
+        cr[x] = cr[x + 1] = crline[x / 2];
+    }
+}
+
+// Read a line of @img to the full resolution Y, Cb and Cr samples
+static void LoadLine(const sw_jpeg_image &img, unsigned int line, short *y, short *cb, short *cr)
+{
+    static const unsigned int yuyv[4] = {0, 1, 2, 3};
+    static const unsigned int yvyu[4] = {0, 3, 2, 1};
+    static const unsigned int uyvy[4] = {1, 0, 3, 2};
+    static const unsigned int vyuy[4] = {1, 2, 3, 0};
+
+    unsigned int w = img.width;
+    const unsigned char *luma = img.planes[0] + w * line;
+
+    switch (img.format) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV21M:
+        ConvertSemiPlanar(luma, img.planes[1] + w * (line / 2), w,
+                          (img.format == V4L2_PIX_FMT_NV21) || (img.format == V4L2_PIX_FMT_NV21M),
+                          y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_NV16:
+    case V4L2_PIX_FMT_NV61:
+        ConvertSemiPlanar(luma, img.planes[1] + w * line, w, img.format == V4L2_PIX_FMT_NV61, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_YVU420M:
+        ConvertPlanar(luma, img.planes[1] + (w / 2) * (line / 2), img.planes[2] + (w / 2) * (line / 2),
+                      w, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_YUV422P:
+        ConvertPlanar(luma, img.planes[1] + (w / 2) * line, img.planes[2] + (w / 2) * line, w, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_YUYV:
+        ConvertPacked422(img.planes[0] + w * 2 * line, w, yuyv, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_YVYU:
+        ConvertPacked422(img.planes[0] + w * 2 * line, w, yvyu, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_UYVY:
+        ConvertPacked422(img.planes[0] + w * 2 * line, w, uyvy, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_VYUY:
+        ConvertPacked422(img.planes[0] + w * 2 * line, w, vyuy, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_RGB24:
+        ConvertRGB(img.planes[0] + w * 3 * line, w, 3, 0, 1, 2, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_BGR24:
+        ConvertRGB(img.planes[0] + w * 3 * line, w, 3, 2, 1, 0, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_RGB32: // RGBA8888 on Exynos
+        ConvertRGB(img.planes[0] + w * 4 * line, w, 4, 0, 1, 2, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_BGR32: // BGRA8888 on Exynos
+        ConvertRGB(img.planes[0] + w * 4 * line, w, 4, 2, 1, 0, y, cb, cr);
+        break;
+    case V4L2_PIX_FMT_RGB565:
+        ConvertRGB565(img.planes[0] + w * 2 * line, w, y, cb, cr);
+        break;
+    }
+}
+
+static inline void LoadLumaBlock(const short *band, unsigned int stride, float blk[64])
+{
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++)
+            blk[i * 8 + j] = static_cast<float>(band[i * stride + j] - 128);
+    }
+}
+
+// Average hfactor x vfactor samples to a chroma sample
+static inline void LoadChromaBlock(const short *band, unsigned int stride,
+                                   unsigned int hfactor, unsigned int vfactor, float blk[64])
+{
+    float scale = 1.0f / (hfactor * vfactor);
+
+    for (unsigned int i = 0; i < 8; i++) {
+        for (unsigned int j = 0; j < 8; j++) {
+            int sum = 0;
+            for (unsigned int v = 0; v < vfactor; v++) {
+                const short *line = band + (i * vfactor + v) * stride + j * hfactor;
+                for (unsigned int h = 0; h < hfactor; h++)
+                    sum += line[h];
+            }
+            blk[i * 8 + j] = sum * scale - 128.0f;
+        }
+    }
+}
+
+static void *CompressSlice(void *priv)
+{
+    sw_jpeg_slice *slice = reinterpret_cast<sw_jpeg_slice *>(priv);
+    const sw_jpeg_image &img = *slice->image;
+    // The MCU of a grayscale image is a block
+    unsigned int mcu_width = (img.num_comps == 1) ? 8 : 8 * img.hfactor;
+    unsigned int mcu_height = (img.num_comps == 1) ? 8 : 8 * img.vfactor;
+    unsigned int stride = img.mcus_x * mcu_width;
+
+    std::vector<short> bands(stride * mcu_height * 3);
+    short *band[3] = {&bands[0], &bands[stride * mcu_height], &bands[stride * mcu_height * 2]};
+
+    CSWJpegBitWriter writer(slice->stream);
+    float blk[64];
+    int coefs[64];
+    int dcpred[3];
+
+    for (unsigned int row = slice->first_row; row < slice->last_row; row++) {
+        for (unsigned int l = 0; l < mcu_height; l++) {
+            short *y = band[0] + stride * l;
+            short *cb = band[1] + stride * l;
+            short *cr = band[2] + stride * l;
+
+            LoadLine(img, min(row * mcu_height + l, img.height - 1), y, cb, cr);
+
+            // replicate the last column to the MCU boundary
+            for (unsigned int x = img.width; x < stride; x++) {
+                y[x] = y[img.width - 1];
+                cb[x] = cb[img.width - 1];
+                cr[x] = cr[img.width - 1];
+            }
+        }
+
+        // The predictors of DC are reset at the restart marker
+        if ((img.restart_interval > 0) || (row == slice->first_row))
+            dcpred[0] = dcpred[1] = dcpred[2] = 0;
+
+        for (unsigned int mcu = 0; mcu < img.mcus_x; mcu++) {
+            unsigned int x = mcu * mcu_width;
+
+            for (unsigned int by = 0; by < mcu_height; by += 8) {
+                for (unsigned int bx = 0; bx < mcu_width; bx += 8) {
+                    LoadLumaBlock(band[0] + by * stride + x + bx, stride, blk);
+                    FDCT(blk);
+                    Quantize(blk, img.divisors[0], coefs);
+                    EncodeBlock(writer, coefs, dcpred[0],
+                                huff_tables[HUFF_DC_LUMA], huff_tables[HUFF_AC_LUMA]);
+                }
+            }
+
+            for (unsigned int c = 1; c < img.num_comps; c++) {
+                LoadChromaBlock(band[c] + x, stride, img.hfactor, img.vfactor, blk);
+                FDCT(blk);
+                Quantize(blk, img.divisors[1], coefs);
+                EncodeBlock(writer, coefs, dcpred[c],
+                            huff_tables[HUFF_DC_CHROMA], huff_tables[HUFF_AC_CHROMA]);
+            }
+        }
+
+        if ((img.restart_interval > 0) || (row == slice->last_row - 1))
+            writer.Flush();
+
+        if ((img.restart_interval > 0) && (row < img.mcus_y - 1))
+            writer.PutMarker(0xD0 + (row % 8)); // RSTm
+    }
+
+    return NULL;
+}
+
+static inline unsigned char *PutMarker(unsigned char *p, unsigned char marker, unsigned int length)
+{
+    *p++ = 0xFF;
+    *p++ = marker;
+    *p++ = static_cast<unsigned char>(length >> 8);
+    *p++ = static_cast<unsigned char>(length);
+    return p;
+}
+
+static unsigned char *PutHuffTable(unsigned char *p, unsigned char id,
+                                   const unsigned char bits[16], const unsigned char vals[])
+{
+    unsigned int count = 0;
+
+    *p++ = id;
+    for (int i = 0; i < 16; i++) {
+        *p++ = bits[i];
+        count += bits[i];
+    }
+    memcpy(p, vals, count);
+
+    return p + count;
+}
+
+// SOI, DQT, SOF0, DHT, DRI and SOS. Returns the length of the headers.
+static size_t WriteHeaders(unsigned char *base, const sw_jpeg_image &img, const unsigned char qtables[2][64])
+{
+    unsigned char *p = base;
+    unsigned int num_tables = (img.num_comps == 1) ? 1 : 2;
+
+    *p++ = 0xFF;
+    *p++ = 0xD8;
+
+    p = PutMarker(p, 0xDB, 2 + 65 * num_tables);
+    for (unsigned int i = 0; i < num_tables; i++) {
+        *p++ = static_cast<unsigned char>(i);
+        memcpy(p, qtables[i], 64);
+        p += 64;
+    }
+
+    p = PutMarker(p, 0xC0, 8 + 3 * img.num_comps);
+    *p++ = 8;
+    *p++ = static_cast<unsigned char>(img.height >> 8);
+    *p++ = static_cast<unsigned char>(img.height);
+    *p++ = static_cast<unsigned char>(img.width >> 8);
+    *p++ = static_cast<unsigned char>(img.width);
+    *p++ = static_cast<unsigned char>(img.num_comps);
+    for (unsigned int i = 0; i < img.num_comps; i++) {
+        *p++ = static_cast<unsigned char>(i + 1);
+        *p++ = (i == 0) ? static_cast<unsigned char>((img.hfactor << 4) | img.vfactor) : 0x11;
+        *p++ = (i == 0) ? 0 : 1;
+    }
+
+    p = PutMarker(p, 0xC4, 2 + (17 + 12) + (17 + 162) + ((num_tables == 2) ? (17 + 12) + (17 + 162) : 0));
+    p = PutHuffTable(p, 0x00, dc_luma_bits, dc_vals);
+    p = PutHuffTable(p, 0x10, ac_luma_bits, ac_luma_vals);
+    if (num_tables == 2) {
+        p = PutHuffTable(p, 0x01, dc_chroma_bits, dc_vals);
+        p = PutHuffTable(p, 0x11, ac_chroma_bits, ac_chroma_vals);
+    }
+
+    if (img.restart_interval > 0) {
+        p = PutMarker(p, 0xDD, 4);
+        *p++ = static_cast<unsigned char>(img.restart_interval >> 8);
+        *p++ = static_cast<unsigned char>(img.restart_interval);
+    }
+
+    p = PutMarker(p, 0xDA, 6 + 2 * img.num_comps);
+    *p++ = static_cast<unsigned char>(img.num_comps);
+    for (unsigned int i = 0; i < img.num_comps; i++) {
+        *p++ = static_cast<unsigned char>(i + 1);
+        *p++ = (i == 0) ? 0x00 : 0x11;
+    }
+    *p++ = 0;  // Ss
+    *p++ = 63; // Se
+    *p++ = 0;  // Ah/Al
+
+    return PTR_DIFF(base, p);
+}
+
+// SOI + DQT + SOF0 + DHT + DRI + SOS
+#define SW_JPEG_MAX_HEADER_SIZE (2 + (4 + 65 * 2) + (4 + 6 + 3 * 3) + (4 + (17 + 12 + 17 + 162) * 2) + 6 + (4 + 4 + 2 * 3))
+
+CHWJpegSWCompressor::CHWJpegSWCompressor()
+        : CHWJpegCompressor(), m_uiFormat(0), m_uiWidth(0), m_uiHeight(0), m_uiNumPlanes(0),
+          m_uiHFactor(2), m_uiVFactor(2), m_bSrcDmabuf(false), m_bDstDmabuf(false),
+          m_pDstBuffer(NULL), m_iDstBuffer(-1), m_szDstBuffer(0), m_iDstOffset(0),
+          m_bSrcConfigured(false), m_bDstConfigured(false)
+{
+    pthread_once(&huff_tables_once, BuildTables);
+
+    memset(m_szPlanes, 0, sizeof(m_szPlanes));
+    memset(m_pSrcBuffers, 0, sizeof(m_pSrcBuffers));
+    memset(m_szSrcBuffers, 0, sizeof(m_szSrcBuffers));
+    for (int i = 0; i < 3; i++)
+        m_iSrcBuffers[i] = -1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    m_uiSlices = (cpus > 0) ? min(static_cast<unsigned int>(cpus), static_cast<unsigned int>(HWJPEG_SW_MAX_SLICES)) : 1;
+
+    SetQuality(DEFAULT_QUALITY_FACTOR);
+
+    ALOGD("CHWJpegSWCompressor Created: %p, %u slices", this, m_uiSlices);
+}
+
+CHWJpegSWCompressor::~CHWJpegSWCompressor()
+{
+    ALOGD("CHWJpegSWCompressor Destroyed: %p", this);
+}
+
+void CHWJpegSWCompressor::SetSliceCount(unsigned int slices)
+{
+    m_uiSlices = max(1U, min(slices, static_cast<unsigned int>(HWJPEG_SW_MAX_SLICES)));
+}
+
+bool CHWJpegSWCompressor::SetImageFormat(unsigned int v4l2_fmt, unsigned int width, unsigned int height,
+                                         unsigned int sec_width, unsigned int sec_height)
+{
+    if ((sec_width | sec_height) != 0) {
+        ALOGE("Back-to-back compression is not supported by the software compressor");
+        return false;
+    }
+
+    if ((width == 0) || (height == 0) || (width > 0xFFFF) || (height > 0xFFFF)) {
+        ALOGE("Invalid image size %ux%u", width, height);
+        return false;
+    }
+
+    size_t pixels = width * height;
+    // horizontal and vertical chroma subsampling of the source image
+    unsigned int hsub = 1, vsub = 1;
+
+    m_uiNumPlanes = 1;
+    memset(m_szPlanes, 0, sizeof(m_szPlanes));
+
+    switch (v4l2_fmt) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+        m_szPlanes[0] = pixels + pixels / 2;
+        hsub = vsub = 2;
+        break;
+    case V4L2_PIX_FMT_NV12M:
+    case V4L2_PIX_FMT_NV21M:
+        m_uiNumPlanes = 2;
+        m_szPlanes[0] = pixels;
+        m_szPlanes[1] = pixels / 2;
+        hsub = vsub = 2;
+        break;
+    case V4L2_PIX_FMT_YUV420M:
+    case V4L2_PIX_FMT_YVU420M:
+        m_uiNumPlanes = 3;
+        m_szPlanes[0] = pixels;
+        m_szPlanes[1] = pixels / 4;
+        m_szPlanes[2] = pixels / 4;
+        hsub = vsub = 2;
+        break;
+    case V4L2_PIX_FMT_NV16:
+    case V4L2_PIX_FMT_NV61:
+    case V4L2_PIX_FMT_YUV422P:
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_YVYU:
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_VYUY:
+        m_szPlanes[0] = pixels * 2;
+        hsub = 2;
+        break;
+    case V4L2_PIX_FMT_RGB24:
+    case V4L2_PIX_FMT_BGR24:
+        m_szPlanes[0] = pixels * 3;
+        break;
+    case V4L2_PIX_FMT_RGB32:
+    case V4L2_PIX_FMT_BGR32:
+        m_szPlanes[0] = pixels * 4;
+        break;
+    case V4L2_PIX_FMT_RGB565:
+        m_szPlanes[0] = pixels * 2;
+        break;
+    default:
+        ALOGE("Unsupported image format %#010x", v4l2_fmt);
+        return false;
+    }
+
+    if (((width % hsub) != 0) || ((height % vsub) != 0)) {
+        ALOGE("The size %ux%u of format %#010x should be multiple of %ux%u",
+              width, height, v4l2_fmt, hsub, vsub);
+        return false;
+    }
+
+    m_uiFormat = v4l2_fmt;
+    m_uiWidth = width;
+    m_uiHeight = height;
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::GetImageBufferSizes(size_t buf_sizes[], unsigned int *num_buffers)
+{
+    if (buf_sizes) {
+        for (unsigned int i = 0; i < m_uiNumPlanes; i++)
+            buf_sizes[i] = m_szPlanes[i];
+    }
+
+    if (num_buffers) {
+        if (*num_buffers < m_uiNumPlanes) {
+            ALOGE("The size array length %u is smaller than the number of required buffers %u",
+                    *num_buffers, m_uiNumPlanes);
+            return false;
+        }
+
+        *num_buffers = m_uiNumPlanes;
+    }
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetChromaSampFactor(unsigned int horizontal, unsigned int vertical)
+{
+    switch ((horizontal << 4) | vertical) {
+        case 0x00: // grayscale
+        case 0x11:
+        case 0x21:
+        case 0x22:
+        case 0x41:
+            break;
+        case 0x12:
+        default:
+           ALOGE("Unsupported chroma subsampling %ux%u", horizontal, vertical);
+           return false;
+    }
+
+    m_uiHFactor = horizontal;
+    m_uiVFactor = vertical;
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetQuality(unsigned int quality_factor, unsigned int quality_factor2)
+{
+    if (quality_factor > 100) {
+        ALOGE("Unsupported quality factor %u", quality_factor);
+        return false;
+    }
+
+    if (quality_factor2 > 100) {
+        ALOGE("Unsupported quality factor %u for the secondary image",
+                 quality_factor2);
+        return false;
+    }
+
+    // The secondary image is not supported. quality_factor2 is just ignored.
+    if (quality_factor == 0)
+        return true;
+
+    // Scaling of IJG libjpeg
+    unsigned int scale = (quality_factor < 50) ? (5000 / quality_factor) : (200 - quality_factor * 2);
+
+    for (unsigned int k = 0; k < 64; k++) {
+        unsigned int luma = (std_luma_qtable[natural_order[k]] * scale + 50) / 100;
+        unsigned int chroma = (std_chroma_qtable[natural_order[k]] * scale + 50) / 100;
+        m_QTables[0][k] = static_cast<unsigned char>(max(1U, min(luma, 255U)));
+        m_QTables[1][k] = static_cast<unsigned char>(max(1U, min(chroma, 255U)));
+    }
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetQuality(const unsigned char qtable[])
+{
+    for (unsigned int i = 0; i < 128; i++) {
+        if (qtable[i] == 0) {
+            ALOGE("Invalid quantizer 0 at %u of the quantization tables", i);
+            return false;
+        }
+    }
+
+    memcpy(m_QTables, qtable, sizeof(m_QTables));
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetImageBufferSizes(size_t len_buffers[], unsigned int num_buffers)
+{
+    if (num_buffers < m_uiNumPlanes) {
+        ALOGE("The number of buffers %u is smaller than the required %u",
+                num_buffers, m_uiNumPlanes);
+        return false;
+    }
+
+    for (unsigned int i = 0; i < m_uiNumPlanes; i++) {
+        if (len_buffers[i] < m_szPlanes[i]) {
+            ALOGE("The size of the buffer[%u] %zu is smaller than required %zu",
+                    i, len_buffers[i], m_szPlanes[i]);
+            return false;
+        }
+        m_szSrcBuffers[i] = len_buffers[i];
+    }
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetImageBuffer(char *buffers[], size_t len_buffers[], unsigned int num_buffers)
+{
+    if (!SetImageBufferSizes(len_buffers, num_buffers))
+        return false;
+
+    for (unsigned int i = 0; i < m_uiNumPlanes; i++)
+        m_pSrcBuffers[i] = buffers[i];
+
+    m_bSrcDmabuf = false;
+    m_bSrcConfigured = true;
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetImageBuffer(int buffers[], size_t len_buffers[], unsigned int num_buffers)
+{
+    if (!SetImageBufferSizes(len_buffers, num_buffers))
+        return false;
+
+    for (unsigned int i = 0; i < m_uiNumPlanes; i++)
+        m_iSrcBuffers[i] = buffers[i];
+
+    m_bSrcDmabuf = true;
+    m_bSrcConfigured = true;
+
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetJpegBuffer(char *buffer, size_t len_buffer)
+{
+    m_pDstBuffer = buffer;
+    m_szDstBuffer = len_buffer;
+    m_iDstOffset = 0;
+    m_bDstDmabuf = false;
+    m_bDstConfigured = true;
+    return true;
+}
+
+bool CHWJpegSWCompressor::SetJpegBuffer(int buffer, size_t len_buffer, int offset)
+{
+    if ((offset < 0) || (static_cast<size_t>(offset) >= len_buffer)) {
+        ALOGE("Invalid offset %d of the JPEG buffer of %zu bytes", offset, len_buffer);
+        return false;
+    }
+
+    m_iDstBuffer = buffer;
+    m_szDstBuffer = len_buffer;
+    m_iDstOffset = offset;
+    m_bDstDmabuf = true;
+    m_bDstConfigured = true;
+    return true;
+}
+
+ssize_t CHWJpegSWCompressor::Compress(size_t *secondary_stream_size, bool block_mode)
+{
+    if (!m_bSrcConfigured) {
+        ALOGE("Source image buffer is not specified");
+        return -1;
+    }
+
+    if (!m_bDstConfigured) {
+        ALOGE("Output JPEG stream buffer is not specified");
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < m_uiNumPlanes; i++) {
+        if (m_szSrcBuffers[i] < m_szPlanes[i]) {
+            ALOGE("The size of the buffer[%u] %zu is smaller than required %zu after format change",
+                    i, m_szSrcBuffers[i], m_szPlanes[i]);
+            return -1;
+        }
+    }
+
+    char *src[3] = {m_pSrcBuffers[0], m_pSrcBuffers[1], m_pSrcBuffers[2]};
+    char *dst = m_pDstBuffer;
+    ssize_t stream_size = -1;
+    unsigned int mapped = 0;
+
+    if (m_bSrcDmabuf) {
+        for (mapped = 0; mapped < m_uiNumPlanes; mapped++) {
+            void *addr = mmap(NULL, m_szSrcBuffers[mapped], PROT_READ, MAP_SHARED, m_iSrcBuffers[mapped], 0);
+            if (addr == MAP_FAILED) {
+                ALOGERR("Failed to map the image buffer[%u] (fd %d, %zu bytes)",
+                        mapped, m_iSrcBuffers[mapped], m_szSrcBuffers[mapped]);
+                goto err_map;
+            }
+            src[mapped] = reinterpret_cast<char *>(addr);
+        }
+    }
+
+    if (m_bDstDmabuf) {
+        void *addr = mmap(NULL, m_szDstBuffer, PROT_READ | PROT_WRITE, MAP_SHARED, m_iDstBuffer, 0);
+        if (addr == MAP_FAILED) {
+            ALOGERR("Failed to map the JPEG buffer (fd %d, %zu bytes)", m_iDstBuffer, m_szDstBuffer);
+            goto err_map;
+        }
+        dst = reinterpret_cast<char *>(addr);
+    }
+
+    {
+        sw_jpeg_image img;
+        const unsigned char *base = reinterpret_cast<const unsigned char *>(src[0]);
+        size_t pixels = m_uiWidth * m_uiHeight;
+
+        img.format = m_uiFormat;
+        img.width = m_uiWidth;
+        img.height = m_uiHeight;
+        img.planes[0] = base;
+        img.planes[1] = NULL;
+        img.planes[2] = NULL;
+
+        switch (m_uiFormat) {
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_NV21:
+        case V4L2_PIX_FMT_NV16:
+        case V4L2_PIX_FMT_NV61:
+            img.planes[1] = base + pixels;
+            break;
+        case V4L2_PIX_FMT_YUV420:
+            img.planes[1] = base + pixels;
+            img.planes[2] = img.planes[1] + pixels / 4;
+            break;
+        case V4L2_PIX_FMT_YUV422P:
+            img.planes[1] = base + pixels;
+            img.planes[2] = img.planes[1] + pixels / 2;
+            break;
+        case V4L2_PIX_FMT_NV12M:
+        case V4L2_PIX_FMT_NV21M:
+            img.planes[1] = reinterpret_cast<const unsigned char *>(src[1]);
+            break;
+        case V4L2_PIX_FMT_YUV420M:
+            img.planes[1] = reinterpret_cast<const unsigned char *>(src[1]);
+            img.planes[2] = reinterpret_cast<const unsigned char *>(src[2]);
+            break;
+        case V4L2_PIX_FMT_YVU420M:
+            img.planes[1] = reinterpret_cast<const unsigned char *>(src[2]);
+            img.planes[2] = reinterpret_cast<const unsigned char *>(src[1]);
+            break;
+        }
+
+        img.num_comps = (m_uiHFactor == 0) ? 1 : 3;
+        img.hfactor = (img.num_comps == 1) ? 1 : m_uiHFactor;
+        img.vfactor = (img.num_comps == 1) ? 1 : m_uiVFactor;
+        img.mcus_x = (m_uiWidth + 8 * img.hfactor - 1) / (8 * img.hfactor);
+        img.mcus_y = (m_uiHeight + 8 * img.vfactor - 1) / (8 * img.vfactor);
+
+        for (unsigned int t = 0; t < 2; t++) {
+            for (unsigned int k = 0; k < 64; k++) {
+                unsigned int n = natural_order[k];
+                img.divisors[t][fdct_order[k]] =
+                    1.0f / (m_QTables[t][k] * aan_scales[n / 8] * aan_scales[n % 8] * 8.0f);
+            }
+        }
+
+        unsigned int num_slices = min(m_uiSlices, img.mcus_y);
+        // A restart interval of an MCU row makes the slices independent
+        img.restart_interval = (num_slices > 1) ? img.mcus_x : 0;
+
+        sw_jpeg_slice slices[HWJPEG_SW_MAX_SLICES];
+        pthread_t threads[HWJPEG_SW_MAX_SLICES];
+        bool joinable[HWJPEG_SW_MAX_SLICES];
+
+        for (unsigned int i = 0; i < num_slices; i++) {
+            slices[i].image = &img;
+            slices[i].first_row = img.mcus_y * i / num_slices;
+            slices[i].last_row = img.mcus_y * (i + 1) / num_slices;
+            slices[i].stream.reserve(pixels / num_slices);
+        }
+
+        // The first slice is compressed by the calling thread
+        for (unsigned int i = 1; i < num_slices; i++) {
+            joinable[i] = pthread_create(&threads[i], NULL, CompressSlice, &slices[i]) == 0;
+            if (!joinable[i]) {
+                ALOGW("Failed to create the thread of slice %u. Compressing it on the caller", i);
+                CompressSlice(&slices[i]);
+            }
+        }
+
+        CompressSlice(&slices[0]);
+
+        for (unsigned int i = 1; i < num_slices; i++) {
+            if (joinable[i])
+                pthread_join(threads[i], NULL);
+        }
+
+        unsigned char jpeg_headers[SW_JPEG_MAX_HEADER_SIZE];
+        size_t len = WriteHeaders(jpeg_headers, img, m_QTables);
+        size_t total = len + 2; // EOI
+        for (unsigned int i = 0; i < num_slices; i++)
+            total += slices[i].stream.size();
+
+        size_t capacity = m_szDstBuffer - m_iDstOffset;
+        if (total > capacity) {
+            ALOGE("Too small JPEG buffer %zu bytes for the stream of %zu bytes", capacity, total);
+            goto err_map;
+        }
+
+        unsigned char *p = reinterpret_cast<unsigned char *>(dst + m_iDstOffset);
+        memcpy(p, jpeg_headers, len);
+        p += len;
+        for (unsigned int i = 0; i < num_slices; i++) {
+            memcpy(p, slices[i].stream.data(), slices[i].stream.size());
+            p += slices[i].stream.size();
+        }
+        *p++ = 0xFF;
+        *p++ = 0xD9;
+
+        stream_size = static_cast<ssize_t>(total);
+    }
+
+err_map:
+    if (m_bDstDmabuf && (dst != m_pDstBuffer))
+        munmap(dst, m_szDstBuffer);
+
+    if (m_bSrcDmabuf) {
+        for (unsigned int i = 0; i < mapped; i++)
+            munmap(src[i], m_szSrcBuffers[i]);
+    }
+
+    if (stream_size < 0)
+        return -1;
+
+    SetStreamSize(stream_size);
+
+    if (secondary_stream_size)
+        *secondary_stream_size = 0;
+
+    return block_mode ? stream_size : 0;
+}
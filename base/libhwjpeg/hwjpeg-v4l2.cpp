@@ -15,6 +15,8 @@
  * limitations under the License.
  */
 
+#include <poll.h>
+
 #include <linux/videodev2.h>
 #include <linux/v4l2-controls.h>
 
@@ -49,6 +51,14 @@ CHWJpegV4L2Compressor::CHWJpegV4L2Compressor(const char *path): CHWJpegCompresso
 
     m_bEnableHWFC = false;
 
+    memset(&m_PipelineSlots, 0, sizeof(m_PipelineSlots));
+    m_uiPipelineSlots = 0;
+    m_uiPipelineQueued = 0;
+    m_uiPipelineSrcMemory = 0;
+    m_uiPipelineDstMemory = 0;
+    m_fnPipelineCallback = NULL;
+    m_pPipelineCallbackData = NULL;
+
     v4l2_capability cap;
     memset(&cap, 0, sizeof(cap));
     if (ioctl(GetDeviceFD(), VIDIOC_QUERYCAP, &cap) < 0) {
@@ -65,6 +75,7 @@ CHWJpegV4L2Compressor::CHWJpegV4L2Compressor(const char *path): CHWJpegCompresso
 
 CHWJpegV4L2Compressor::~CHWJpegV4L2Compressor()
 {
+    StopPipeline();
     StopStreaming();
 
     ALOGD("CHWJpegV4L2Compressor Destroyed: %p, FD %d", this, GetDeviceFD());
@@ -363,21 +374,16 @@ bool CHWJpegV4L2Compressor::StopStreaming()
     return true;
 }
 
-ssize_t CHWJpegV4L2Compressor::Compress(size_t *secondary_stream_size, bool block_mode)
+bool CHWJpegV4L2Compressor::PrepareBuffers()
 {
-    if (TestFlag(HWJPEG_FLAG_PIX_FMT)) {
-        if (!StopStreaming() || !SetFormat())
-            return -1;
-    }
-
     if (!TestFlag(HWJPEG_FLAG_SRC_BUFFER)) {
         ALOGE("Source image buffer is not specified");
-        return -1;
+        return false;
     }
 
     if (!TestFlag(HWJPEG_FLAG_DST_BUFFER)) {
         ALOGE("Output JPEG stream buffer is not specified");
-        return -1;
+        return false;
     }
 
     m_v4l2SrcBuffer.length = m_v4l2Format.fmt.pix_mp.num_planes;
@@ -386,7 +392,7 @@ ssize_t CHWJpegV4L2Compressor::Compress(size_t *secondary_stream_size, bool bloc
         if (!TestFlag(HWJPEG_FLAG_SRC_BUFFER2 | HWJPEG_FLAG_DST_BUFFER2)) {
             ALOGE("Either of source or destination buffer of secondary image is not specified (%#x)",
                   GetFlags());
-            return -1;
+            return false;
         }
         // The SMFC Driver expects the number of buffers to be doubled
         // if back-to-back compression is enabled
@@ -399,6 +405,24 @@ ssize_t CHWJpegV4L2Compressor::Compress(size_t *secondary_stream_size, bool bloc
     if (!!(GetAuxFlags() & EXYNOS_HWJPEG_AUXOPT_DST_NOCACHECLEAN))
         m_v4l2DstBuffer.flags |= V4L2_BUF_FLAG_NO_CACHE_CLEAN;
 
+    return true;
+}
+
+ssize_t CHWJpegV4L2Compressor::Compress(size_t *secondary_stream_size, bool block_mode)
+{
+    if (TestFlag(HWJPEG_FLAG_PIPELINE)) {
+        ALOGE("Compress() is not permitted while the pipeline is running");
+        return -1;
+    }
+
+    if (TestFlag(HWJPEG_FLAG_PIX_FMT)) {
+        if (!StopStreaming() || !SetFormat())
+            return -1;
+    }
+
+    if (!PrepareBuffers())
+        return -1;
+
     if (!ReqBufs() || !StreamOn() || !UpdateControls() || !QBuf())
         return -1;
 
@@ -481,12 +505,15 @@ bool CHWJpegV4L2Compressor::UpdateControls()
     return true;
 }
 
-bool CHWJpegV4L2Compressor::ReqBufs(unsigned int count)
+bool CHWJpegV4L2Compressor::ReqBufs(unsigned int count, unsigned int *granted)
 {
     // - count > 0 && REQBUFS is set: Just return true
     // - count > 0 && REQBUFS is unset: REQBUFS(count) is required
     // - count == 0 && REQBUFS is set: REQBUFS(0) is required
     // - count == 0 && REQBUFS is unset: Just return true;
+    if (granted)
+        *granted = count;
+
     if ((count > 0) == TestFlag(HWJPEG_FLAG_REQBUFS))
         return true;
 
@@ -501,6 +528,9 @@ bool CHWJpegV4L2Compressor::ReqBufs(unsigned int count)
         return false;
     }
 
+    // The driver may give the different number of buffers from count
+    unsigned int src_count = reqbufs.count;
+
     memset(&reqbufs, 0, sizeof(reqbufs));
     reqbufs.count = count;
     reqbufs.memory = m_v4l2DstBuffer.memory;
@@ -515,6 +545,9 @@ bool CHWJpegV4L2Compressor::ReqBufs(unsigned int count)
         return false;
     }
 
+    if (granted)
+        *granted = min(src_count, reqbufs.count);
+
     if (count > 0)
         SetFlag(HWJPEG_FLAG_REQBUFS);
     else
@@ -723,9 +756,251 @@ bool CHWJpegV4L2Compressor::GetJpegBuffer(char **buffer, size_t *len_buffer)
 
 void CHWJpegV4L2Compressor::Release()
 {
+    StopPipeline();
     StopStreaming();
 }
 
+bool CHWJpegV4L2Compressor::StartPipeline(unsigned int num_slots)
+{
+    if (TestFlag(HWJPEG_FLAG_PIPELINE)) {
+        ALOGE("The pipeline is already running with %u slots", m_uiPipelineSlots);
+        return false;
+    }
+
+    if ((num_slots == 0) || (num_slots > HWJPEG_PIPELINE_MAX_SLOTS)) {
+        ALOGE("Invalid number of pipeline slots %u (max %u)", num_slots, HWJPEG_PIPELINE_MAX_SLOTS);
+        return false;
+    }
+
+    // REQBUFS needs the memory types of the buffers
+    if (!TestFlag(HWJPEG_FLAG_SRC_BUFFER | HWJPEG_FLAG_DST_BUFFER)) {
+        ALOGE("The buffers should be configured before starting the pipeline");
+        return false;
+    }
+
+    if (!StopStreaming())
+        return false;
+
+    if (TestFlag(HWJPEG_FLAG_PIX_FMT) && !SetFormat())
+        return false;
+
+    unsigned int granted;
+    if (!ReqBufs(num_slots, &granted)) {
+        StopStreaming();
+        return false;
+    }
+
+    if (granted == 0) {
+        ALOGE("No buffer is given by the driver for the pipeline of %u slots", num_slots);
+        StopStreaming();
+        return false;
+    }
+
+    if (granted < num_slots) {
+        ALOGI("The pipeline is limited to %u slots by the driver (%u requested)", granted, num_slots);
+        num_slots = granted;
+    }
+
+    if (!StreamOn()) {
+        StopStreaming();
+        return false;
+    }
+
+    memset(&m_PipelineSlots, 0, sizeof(m_PipelineSlots));
+    m_uiPipelineSlots = num_slots;
+    m_uiPipelineQueued = 0;
+    m_uiPipelineSrcMemory = m_v4l2SrcBuffer.memory;
+    m_uiPipelineDstMemory = m_v4l2DstBuffer.memory;
+
+    SetFlag(HWJPEG_FLAG_PIPELINE);
+
+    ALOGD("Started the compression pipeline with %u slots", num_slots);
+
+    return true;
+}
+
+void CHWJpegV4L2Compressor::StopPipeline()
+{
+    if (!TestFlag(HWJPEG_FLAG_PIPELINE))
+        return;
+
+    // Stream off dequeues all queued buffers
+    StopStreaming();
+
+    for (unsigned int i = 0; i < m_uiPipelineSlots; i++) {
+        if (m_PipelineSlots[i].busy && m_fnPipelineCallback)
+            m_fnPipelineCallback(m_pPipelineCallbackData, m_PipelineSlots[i].priv, -1, 0);
+        m_PipelineSlots[i].busy = false;
+    }
+
+    if (m_uiPipelineQueued > 0)
+        ALOGI("%u pipelined compressions are cancelled", m_uiPipelineQueued);
+
+    m_uiPipelineSlots = 0;
+    m_uiPipelineQueued = 0;
+
+    // Compress() always queues the buffers of index 0
+    m_v4l2SrcBuffer.index = 0;
+    m_v4l2DstBuffer.index = 0;
+
+    ClearFlag(HWJPEG_FLAG_PIPELINE);
+}
+
+int CHWJpegV4L2Compressor::SubmitCompression(void *priv)
+{
+    if (!TestFlag(HWJPEG_FLAG_PIPELINE)) {
+        ALOGE("The pipeline is not started");
+        return -1;
+    }
+
+    if (TestFlag(HWJPEG_FLAG_PIX_FMT)) {
+        ALOGE("The image format is not permitted to change while the pipeline is running");
+        return -1;
+    }
+
+    if ((m_v4l2SrcBuffer.memory != m_uiPipelineSrcMemory) ||
+            (m_v4l2DstBuffer.memory != m_uiPipelineDstMemory)) {
+        ALOGE("The memory types of the buffers are changed while the pipeline is running");
+        return -1;
+    }
+
+    // The controls are context-wide. S_EXT_CTRLS would also change the
+    // compressions that are already queued.
+    bool enable_hwfc = !!(GetAuxFlags() & EXYNOS_HWJPEG_AUXOPT_ENABLE_HWFC);
+    if ((m_uiPipelineQueued > 0) &&
+            ((m_uiControlsToSet != 0) || (enable_hwfc != m_bEnableHWFC))) {
+        ALOGE("The controls are not permitted to change while %u compressions are in flight",
+              m_uiPipelineQueued);
+        return -1;
+    }
+
+    unsigned int slot;
+    for (slot = 0; slot < m_uiPipelineSlots; slot++) {
+        if (!m_PipelineSlots[slot].busy)
+            break;
+    }
+
+    if (slot == m_uiPipelineSlots) {
+        ALOGE("All %u pipeline slots are busy", m_uiPipelineSlots);
+        return -1;
+    }
+
+    if (!PrepareBuffers() || !UpdateControls())
+        return -1;
+
+    m_v4l2SrcBuffer.index = slot;
+    m_v4l2DstBuffer.index = slot;
+
+    if (ioctl(GetDeviceFD(), VIDIOC_QBUF, &m_v4l2SrcBuffer) < 0) {
+        ALOGERR("QBuf of the source buffers to slot %u is failed", slot);
+        return -1;
+    }
+
+    if (ioctl(GetDeviceFD(), VIDIOC_QBUF, &m_v4l2DstBuffer) < 0) {
+        ALOGERR("QBuf of the JPEG buffers to slot %u is failed", slot);
+        // The queued source buffer has no pair. Reqbufs(0) is the only way to cancel it.
+        StopPipeline();
+        return -1;
+    }
+
+    m_PipelineSlots[slot].priv = priv;
+    m_PipelineSlots[slot].busy = true;
+    m_uiPipelineQueued++;
+
+    return static_cast<int>(slot);
+}
+
+ssize_t CHWJpegV4L2Compressor::ReapCompression(void **priv, size_t *secondary_stream_size,
+                                               bool block_mode)
+{
+    if (priv)
+        *priv = NULL;
+
+    if (!TestFlag(HWJPEG_FLAG_PIPELINE) || (m_uiPipelineQueued == 0)) {
+        ALOGE("No pipelined compression is pending");
+        return -1;
+    }
+
+    if (!block_mode) {
+        pollfd pfd;
+        pfd.fd = GetDeviceFD();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int ret = poll(&pfd, 1, 0);
+        if (ret < 0) {
+            ALOGERR("Failed to poll the completion of the compression");
+            return -1;
+        }
+
+        if ((ret == 0) || !(pfd.revents & (POLLIN | POLLERR)))
+            return 0;
+    }
+
+    bool failed = false;
+    v4l2_buffer buffer_src, buffer_dst;
+    v4l2_plane planes_src[6], planes_dst[2];
+
+    memset(&buffer_src, 0, sizeof(buffer_src));
+    memset(&buffer_dst, 0, sizeof(buffer_dst));
+    memset(&planes_src, 0, sizeof(planes_src));
+    memset(&planes_dst, 0, sizeof(planes_dst));
+
+    buffer_src.type = m_v4l2SrcBuffer.type;
+    buffer_src.memory = m_uiPipelineSrcMemory;
+    buffer_src.length = m_v4l2SrcBuffer.length;
+    buffer_src.m.planes = planes_src;
+
+    buffer_dst.type = m_v4l2DstBuffer.type;
+    buffer_dst.memory = m_uiPipelineDstMemory;
+    buffer_dst.length = m_v4l2DstBuffer.length;
+    buffer_dst.m.planes = planes_dst;
+
+    // The JPEG stream buffer identifies the slot. The image buffers are
+    // processed in the order of submission as well.
+    if (ioctl(GetDeviceFD(), VIDIOC_DQBUF, &buffer_dst) < 0) {
+        ALOGERR("Failed to DQBUF of the JPEG stream buffer");
+        return -1;
+    }
+
+    if (ioctl(GetDeviceFD(), VIDIOC_DQBUF, &buffer_src) < 0) {
+        ALOGERR("Failed to DQBUF of the image buffer");
+        failed = true;
+    }
+
+    if ((buffer_dst.index >= m_uiPipelineSlots) || !m_PipelineSlots[buffer_dst.index].busy) {
+        ALOGE("Unexpected JPEG stream buffer of slot %u is dequeued", buffer_dst.index);
+        return -1;
+    }
+
+    hwjpeg_pipeline_slot &slot = m_PipelineSlots[buffer_dst.index];
+    slot.busy = false;
+    m_uiPipelineQueued--;
+
+    if (!!((buffer_src.flags | buffer_dst.flags) & V4L2_BUF_FLAG_ERROR)) {
+        ALOGE("Error occurred during compression of slot %u", buffer_dst.index);
+        failed = true;
+    }
+
+    ssize_t stream_size = failed ? -1 : static_cast<ssize_t>(buffer_dst.m.planes[0].bytesused);
+    size_t secondary_size = failed ? 0 : buffer_dst.m.planes[1].bytesused;
+
+    // The driver stores the delay in usec. of JPEG compression by H/W
+    // to v4l2_buffer.reserved2.
+    if (!failed)
+        m_uiHWDelay = buffer_dst.reserved2;
+
+    if (priv)
+        *priv = slot.priv;
+    if (secondary_stream_size)
+        *secondary_stream_size = secondary_size;
+
+    if (m_fnPipelineCallback)
+        m_fnPipelineCallback(m_pPipelineCallbackData, slot.priv, stream_size, secondary_size);
+
+    return stream_size;
+}
+
 /******************************************************************************/
 /********* D E C O M P R E S S I O N   S U P P O R T **************************/
 /******************************************************************************/
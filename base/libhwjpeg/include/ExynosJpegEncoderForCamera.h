@@ -19,6 +19,7 @@
 #define __HARDWARE_EXYNOS_JPEG_ENCODER_FOR_CAMERA_H__
 
 #include <memory>
+#include <deque>
 
 #include <pthread.h>
 
@@ -28,6 +29,7 @@
 
 class CAppMarkerWriter; // defined in libhwjpeg/AppMarkerWriter.h
 class ThumbnailScaler; // defined in libhwjpeg/thumbnail_scaler.h
+class ThumbnailRateControl; // defined in libhwjpeg/ThumbnailRateControl.h
 
 class ExynosJpegEncoderForCamera: public ExynosJpegEncoder {
     enum {
@@ -39,6 +41,7 @@ class ExynosJpegEncoderForCamera: public ExynosJpegEncoder {
 
     CHWJpegCompressor *m_phwjpeg4thumb;
     std::unique_ptr<ThumbnailScaler> mThumbnailScaler;
+    std::unique_ptr<ThumbnailRateControl> mThumbnailRateControl;
     int m_fdIONClient;
     int m_fdIONThumbImgBuffer;
     char *m_pIONThumbImgBuffer;
@@ -46,6 +49,10 @@ class ExynosJpegEncoderForCamera: public ExynosJpegEncoder {
     char *m_pIONThumbJpegBuffer;
     int m_fdIONThumbJpegBuffer;
     size_t m_szIONThumbJpegBuffer;
+    // The thumbnail quality search compresses to the scratch buffer not to
+    // overwrite the best stream found so far. It has the same size.
+    char *m_pIONThumbJpegScratch;
+    int m_fdIONThumbJpegScratch;
 
     int m_nThumbWidth;
     int m_nThumbHeight;
@@ -70,24 +77,57 @@ class ExynosJpegEncoderForCamera: public ExynosJpegEncoder {
 
     CAppMarkerWriter *m_pAppWriter;
 
+    /*
+     * Thumbnail generation is requested to a worker that lives as long as
+     * the encoder. A job has a copy of the main image configuration so
+     * that the worker does not refer the state of the encoder.
+     */
+    struct ThumbnailJob {
+        int mainWidth;
+        int mainHeight;
+        int v4l2Format;
+        int bufType;
+        union {
+            char *srcBufPtr[3]; // bufType == JPEG_BUF_TYPE_USER_PTR
+            int srcBufFd[3]; // bufType == JPEG_BUF_TYPE_DMA_BUF
+        };
+        int srcLen[3];
+        size_t thumblen;
+        bool done;
+    };
+
     pthread_t m_threadWorker;
+    pthread_mutex_t m_mutexWorker;
+    pthread_cond_t m_condWorker; // signaled when a job is queued or the worker should exit
+    pthread_cond_t m_condJobDone;
+    std::deque<ThumbnailJob *> m_thumbJobs;
+    ThumbnailJob m_thumbJob; // the job of the current compression
+    bool m_bWorkerRunning;
+    bool m_bWorkerExit;
+    bool m_bThumbJobQueued;
 
     extra_appinfo_t m_extraInfo;
     app_info_t m_appInfo[15];
 
     bool AllocThumbBuffer(int v4l2Format); /* For single compression */
     bool AllocThumbJpegBuffer(); /* For BTB compression */
-    bool GenerateThumbnailImage();
-    size_t CompressThumbnail();
+    void FreeThumbJpegBuffer();
+    char *MapThumbJpegBuffer(size_t len, int *fd);
+    bool GenerateThumbnailImage(ThumbnailJob &job);
+    size_t CompressThumbnail(ThumbnailJob &job);
     size_t CompressThumbnailOnly(size_t limit, int quality, unsigned int v4l2Format, int src_buftype);
     size_t RemoveTrailingDummies(char *base, size_t len);
     ssize_t FinishCompression(size_t mainlen, size_t thumblen);
     bool ProcessExif(char *base, size_t limit, exif_attribute_t *exifInfo, extra_appinfo_t *extra);
-    static void *tCompressThumbnail(void *p);
+    static void *tThumbnailWorker(void *p);
+    bool StartThumbnailWorker();
+    void StopThumbnailWorker();
+    bool QueueThumbnailJob();
+    size_t WaitForThumbnailJob();
     bool PrepareCompression(bool thumbnail);
 
     // IsThumbGenerationNeeded - true if thumbnail image needed to be generated from the main image
-    //                           It also implies that a worker thread is generated to generate thumbnail concurrently.
+    //                           It also implies that the worker generates thumbnail concurrently.
     inline bool IsThumbGenerationNeeded() { return !TestState(STATE_NO_CREATE_THUMBIMAGE); }
     inline void NoThumbGenerationNeeded() { SetState(STATE_NO_CREATE_THUMBIMAGE); }
     inline void ThumbGenerationNeeded() { ClearState(STATE_NO_CREATE_THUMBIMAGE); }
@@ -83,6 +83,8 @@ class CHWJpegBase {
     unsigned int m_uiAuxFlags;
 protected:
     CHWJpegBase(const char *path);
+    // For the implementations that do not need a device node
+    CHWJpegBase() : m_iFD(-1), m_uiDeviceCaps(0), m_uiAuxFlags(0) { }
     virtual ~CHWJpegBase();
     int GetDeviceFD() { return m_iFD; }
     void SetDeviceCapabilities(unsigned int cap) { m_uiDeviceCaps = cap; }
@@ -99,7 +101,7 @@ public:
      * A user that creates this object *must* test if the object is successfully
      * created because some initialization in the constructor may fail.
      */
-    bool Okay() { return m_iFD >= 0; }
+    virtual bool Okay() { return m_iFD >= 0; }
     operator bool() { return Okay(); }
 
     /*
@@ -157,6 +159,7 @@ protected:
     }
 public:
     CHWJpegCompressor(const char *path): CHWJpegBase(path), m_nLastStreamSize(0), m_nLastThumbStreamSize(0) { }
+    CHWJpegCompressor(): CHWJpegBase(), m_nLastStreamSize(0), m_nLastThumbStreamSize(0) { }
 
     /*
      * SetImageFormat - Configure uncompressed image format, width and height
@@ -499,6 +502,20 @@ class CHWJpegM2M1SHOTCompressor: public CHWJpegCompressor {
 
 #define TO_SEC_IMG_SIZE(val)    (((val) >> 16) & 0xFFFF)
 
+// The maximum number of compressions that can be in flight in the pipeline
+#define HWJPEG_PIPELINE_MAX_SLOTS   8
+
+/*
+ * hwjpeg_pipeline_callback_t - Notification of the completion of a pipelined compression
+ * @data[in]                  : The value given to SetPipelineCallback()
+ * @priv[in]                  : The value given to SubmitCompression()
+ * @stream_size[in]           : The size of the compressed JPEG stream. Negative value on error
+ *                              or if the compression is cancelled by StopPipeline().
+ * @secondary_stream_size[in] : The size of secondary JPEG stream
+ */
+typedef void (*hwjpeg_pipeline_callback_t)(void *data, void *priv,
+                                           ssize_t stream_size, size_t secondary_stream_size);
+
 class CHWJpegV4L2Compressor : public CHWJpegCompressor, private CHWJpegFlagManager {
     enum {
         HWJPEG_CTRL_CHROMFACTOR = 0,
@@ -515,6 +532,7 @@ class CHWJpegV4L2Compressor : public CHWJpegCompressor, private CHWJpegFlagManag
         HWJPEG_FLAG_QBUF_CAP    = 0x200, // Set if the JPEG stream buffer is queued
         HWJPEG_FLAG_REQBUFS     = 0x400,
         HWJPEG_FLAG_STREAMING   = 0x800,
+        HWJPEG_FLAG_PIPELINE    = 0x1000, // Set if StartPipeline() is invoked successfully
 
         HWJPEG_FLAG_SRC_BUFFER  = 0x10000, // Set if SetImageBuffer() is invoked successfully
         HWJPEG_FLAG_SRC_BUFFER2 = 0x20000, // Set if SetImageBuffer2() is invoked successfully
@@ -540,6 +558,18 @@ class CHWJpegV4L2Compressor : public CHWJpegCompressor, private CHWJpegFlagManag
 
     bool m_bEnableHWFC;
 
+    // The states of the buffer indices requested by StartPipeline()
+    struct hwjpeg_pipeline_slot {
+        void *priv;
+        bool busy;
+    } m_PipelineSlots[HWJPEG_PIPELINE_MAX_SLOTS];
+    unsigned int m_uiPipelineSlots;
+    unsigned int m_uiPipelineQueued;
+    __u32 m_uiPipelineSrcMemory;
+    __u32 m_uiPipelineDstMemory;
+    hwjpeg_pipeline_callback_t m_fnPipelineCallback;
+    void *m_pPipelineCallbackData;
+
     bool IsB2BCompression() {
         return (TO_SEC_IMG_SIZE(m_v4l2Format.fmt.pix_mp.width) +
                     TO_SEC_IMG_SIZE(m_v4l2Format.fmt.pix_mp.height)) != 0;
@@ -549,12 +579,14 @@ class CHWJpegV4L2Compressor : public CHWJpegCompressor, private CHWJpegFlagManag
     bool TryFormat();
     bool SetFormat();
     bool UpdateControls();
-    bool ReqBufs(unsigned int count = 1);
+    // granted is the number of the buffers given for both of the image and the stream
+    bool ReqBufs(unsigned int count = 1, unsigned int *granted = NULL);
     bool StreamOn();
     bool StreamOff();
     bool QBuf();
     ssize_t DQBuf(size_t *secondary_stream_size);
     bool StopStreaming();
+    bool PrepareBuffers();
 public:
     CHWJpegV4L2Compressor(const char *path);
     virtual ~CHWJpegV4L2Compressor();
@@ -586,6 +618,121 @@ public:
     virtual bool GetJpegBuffer(int *buffer, size_t *len_buffer);
     virtual ssize_t WaitForCompression(size_t *secondary_stream_size = NULL);
     virtual void Release();
+
+    /*
+     * Pipelined compression keeps HWJPEG streaming with up to @num_slots pairs
+     * of the image buffer and the JPEG stream buffer queued so that the
+     * compressions of a burst are performed back to back without REQBUFS and
+     * STREAMON/STREAMOFF between them.
+     *
+     * StartPipeline - Request @num_slots buffers and start streaming
+     * The image format and the memory types of the buffers are fixed until
+     * StopPipeline(). Therefore, SetImageFormat(), SetImageBuffer() and
+     * SetJpegBuffer() should be called before StartPipeline(). Compress() is
+     * not permitted while the pipeline is running.
+     *
+     * SubmitCompression - Queue the compression of the image buffer and the JPEG
+     * stream buffer configured by the last calls to SetImageBuffer(), SetImageBuffer2(),
+     * SetJpegBuffer() and SetJpegBuffer2(). The quality factors configured before
+     * the submission are applied. The controls including the quality factors,
+     * the chroma subsampling and HWFC apply to all the queued compressions.
+     * Therefore, they are fixed while any compression is in flight: the
+     * submission fails if they are changed before all the submitted
+     * compressions are reaped.
+     * @priv[in] : The user data that is handed back on the completion
+     * @return   : The index of the slot of the compression. Negative value on error
+     *             or if all the slots are busy.
+     *
+     * ReapCompression - Retrieve the result of the oldest submitted compression
+     * @priv[out]                  : The value given to SubmitCompression() (optional)
+     * @secondary_stream_size[out] : The size of secondary JPEG stream (optional)
+     * @block_mode[in]             : Wait for the completion if it is true.
+     * @return : The size of the compressed JPEG stream.
+     *           Zero if @block_mode is false and no compression is completed.
+     *           Negative value on error.
+     * The callback configured by SetPipelineCallback() is also invoked in
+     * ReapCompression(). GetPollFD() is notified with POLLIN when a compression
+     * is completed to let the users reap it from their event loop.
+     *
+     * StopPipeline - Stop streaming and release the buffers. The compressions
+     * that are not reaped yet are cancelled and notified to the callback.
+     */
+    bool StartPipeline(unsigned int num_slots);
+    void StopPipeline();
+    int SubmitCompression(void *priv = NULL);
+    ssize_t ReapCompression(void **priv = NULL, size_t *secondary_stream_size = NULL,
+                            bool block_mode = true);
+    void SetPipelineCallback(hwjpeg_pipeline_callback_t callback, void *data) {
+        m_fnPipelineCallback = callback;
+        m_pPipelineCallbackData = data;
+    }
+    int GetPollFD() { return GetDeviceFD(); }
+    unsigned int GetPendingCompressions() { return m_uiPipelineQueued; }
+};
+
+// The maximum number of threads that compress the slices of an image
+#define HWJPEG_SW_MAX_SLICES    4
+
+/*
+ * CHWJpegSWCompressor - JPEG compression on CPU
+ *
+ * It produces the same baseline JPEG stream as HWJPEG: SOI, DQT, SOF0, DHT,
+ * SOS, the entropy-coded segment and EOI with the standard Huffman tables.
+ * The image is split into slices of MCU rows that are compressed by separate
+ * threads. The slices are independent because the restart interval is one
+ * MCU row if the image is compressed in multiple slices.
+ * Back-to-back compression of the secondary image is not supported.
+ * Compress() always blocks until the compression finishes.
+ */
+class CHWJpegSWCompressor : public CHWJpegCompressor {
+    unsigned int m_uiFormat;
+    unsigned int m_uiWidth;
+    unsigned int m_uiHeight;
+    unsigned int m_uiNumPlanes;
+    size_t m_szPlanes[3];
+
+    unsigned int m_uiHFactor; // 0 if grayscale
+    unsigned int m_uiVFactor;
+
+    unsigned char m_QTables[2][64]; // in the zig-zag scan order
+
+    bool m_bSrcDmabuf;
+    char *m_pSrcBuffers[3];
+    int m_iSrcBuffers[3];
+    size_t m_szSrcBuffers[3];
+
+    bool m_bDstDmabuf;
+    char *m_pDstBuffer;
+    int m_iDstBuffer;
+    size_t m_szDstBuffer;
+    int m_iDstOffset;
+
+    unsigned int m_uiSlices;
+
+    bool m_bSrcConfigured;
+    bool m_bDstConfigured;
+
+    bool SetImageBufferSizes(size_t len_buffers[], unsigned int num_buffers);
+public:
+    CHWJpegSWCompressor();
+    virtual ~CHWJpegSWCompressor();
+
+    virtual bool Okay() { return true; }
+
+    // The number of threads is limited by HWJPEG_SW_MAX_SLICES
+    void SetSliceCount(unsigned int slices);
+
+    virtual bool SetImageFormat(unsigned int v4l2_fmt, unsigned int width, unsigned int height,
+                              unsigned int sec_width = 0, unsigned int sec_height = 0);
+    virtual bool GetImageBufferSizes(size_t buf_sizes[], unsigned int *num_bufffers);
+    virtual bool SetChromaSampFactor(unsigned int horizontal, unsigned int vertical);
+    virtual bool SetQuality(unsigned int quality_factor, unsigned int quality_factor2 = 0);
+    virtual bool SetQuality(const unsigned char qtable[]);
+    virtual bool SetImageBuffer(char *buffers[], size_t len_buffers[], unsigned int num_buffers);
+    virtual bool SetImageBuffer(int buffers[], size_t len_buffers[], unsigned int num_buffers);
+    virtual bool SetJpegBuffer(char *buffer, size_t len_buffer);
+    virtual bool SetJpegBuffer(int buffer, size_t len_buffer, int offset = 0);
+    virtual ssize_t Compress(size_t *secondary_stream_size = NULL, bool block_mode = true);
 };
 
 class CHWJpegV4L2Decompressor : public CHWJpegDecompressor, private CHWJpegFlagManager {
@@ -1,10 +1,15 @@
-#include <fstream>
-#include <sstream>
-#include <regex>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
-#include <algorithm>
 
 #include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include <hardware/memtrack.h>
@@ -24,82 +29,215 @@ static unsigned int available_flags [NUM_AVAILABLE_FLAGS] = {
 
 struct DmabufBuffer {
     unsigned int id;
-    unsigned int type;
     size_t size;
     size_t pss;
     DmabufBuffer(unsigned int _id, size_t _size, size_t _pss)
-        : id(_id), type(MEMTRACK_FLAG_SMAPS_UNACCOUNTED | MEMTRACK_FLAG_SHARED_PSS), size(_size), pss(_pss)
+        : id(_id), size(_size), pss(_pss)
     { }
-    void setPoolType(string _type) { type |= (_type == "carveout") ? MEMTRACK_FLAG_DEDICATED : MEMTRACK_FLAG_SYSTEM; }
-    void setFlags(unsigned int flags) { type |= (flags & ION_FLAG_PROTECTED) ? MEMTRACK_FLAG_SECURE : MEMTRACK_FLAG_NONSECURE; }
 };
 
+struct IonBuffer {
+    size_t size;
+    unsigned int flags;
+    bool carveout;
+    unsigned int getType() const {
+        unsigned int type = MEMTRACK_FLAG_SMAPS_UNACCOUNTED | MEMTRACK_FLAG_SHARED_PSS;
+        type |= carveout ? MEMTRACK_FLAG_DEDICATED : MEMTRACK_FLAG_SYSTEM;
+        type |= (flags & ION_FLAG_PROTECTED) ? MEMTRACK_FLAG_SECURE : MEMTRACK_FLAG_NONSECURE;
+        return type;
+    }
+};
+
+/*
+ * The ion buffer table is shared by the queries of all pids that are made
+ * within ION_SNAPSHOT_TTL_MS. A system-wide dump queries every pid in a row
+ * and reading the whole table for each of them dominates the time.
+ */
+#define ION_SNAPSHOT_TTL_MS 500
+typedef unordered_map<unsigned int, IonBuffer> IonBufferTable;
+
+static mutex ion_snapshot_lock;
+static shared_ptr<const IonBufferTable> ion_snapshot;
+static uint64_t ion_snapshot_time_ms;
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// The files in debugfs report the size of zero. Read until the end of file.
+static bool read_file(const char *path, string &content)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    char buf[4096];
+    ssize_t len;
+    content.clear();
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        content.append(buf, len);
+    close(fd);
+
+    return len == 0;
+}
+
+// Tokenizer for the lines of the debugfs files. p is advanced over the parsed token.
+static inline void skip_spaces(const char *&p, const char *end)
+{
+    while ((p < end) && ((*p == ' ') || (*p == '\t')))
+        p++;
+}
+
+static inline bool skip_char(const char *&p, const char *end, char c)
+{
+    if ((p == end) || (*p != c))
+        return false;
+    p++;
+    return true;
+}
+
+static inline bool skip_token(const char *&p, const char *end)
+{
+    const char *start = p;
+    while ((p < end) && (*p != ' ') && (*p != '\t'))
+        p++;
+    return p != start;
+}
+
+static inline int hex_value(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    if ((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F'))
+        return c - 'A' + 10;
+    return -1;
+}
+
+static inline bool parse_number(const char *&p, const char *end, unsigned long &val, unsigned int base = 10)
+{
+    if ((base == 16) && (end - p > 2) && (p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X')))
+        p += 2;
+
+    const char *start = p;
+    int digit;
+    val = 0;
+    while ((p < end) && ((digit = hex_value(*p)) >= 0) && (digit < (int)base)) {
+        val = val * base + digit;
+        p++;
+    }
+    return p != start;
+}
+
 const char DMABUF_FOOTPRINT_PATH[] = "/sys/kernel/debug/dma_buf/footprint/";
 static bool build_dmabuf_footprint(vector<DmabufBuffer> &buffers, pid_t pid)
 {
-    ostringstream dmabuf_path;
-    dmabuf_path << DMABUF_FOOTPRINT_PATH << pid;
+    char path[64];
+    snprintf(path, sizeof(path), "%s%d", DMABUF_FOOTPRINT_PATH, pid);
 
-    ifstream dmabuf(dmabuf_path.str());
-    if (!dmabuf)
+    string content;
+    if (!read_file(path, content))
         return false;
     //
     // exp_name      size     share
     // ion-102   69271552  34635776
-    regex rex("\\s*ion-(\\d+)\\s+(\\d+)\\s+(\\d+).*");
-    smatch mch;
-    // 1-id, 2-size, 3-pss
-    for (string line; getline(dmabuf, line); )
-        if (regex_match(line, mch, rex))
-            buffers.emplace_back(stoul(mch[1], 0, 10), stoul(mch[2], 0, 10), stoul(mch[3], 0, 10));
+    const char *p = content.data();
+    const char *end = p + content.size();
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+
+        unsigned long id, size, pss;
+        skip_spaces(p, eol);
+        if ((eol - p > 4) && !memcmp(p, "ion-", 4)) {
+            p += 4;
+            if (parse_number(p, eol, id)) {
+                skip_spaces(p, eol);
+                if (parse_number(p, eol, size)) {
+                    skip_spaces(p, eol);
+                    if (parse_number(p, eol, pss))
+                        buffers.emplace_back(id, size, pss);
+                }
+            }
+        }
+
+        p = eol + 1;
+    }
 
     return true;
 }
 
 const char ION_BUFFERS_PATH[] = "/sys/kernel/debug/ion/buffers";
-static bool complete_dmabuf_footprint(int type, vector<DmabufBuffer> &buffers)
+static bool build_ion_buffer_table(IonBufferTable &table)
 {
-    ifstream ion(ION_BUFFERS_PATH);
-    if (!ion)
+    string content;
+    if (!read_file(ION_BUFFERS_PATH, content))
         return false;
 
     // [  id]            heap heaptype flags size(kb) : iommu_mapped...
     // [ 106] ion_system_heap   system  0x40    16912 : 19080000.dsim(0)
-    regex rexion("\\[ *(\\d+)\\] +[[:alnum:]\\-_]+ +(\\w+) +([x[:xdigit:]]+) +(\\d+).*");
-    smatch mch;
-    // 1-id, 2-heaptype, 3-flags, 4-size
-    for (string line; getline(ion, line); ) {
-        if (regex_match(line, mch, rexion)) {
-            unsigned int id = stoul(mch[1], 0, 10);
-            unsigned int flags = stoul(mch[3], 0, 16);
-            size_t len = stoul(mch[4], 0, 10) * 1024;
-            auto elem = find_if(begin(buffers), end(buffers), [id, len] (auto &item) {
-                                    return (item.id == id) && (item.size == len);
-                                });
-            // passes if type = OTHER && not flag & hwrender or type == GRAPHIC && flag & hwrender
-            if ((elem != end(buffers)) && ((type == MEMTRACK_TYPE_OTHER) == !(flags & ION_FLAG_MAY_HWRENDER))) {
-                elem->setFlags(flags);
-                elem->setPoolType(mch[2]);
+    const char *p = content.data();
+    const char *end = p + content.size();
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+
+        unsigned long id, flags, size;
+        skip_spaces(p, eol);
+        if (skip_char(p, eol, '[')) {
+            skip_spaces(p, eol);
+            if (parse_number(p, eol, id) && skip_char(p, eol, ']')) {
+                skip_spaces(p, eol);
+                skip_token(p, eol);      // heap name
+                skip_spaces(p, eol);
+                const char *heaptype = p;
+                if (skip_token(p, eol)) {
+                    bool carveout = ((p - heaptype) == 8) && !memcmp(heaptype, "carveout", 8);
+                    skip_spaces(p, eol);
+                    if (parse_number(p, eol, flags, 16)) {
+                        skip_spaces(p, eol);
+                        if (parse_number(p, eol, size))
+                            table[id] = { size * 1024, (unsigned int)flags, carveout };
+                    }
+                }
             }
         }
+
+        p = eol + 1;
     }
 
     return true;
 }
 
-int dmabuf_memtrack_get_memory(pid_t pid, int type, struct memtrack_record *records, size_t *num_records)
+static shared_ptr<const IonBufferTable> get_ion_buffer_table()
 {
-    if ((type != MEMTRACK_TYPE_OTHER) && (type != MEMTRACK_TYPE_GRAPHICS))
-        return -ENODEV;
+    lock_guard<mutex> lock(ion_snapshot_lock);
 
-    if (*num_records == 0) {
-        *num_records = NUM_AVAILABLE_FLAGS;
-        return 0;
-    }
+    uint64_t now = now_ms();
+    if (ion_snapshot && (now - ion_snapshot_time_ms < ION_SNAPSHOT_TTL_MS))
+        return ion_snapshot;
 
-    *num_records = (*num_records < NUM_AVAILABLE_FLAGS) ? *num_records : NUM_AVAILABLE_FLAGS;
+    auto table = make_shared<IonBufferTable>();
+    if (!build_ion_buffer_table(*table))
+        return nullptr;
 
-    for (size_t i = 0; i < *num_records; i++) {
+    ion_snapshot = table;
+    ion_snapshot_time_ms = now;
+
+    return ion_snapshot;
+}
+
+// The ion buffer table is taken at the first pid that has dmabufs
+static int fill_dmabuf_records(pid_t pid, int type, shared_ptr<const IonBufferTable> &table,
+                               struct memtrack_record *records, size_t num_records)
+{
+    for (size_t i = 0; i < num_records; i++) {
         records[i].size_in_bytes = 0;
         records[i].flags = available_flags[i];
     }
@@ -112,12 +250,22 @@ int dmabuf_memtrack_get_memory(pid_t pid, int type, struct memtrack_record *reco
     if (buffers.size() == 0)
         return 0;
 
-    if (!complete_dmabuf_footprint(type, buffers))
+    if (!table && !(table = get_ion_buffer_table()))
         return -ENODEV;
 
-    for (auto item: buffers) {
-        for (size_t i = 0; i < *num_records; i++) {
-            if (item.type == available_flags[i]) {
+    for (auto &item: buffers) {
+        auto elem = table->find(item.id);
+        if ((elem == table->end()) || (elem->second.size != item.size))
+            continue;
+
+        // passes if type = OTHER && not flag & hwrender or type == GRAPHIC && flag & hwrender
+        const IonBuffer &ion = elem->second;
+        if ((type == MEMTRACK_TYPE_OTHER) != !(ion.flags & ION_FLAG_MAY_HWRENDER))
+            continue;
+
+        unsigned int item_type = ion.getType();
+        for (size_t i = 0; i < num_records; i++) {
+            if (item_type == available_flags[i]) {
                 records[i].size_in_bytes += item.pss;
                 break;
             }
@@ -126,3 +274,43 @@ int dmabuf_memtrack_get_memory(pid_t pid, int type, struct memtrack_record *reco
 
     return 0;
 }
+
+int dmabuf_memtrack_get_memory(pid_t pid, int type, struct memtrack_record *records, size_t *num_records)
+{
+    if ((type != MEMTRACK_TYPE_OTHER) && (type != MEMTRACK_TYPE_GRAPHICS))
+        return -ENODEV;
+
+    if (*num_records == 0) {
+        *num_records = NUM_AVAILABLE_FLAGS;
+        return 0;
+    }
+
+    *num_records = (*num_records < NUM_AVAILABLE_FLAGS) ? *num_records : NUM_AVAILABLE_FLAGS;
+
+    shared_ptr<const IonBufferTable> table;
+
+    return fill_dmabuf_records(pid, type, table, records, *num_records);
+}
+
+int dmabuf_memtrack_get_memory_batch(const pid_t *pids, size_t num_pids, int type,
+                                     struct memtrack_record *records, size_t *num_records,
+                                     int *results)
+{
+    if ((type != MEMTRACK_TYPE_OTHER) && (type != MEMTRACK_TYPE_GRAPHICS))
+        return -ENODEV;
+
+    if (*num_records == 0) {
+        *num_records = NUM_AVAILABLE_FLAGS;
+        return 0;
+    }
+
+    size_t stride = *num_records;
+    *num_records = (*num_records < NUM_AVAILABLE_FLAGS) ? *num_records : NUM_AVAILABLE_FLAGS;
+
+    shared_ptr<const IonBufferTable> table;
+
+    for (size_t i = 0; i < num_pids; i++)
+        results[i] = fill_dmabuf_records(pids[i], type, table, &records[i * stride], *num_records);
+
+    return 0;
+}
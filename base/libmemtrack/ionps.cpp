@@ -7,14 +7,23 @@
 #include <algorithm>
 #include <iomanip>
 #include <map>
+#include <set>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 #include <dirent.h>
 #include <cerrno>
+#include <cstring>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
 
 #include <hardware/exynos/ion.h>
 
@@ -85,6 +94,19 @@ struct ProcessNode {
     MapType mapList;
 };
 
+/*
+ * Change of the buffers that a process has since the last refresh.
+ * op is '+' if the process gets the buffer and '-' if it releases.
+ */
+struct MapDelta {
+    char op;
+    unsigned int pid;
+    unsigned int id;
+    size_t size;
+};
+
+typedef vector<pair<unsigned int, unsigned int>> FileList;   // buffer id with fd or refcount
+
 class MapTable {
 public:
     MapTable()
@@ -93,11 +115,18 @@ public:
     };
     ~MapTable() { };
 
-    bool setupBuffer();
+    bool setupBuffer(set<unsigned int> *touched = nullptr);
     bool setupTraceInfo();
-    bool setupMapInfo();
+    bool setupMapInfo(unsigned int jobs = 1);
     ProcessNode *setupProcessNode(unsigned int pid);
 
+    /*
+     * Update the table to the current state. Only the processes whose
+     * footprint is changed are walked unless fullScan is set.
+     * deltas gets the buffers that the processes get or release.
+     */
+    bool refresh(unsigned int jobs, bool fullScan, vector<MapDelta> &deltas);
+
     BufferNode *getBufferNode(unsigned int buffer_id)
     {
         BufferType::iterator iter;
@@ -127,9 +156,19 @@ public:
     void print();
     void printSummary(void);
 private:
+    void setupTraceNode(unsigned int pid, const FileList &traces);
+    void setupMapNode(unsigned int pid, const FileList &fds);
+    void detachProcess(unsigned int pid);
+    void removeBuffer(unsigned int buffer_id, set<unsigned int> *touched);
+    void collectDeltas(const set<unsigned int> &touched, vector<MapDelta> &deltas);
+
     unsigned int totalIonMemory;
     BufferType bufferList;
     ProcessType processList;
+    /* hash of the footprint of each process to find the changed processes */
+    map<unsigned int, size_t> traceSignature;
+    /* buffers of each process with their size that are reported by refresh() */
+    map<unsigned int, map<unsigned int, size_t>> reportedBuffers;
 };
 
 void BufferNode::setTraceNode(unsigned int refcount, ProcessNode *procNode)
@@ -238,7 +277,7 @@ const char DMABUF_BUFINFO_PATH[] = "/sys/kernel/debug/dma_buf/bufinfo";
 const char PROC_PATH[] = "/proc";
 const char DMABUF_FOOTPRINT_PATH[] = "/sys/kernel/debug/dma_buf/footprint";
 
-bool MapTable::setupBuffer()
+bool MapTable::setupBuffer(set<unsigned int> *touched)
 {
     ifstream ion(ION_BUFFERS_PATH);
     if (!ion) {
@@ -250,6 +289,9 @@ bool MapTable::setupBuffer()
     // [ 106] ion_system_heap   system  0x40    16912
     regex rexion_ion("\\[ *(\\d+)\\] +(\\w+)+ +(\\w+) +([x[:xdigit:]]+) +(\\d+).*");
     smatch mch;
+    set<unsigned int> alive;
+
+    totalIonMemory = 0;
 
     // 1-id, 2-heapname 3-heaptype, 3-flags, 4-size
     for (string line; getline(ion, line); ) {
@@ -258,11 +300,24 @@ bool MapTable::setupBuffer()
             unsigned int flags = stoul(mch[4], 0, 16);
             size_t len = stoul(mch[5]);
 
+            // the buffer id is reused by another buffer
+            BufferNode *bufferNode = getBufferNode(id);
+            if (bufferNode && ((bufferNode->size != len * 1024) || (bufferNode->flags != flags)))
+                removeBuffer(id, touched);
+
             bufferList.emplace(id, BufferNode(id, flags, len * 1024, mch[3], mch[2]));
             totalIonMemory += len;
+            alive.insert(id);
         }
     }
 
+    // the buffers that are freed since the last update
+    for (auto iter = bufferList.begin(); iter != bufferList.end(); ) {
+        unsigned int id = (iter++)->first;
+        if (alive.find(id) == alive.end())
+            removeBuffer(id, touched);
+    }
+
     ifstream dmabuf(DMABUF_BUFINFO_PATH);
     if (!dmabuf) {
         cout << "dmabuf path does not exist (" << DMABUF_BUFINFO_PATH << ")" << endl;
@@ -288,6 +343,7 @@ bool MapTable::setupBuffer()
                 continue;
 
             bufferNode->setFileCount(file_count);
+            bufferNode->attachedDevice.clear();
 
             // Attached Devices:
             getline(dmabuf, line);
@@ -305,131 +361,337 @@ bool MapTable::setupBuffer()
     return true;
 }
 
-bool MapTable::setupTraceInfo()
+static bool readTraceInfo(unsigned int pid, string &content)
+{
+    /* file_directory : /d/dma_buf/footprint/<pid> */
+    ostringstream file_directory;
+    file_directory << DMABUF_FOOTPRINT_PATH << "/" << pid;
+
+    ifstream trace(file_directory.str().c_str());
+    if (!trace)
+        return false;
+
+    ostringstream ostr;
+    ostr << trace.rdbuf();
+    content = ostr.str();
+
+    return true;
+}
+
+static void parseTraceInfo(const string &content, FileList &traces)
 {
     //Dma-buf-trace Objects:
     //   exp_name          size        share       refcount
     //    ion-333        151552       151552              1
-    DIR *proc = opendir(DMABUF_FOOTPRINT_PATH);
+    istringstream trace(content);
+    smatch mch;
+    regex rexion_trace(" *ion\\-(\\d+) *(\\d+) *(\\d+) *(\\d+)");
 
-    if (!proc) {
-        cout << "Footprint path does not exist (" << DMABUF_FOOTPRINT_PATH << ")" << endl;
-        return false;
+    for (string line; getline(trace, line); ) {
+        // 1-id 2-size 3-share 4-refcount
+        if (regex_match(line, mch, rexion_trace))
+            traces.emplace_back(stoul(mch[1]), stoul(mch[4]));
     }
+}
+
+/* The numeric entries of the directory such as /proc and the footprint */
+static bool listProcesses(const char *path, vector<unsigned int> &pids)
+{
+    DIR *proc = opendir(path);
+
+    if (!proc)
+        return false;
 
     struct dirent *ProcessDirectory;
 
     while ((ProcessDirectory = readdir(proc)) != NULL) {
         char *strptr;
         unsigned int pid = strtoul(ProcessDirectory->d_name, &strptr, 10);
-        if (strptr == ProcessDirectory->d_name)
+        if ((strptr == ProcessDirectory->d_name) || (*strptr != '\0'))
             continue;
 
-        /* file_directory : /d/dma_buf/footprint/<pid> */
-        ostringstream file_directory;
-        file_directory << DMABUF_FOOTPRINT_PATH << "/" << pid;
+        pids.push_back(pid);
+    }
 
-        ifstream trace(file_directory.str().c_str());
-        if (!trace) {
-            closedir(proc);
-            cout << "Process file of footprint does not exist (" << file_directory.str() << ")" << endl;
-            return false;
-        }
+    closedir(proc);
 
-        smatch mch;
-        regex rexion_trace(" *ion\\-(\\d+) *(\\d+) *(\\d+) *(\\d+)");
-        ProcessNode *procNode = nullptr;
+    return true;
+}
 
-        for (string line; getline(trace, line); ) {
-            // 1-id 2-size 3-share 4-refcount
-            if (regex_match(line, mch, rexion_trace)) {
-                    unsigned int id = stoul(mch[1]);
-                    unsigned int refcount = stoul(mch[4]);
+/* Collect the dmabuf of ion in /proc/<pid>/fd. It does not touch MapTable. */
+static void walkProcessFiles(unsigned int pid, FileList &fds)
+{
+    /* fd_directory : /proc/<pid>/fd */
+    char fd_directory[MAX_NAME_SIZE];
+    snprintf(fd_directory, sizeof(fd_directory), "/proc/%u/fd/", pid);
 
-                    BufferNode *bufferNode = getBufferNode(id);
-                    if (!bufferNode)
-                        continue;
+    DIR *ProcessFileDirectory;
+    if ((ProcessFileDirectory = opendir(fd_directory)) == NULL)
+        return;
 
-                    if (!procNode)
-                        procNode = setupProcessNode(pid);
+    struct dirent *FileEntry;
+    char *strptr;
 
-                    bufferNode->setTraceNode(refcount, procNode);
-                    procNode->setTraceNode(refcount, bufferNode);
-            }
+    while ((FileEntry = readdir(ProcessFileDirectory)) != NULL) {
+        unsigned int fd = strtoul(FileEntry->d_name, &strptr, 10);
+        if (strptr == FileEntry->d_name)
+            continue;
+
+        char symbolFile[MAX_NAME_SIZE] = {0, };
+        if (readlinkat(dirfd(ProcessFileDirectory), FileEntry->d_name,
+                       symbolFile, sizeof(symbolFile) - 1) < 0)
+                continue;
+
+        if (!strncmp(symbolFile, ION_DMABUF_PREFIX, sizeof(ION_DMABUF_PREFIX) - 1)) {
+            char *prefixStart = symbolFile + sizeof(ION_DMABUF_PREFIX);
+            unsigned int buffer_id = strtoul(prefixStart, &strptr, 10);
+            if (strptr == prefixStart)
+                continue;
+
+            fds.emplace_back(buffer_id, fd);
         }
     }
 
-    closedir(proc);
+    closedir(ProcessFileDirectory);
+}
+
+/* Walk the fd directories of the processes with the given number of threads */
+static void walkProcesses(const vector<unsigned int> &pids, unsigned int jobs, vector<FileList> &files)
+{
+    files.assign(pids.size(), FileList());
+
+    if ((jobs <= 1) || (pids.size() <= 1)) {
+        for (size_t i = 0; i < pids.size(); i++)
+            walkProcessFiles(pids[i], files[i]);
+        return;
+    }
+
+    atomic<size_t> next(0);
+    vector<thread> workers;
+    for (unsigned int i = 0; i < min<size_t>(jobs, pids.size()); i++) {
+        workers.emplace_back([&pids, &files, &next] () {
+            size_t index;
+            while ((index = next++) < pids.size())
+                walkProcessFiles(pids[index], files[index]);
+        });
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void MapTable::setupTraceNode(unsigned int pid, const FileList &traces)
+{
+    ProcessNode *procNode = nullptr;
+
+    for (auto trace : traces) {
+        BufferNode *bufferNode = getBufferNode(trace.first);
+        if (!bufferNode)
+            continue;
+
+        if (!procNode)
+            procNode = setupProcessNode(pid);
+
+        bufferNode->setTraceNode(trace.second, procNode);
+        procNode->setTraceNode(trace.second, bufferNode);
+    }
+}
+
+void MapTable::setupMapNode(unsigned int pid, const FileList &fds)
+{
+    ProcessNode *procNode = nullptr;
+
+    for (auto file : fds) {
+        BufferNode *bufferNode = getBufferNode(file.first);
+        if (!bufferNode)
+            continue;
+
+        if (!procNode)
+            procNode = setupProcessNode(pid);
+
+        bufferNode->setMapNode(file.second, procNode);
+        procNode->setMapNode(file.second, bufferNode);
+    }
+}
+
+bool MapTable::setupTraceInfo()
+{
+    vector<unsigned int> pids;
+
+    if (!listProcesses(DMABUF_FOOTPRINT_PATH, pids)) {
+        cout << "Footprint path does not exist (" << DMABUF_FOOTPRINT_PATH << ")" << endl;
+        return false;
+    }
+
+    for (auto pid : pids) {
+        string content;
+
+        if (!readTraceInfo(pid, content)) {
+            cout << "Process file of footprint does not exist (" << DMABUF_FOOTPRINT_PATH << "/" << pid << ")" << endl;
+            return false;
+        }
+
+        FileList traces;
+        parseTraceInfo(content, traces);
+        setupTraceNode(pid, traces);
+        traceSignature[pid] = hash<string>()(content);
+    }
 
     return true;
 }
 
-bool MapTable::setupMapInfo()
+bool MapTable::setupMapInfo(unsigned int jobs)
 {
-    DIR *proc = opendir(PROC_PATH);
+    vector<unsigned int> pids;
 
-    if (!proc) {
+    if (!listProcesses(PROC_PATH, pids)) {
         cout << "Access Fail /proc" << endl;
         return false;
     }
 
-    struct dirent *ProcessDirectory;
+    vector<FileList> files;
+    walkProcesses(pids, jobs, files);
 
-    /* ProcessDirectory : /proc/ */
-    while ((ProcessDirectory = readdir(proc)) != NULL) {
-        char *strptr;
-        unsigned int pid = strtoul(ProcessDirectory->d_name, &strptr, 10);
-        if ((strptr == ProcessDirectory->d_name) || (*strptr != '\0'))
-            continue;
+    for (size_t i = 0; i < pids.size(); i++)
+        setupMapNode(pids[i], files[i]);
 
-        /* fd_directory : /proc/<pid>/fd */
-        ostringstream fd_directory;
-        fd_directory << "/proc/" << pid << "/fd/";
+    return true;
+}
+
+void MapTable::detachProcess(unsigned int pid)
+{
+    ProcessNode *procNode = getProcessNode(pid);
+    if (!procNode)
+        return;
 
-        ProcessNode *procNode = nullptr;
+    for (auto node : procNode->mapList)
+        node.second.bufferNode->mapList.erase(pid);
 
-        DIR *ProcessFileDirectory;
-        if ((ProcessFileDirectory = opendir(fd_directory.str().c_str())) != NULL) {
-            struct dirent *FileEntry;
+    processList.erase(pid);
+}
 
-            while ((FileEntry = readdir(ProcessFileDirectory)) != NULL) {
-                unsigned int fd = strtoul(FileEntry->d_name, &strptr, 10);
-                if (strptr == FileEntry->d_name)
-                    continue;
+void MapTable::removeBuffer(unsigned int buffer_id, set<unsigned int> *touched)
+{
+    BufferNode *bufferNode = getBufferNode(buffer_id);
+    if (!bufferNode)
+        return;
 
-                /* file_directory : /proc/<pid>/fd/<fd> */
-                ostringstream file_directory;
-                file_directory << fd_directory.str() << FileEntry->d_name;
+    for (auto node : bufferNode->mapList) {
+        ProcessNode *procNode = node.second.procNode;
 
-                char symbolFile[MAX_NAME_SIZE] = {0, };
-                if (readlink(file_directory.str().c_str(),
-                             symbolFile, sizeof(symbolFile)) < 0)
-                        continue;
+        procNode->mapList.erase(buffer_id);
+        if (touched)
+            touched->insert(procNode->pid);
+        if (procNode->mapList.empty())
+            processList.erase(procNode->pid);
+    }
 
-                if (!strncmp(symbolFile, ION_DMABUF_PREFIX, sizeof(ION_DMABUF_PREFIX) - 1)) {
-                    char *prefixStart = symbolFile + sizeof(ION_DMABUF_PREFIX);
-                    unsigned int buffer_id = strtoul(prefixStart, &strptr, 10);
-                    if (strptr == prefixStart)
-                        continue;
+    bufferList.erase(buffer_id);
+}
 
-                    BufferNode *bufferNode = getBufferNode(buffer_id);
-                    if (!bufferNode) continue;
+bool MapTable::refresh(unsigned int jobs, bool fullScan, vector<MapDelta> &deltas)
+{
+    set<unsigned int> touched;
 
-                    if (!procNode)
-                        procNode = setupProcessNode(pid);
+    if (!setupBuffer(&touched))
+        return false;
 
-                    bufferNode->setMapNode(fd, procNode);
-                    procNode->setMapNode(fd, bufferNode);
-                }
-            }
+    vector<unsigned int> tracePids;
+    if (!listProcesses(DMABUF_FOOTPRINT_PATH, tracePids)) {
+        cout << "Footprint path does not exist (" << DMABUF_FOOTPRINT_PATH << ")" << endl;
+        return false;
+    }
+
+    // the processes of which footprint is changed, created or removed
+    set<unsigned int> dirty;
+    map<unsigned int, string> contents;
+    map<unsigned int, size_t> signature;
+
+    for (auto pid : tracePids) {
+        string content;
+
+        // the process has exited after readdir
+        if (!readTraceInfo(pid, content))
+            continue;
+
+        size_t hashValue = hash<string>()(content);
+        auto iter = traceSignature.find(pid);
+        if (fullScan || (iter == traceSignature.end()) || (iter->second != hashValue))
+            dirty.insert(pid);
+
+        signature[pid] = hashValue;
+        contents[pid] = move(content);
+    }
+
+    for (auto trace : traceSignature) {
+        if (signature.find(trace.first) == signature.end())
+            dirty.insert(trace.first);
+    }
+    traceSignature = move(signature);
+
+    if (fullScan) {
+        vector<unsigned int> pids;
+        if (listProcesses(PROC_PATH, pids))
+            dirty.insert(pids.begin(), pids.end());
+        for (auto process : processList)
+            dirty.insert(process.first);
+    }
+
+    vector<unsigned int> pids(dirty.begin(), dirty.end());
+    vector<FileList> files;
+    walkProcesses(pids, jobs, files);
+
+    for (size_t i = 0; i < pids.size(); i++) {
+        unsigned int pid = pids[i];
+
+        detachProcess(pid);
+
+        auto content = contents.find(pid);
+        if (content != contents.end()) {
+            FileList traces;
+            parseTraceInfo(content->second, traces);
+            setupTraceNode(pid, traces);
         }
-        closedir(ProcessFileDirectory);
+
+        setupMapNode(pid, files[i]);
+        touched.insert(pid);
     }
-    closedir(proc);
+
+    collectDeltas(touched, deltas);
 
     return true;
 }
 
+void MapTable::collectDeltas(const set<unsigned int> &touched, vector<MapDelta> &deltas)
+{
+    for (auto pid : touched) {
+        map<unsigned int, size_t> current;
+        ProcessNode *procNode = getProcessNode(pid);
+
+        if (procNode) {
+            for (auto node : procNode->mapList)
+                current.emplace(node.first, node.second.bufferNode->size);
+        }
+
+        map<unsigned int, size_t> &reported = reportedBuffers[pid];
+
+        for (auto buffer : reported) {
+            if (current.find(buffer.first) == current.end())
+                deltas.push_back({'-', pid, buffer.first, buffer.second});
+        }
+
+        for (auto buffer : current) {
+            if (reported.find(buffer.first) == reported.end())
+                deltas.push_back({'+', pid, buffer.first, buffer.second});
+        }
+
+        if (current.empty())
+            reportedBuffers.erase(pid);
+        else
+            reported = move(current);
+    }
+}
+
 ProcessNode *MapTable::setupProcessNode(unsigned int pid)
 {
     ProcessNode *processNode;
@@ -629,9 +891,69 @@ static void printHeap(string heapName)
     cout << endl;
 }
 
+/*
+ * Every WATCH_FULL_SCAN_PERIOD refreshes, all processes are walked to find
+ * the processes that have dmabuf without the footprint.
+ */
+#define WATCH_FULL_SCAN_PERIOD 10
+
+static void printDeltas(const vector<MapDelta> &deltas)
+{
+    if (deltas.empty())
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    // @<monotonic time in ms>
+    // +<pid> <buffer id> <size>
+    // -<pid> <buffer id> <size>
+    cout << "@" << (ts.tv_sec * 1000 + ts.tv_nsec / 1000000) << "\n";
+    for (auto &delta : deltas)
+        cout << delta.op << delta.pid << " " << delta.id << " " << delta.size << "\n";
+    cout << flush;
+}
+
+static int watchTable(MapTable &maptable, unsigned int interval, unsigned int jobs)
+{
+    // footprint of a process is created and removed with the process
+    int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0 &&
+            inotify_add_watch(inotifyFd, DMABUF_FOOTPRINT_PATH, IN_CREATE | IN_DELETE) < 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+
+    for (unsigned int count = 0; ; count++) {
+        vector<MapDelta> deltas;
+
+        if (!maptable.refresh(jobs, (count % WATCH_FULL_SCAN_PERIOD) == 0, deltas))
+            break;
+
+        printDeltas(deltas);
+
+        if (inotifyFd >= 0) {
+            struct pollfd fds = { inotifyFd, POLLIN, 0 };
+            if (poll(&fds, 1, interval) > 0) {
+                char events[4096];
+                while (read(inotifyFd, events, sizeof(events)) > 0)
+                    ;
+            }
+        } else {
+            usleep(interval * 1000);
+        }
+    }
+
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+
+    return -1;
+}
+
 static void printHelp(void)
 {
     cout << "usage : ionps [-aesh] [-b BUFFER ID] [-p PROCESS ID] [-H HEAP NAME]" << endl;
+    cout << "              [-w INTERVAL] [-j JOBS]" << endl;
 
     cout << setw(5) << "-b" << setw(10) << "--buffer" << setw(20) << "<buffer index>";
     cout << "   show process information that owns request buffer" << endl;
@@ -645,6 +967,10 @@ static void printHelp(void)
     cout <<  "   show every buffer, process in detail" << endl;
     cout << setw(5) << "-s" << setw(10) << "--summary" << setw(20) << " ";
     cout <<  "   show summary such as ion total memory, and rss, pss by process" << endl;
+    cout << setw(5) << "-w" << setw(10) << "--watch" << setw(20) << "<interval in ms>";
+    cout << "   keep running and show buffers that processes get(+) or release(-)" << endl;
+    cout << setw(5) << "-j" << setw(10) << "--jobs" << setw(20) << "<number>";
+    cout << "   walk /proc with the number of threads" << endl;
     cout << setw(5) << "-h" << setw(10) << "--help" << setw(20) << " ";
     cout << "   This help message" << endl << endl;
 
@@ -715,11 +1041,6 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    MapTable maptable;
-
-    if (!(maptable.setupBuffer() && maptable.setupTraceInfo() && maptable.setupMapInfo()))
-        return -1;
-
     static const struct option long_options[] = {
         {"buffer",    required_argument,  0,          'b'},
         {"process",   required_argument,  0,          'p'},
@@ -727,17 +1048,41 @@ int main(int argc, char *argv[])
         {"event",     required_argument,  0,          'e'},
         {"all",       no_argument,        0,          'a'},
         {"summary",   no_argument,        0,          's'},
+        {"watch",     required_argument,  0,          'w'},
+        {"jobs",      required_argument,  0,          'j'},
         {"help",      no_argument,        0,          'h'},
         {0, 0, 0, 0}
     };
 
     int c, option_index = 0;
-    if ((c = getopt_long(argc, argv, "b:p:H:eash", long_options, &option_index)) == -1) {
+    int watch = -1;
+    int jobs = 1;
+
+    // -w and -j are combined with the other option
+    while ((c = getopt_long(argc, argv, "b:p:H:eashw:j:", long_options, &option_index)) != -1) {
+        if (c == 'w')
+            watch = args_to_num(optarg);
+        else if (c == 'j')
+            jobs = args_to_num(optarg);
+        else
+            break;
+    }
+
+    if ((c == -1) && (watch < 0)) {
         cout << "No argument" << endl;
 
         return -1;
     }
 
+    MapTable maptable;
+
+    // the table is built by the first refresh of the watch
+    if (watch >= 0)
+        return watchTable(maptable, watch, max(jobs, 1));
+
+    if (!(maptable.setupBuffer() && maptable.setupTraceInfo() && maptable.setupMapInfo(max(jobs, 1))))
+        return -1;
+
     switch (c) {
         case 'a':
             maptable.print();
@@ -26,5 +26,13 @@ int ion_memtrack_get_memory(pid_t pid, int type,
 int dmabuf_memtrack_get_memory(pid_t pid, int type,
                                struct memtrack_record *records,
                                size_t *num_records);
+/*
+ * Fill the records of many pids at once with a single snapshot of the ion
+ * buffers. records has *num_records entries for each pid and results gets
+ * the result of each pid that dmabuf_memtrack_get_memory() would return.
+ */
+int dmabuf_memtrack_get_memory_batch(const pid_t *pids, size_t num_pids, int type,
+                                     struct memtrack_record *records,
+                                     size_t *num_records, int *results);
 
 #endif
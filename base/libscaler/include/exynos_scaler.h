@@ -531,6 +531,42 @@ bool exynos_sc_copy_pixels(
     struct exynos_sc_pxinfo *pxinfo,
     int dev_num);
 
+/*!
+ * Request a pixel copy from RGB to RGB without waiting for its completion
+ *
+ * \ingroup exynos_scaler
+ *
+ * \param pxinfo
+ *   information for pixel data copy. It is copied before returning but
+ *   the buffers it describes should be valid until the completion [in]
+ *
+ * \param dev_num
+ *   Scaler H/W instance number. Starts from 0 [in]
+ *
+ * \return
+ *   handle of the request to pass to exynos_sc_copy_pixels_wait().
+ *   NULL on failure in requesting.
+ */
+void *exynos_sc_copy_pixels_async(
+    struct exynos_sc_pxinfo *pxinfo,
+    int dev_num);
+
+/*!
+ * Wait for the completion of a pixel copy requested by
+ * exynos_sc_copy_pixels_async() and release the request handle.
+ *
+ * \ingroup exynos_scaler
+ *
+ * \param request
+ *   handle returned by exynos_sc_copy_pixels_async() [in]
+ *
+ * \return
+ *   true on success in copying pixel data.
+ *   false on failure.
+ */
+bool exynos_sc_copy_pixels_wait(
+    void *request);
+
 int hal_pixfmt_to_v4l2(int hal_pixel_format);
 
 #ifdef __cplusplus
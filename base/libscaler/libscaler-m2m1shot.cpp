@@ -314,6 +314,29 @@ bool CScalerM2M1SHOT::RunSWScaling()
 
             swsc = new CScalerSW_NV12(src[0], src[1], dst[0], dst[1]);
             break;
+        case V4L2_PIX_FMT_RGB32:
+        case V4L2_PIX_FMT_BGR32:
+            if (!GetBuffer(m_task.buf_out, src))
+                return false;
+
+            if (!GetBuffer(m_task.buf_cap, dst)) {
+                PutBuffer(m_task.buf_out, src);
+                return false;
+            }
+
+            swsc = new CScalerSW_RGBA8888(src[0], dst[0]);
+            break;
+        case V4L2_PIX_FMT_NV12M_P010:
+            if (!GetBuffer(m_task.buf_out, src))
+                return false;
+
+            if (!GetBuffer(m_task.buf_cap, dst)) {
+                PutBuffer(m_task.buf_out, src);
+                return false;
+            }
+
+            swsc = new CScalerSW_P010(src[0], src[1], dst[0], dst[1]);
+            break;
         case V4L2_PIX_FMT_UYVY: // TODO: UYVY is not implemented yet.
         default:
             SC_LOGE("Format %x is not supported", m_task.fmt_out.fmt);
@@ -1,5 +1,17 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
 #include "libscaler-swscaler.h"
 
+#define SC_SW_COEF_BITS     14
+#define SC_SW_COEF_ONE      (1 << SC_SW_COEF_BITS)
+#define SC_SW_PHASES        64
+#define SC_SW_BAND_ROWS     32
+#define SC_SW_MAX_THREADS   4
+
 void CScalerSW::Clear() {
     m_pSrc[0] = NULL;
     m_pSrc[1] = NULL;
@@ -18,46 +30,297 @@ void CScalerSW::Clear() {
     m_nDstWidth = 0;
     m_nDstHeight = 0;
     m_nDstStride = 0;
+    m_nFilter = SC_SWFILTER_AUTO;
 }
 
-bool CScalerSW_YUYV::Scale() {
-    if (((m_nSrcLeft | m_nSrcWidth | m_nDstWidth | m_nSrcStride) % 2) != 0) {
-        SC_LOGE("Width of YUV422 should be even");
-        return false;
-    }
+static double Lanczos2(double x) {
+    x = std::fabs(x);
+    if (x < 1e-8)
+        return 1.0;
+    if (x >= 2.0)
+        return 0.0;
 
-    unsigned int h_ratio = (m_nSrcWidth << 16) / m_nDstWidth;
-    unsigned int v_ratio = (m_nSrcHeight << 16) / m_nDstHeight;
+    double px = M_PI * x;
 
-    unsigned int src_x;
-    unsigned int src_y = m_nSrcTop << 16;
+    return 2.0 * std::sin(px) * std::sin(px / 2.0) / (px * px);
+}
 
-    // Luminance + Chrominance at once
-    for (unsigned int y = m_nDstTop; y < (m_nDstTop + m_nDstHeight); y++) {
-        src_x = m_nSrcLeft << 16;
-        for (unsigned int x = m_nDstLeft; x < (m_nDstLeft + m_nDstWidth); x++) {
-            m_pDst[0][y * (m_nDstStride * 2) + x * 2] =
-                m_pSrc[0][(src_y >> 16) * (m_nSrcStride * 2) + (src_x >> 16) * 2];
+/*
+ * Build the coefficients to resample @in pixels to @out pixels.
+ * The polyphase filter is the Lanczos kernel of 2 lobes stretched by the
+ * downscaling factor and quantized to SC_SW_PHASES phases. The coefficients
+ * that reference pixels out of the input area are folded to the edge pixel.
+ */
+static void BuildFilter(unsigned int filter, unsigned int in, unsigned int out,
+                        std::vector<int> &start, std::vector<short> &coef, unsigned int &taps) {
+    double scale = static_cast<double>(in) / out;
+    double stretch = std::max(scale, 1.0);
+    unsigned int ntaps;
 
-            if (!(x & 1)) {
-                unsigned int cx = (src_x >> 16) & ~1;
+    if (filter == SC_SWFILTER_AUTO)
+        filter = (in > out) ? SC_SWFILTER_POLYPHASE : SC_SWFILTER_BILINEAR;
 
-                m_pDst[0][y * (m_nDstStride * 2) + x * 2 + 1] =
-                    m_pSrc[0][(src_y >> 16) * (m_nSrcStride * 2) + cx * 2 + 1];
-                m_pDst[0][y * (m_nDstStride * 2) + x * 2 + 3] =
-                    m_pSrc[0][(src_y >> 16) * (m_nSrcStride * 2) + cx * 2 + 3];
+    if (filter == SC_SWFILTER_NEAREST)
+        ntaps = 1;
+    else if (filter == SC_SWFILTER_BILINEAR)
+        ntaps = 2;
+    else
+        ntaps = 2 * static_cast<unsigned int>(std::ceil(2.0 * stretch));
 
+    // phase table of the polyphase filter
+    std::vector<double> table;
+    if (filter == SC_SWFILTER_POLYPHASE) {
+        table.resize((SC_SW_PHASES + 1) * ntaps);
+        for (unsigned int ph = 0; ph <= SC_SW_PHASES; ph++) {
+            double frac = static_cast<double>(ph) / SC_SW_PHASES;
+            for (unsigned int k = 0; k < ntaps; k++) {
+                double d = static_cast<double>(k) - (ntaps / 2 - 1) - frac;
+                table[ph * ntaps + k] = Lanczos2(d / stretch);
             }
+        }
+    }
+
+    taps = std::min(ntaps, in);
+    start.resize(out);
+    coef.assign(out * taps, 0);
 
-            src_x = LibScaler::min(src_x + h_ratio, (m_nSrcLeft + m_nSrcWidth) << 16);
+    std::vector<double> w(ntaps);
+    std::vector<double> folded(taps);
+
+    for (unsigned int i = 0; i < out; i++) {
+        double center = (i + 0.5) * scale - 0.5;
+        int first;
+
+        if (filter == SC_SWFILTER_NEAREST) {
+            first = static_cast<int>((i + 0.5) * scale);
+            w[0] = 1.0;
+        } else if (filter == SC_SWFILTER_BILINEAR) {
+            first = static_cast<int>(std::floor(center));
+            w[1] = center - first;
+            w[0] = 1.0 - w[1];
+        } else {
+            int base = static_cast<int>(std::floor(center));
+            unsigned int ph = static_cast<unsigned int>(std::lround((center - base) * SC_SW_PHASES));
+
+            first = base - static_cast<int>(ntaps / 2 - 1);
+            std::copy(&table[ph * ntaps], &table[(ph + 1) * ntaps], w.begin());
+        }
+
+        int pos = std::min(std::max(first, 0), static_cast<int>(in - taps));
+
+        std::fill(folded.begin(), folded.end(), 0.0);
+        for (unsigned int k = 0; k < ntaps; k++) {
+            int idx = std::min(std::max(first + static_cast<int>(k), 0), static_cast<int>(in - 1));
+            folded[idx - pos] += w[k];
         }
 
-        src_y = LibScaler::min(src_y + v_ratio, (m_nSrcTop + m_nSrcHeight) << 16);
+        double sum = 0.0;
+        for (unsigned int k = 0; k < taps; k++)
+            sum += folded[k];
+
+        int total = 0;
+        unsigned int peak = 0;
+        for (unsigned int k = 0; k < taps; k++) {
+            int q = static_cast<int>(std::lround(folded[k] / sum * SC_SW_COEF_ONE));
+            coef[i * taps + k] = static_cast<short>(q);
+            total += q;
+            if (folded[k] > folded[peak])
+                peak = k;
+        }
+        // the sum of the coefficients should be exactly 1.0 not to change the brightness
+        coef[i * taps + peak] += SC_SW_COEF_ONE - total;
+        start[i] = pos;
     }
+}
+
+/*
+ * Horizontal pass: resample a row of @src to @out that keeps the result in
+ * (14 - hshift) fractional bits.
+ */
+template <typename T>
+static void FilterRow(const char *row, const CScalerSW::SWPlane &src, unsigned int dstw,
+                      const int *start, const short *coef, unsigned int taps,
+                      unsigned int hshift, int *out) {
+    const unsigned int comps = src.comps;
+    const int round = 1 << (hshift - 1);
+
+    row += src.left * src.step;
+
+    for (unsigned int x = 0; x < dstw; x++, out += comps) {
+        const char *p = row + start[x] * src.step;
+        const short *c = coef + x * taps;
+
+        for (unsigned int n = 0; n < comps; n++) {
+            const char *s = p + src.offset[n];
+            int acc = round;
+
+            for (unsigned int k = 0; k < taps; k++, s += src.step)
+                acc += c[k] * *reinterpret_cast<const T *>(s);
+
+            out[n] = acc >> hshift;
+        }
+    }
+}
+
+/*
+ * Vertical pass: accumulate @taps rows of the horizontal pass. The loop over
+ * the row has no dependency between the elements so that it is vectorized.
+ */
+static void FilterColumn(int *const *rows, const short *coef, unsigned int taps,
+                         unsigned int count, int *acc) {
+    std::fill(acc, acc + count, 0);
+
+    for (unsigned int k = 0; k < taps; k++) {
+        const int c = coef[k];
+        const int *r = rows[k];
+
+        for (unsigned int i = 0; i < count; i++)
+            acc[i] += c * r[i];
+    }
+}
+
+/*
+ * Write a row of the vertical pass to @dst with @bits bits of precision
+ * that are stored in the MSBs of T.
+ */
+template <typename T>
+static void StoreRow(const int *acc, const CScalerSW::SWPlane &dst, unsigned int y,
+                     unsigned int vshift, unsigned int bits) {
+    char *row = dst.base + (dst.top + y) * dst.stride + dst.left * dst.step;
+    const unsigned int lshift = sizeof(T) * 8 - bits;
+    const unsigned int shift = vshift + lshift;
+    const int round = 1 << (shift - 1);
+    const int maxval = (1 << bits) - 1;
+
+    for (unsigned int x = 0; x < dst.width; x++, row += dst.step) {
+        for (unsigned int n = 0; n < dst.comps; n++) {
+            int v = std::min(std::max((*acc++ + round) >> shift, 0), maxval);
+            *reinterpret_cast<T *>(row + dst.offset[n]) = static_cast<T>(v << lshift);
+        }
+    }
+}
+
+template <typename T>
+static void ScaleBand(const CScalerSW::SWPlane &src, const CScalerSW::SWPlane &dst,
+                      const std::vector<int> &hstart, const std::vector<short> &hcoef, unsigned int htaps,
+                      const std::vector<int> &vstart, const std::vector<short> &vcoef, unsigned int vtaps,
+                      unsigned int y0, unsigned int y1,
+                      std::vector<int> &tmp, std::vector<int> &acc, std::vector<int *> &rows) {
+    // 8-bit samples keep 4 more fractional bits between the passes.
+    // 16-bit samples do not to avoid the overflow of the accumulation.
+    const unsigned int hshift = (sizeof(T) == 1) ? (SC_SW_COEF_BITS - 4) : SC_SW_COEF_BITS;
+    const unsigned int vshift = SC_SW_COEF_BITS + (SC_SW_COEF_BITS - hshift);
+    const unsigned int linelen = dst.width * dst.comps;
+    const unsigned int bits = dst.msb10 ? 10 : sizeof(T) * 8;
+
+    unsigned int first = vstart[y0];
+    unsigned int last = vstart[y1 - 1] + vtaps;
+
+    tmp.resize((last - first) * linelen);
+    acc.resize(linelen);
+    rows.resize(vtaps);
+
+    for (unsigned int sy = first; sy < last; sy++)
+        FilterRow<T>(src.base + (src.top + sy) * src.stride, src, dst.width,
+                     hstart.data(), hcoef.data(), htaps, hshift,
+                     tmp.data() + (sy - first) * linelen);
+
+    for (unsigned int y = y0; y < y1; y++) {
+        for (unsigned int k = 0; k < vtaps; k++)
+            rows[k] = tmp.data() + (vstart[y] + k - first) * linelen;
+
+        FilterColumn(rows.data(), vcoef.data() + y * vtaps, vtaps, linelen, acc.data());
+        StoreRow<T>(acc.data(), dst, y, vshift, bits);
+    }
+}
+
+bool CScalerSW::ScalePlanes(const SWPlane src[], const SWPlane dst[], unsigned int count) {
+    struct PlaneFilters {
+        SWFilter h, v;
+    };
+    struct Job {
+        unsigned int plane;
+        unsigned int y0, y1;
+    };
+
+    std::vector<PlaneFilters> filters(count);
+    std::vector<Job> jobs;
+
+    for (unsigned int i = 0; i < count; i++) {
+        if ((src[i].width == 0) || (src[i].height == 0) || (dst[i].width == 0) || (dst[i].height == 0)) {
+            SC_LOGE("Invalid area of plane %u: %ux%u -> %ux%u",
+                    i, src[i].width, src[i].height, dst[i].width, dst[i].height);
+            return false;
+        }
+
+        BuildFilter(m_nFilter, src[i].width, dst[i].width,
+                    filters[i].h.start, filters[i].h.coef, filters[i].h.taps);
+        BuildFilter(m_nFilter, src[i].height, dst[i].height,
+                    filters[i].v.start, filters[i].v.coef, filters[i].v.taps);
+
+        for (unsigned int y = 0; y < dst[i].height; y += SC_SW_BAND_ROWS)
+            jobs.push_back({i, y, std::min(y + SC_SW_BAND_ROWS, dst[i].height)});
+    }
+
+    std::atomic<unsigned int> next(0);
+
+    auto worker = [&] () {
+        std::vector<int> tmp, acc;
+        std::vector<int *> rows;
+        unsigned int j;
+
+        while ((j = next.fetch_add(1)) < jobs.size()) {
+            const Job &job = jobs[j];
+            const SWPlane &s = src[job.plane];
+            const SWPlane &d = dst[job.plane];
+            const PlaneFilters &f = filters[job.plane];
+
+            if (s.wide)
+                ScaleBand<uint16_t>(s, d, f.h.start, f.h.coef, f.h.taps,
+                                    f.v.start, f.v.coef, f.v.taps, job.y0, job.y1, tmp, acc, rows);
+            else
+                ScaleBand<uint8_t>(s, d, f.h.start, f.h.coef, f.h.taps,
+                                   f.v.start, f.v.coef, f.v.taps, job.y0, job.y1, tmp, acc, rows);
+        }
+    };
+
+    unsigned int nthreads = std::min(std::max(std::thread::hardware_concurrency(), 1U),
+                                     static_cast<unsigned int>(SC_SW_MAX_THREADS));
+    nthreads = std::min(nthreads, static_cast<unsigned int>(jobs.size()));
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < nthreads; i++)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto &t: threads)
+        t.join();
 
     return true;
 }
 
+bool CScalerSW_YUYV::Scale() {
+    if (((m_nSrcLeft | m_nSrcWidth | m_nDstWidth | m_nSrcStride) % 2) != 0) {
+        SC_LOGE("Width of YUV422 should be even");
+        return false;
+    }
+
+    // Y is at every even byte and Cb/Cr (or Cr/Cb) are at byte 1 and 3 of every 4 bytes
+    SWPlane src[2], dst[2];
+
+    src[0] = {m_pSrc[0], m_nSrcLeft, m_nSrcTop, m_nSrcWidth, m_nSrcHeight,
+              m_nSrcStride * 2, 2, 1, {0, 0, 0, 0}, false, false};
+    dst[0] = {m_pDst[0], m_nDstLeft, m_nDstTop, m_nDstWidth, m_nDstHeight,
+              m_nDstStride * 2, 2, 1, {0, 0, 0, 0}, false, false};
+    src[1] = {m_pSrc[0], m_nSrcLeft / 2, m_nSrcTop, m_nSrcWidth / 2, m_nSrcHeight,
+              m_nSrcStride * 2, 4, 2, {1, 3, 0, 0}, false, false};
+    dst[1] = {m_pDst[0], m_nDstLeft / 2, m_nDstTop, m_nDstWidth / 2, m_nDstHeight,
+              m_nDstStride * 2, 4, 2, {1, 3, 0, 0}, false, false};
+
+    return ScalePlanes(src, dst, 2);
+}
+
 bool CScalerSW_NV12::Scale() {
     if (((m_nSrcLeft | m_nSrcTop | m_nSrcWidth | m_nSrcHeight | m_nSrcStride |
                     m_nDstLeft | m_nDstTop | m_nDstWidth | m_nDstHeight | m_nDstStride) % 2) != 0) {
@@ -65,42 +328,48 @@ bool CScalerSW_NV12::Scale() {
         return false;
     }
 
-    unsigned int h_ratio = (m_nSrcWidth << 16) / m_nDstWidth;
-    unsigned int v_ratio = (m_nSrcHeight << 16) / m_nDstHeight;
+    SWPlane src[2], dst[2];
 
-    unsigned int src_x;
-    unsigned int src_y = m_nSrcTop << 16;
+    src[0] = {m_pSrc[0], m_nSrcLeft, m_nSrcTop, m_nSrcWidth, m_nSrcHeight,
+              m_nSrcStride, 1, 1, {0, 0, 0, 0}, false, false};
+    dst[0] = {m_pDst[0], m_nDstLeft, m_nDstTop, m_nDstWidth, m_nDstHeight,
+              m_nDstStride, 1, 1, {0, 0, 0, 0}, false, false};
+    src[1] = {m_pSrc[1], m_nSrcLeft / 2, m_nSrcTop / 2, m_nSrcWidth / 2, m_nSrcHeight / 2,
+              m_nSrcStride, 2, 2, {0, 1, 0, 0}, false, false};
+    dst[1] = {m_pDst[1], m_nDstLeft / 2, m_nDstTop / 2, m_nDstWidth / 2, m_nDstHeight / 2,
+              m_nDstStride, 2, 2, {0, 1, 0, 0}, false, false};
 
-    // Luminance
-    for (unsigned int y = m_nDstTop; y < (m_nDstTop + m_nDstHeight); y++) {
-        src_x = m_nSrcLeft << 16;
-        for (unsigned int x = m_nDstLeft; x < (m_nDstLeft + m_nDstWidth); x++) {
-            m_pDst[0][y * m_nDstStride + x] = m_pSrc[0][(src_y >> 16) * m_nSrcStride + (src_x >> 16)];
-
-            src_x = LibScaler::min(src_x + h_ratio, (m_nSrcLeft + m_nSrcWidth) << 16);
-        }
+    return ScalePlanes(src, dst, 2);
+}
 
-        src_y = LibScaler::min(src_y + v_ratio, (m_nSrcTop + m_nSrcHeight) << 16);
-    }
+bool CScalerSW_RGBA8888::Scale() {
+    SWPlane src, dst;
 
-    // Chrominance
+    src = {m_pSrc[0], m_nSrcLeft, m_nSrcTop, m_nSrcWidth, m_nSrcHeight,
+           m_nSrcStride * 4, 4, 4, {0, 1, 2, 3}, false, false};
+    dst = {m_pDst[0], m_nDstLeft, m_nDstTop, m_nDstWidth, m_nDstHeight,
+           m_nDstStride * 4, 4, 4, {0, 1, 2, 3}, false, false};
 
-    // change pointers to 1-byte to pointers to 2-byte storage.
-    unsigned short *src = reinterpret_cast<unsigned short *>(m_pSrc[1]);
-    unsigned short *dst = reinterpret_cast<unsigned short *>(m_pDst[1]);
+    return ScalePlanes(&src, &dst, 1);
+}
 
-    src_y = (m_nSrcTop / 2) << 16;
-    for (unsigned int y = m_nDstTop / 2; y < ((m_nDstTop + m_nDstHeight) / 2); y++) {
-        // Move 2 pixels at once (CbCr)
-        src_x = (m_nSrcLeft / 2) << 16;
-        for (unsigned int x = m_nDstLeft / 2; x < ((m_nDstLeft + m_nDstWidth) / 2); x++) {
-            dst[y * (m_nDstStride / 2) + x] = src[(src_y >> 16) * (m_nSrcStride / 2) + (src_x >> 16)];
+bool CScalerSW_P010::Scale() {
+    if (((m_nSrcLeft | m_nSrcTop | m_nSrcWidth | m_nSrcHeight | m_nSrcStride |
+                    m_nDstLeft | m_nDstTop | m_nDstWidth | m_nDstHeight | m_nDstStride) % 2) != 0) {
+        SC_LOGE("Both of width and height of P010 should be even");
+        return false;
+    }
 
-            src_x = LibScaler::min(src_x + h_ratio, ((m_nSrcLeft + m_nSrcWidth) / 2) << 16);
-        }
+    SWPlane src[2], dst[2];
 
-        src_y = LibScaler::min(src_y + v_ratio, ((m_nSrcTop + m_nSrcHeight) / 2) << 16);
-    }
+    src[0] = {m_pSrc[0], m_nSrcLeft, m_nSrcTop, m_nSrcWidth, m_nSrcHeight,
+              m_nSrcStride * 2, 2, 1, {0, 0, 0, 0}, true, true};
+    dst[0] = {m_pDst[0], m_nDstLeft, m_nDstTop, m_nDstWidth, m_nDstHeight,
+              m_nDstStride * 2, 2, 1, {0, 0, 0, 0}, true, true};
+    src[1] = {m_pSrc[1], m_nSrcLeft / 2, m_nSrcTop / 2, m_nSrcWidth / 2, m_nSrcHeight / 2,
+              m_nSrcStride * 2, 4, 2, {0, 2, 0, 0}, true, true};
+    dst[1] = {m_pDst[1], m_nDstLeft / 2, m_nDstTop / 2, m_nDstWidth / 2, m_nDstHeight / 2,
+              m_nDstStride * 2, 4, 2, {0, 2, 0, 0}, true, true};
 
-    return true;
+    return ScalePlanes(src, dst, 2);
 }
@@ -1,9 +1,55 @@
 #ifndef __LIBSCALER_SWSCALER_H__
 #define __LIBSCALER_SWSCALER_H__
 
+#include <vector>
+
 #include "libscaler-common.h"
 
+/*
+ * Resampling filters of CScalerSW.
+ * SC_SWFILTER_AUTO selects the polyphase filter for the direction that is
+ * downscaled and the bilinear filter for the direction that is upscaled.
+ */
+enum {
+    SC_SWFILTER_AUTO,
+    SC_SWFILTER_NEAREST,
+    SC_SWFILTER_BILINEAR,
+    SC_SWFILTER_POLYPHASE,
+};
+
 class CScalerSW {
+    public:
+        /*
+         * Description of a plane to resample.
+         * The component @c of the pixel (x, y) is at
+         * base + (top + y) * stride + (left + x) * step + offset[c].
+         * The component is 16-bit if wide is true. If msb10 is also true,
+         * only the upper 10 bits are valid as P010 does.
+         */
+        struct SWPlane {
+            char *base;
+            unsigned int left, top;
+            unsigned int width, height;
+            unsigned int stride;
+            unsigned int step;
+            unsigned int comps;
+            unsigned int offset[4];
+            bool wide;
+            bool msb10;
+        };
+
+        /*
+         * Coefficients of a resampling filter in one direction.
+         * The output pixel i is the sum of coef[i * taps + k] (Q14) multiplied
+         * with the input pixel start[i] + k. All the input pixels referenced
+         * are in the input area so that no clamping is required while filtering.
+         */
+        struct SWFilter {
+            unsigned int taps;
+            std::vector<int> start;
+            std::vector<short> coef;
+        };
+
     protected:
         char *m_pSrc[3];
         char *m_pDst[3];
@@ -13,6 +59,9 @@ class CScalerSW {
         unsigned int m_nDstLeft, m_nDstTop;
         unsigned int m_nDstWidth, m_nDstHeight;
         unsigned int m_nDstStride;
+        unsigned int m_nFilter;
+
+        bool ScalePlanes(const SWPlane src[], const SWPlane dst[], unsigned int count);
     public:
         CScalerSW() { Clear(); }
         virtual ~CScalerSW() { };
@@ -34,6 +83,10 @@ class CScalerSW {
             m_nDstHeight = height;
             m_nDstStride = stride;
         }
+
+        void SetFilter(unsigned int filter) {
+            m_nFilter = filter;
+        }
 };
 
 class CScalerSW_YUYV: public CScalerSW {
@@ -58,4 +111,28 @@ class CScalerSW_NV12: public CScalerSW {
         virtual bool Scale();
 };
 
+// 32-bit RGB formats with 4 components of 8-bit in any order
+class CScalerSW_RGBA8888: public CScalerSW {
+    public:
+        CScalerSW_RGBA8888(char *src, char *dst) {
+            m_pSrc[0] = src;
+            m_pDst[0] = dst;
+        }
+
+        virtual bool Scale();
+};
+
+// The stride of P010 is given in pixels like other formats
+class CScalerSW_P010: public CScalerSW {
+    public:
+        CScalerSW_P010(char *src0, char *src1, char *dst0, char *dst1) {
+            m_pSrc[0] = src0;
+            m_pDst[0] = dst0;
+            m_pSrc[1] = src1;
+            m_pDst[1] = dst1;
+        }
+
+        virtual bool Scale();
+};
+
 #endif //__LIBSCALER_SWSCALER_H__
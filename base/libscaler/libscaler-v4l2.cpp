@@ -622,6 +622,41 @@ bool CScalerV4L2::RunSWScaling()
 
             swsc = new CScalerSW_NV12(src[0], src[1], dst[0], dst[1]);
             break;
+        case V4L2_PIX_FMT_RGB32:
+        case V4L2_PIX_FMT_BGR32:
+            m_frmSrc.out_num_planes = 1;
+            m_frmSrc.out_plane_size[0] = m_frmSrc.width * m_frmSrc.height * 4;
+            m_frmDst.out_num_planes = 1;
+            m_frmDst.out_plane_size[0] = m_frmDst.width * m_frmDst.height * 4;
+
+            if (!GetBuffer(m_frmSrc, src))
+                return false;
+
+            if (!GetBuffer(m_frmDst, dst)) {
+                PutBuffer(m_frmSrc, src);
+                return false;
+            }
+
+            swsc = new CScalerSW_RGBA8888(src[0], dst[0]);
+            break;
+        case V4L2_PIX_FMT_NV12M_P010:
+            m_frmSrc.out_num_planes = 2;
+            m_frmDst.out_num_planes = 2;
+            m_frmSrc.out_plane_size[0] = m_frmSrc.width * m_frmSrc.height * 2;
+            m_frmDst.out_plane_size[0] = m_frmDst.width * m_frmDst.height * 2;
+            m_frmSrc.out_plane_size[1] = m_frmSrc.out_plane_size[0] / 2;
+            m_frmDst.out_plane_size[1] = m_frmDst.out_plane_size[0] / 2;
+
+            if (!GetBuffer(m_frmSrc, src))
+                return false;
+
+            if (!GetBuffer(m_frmDst, dst)) {
+                PutBuffer(m_frmSrc, src);
+                return false;
+            }
+
+            swsc = new CScalerSW_P010(src[0], src[1], dst[0], dst[1]);
+            break;
         case V4L2_PIX_FMT_UYVY: // TODO: UYVY is not implemented yet.
         default:
             SC_LOGE("Format %x is not supported", m_frmSrc.color_format);
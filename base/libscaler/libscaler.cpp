@@ -36,6 +36,12 @@
 #include <unistd.h>
 #include <system/graphics.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "exynos_scaler.h"
 
 #include "libscaler-common.h"
@@ -183,37 +189,237 @@ static bool find_pixel(unsigned int sc_pxfmt, unsigned int __out *v4l2_pxfmt)
     return false;
 }
 
-bool exynos_sc_copy_pixels(exynos_sc_pxinfo *pxinfo, int dev_num)
+#define SC_COPY_MAX_DEVICES 4 // CScalerM2M1SHOT accepts the instance 0 ~ 3
+#define SC_COPY_MAX_IDLE    2 // the number of idle contexts kept for each device
+
+/*
+ * Scaler context for exynos_sc_copy_pixels(). It remembers the last
+ * configuration not to configure the same format, crop and rotation again.
+ */
+struct CScalerCopyContext {
+    CScalerM2M1SHOT sc;
+    bool configured;
+    exynos_sc_pxinfo last;
+
+    CScalerCopyContext(int dev_num) : sc(dev_num), configured(false) {
+        memset(&last, 0, sizeof(last));
+    }
+};
+
+struct CScalerCopyRequest {
+    exynos_sc_pxinfo pxinfo;
+    bool done;
+    bool result;
+};
+
+/*
+ * Process-wide pool of the opened scaler contexts for the pixel copy.
+ * Requests of exynos_sc_copy_pixels_async() are processed in the order of
+ * the submission by a worker thread of each device that is created on the
+ * first request to the device.
+ */
+class CScalerCopyPool {
+    std::mutex m_lock;
+    std::condition_variable m_condQueue;
+    std::condition_variable m_condDone;
+    std::vector<CScalerCopyContext *> m_idle[SC_COPY_MAX_DEVICES];
+    std::deque<CScalerCopyRequest *> m_queue[SC_COPY_MAX_DEVICES];
+    bool m_hasWorker[SC_COPY_MAX_DEVICES];
+
+    CScalerCopyPool() {
+        for (int i = 0; i < SC_COPY_MAX_DEVICES; i++)
+            m_hasWorker[i] = false;
+    }
+
+    void WorkerLoop(int dev_num);
+public:
+    // never destroyed because the worker threads may be alive until the process exits
+    static CScalerCopyPool &Instance() {
+        static CScalerCopyPool *pool = new CScalerCopyPool();
+        return *pool;
+    }
+
+    CScalerCopyContext *Acquire(int dev_num);
+    void Release(int dev_num, CScalerCopyContext *ctx);
+    CScalerCopyRequest *Submit(exynos_sc_pxinfo *pxinfo, int dev_num);
+    bool Wait(CScalerCopyRequest *req);
+};
+
+CScalerCopyContext *CScalerCopyPool::Acquire(int dev_num)
 {
-    unsigned int srcfmt;
-    unsigned int dstfmt;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
 
-    CScalerM2M1SHOT sc(dev_num);
+        if (!m_idle[dev_num].empty()) {
+            CScalerCopyContext *ctx = m_idle[dev_num].back();
+            m_idle[dev_num].pop_back();
+            return ctx;
+        }
+    }
 
-    if (!sc.Valid())
-        return false;
+    CScalerCopyContext *ctx = new CScalerCopyContext(dev_num);
+    if (!ctx->sc.Valid()) {
+        delete ctx;
+        return NULL;
+    }
 
-    if (!find_pixel(pxinfo->src.pxfmt, &srcfmt))
-        return false;
+    return ctx;
+}
 
-    if (!find_pixel(pxinfo->dst.pxfmt, &dstfmt))
-        return false;
+void CScalerCopyPool::Release(int dev_num, CScalerCopyContext *ctx)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
 
-    if (!sc.SetSrcFormat(pxinfo->src.width, pxinfo->src.height, srcfmt))
-        return false;
+        if (m_idle[dev_num].size() < SC_COPY_MAX_IDLE) {
+            m_idle[dev_num].push_back(ctx);
+            return;
+        }
+    }
 
-    if (!sc.SetDstFormat(pxinfo->dst.width, pxinfo->dst.height, dstfmt))
-        return false;
+    delete ctx;
+}
 
-    if (!sc.SetSrcCrop(pxinfo->src.crop_left, pxinfo->src.crop_top,
-                        pxinfo->src.crop_width, pxinfo->src.crop_height))
-        return false;
+static bool copy_pixels(CScalerCopyContext *ctx, exynos_sc_pxinfo *pxinfo);
 
-    if (!sc.SetDstCrop(pxinfo->dst.crop_left, pxinfo->dst.crop_top,
-                        pxinfo->dst.crop_width, pxinfo->dst.crop_height))
-        return false;
+void CScalerCopyPool::WorkerLoop(int dev_num)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (true) {
+        m_condQueue.wait(lock, [&] { return !m_queue[dev_num].empty(); });
 
-    if (!sc.SetRotate(pxinfo->rotate, pxinfo->hflip, pxinfo->vflip))
+        CScalerCopyRequest *req = m_queue[dev_num].front();
+        m_queue[dev_num].pop_front();
+
+        lock.unlock();
+
+        bool result = false;
+        CScalerCopyContext *ctx = Acquire(dev_num);
+        if (ctx) {
+            result = copy_pixels(ctx, &req->pxinfo);
+            Release(dev_num, ctx);
+        }
+
+        lock.lock();
+
+        req->result = result;
+        req->done = true;
+        m_condDone.notify_all();
+    }
+}
+
+CScalerCopyRequest *CScalerCopyPool::Submit(exynos_sc_pxinfo *pxinfo, int dev_num)
+{
+    CScalerCopyRequest *req = new CScalerCopyRequest;
+
+    req->pxinfo = *pxinfo;
+    req->done = false;
+    req->result = false;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (!m_hasWorker[dev_num]) {
+        std::thread(&CScalerCopyPool::WorkerLoop, this, dev_num).detach();
+        m_hasWorker[dev_num] = true;
+    }
+
+    m_queue[dev_num].push_back(req);
+    m_condQueue.notify_all();
+
+    return req;
+}
+
+bool CScalerCopyPool::Wait(CScalerCopyRequest *req)
+{
+    bool result;
+
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        m_condDone.wait(lock, [&] { return req->done; });
+        result = req->result;
+    }
+
+    delete req;
+
+    return result;
+}
+
+static inline bool same_pxinfo_format(exynos_sc_pxinfo_img &a, exynos_sc_pxinfo_img &b)
+{
+    return (a.width == b.width) && (a.height == b.height) && (a.pxfmt == b.pxfmt);
+}
+
+static inline bool same_pxinfo_crop(exynos_sc_pxinfo_img &a, exynos_sc_pxinfo_img &b)
+{
+    return (a.crop_left == b.crop_left) && (a.crop_top == b.crop_top) &&
+           (a.crop_width == b.crop_width) && (a.crop_height == b.crop_height);
+}
+
+static bool configure_copy(CScalerCopyContext *ctx, exynos_sc_pxinfo *pxinfo)
+{
+    CScalerM2M1SHOT &sc = ctx->sc;
+    exynos_sc_pxinfo &last = ctx->last;
+    bool configured = ctx->configured;
+
+    // any failure below leaves the context in an unknown configuration
+    ctx->configured = false;
+
+    if (!configured || !same_pxinfo_format(last.src, pxinfo->src)) {
+        unsigned int srcfmt;
+
+        if (!find_pixel(pxinfo->src.pxfmt, &srcfmt))
+            return false;
+
+        if (!sc.SetSrcFormat(pxinfo->src.width, pxinfo->src.height, srcfmt))
+            return false;
+
+        // the crop should be checked again with the new image size
+        configured = false;
+    }
+
+    if (!configured || !same_pxinfo_format(last.dst, pxinfo->dst)) {
+        unsigned int dstfmt;
+
+        if (!find_pixel(pxinfo->dst.pxfmt, &dstfmt))
+            return false;
+
+        if (!sc.SetDstFormat(pxinfo->dst.width, pxinfo->dst.height, dstfmt))
+            return false;
+
+        configured = false;
+    }
+
+    if (!configured || !same_pxinfo_crop(last.src, pxinfo->src)) {
+        if (!sc.SetSrcCrop(pxinfo->src.crop_left, pxinfo->src.crop_top,
+                            pxinfo->src.crop_width, pxinfo->src.crop_height))
+            return false;
+    }
+
+    if (!configured || !same_pxinfo_crop(last.dst, pxinfo->dst)) {
+        if (!sc.SetDstCrop(pxinfo->dst.crop_left, pxinfo->dst.crop_top,
+                            pxinfo->dst.crop_width, pxinfo->dst.crop_height))
+            return false;
+    }
+
+    if (!configured || (last.rotate != pxinfo->rotate) ||
+            (!last.hflip != !pxinfo->hflip) || (!last.vflip != !pxinfo->vflip)) {
+        if (!sc.SetRotate(pxinfo->rotate, pxinfo->hflip, pxinfo->vflip))
+            return false;
+    }
+
+    last = *pxinfo;
+    ctx->configured = true;
+
+    return true;
+}
+
+static bool copy_pixels(CScalerCopyContext *ctx, exynos_sc_pxinfo *pxinfo)
+{
+    CScalerM2M1SHOT &sc = ctx->sc;
+
+    if (!configure_copy(ctx, pxinfo))
         return false;
 
     // the first argument ot CScalerM2M1SHOT.SetXXXAddr() must be void *[3]
@@ -236,6 +442,46 @@ bool exynos_sc_copy_pixels(exynos_sc_pxinfo *pxinfo, int dev_num)
     return sc.Run();
 }
 
+bool exynos_sc_copy_pixels(exynos_sc_pxinfo *pxinfo, int dev_num)
+{
+    if ((dev_num < 0) || (dev_num >= SC_COPY_MAX_DEVICES)) {
+        SC_LOGE("Invalid device instance ID %d", dev_num);
+        return false;
+    }
+
+    CScalerCopyPool &pool = CScalerCopyPool::Instance();
+
+    CScalerCopyContext *ctx = pool.Acquire(dev_num);
+    if (!ctx)
+        return false;
+
+    bool ret = copy_pixels(ctx, pxinfo);
+
+    pool.Release(dev_num, ctx);
+
+    return ret;
+}
+
+void *exynos_sc_copy_pixels_async(exynos_sc_pxinfo *pxinfo, int dev_num)
+{
+    if ((dev_num < 0) || (dev_num >= SC_COPY_MAX_DEVICES)) {
+        SC_LOGE("Invalid device instance ID %d", dev_num);
+        return NULL;
+    }
+
+    return reinterpret_cast<void *>(CScalerCopyPool::Instance().Submit(pxinfo, dev_num));
+}
+
+bool exynos_sc_copy_pixels_wait(void *request)
+{
+    if (request == NULL) {
+        SC_LOGE("NULL copy request");
+        return false;
+    }
+
+    return CScalerCopyPool::Instance().Wait(reinterpret_cast<CScalerCopyRequest *>(request));
+}
+
 #ifdef SCALER_USE_M2M1SHOT
 typedef CScalerM2M1SHOT CScalerNonStream;
 #else
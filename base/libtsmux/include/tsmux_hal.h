@@ -58,6 +58,26 @@ void tsmux_deinit_otf(void *handle);
 int tsmux_dq_buf_otf(void *handle, sp<ABuffer> &outbuf);
 void tsmux_q_buf_otf(void *handle);
 int tsmux_get_config_otf(void *handle, struct tsmux_config_data *config);
+
+/*
+ * Zero-copy mode
+ *
+ * The output ABuffers of tsmux_packetize_m2m() and tsmux_dq_buf_otf() refer to
+ * the buffers of tsmux instead of copies. The M2M output buffers should be
+ * released with tsmux_release_outbufs_m2m() before the next
+ * tsmux_packetize_m2m(). The OTF output buffer has "buf_index" in its meta and
+ * should be released with tsmux_release_buf_otf() to be filled again.
+ * The output ABuffers are invalid after they are released.
+ *
+ * An input ABuffer of tsmux_get_inbuf_m2m() refers to the input buffer of the
+ * M2M job @index. The elementary stream written to it with setRange() is not
+ * copied by tsmux_packetize_m2m() when it is given as inbufs[index].
+ * It is available in both modes.
+ */
+int tsmux_set_zero_copy(void *handle, bool enable);
+int tsmux_get_inbuf_m2m(void *handle, int index, sp<ABuffer> &inbuf);
+void tsmux_release_outbufs_m2m(void *handle);
+void tsmux_release_buf_otf(void *handle, int index);
 }
 
 #endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tsmux_crc32.h"
+
+using namespace android;
+
+TEST(TsmuxCrc32, CheckValue)
+{
+    static const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+    // CRC-32/MPEG-2 check value
+    EXPECT_EQ(0x0376E6E7U, tsmux_crc32_update(TSMUX_CRC32_INIT, check, sizeof(check)));
+    EXPECT_EQ(0x0376E6E7U, tsmux_crc32_update_bytewise(TSMUX_CRC32_INIT, check, sizeof(check)));
+}
+
+TEST(TsmuxCrc32, PatSection)
+{
+    // PAT of program 1 on PMT PID 0x100 that tsmux_send_psi() generates
+    static const uint8_t pat[] = {
+        0x00, 0xb0, 0x0d, 0x00, 0x00, 0xc3, 0x00, 0x00,
+        0x00, 0x01, 0xe1, 0x00,
+    };
+    uint8_t section[sizeof(pat) + 4];
+    uint32_t crc = tsmux_crc32_update(TSMUX_CRC32_INIT, pat, sizeof(pat));
+
+    EXPECT_EQ(tsmux_crc32_update_bytewise(TSMUX_CRC32_INIT, pat, sizeof(pat)), crc);
+
+    // The CRC over a section including its CRC_32 field is zero
+    memcpy(section, pat, sizeof(pat));
+    section[sizeof(pat) + 0] = crc >> 24;
+    section[sizeof(pat) + 1] = crc >> 16;
+    section[sizeof(pat) + 2] = crc >> 8;
+    section[sizeof(pat) + 3] = crc;
+    EXPECT_EQ(0U, tsmux_crc32_update(TSMUX_CRC32_INIT, section, sizeof(section)));
+}
+
+TEST(TsmuxCrc32, MatchesBytewise)
+{
+    std::vector<uint8_t> data(4096 + 16);
+
+    srand(0x47);
+    for (auto &d : data)
+        d = rand() & 0xFF;
+
+    // Every length around the 8-byte block and every misalignment
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t len = 0; len < 64; len++)
+            ASSERT_EQ(tsmux_crc32_update_bytewise(TSMUX_CRC32_INIT, &data[offset], len),
+                      tsmux_crc32_update(TSMUX_CRC32_INIT, &data[offset], len))
+                << "offset " << offset << " length " << len;
+    }
+
+    for (size_t len = 64; len <= 4096; len += 61)
+        ASSERT_EQ(tsmux_crc32_update_bytewise(TSMUX_CRC32_INIT, &data[3], len),
+                  tsmux_crc32_update(TSMUX_CRC32_INIT, &data[3], len)) << "length " << len;
+}
+
+TEST(TsmuxCrc32, Incremental)
+{
+    std::vector<uint8_t> data(1021);
+
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i * 31 + 7);
+
+    uint32_t oneshot = tsmux_crc32_update(TSMUX_CRC32_INIT, data.data(), data.size());
+
+    for (size_t split = 0; split <= data.size(); split += 13) {
+        uint32_t crc = tsmux_crc32_update(TSMUX_CRC32_INIT, data.data(), split);
+        crc = tsmux_crc32_update(crc, data.data() + split, data.size() - split);
+        ASSERT_EQ(oneshot, crc) << "split at " << split;
+    }
+}
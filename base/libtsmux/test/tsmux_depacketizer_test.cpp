@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tsmux_depacketizer.h"
+
+using namespace android;
+
+#define TS_SIZE     188
+#define ES_PID      0x1011
+#define PMT_PID     0x100
+#define PCR_PID     0x1000
+
+class TsmuxDepacketizer : public ::testing::Test {
+protected:
+    std::vector<uint8_t> mTs;
+    std::vector<uint8_t> mEs;
+
+    void addPacket(int pid, bool unit_start, const uint8_t *payload, size_t size) {
+        uint8_t pkt[TS_SIZE];
+        size_t offset = 4;
+
+        pkt[0] = 0x47;
+        pkt[1] = (unit_start ? 0x40 : 0) | (pid >> 8);
+        pkt[2] = pid & 0xFF;
+        if (size < TS_SIZE - 4) {
+            /* stuffing in the adaptation field */
+            size_t af_len = TS_SIZE - 4 - 1 - size;
+            pkt[3] = payload ? 0x30 : 0x20;
+            pkt[4] = af_len;
+            if (af_len > 0) {
+                pkt[5] = 0x00;
+                memset(pkt + 6, 0xFF, af_len - 1);
+            }
+            offset += 1 + af_len;
+        } else {
+            pkt[3] = 0x10;
+        }
+        if (payload)
+            memcpy(pkt + offset, payload, size);
+        mTs.insert(mTs.end(), pkt, pkt + TS_SIZE);
+    }
+
+    void addPsi() {
+        uint8_t section[TS_SIZE - 4];
+
+        memset(section, 0xFF, sizeof(section));
+        section[0] = 0x00; /* pointer_field */
+        section[1] = 0x00; /* table_id of PAT */
+        section[2] = 0xb0;
+        addPacket(0, true, section, sizeof(section));
+        section[1] = 0x02; /* table_id of PMT */
+        addPacket(PMT_PID, true, section, sizeof(section));
+        addPacket(PCR_PID, false, NULL, 0); /* adaptation field only */
+    }
+
+    void addPes(size_t es_size, uint8_t seed) {
+        std::vector<uint8_t> pes;
+        /* PES header with PTS */
+        static const uint8_t header[] = {
+            0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05,
+            0x21, 0x00, 0x01, 0x00, 0x01,
+        };
+
+        pes.assign(header, header + sizeof(header));
+        for (size_t i = 0; i < es_size; i++) {
+            uint8_t d = static_cast<uint8_t>(seed + i * 7);
+            pes.push_back(d);
+            mEs.push_back(d);
+        }
+
+        for (size_t pos = 0; pos < pes.size(); pos += TS_SIZE - 4) {
+            size_t len = std::min(pes.size() - pos, static_cast<size_t>(TS_SIZE - 4));
+            addPacket(ES_PID, pos == 0, &pes[pos], len);
+        }
+    }
+
+    std::vector<uint8_t> buildRtp() {
+        std::vector<uint8_t> rtp;
+
+        for (size_t pos = 0, seq = 0; pos < mTs.size(); pos += 7 * TS_SIZE, seq++) {
+            uint8_t header[16] = { 0x80, 0x21, 0, (uint8_t)seq, };
+            size_t header_size = 12;
+            if (seq % 2) { /* one CSRC */
+                header[0] |= 1;
+                header_size += 4;
+            }
+            size_t len = std::min(mTs.size() - pos, static_cast<size_t>(7 * TS_SIZE));
+            rtp.insert(rtp.end(), header, header + header_size);
+            rtp.insert(rtp.end(), mTs.begin() + pos, mTs.begin() + pos + len);
+        }
+
+        return rtp;
+    }
+
+    static bool inBuffer(const std::vector<uint8_t> &buf, const struct iovec &iov) {
+        const uint8_t *p = static_cast<const uint8_t *>(iov.iov_base);
+        return p >= buf.data() && p + iov.iov_len <= buf.data() + buf.size();
+    }
+};
+
+TEST_F(TsmuxDepacketizer, RtpToTs)
+{
+    addPsi();
+    addPes(3000, 1);
+
+    std::vector<uint8_t> rtp = buildRtp();
+    std::vector<struct iovec> ts;
+
+    ASSERT_EQ(static_cast<ssize_t>(mTs.size()),
+              tsmux_depacketize_rtp_iov(rtp.data(), rtp.size(), ts));
+    ASSERT_EQ((mTs.size() + 7 * TS_SIZE - 1) / (7 * TS_SIZE), ts.size());
+    for (auto &iov : ts)
+        EXPECT_TRUE(inBuffer(rtp, iov));
+
+    std::vector<uint8_t> copied(mTs.size());
+    EXPECT_EQ(mTs.size(), tsmux_iov_copy(copied.data(), ts));
+    EXPECT_EQ(mTs, copied);
+}
+
+TEST_F(TsmuxDepacketizer, TsToEs)
+{
+    addPsi();
+    addPes(1000, 3);
+    addPes(57, 9);   /* ends with a large adaptation field */
+    addPes(184, 5);
+
+    std::vector<struct iovec> es;
+    struct tsmux_es_parser parser;
+
+    tsmux_es_parser_init(&parser, -1, 0);
+    ASSERT_EQ(static_cast<ssize_t>(mEs.size()),
+              tsmux_depacketize_ts_iov(&parser, mTs.data(), mTs.size(), es));
+    EXPECT_EQ(ES_PID, parser.pid);
+    for (auto &iov : es)
+        EXPECT_TRUE(inBuffer(mTs, iov));
+
+    std::vector<uint8_t> copied(mEs.size());
+    EXPECT_EQ(mEs.size(), tsmux_iov_copy(copied.data(), es));
+    EXPECT_EQ(mEs, copied);
+}
+
+TEST_F(TsmuxDepacketizer, Limit)
+{
+    addPes(2000, 7);
+
+    std::vector<struct iovec> es;
+    struct tsmux_es_parser parser;
+
+    tsmux_es_parser_init(&parser, ES_PID, 500);
+    ASSERT_EQ(500, tsmux_depacketize_ts_iov(&parser, mTs.data(), mTs.size(), es));
+
+    std::vector<uint8_t> copied(500);
+    tsmux_iov_copy(copied.data(), es);
+    EXPECT_TRUE(std::equal(copied.begin(), copied.end(), mEs.begin()));
+}
+
+TEST_F(TsmuxDepacketizer, Corrupted)
+{
+    addPes(500, 1);
+    mTs[TS_SIZE] = 0x00; /* sync byte of the second packet */
+
+    std::vector<struct iovec> es;
+    struct tsmux_es_parser parser;
+
+    tsmux_es_parser_init(&parser, -1, 0);
+    EXPECT_EQ(-1, tsmux_depacketize_ts_iov(&parser, mTs.data(), mTs.size(), es));
+
+    static const uint8_t not_rtp[16] = { 0x47, };
+    std::vector<struct iovec> ts;
+    EXPECT_EQ(-1, tsmux_depacketize_rtp_iov(not_rtp, sizeof(not_rtp), ts));
+}
+
+TEST_F(TsmuxDepacketizer, Truncated)
+{
+    addPes(2000, 1);
+
+    std::vector<uint8_t> rtp = buildRtp();
+    std::vector<struct iovec> ts;
+
+    /* The TS packet cut at the end of the buffer is not taken */
+    size_t first = tsmux_depacketize_rtp_packet(rtp.data(), rtp.size(), ts);
+    ts.clear();
+    ASSERT_EQ(static_cast<ssize_t>(first - TS_SIZE),
+              tsmux_depacketize_rtp_packet(rtp.data(), first - 1, ts));
+    ASSERT_EQ(1u, ts.size());
+    EXPECT_TRUE(inBuffer(rtp, ts[0]));
+
+    /* The header extension does not fit in the buffer */
+    static const uint8_t extension[14] = { 0x90, };
+    ts.clear();
+    EXPECT_EQ(-1, tsmux_depacketize_rtp_packet(extension, sizeof(extension), ts));
+    EXPECT_TRUE(ts.empty());
+}
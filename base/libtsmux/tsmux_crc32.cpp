@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tsmux_crc32.h"
+
+namespace android {
+
+#define TSMUX_CRC32_POLY    0x04C11DB7
+
+/*
+ * table[0] is the classic bytewise table. table[k][i] is the CRC of the byte i
+ * followed by k zero bytes so that eight bytes are folded into the CRC with
+ * eight independent lookups (slice-by-8).
+ */
+struct tsmux_crc32_tables {
+    uint32_t table[8][256];
+
+    tsmux_crc32_tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i << 24;
+            for (int j = 0; j < 8; j++)
+                crc = (crc << 1) ^ ((crc & 0x80000000) ? TSMUX_CRC32_POLY : 0);
+            table[0][i] = crc;
+        }
+
+        for (int k = 1; k < 8; k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = table[k - 1][i];
+                table[k][i] = (crc << 8) ^ table[0][crc >> 24];
+            }
+        }
+    }
+};
+
+static const tsmux_crc32_tables &get_crc32_tables()
+{
+    static const tsmux_crc32_tables tables;
+    return tables;
+}
+
+uint32_t tsmux_crc32_update_bytewise(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const uint32_t *t0 = get_crc32_tables().table[0];
+
+    for (const uint8_t *p = data; p < data + size; ++p)
+        crc = (crc << 8) ^ t0[((crc >> 24) ^ *p) & 0xFF];
+
+    return crc;
+}
+
+uint32_t tsmux_crc32_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const tsmux_crc32_tables &tables = get_crc32_tables();
+    const uint32_t (*t)[256] = tables.table;
+
+    /*
+     * The eight bytes are combined by shifts regardless of the byte order of
+     * the CPU and the alignment of @data, so no alignment prologue is required.
+     */
+    while (size >= 8) {
+        uint32_t hi = crc ^ ((uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+                             (uint32_t)data[2] << 8 | data[3]);
+        crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xFF] ^
+              t[5][(hi >> 8) & 0xFF] ^ t[4][hi & 0xFF] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+
+    while (size-- > 0)
+        crc = (crc << 8) ^ t[0][((crc >> 24) ^ *data++) & 0xFF];
+
+    return crc;
+}
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TSMUX_CRC32_H
+#define TSMUX_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * CRC32 of MPEG-2 PSI sections (ISO/IEC 13818-1 Annex A):
+ * polynomial 0x04C11DB7, MSB first, initial value 0xFFFFFFFF, no final xor.
+ */
+#define TSMUX_CRC32_INIT    0xFFFFFFFF
+
+/*
+ * Continue the CRC @crc over @size bytes at @data.
+ * A section is checked with tsmux_crc32_update(TSMUX_CRC32_INIT, section, len)
+ * and the same result is given by splitting the section into any pieces.
+ * The tables are built on the first call and the function is thread-safe.
+ */
+uint32_t tsmux_crc32_update(uint32_t crc, const uint8_t *data, size_t size);
+
+/*
+ * Bytewise implementation that tsmux used to have.
+ * It is kept as the reference of tsmux_crc32_update() for tests.
+ */
+uint32_t tsmux_crc32_update_bytewise(uint32_t crc, const uint8_t *data, size_t size);
+
+}
+
+#endif /* TSMUX_CRC32_H */
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#undef LOG_TAG
+//#define LOG_NDEBUG 0
+#define LOG_TAG "tsmux_depacketizer"
+
+#include <string.h>
+
+#include <log/log.h>
+
+#include "tsmux_depacketizer.h"
+
+namespace android {
+
+#define RTP_VERSION             2
+#define RTP_FIXED_HEADER_SIZE   12
+#define RTP_MAX_TS_PACKETS      7   /* TS_PKT_COUNT_PER_RTP */
+
+#define TS_SYNC_BYTE            0x47
+#define TS_PKT_SIZE             188
+#define TS_PID_PAT              0x0000
+#define TS_PID_NULL             0x1FFF
+
+#define PES_FIXED_HEADER_SIZE   6
+#define PES_OPTIONAL_HEADER_SIZE    3
+
+ssize_t tsmux_depacketize_rtp_packet(const uint8_t *rtp, size_t size,
+        std::vector<struct iovec> &ts)
+{
+    if (size < RTP_FIXED_HEADER_SIZE || (rtp[0] >> 6) != RTP_VERSION) {
+        ALOGE("%s: invalid RTP header", __func__);
+        return -1;
+    }
+
+    size_t header_size = RTP_FIXED_HEADER_SIZE + (rtp[0] & 0xF) * 4; /* CSRC list */
+
+    if (rtp[0] & 0x10) { /* header extension */
+        if (size < header_size + 4) {
+            ALOGE("%s: truncated RTP header extension", __func__);
+            return -1;
+        }
+        header_size += 4 + ((rtp[header_size + 2] << 8) | rtp[header_size + 3]) * 4;
+    }
+
+    /*
+     * The RTP packets are not framed in the buffer. The next RTP header starts
+     * with the version 2 that is never the sync byte of TS.
+     */
+    size_t count = 0;
+    const uint8_t *payload = rtp + header_size;
+    while (count < RTP_MAX_TS_PACKETS &&
+            header_size + (count + 1) * TS_PKT_SIZE <= size &&
+            payload[count * TS_PKT_SIZE] == TS_SYNC_BYTE)
+        count++;
+
+    if (count == 0) {
+        ALOGE("%s: no TS packet in the RTP packet", __func__);
+        return -1;
+    }
+
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t *>(payload);
+    iov.iov_len = count * TS_PKT_SIZE;
+    ts.push_back(iov);
+
+    return header_size + iov.iov_len;
+}
+
+ssize_t tsmux_depacketize_rtp_iov(const uint8_t *rtp, size_t size,
+        std::vector<struct iovec> &ts)
+{
+    size_t ts_size = 0;
+
+    while (size > 0) {
+        ssize_t len = tsmux_depacketize_rtp_packet(rtp, size, ts);
+        if (len < 0)
+            return -1;
+
+        ts_size += ts.back().iov_len;
+        rtp += len;
+        size -= len;
+    }
+
+    return ts_size;
+}
+
+void tsmux_es_parser_init(struct tsmux_es_parser *parser, int pid, size_t limit)
+{
+    parser->pid = pid;
+    parser->limit = limit;
+    parser->es_size = 0;
+    parser->in_pes = false;
+}
+
+/* ISO/IEC 13818-1 Table 2-21: streams without the optional PES header */
+static bool pes_has_optional_header(uint8_t stream_id)
+{
+    switch (stream_id) {
+    case 0xBC: /* program_stream_map */
+    case 0xBE: /* padding_stream */
+    case 0xBF: /* private_stream_2 */
+    case 0xF0: /* ECM */
+    case 0xF1: /* EMM */
+    case 0xF2: /* DSMCC_stream */
+    case 0xF8: /* ITU-T Rec. H.222.1 type E */
+    case 0xFF: /* program_stream_directory */
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool is_pes_start(const uint8_t *payload, size_t size)
+{
+    return size >= 3 && payload[0] == 0 && payload[1] == 0 && payload[2] == 1;
+}
+
+/* Returns the size of the PES header at @pes or 0 if it is corrupted */
+static size_t parse_pes_header(const uint8_t *pes, size_t size)
+{
+    if (size < PES_FIXED_HEADER_SIZE || !is_pes_start(pes, size))
+        return 0;
+
+    if (!pes_has_optional_header(pes[3]))
+        return PES_FIXED_HEADER_SIZE;
+
+    if (size < PES_FIXED_HEADER_SIZE + PES_OPTIONAL_HEADER_SIZE)
+        return 0;
+
+    size_t header_size = PES_FIXED_HEADER_SIZE + PES_OPTIONAL_HEADER_SIZE + pes[8];
+
+    return (header_size <= size) ? header_size : 0;
+}
+
+ssize_t tsmux_depacketize_ts_iov(struct tsmux_es_parser *parser,
+        const uint8_t *ts, size_t size, std::vector<struct iovec> &es)
+{
+    size_t es_size = 0;
+
+    for (; size >= TS_PKT_SIZE; ts += TS_PKT_SIZE, size -= TS_PKT_SIZE) {
+        if (parser->limit && parser->es_size >= parser->limit)
+            break;
+
+        if (ts[0] != TS_SYNC_BYTE) {
+            ALOGE("%s: lost TS sync (0x%02x)", __func__, ts[0]);
+            return -1;
+        }
+
+        bool unit_start = !!(ts[1] & 0x40);
+        int pid = ((ts[1] & 0x1F) << 8) | ts[2];
+        uint8_t adaptation_field_control = (ts[3] >> 4) & 0x3;
+        size_t offset = 4;
+
+        if (adaptation_field_control & 0x2) {
+            offset += 1 + ts[4];
+            if (offset > TS_PKT_SIZE) {
+                ALOGE("%s: invalid adaptation field length %u", __func__, ts[4]);
+                return -1;
+            }
+        }
+
+        if (!(adaptation_field_control & 0x1))
+            continue; /* no payload */
+
+        const uint8_t *payload = ts + offset;
+        size_t payload_size = TS_PKT_SIZE - offset;
+
+        if (parser->pid < 0) {
+            /* The sections of PSI start with pointer_field and table_id */
+            if (!unit_start || pid == TS_PID_PAT || pid == TS_PID_NULL ||
+                    !is_pes_start(payload, payload_size))
+                continue;
+            ALOGV("%s: elementary stream PID 0x%x", __func__, pid);
+            parser->pid = pid;
+        }
+
+        if (pid != parser->pid)
+            continue;
+
+        if (unit_start) {
+            size_t header_size = parse_pes_header(payload, payload_size);
+            if (header_size == 0) {
+                ALOGE("%s: invalid PES header on PID 0x%x", __func__, pid);
+                return -1;
+            }
+            payload += header_size;
+            payload_size -= header_size;
+            parser->in_pes = true;
+        } else if (!parser->in_pes) {
+            continue; /* the rest of a PES packet started before */
+        }
+
+        if (parser->limit && payload_size > parser->limit - parser->es_size)
+            payload_size = parser->limit - parser->es_size;
+
+        if (payload_size == 0)
+            continue;
+
+        struct iovec iov;
+        iov.iov_base = const_cast<uint8_t *>(payload);
+        iov.iov_len = payload_size;
+        es.push_back(iov);
+
+        parser->es_size += payload_size;
+        es_size += payload_size;
+    }
+
+    return es_size;
+}
+
+size_t tsmux_iov_copy(void *dst, const std::vector<struct iovec> &iov)
+{
+    uint8_t *out = static_cast<uint8_t *>(dst);
+
+    for (auto &v : iov) {
+        memcpy(out, v.iov_base, v.iov_len);
+        out += v.iov_len;
+    }
+
+    return out - static_cast<uint8_t *>(dst);
+}
+
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TSMUX_DEPACKETIZER_H
+#define TSMUX_DEPACKETIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+namespace android {
+
+/*
+ * Parsers of the RTP/TS stream that tsmux generates.
+ * They do not copy the payloads but append struct iovec entries that point
+ * into the source buffer. The source buffer should be valid while the
+ * entries are in use.
+ */
+
+/*
+ * Find the TS packets in the RTP packet at @rtp.
+ * The RTP header is parsed including the CSRC list and the header extension.
+ * Up to TS_PKT_COUNT_PER_RTP TS packets that follow the header are appended
+ * to @ts as a single entry.
+ * Returns the number of bytes of the RTP packet or -1 if @rtp is not a valid
+ * RTP packet with TS payload.
+ */
+ssize_t tsmux_depacketize_rtp_packet(const uint8_t *rtp, size_t size,
+        std::vector<struct iovec> &ts);
+
+/*
+ * Find the TS packets in the RTP packets at @rtp of @size bytes.
+ * Returns the number of bytes of TS packets appended to @ts or -1 on error.
+ */
+ssize_t tsmux_depacketize_rtp_iov(const uint8_t *rtp, size_t size,
+        std::vector<struct iovec> &ts);
+
+/*
+ * State of the elementary stream parser.
+ * @pid is the PID of the elementary stream. If it is -1, the parser locks on
+ * the PID of the first PES packet found.
+ * @limit stops parsing after @limit bytes of the elementary stream if non-zero.
+ */
+struct tsmux_es_parser {
+    int pid;
+    size_t limit;
+    size_t es_size;
+    bool in_pes;
+};
+
+void tsmux_es_parser_init(struct tsmux_es_parser *parser, int pid, size_t limit);
+
+/*
+ * Find the elementary stream data in the TS packets at @ts of @size bytes.
+ * The adaptation fields and the PES headers are skipped. The payloads of PSI
+ * and the other PIDs are ignored.
+ * Returns the number of bytes of the elementary stream appended to @es or -1
+ * if a TS packet or a PES header is corrupted.
+ */
+ssize_t tsmux_depacketize_ts_iov(struct tsmux_es_parser *parser,
+        const uint8_t *ts, size_t size, std::vector<struct iovec> &es);
+
+/* Gather the data of @iov to @dst. Returns the number of bytes copied */
+size_t tsmux_iov_copy(void *dst, const std::vector<struct iovec> &iov);
+
+}
+
+#endif /* TSMUX_DEPACKETIZER_H */
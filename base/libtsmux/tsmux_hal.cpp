@@ -33,6 +33,8 @@
 #include "exynos_format.h"
 
 #include "tsmux_hal.h"
+#include "tsmux_crc32.h"
+#include "tsmux_depacketizer.h"
 
 #define MAX_HEAP_NAME 32
 
@@ -68,6 +70,7 @@ namespace android {
 #define VIDEO_LEVEL_IDC         40
 #define VIDEO_CONSTRAINT_SET    192
 #define M2M_BUF_SIZE            32768
+#define ADTS_HEADER_SIZE        7
 
 struct tsmux_hal {
     struct tsmux_m2m_cmd_queue m2m_cmd_queue;
@@ -86,117 +89,71 @@ struct tsmux_hal {
 
     struct tsmux_rtp_ts_info rtp_ts_info;
 
-    uint32_t crc_table[256];
     bool use_hevc;
     bool use_lpcm;
+
+    /*
+     * In the zero-copy mode, the ABuffers of the M2M and OTF output refer to
+     * the buffers of tsmux. They are lent to the caller until released.
+     */
+    bool zero_copy;
+    bool m2m_outbuf_lent;
+    uint32_t otf_outbuf_lent;   /* bitmap of the indices of out_buf */
 };
 
+/*
+ * Copy-mode adapters of the parsers in tsmux_depacketizer.cpp.
+ * Use tsmux_depacketize_rtp_iov() and tsmux_depacketize_ts_iov() to refer to
+ * the payloads in the packetized buffer without copying.
+ */
 void depacketize_rtp(char *ts_data, int *ts_size, char *rtp_data, int rtp_size)
 {
-    char *rtp_ptr, *ts_ptr;
-    rtp_ptr = rtp_data;
-    *ts_size = 0;
-    int ts_packet_size = 188;
-    while (rtp_size > 0) {
-
-        rtp_ptr += 1; /* skip ver(2b), padding(1b), extenstion(2b), CSCR Count(4b) */
-        rtp_ptr += 1; /* skip Marker(1b), payload type(7b) */
-        rtp_ptr += 2; /* skip sequence number(16b) */
-        rtp_ptr += 4; /* skip timestamp(32b) */
-        rtp_ptr += 4; /* skip SSRC(32b) */
-        rtp_size -= 12;
-
-        ts_ptr = rtp_ptr;
-        int remain_ts_packet = TS_PKT_COUNT_PER_RTP;
-        while (remain_ts_packet > 0) {
-            memcpy(ts_data, ts_ptr, ts_packet_size);
-            ts_data += ts_packet_size;
-            ts_ptr += ts_packet_size;
-            rtp_size -= ts_packet_size;
-            *ts_size += ts_packet_size;
-            remain_ts_packet -= 1;
-            if (rtp_size == 0)
-                break;
-        }
-        rtp_ptr = ts_ptr;
-    }
+    std::vector<struct iovec> ts;
+
+    if (tsmux_depacketize_rtp_iov((const uint8_t *)rtp_data, rtp_size, ts) < 0)
+        ALOGE("depacketize_rtp(), stopped at a corrupted RTP packet");
+
+    *ts_size = tsmux_iov_copy(ts_data, ts);
 }
 
-void depacketize(char* depacketized_data, char* packetized_data, int es_size, bool psi)
+/*
+ * @psi is kept for the old callers. PSI packets are always skipped because the
+ * elementary stream is located by its PID.
+ * Parsing stops at the end of ES or at the end of @packetized_size bytes of
+ * the packetized data, whichever comes first.
+ */
+void depacketize(char* depacketized_data, char* packetized_data, int packetized_size,
+        int es_size, bool __unused psi)
 {
-    char *rtp_ptr, *ts_ptr, *pes_ptr, *es_ptr;
-    char *out_data_ptr = depacketized_data;
-    char adaptation_field_control;
-    int adaptation_field_length;
-    int is_pes_header = 1;
-    int remain_es_size = es_size;
-    int psi_packet = 3;
-
-    rtp_ptr = packetized_data;
-    while (remain_es_size > 0) {
-
-        rtp_ptr += 1; /* skip ver(2b), padding(1b), extenstion(2b), CSCR Count(4b) */
-        rtp_ptr += 1; /* skip Marker(1b), payload type(7b) */
-        rtp_ptr += 2; /* skip sequence number(16b) */
-        rtp_ptr += 4; /* skip timestamp(32b) */
-        rtp_ptr += 4; /* skip SSRC(32b) */
-
-        ts_ptr = rtp_ptr;
-        int remain_ts_packet = 7;
-        while (remain_ts_packet > 0) {
-            ts_ptr += 1; /* skip sync byte(8b) */
-            ts_ptr += 2; /* skip err(1b), start(1b), priority(1b), PID(13b) */
-            adaptation_field_control = ((*ts_ptr) >> 4) & 0x3;
-            ALOGV("depacketize(), adaptation_field_control 0x%x", adaptation_field_control);
-            ts_ptr += 1; /* skip scarmbling(1b), adaptation(2b), continuity counter(2b) */
-            if (adaptation_field_control == 0x3) {
-                adaptation_field_length = *ts_ptr;
-                ts_ptr += 1;
-            }
+    std::vector<struct iovec> ts;
+    std::vector<struct iovec> es;
+    struct tsmux_es_parser parser;
+    const uint8_t *rtp_ptr = (const uint8_t *)packetized_data;
+    size_t remain = (packetized_size > 0) ? packetized_size : 0;
 
-            int ts_payload = 184;
+    if (es_size <= 0)
+        return;
 
-            if (psi && psi_packet > 0) {
-                ts_ptr += 184;
-                psi_packet--;
-            } else {
-                pes_ptr = ts_ptr;
-                if (is_pes_header) {
-                    pes_ptr += 3; /* skip start code */
-                    pes_ptr += 1; /* skip stream id */
-                    pes_ptr += 2; /* skip PES packet length */
-                    pes_ptr += 1; /* skip scramble, priority, coptyright, copy */
-                    pes_ptr += 1; /* skip PTS DTS flag, PES extention flag */
-                    pes_ptr += 1; /* skip PES header data length */
-                    pes_ptr += 5; /* skip PTS */
-                    is_pes_header = 0;
-                    ts_payload -= 14;
-                }
-
-                es_ptr = pes_ptr;
-                if (adaptation_field_control == 0x3) {
-                    es_ptr += adaptation_field_length;
-                    ALOGV("depacketize(), adaptation_field_length %d, %.2x %.2x %.2x %.2x",
-                        adaptation_field_length, *(es_ptr), *(es_ptr + 1), *(es_ptr + 2), *(es_ptr + 3));
-                }
-                int copy_size;
-                if (remain_es_size >= ts_payload) {
-                    copy_size = ts_payload;
-                } else {
-                    copy_size = remain_es_size;
-                }
-                memcpy(out_data_ptr, es_ptr, copy_size);
-                out_data_ptr += copy_size;
-                remain_es_size -= copy_size;
-                ts_ptr = es_ptr + copy_size;
-            }
+    tsmux_es_parser_init(&parser, -1, es_size);
 
-            remain_ts_packet -= 1;
-            if (remain_es_size == 0)
-                break;
-        }
-        rtp_ptr = ts_ptr;
+    while ((parser.es_size < (size_t)es_size) && (remain > 0)) {
+        ts.clear();
+        ssize_t rtp_size = tsmux_depacketize_rtp_packet(rtp_ptr, remain, ts);
+        if (rtp_size < 0)
+            break;
+
+        if (tsmux_depacketize_ts_iov(&parser, (const uint8_t *)ts[0].iov_base,
+                    ts[0].iov_len, es) < 0)
+            break;
+
+        rtp_ptr += rtp_size;
+        remain -= rtp_size;
     }
+
+    if (parser.es_size < (size_t)es_size)
+        ALOGE("depacketize(), found %zu bytes of %d bytes", parser.es_size, es_size);
+
+    tsmux_iov_copy(depacketized_data, es);
 }
 
 int increament_ts_continuity_counter(int ts_continuity_counter, int rtp_size, int psi_enable)
@@ -301,7 +258,9 @@ void addADTSHeader(uint8_t *dst, uint8_t *src, int es_size,
     // adts_buffer_fullness=0, number_of_raw_data_blocks_in_frame=0
     *ptr++ = 0;
 
-    memcpy(ptr, src, es_size);
+    /* src is already at the payload if the input buffer is lent in the zero-copy mode */
+    if (ptr != src)
+        memcpy(ptr, src, es_size);
 
     uint8_t *temp_ptr = src;
     ALOGV("addADTSHeader(), src %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x %.2x",
@@ -316,52 +275,8 @@ void addADTSHeader(uint8_t *dst, uint8_t *src, int es_size,
         *(temp_ptr + 8), *(temp_ptr + 9), *(temp_ptr + 10), *(temp_ptr + 11));
 }
 
-void tsmux_init_crc_table(void *handle) {
-    struct tsmux_hal *hal;
-
-    if (!handle) {
-        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
-        return;
-    }
-
-    hal = (struct tsmux_hal *)handle;
-
-    uint32_t poly = 0x04C11DB7;
-
-    for (int i = 0; i < 256; i++) {
-        uint32_t crc = i << 24;
-        for (int j = 0; j < 8; j++) {
-            crc = (crc << 1) ^ ((crc & 0x80000000) ? (poly) : 0);
-        }
-        hal->crc_table[i] = crc;
-    }
-
-    for (int i = 0; i < 256; i += 8) {
-        ALOGV("hal->crc_table 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x",
-            hal->crc_table[i], hal->crc_table[i + 1], hal->crc_table[i + 2], hal->crc_table[i + 3],
-            hal->crc_table[i + 4], hal->crc_table[i + 5], hal->crc_table[i + 6], hal->crc_table[i + 7]);
-    }
-
-}
-
-static uint32_t tsmux_crc32(void *handle, const uint8_t *start, size_t size) {
-    struct tsmux_hal *hal;
-
-    if (!handle) {
-        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
-        return 0;
-    }
-
-    hal = (struct tsmux_hal *)handle;
-
-    uint32_t crc = 0xFFFFFFFF;
-    const uint8_t *p;
-
-    for (p = start; p < start + size; ++p) {
-        crc = (crc << 8) ^ hal->crc_table[((crc >> 24) ^ *p) & 0xFF];
-    }
-
-    return crc;
+static uint32_t tsmux_crc32(const uint8_t *start, size_t size) {
+    return tsmux_crc32_update(TSMUX_CRC32_INIT, start, size);
 }
 
 void tsmux_send_psi(void *handle)
@@ -402,7 +317,7 @@ void tsmux_send_psi(void *handle)
     *ptr++ = 0xe0 | (TS_PID_PMT >> 8);
     *ptr++ = TS_PID_PMT & 0xff;
 
-    uint32_t crc = htonl(tsmux_crc32(hal, crcDataStart, ptr - crcDataStart));
+    uint32_t crc = htonl(tsmux_crc32(crcDataStart, ptr - crcDataStart));
     ALOGV("pat crc 0x%x", crc);
     memcpy(ptr, &crc, 4);
     ptr += 4;
@@ -541,7 +456,7 @@ void tsmux_send_psi(void *handle)
     size_t section_length = ptr - (crcDataStart + 3) + 4 /* CRC */;
     crcDataStart[1] = 0xb0 | (section_length >> 8);
     crcDataStart[2] = section_length & 0xff;
-    crc = htonl(tsmux_crc32(hal, crcDataStart, ptr - crcDataStart));
+    crc = htonl(tsmux_crc32(crcDataStart, ptr - crcDataStart));
     ALOGV("pmt crc 0x%x", crc);
     memcpy(ptr, &crc, 4);
     ptr += 4;
@@ -646,12 +561,13 @@ void *tsmux_open(bool enable_hdcp, bool use_hevc, bool use_lpcm)
 
     hal->last_psi_time_us = 0;
 
-    tsmux_init_crc_table(hal);
-
     hal->otf_cmd_queue.config.hex_ctrl.otf_enable = enable_hdcp ? 1 : 0;
     hal->otf_cmd_queue.config.hex_ctrl.m2m_enable = 0;
     hal->use_hevc = use_hevc;
     hal->use_lpcm = use_lpcm;
+    hal->zero_copy = false;
+    hal->m2m_outbuf_lent = false;
+    hal->otf_outbuf_lent = 0;
     ALOGI("tsmux opened, enable_hdcp: %d, use_hevc: %d, use_lpcm: %d", enable_hdcp, use_hevc, use_lpcm);
 
     return hal;
@@ -841,6 +757,7 @@ void tsmux_deinit_m2m(void *handle)
     hal = (struct tsmux_hal *)handle;
 
     ioctl(hal->tsmux_fd, TSMUX_IOCTL_M2M_UNMAP_BUF);
+    hal->m2m_outbuf_lent = false;
 
     /* ion free */
     for (i = 0; i < TSMUX_MAX_M2M_CMD_QUEUE_NUM; i++) {
@@ -881,6 +798,11 @@ int tsmux_packetize_m2m(void *handle, sp<ABuffer> *inbufs, sp<ABuffer> *outbufs)
 
     hal = (struct tsmux_hal *)handle;
 
+    if (hal->m2m_outbuf_lent) {
+        ALOGE("%s: the output buffers of the previous run are not released", __FUNCTION__);
+        return -EBUSY;
+    }
+
     // init
     for (i = 0; i <TSMUX_MAX_M2M_CMD_QUEUE_NUM; i++) {
         pes_hdr = &hal->m2m_cmd_queue.m2m_job[i].pes_hdr;
@@ -896,9 +818,10 @@ int tsmux_packetize_m2m(void *handle, sp<ABuffer> *inbufs, sp<ABuffer> *outbufs)
         int inbuf_size = inbufs[i]->size();
         ALOGV("tsmux_packetize_m2m(), i %d, inbufs %d", i, inbuf_size);
 
-        if (hal->use_lpcm)
-            memcpy((uint8_t *)hal->inbuf_addr[i], (uint8_t *)inbufs[i]->data(), inbuf_size);
-        else {
+        if (hal->use_lpcm) {
+            if (inbufs[i]->data() != hal->inbuf_addr[i])
+                memcpy((uint8_t *)hal->inbuf_addr[i], (uint8_t *)inbufs[i]->data(), inbuf_size);
+        } else {
             addADTSHeader((uint8_t *)hal->inbuf_addr[i], (uint8_t *)inbufs[i]->data(),
                 inbuf_size, 1/* AAC_LC */, 3/* 48000Hz */, 2 /* 2 channels */);
             inbuf_size += 7;
@@ -987,9 +910,14 @@ int tsmux_packetize_m2m(void *handle, sp<ABuffer> *inbufs, sp<ABuffer> *outbufs)
         pkt_ctrl = &hal->m2m_cmd_queue.m2m_job[i].pkt_ctrl;
         ALOGV("tsmux_packetize_m2m(), i %d, outbufSize %d", i, outbufSize);
         if (outbufSize > 0) {
-            outbufs[i] = new ABuffer(outbufSize);
-            memcpy(outbufs[i]->data(), hal->outbuf_addr[i],
-                hal->m2m_cmd_queue.m2m_job[i].out_buf.actual_size);
+            if (hal->zero_copy) {
+                outbufs[i] = new ABuffer(hal->outbuf_addr[i], outbufSize);
+                hal->m2m_outbuf_lent = true;
+            } else {
+                outbufs[i] = new ABuffer(outbufSize);
+                memcpy(outbufs[i]->data(), hal->outbuf_addr[i],
+                    hal->m2m_cmd_queue.m2m_job[i].out_buf.actual_size);
+            }
             outbufs[i]->meta()->setInt64("timeUs", timeUs[i]);
             hal->audio_frame_count++;
             outbufs[i]->meta()->setInt32("rtp_size", pkt_ctrl->rtp_size);
@@ -999,6 +927,67 @@ int tsmux_packetize_m2m(void *handle, sp<ABuffer> *inbufs, sp<ABuffer> *outbufs)
     return ret;
 }
 
+int tsmux_set_zero_copy(void *handle, bool enable)
+{
+    struct tsmux_hal *hal;
+
+    if (!handle) {
+        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
+        return -ENOENT;
+    }
+
+    hal = (struct tsmux_hal *)handle;
+
+    if (hal->m2m_outbuf_lent || hal->otf_outbuf_lent) {
+        ALOGE("%s: output buffers are still lent (m2m %d, otf 0x%x)", __FUNCTION__,
+            hal->m2m_outbuf_lent, hal->otf_outbuf_lent);
+        return -EBUSY;
+    }
+
+    hal->zero_copy = enable;
+    ALOGI("tsmux zero-copy mode %s", enable ? "enabled" : "disabled");
+
+    return 0;
+}
+
+int tsmux_get_inbuf_m2m(void *handle, int index, sp<ABuffer> &inbuf)
+{
+    struct tsmux_hal *hal;
+
+    if (!handle) {
+        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
+        return -ENOENT;
+    }
+
+    hal = (struct tsmux_hal *)handle;
+
+    if (index < 0 || index >= TSMUX_MAX_M2M_CMD_QUEUE_NUM || hal->inbuf_addr[index] == NULL) {
+        ALOGE("%s: invalid input buffer index %d", __FUNCTION__, index);
+        return -EINVAL;
+    }
+
+    /* leave the room for the ADTS header that tsmux_packetize_m2m() writes */
+    size_t headroom = hal->use_lpcm ? 0 : ADTS_HEADER_SIZE;
+    inbuf = new ABuffer((uint8_t *)hal->inbuf_addr[index] + headroom, M2M_BUF_SIZE - headroom);
+    inbuf->setRange(0, 0);
+
+    return 0;
+}
+
+void tsmux_release_outbufs_m2m(void *handle)
+{
+    struct tsmux_hal *hal;
+
+    if (!handle) {
+        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
+        return;
+    }
+
+    hal = (struct tsmux_hal *)handle;
+
+    hal->m2m_outbuf_lent = false;
+}
+
 int tsmux_init_otf(void *handle, uint32_t width, uint32_t height) {
     int ret;
     struct tsmux_hal *hal;
@@ -1076,6 +1065,7 @@ void tsmux_deinit_otf(void *handle) {
     hal = (struct tsmux_hal *)handle;
 
     ioctl(hal->tsmux_fd, TSMUX_IOCTL_OTF_UNMAP_BUF);
+    hal->otf_outbuf_lent = 0;
 
     /* ion free */
     for (i = 0; i < TSMUX_OUT_BUF_CNT; i++) {
@@ -1193,8 +1183,14 @@ int tsmux_dq_buf_otf(void *handle, sp<ABuffer> &outbuf)
     cur_out_buf = &hal->otf_cmd_queue.out_buf[cur_buf_index];
 
     int out_buf_size = cur_out_buf->actual_size;
-    outbuf = new ABuffer(out_buf_size);
-    memcpy(outbuf->data(), hal->otfbuf_addr[cur_buf_index], out_buf_size);
+    if (hal->zero_copy) {
+        outbuf = new ABuffer(hal->otfbuf_addr[cur_buf_index], out_buf_size);
+        outbuf->meta()->setInt32("buf_index", cur_buf_index);
+        hal->otf_outbuf_lent |= 1 << cur_buf_index;
+    } else {
+        outbuf = new ABuffer(out_buf_size);
+        memcpy(outbuf->data(), hal->otfbuf_addr[cur_buf_index], out_buf_size);
+    }
 
     outbuf->meta()->setInt32("rtp_size", pkt_ctrl->rtp_size);
     outbuf->meta()->setInt64("g2ds", cur_out_buf->g2d_start_stamp);
@@ -1214,6 +1210,20 @@ int tsmux_dq_buf_otf(void *handle, sp<ABuffer> &outbuf)
 }
 
 void tsmux_q_buf_otf(void *handle)
+{
+    struct tsmux_hal *hal;
+
+    if (!handle) {
+        ALOGE("%s: tsmux module was not opened", __FUNCTION__);
+        return;
+    }
+
+    hal = (struct tsmux_hal *)handle;
+
+    tsmux_release_buf_otf(handle, hal->otf_cmd_queue.cur_buf_num);
+}
+
+void tsmux_release_buf_otf(void *handle, int index)
 {
     int ret;
     struct tsmux_hal *hal;
@@ -1225,7 +1235,14 @@ void tsmux_q_buf_otf(void *handle)
 
     hal = (struct tsmux_hal *)handle;
 
-    ret = ioctl(hal->tsmux_fd, TSMUX_IOCTL_OTF_Q_BUF, &hal->otf_cmd_queue.cur_buf_num);
+    if (index < 0 || index >= TSMUX_OUT_BUF_CNT) {
+        ALOGE("%s: invalid buffer index %d", __FUNCTION__, index);
+        return;
+    }
+
+    hal->otf_outbuf_lent &= ~(1 << index);
+
+    ret = ioctl(hal->tsmux_fd, TSMUX_IOCTL_OTF_Q_BUF, &index);
     if (ret < 0) {
         ALOGE("fail to ioctl: TSMUX_IOCTL_OTF_Q_BUF");
         return;
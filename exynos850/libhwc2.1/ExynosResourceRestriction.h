@@ -112,7 +112,7 @@ enum {
 };
 *************************************************************************************/
 
-const restriction_key_t restriction_format_table[] =
+constexpr restriction_key_t restriction_format_table[] =
 {
     {MPP_DPP_G, NODE_NONE, HAL_PIXEL_FORMAT_RGB_565, 0},
     {MPP_DPP_G, NODE_NONE, HAL_PIXEL_FORMAT_RGBA_8888, 0},
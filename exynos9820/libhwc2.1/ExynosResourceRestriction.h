@@ -60,7 +60,7 @@ enum {
 };
 *************************************************************************************/
 
-const restriction_key restriction_format_table[] =
+constexpr restriction_key restriction_format_table[] =
 {
     {MPP_DPP_GF, NODE_NONE, HAL_PIXEL_FORMAT_RGB_565, 0},
     {MPP_DPP_GF, NODE_NONE, HAL_PIXEL_FORMAT_RGBA_8888, 0},